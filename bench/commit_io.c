@@ -0,0 +1,140 @@
+/* commit_io.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Synced commits of a few sizes, with pages written by write() from
+ * one thread or from several, and by io_uring: sequential loads, where
+ * dirty pages form long runs, and scattered updates, where nearly every
+ * page is a run of its own.
+ * Usage: commit_io <dir> [commits]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	200
+#define KEYS	400000
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void mkkey(unsigned char *buf, uint64_t i)
+{
+	int b;
+
+	for (b = 7; b >= 0; b--, i >>= 8)
+		buf[b] = i;
+}
+
+static void run(const char *dir, unsigned int flags, unsigned int nthreads,
+	int commits, int items, int scattered)
+{
+	int rc, c, i;
+	unsigned int got;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key, data;
+	unsigned char kbuf[8];
+	static char vbuf[VALSIZE];
+	char path[256], mode[32];
+	uint64_t next = 0;
+	double start, t, worst = 0, total = 0;
+
+	snprintf(path, sizeof(path), "%s/commit.rdb", dir);
+	remove(path);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, (size_t)4 << 30));
+	E(rdb_env_set_flushthreads(env, nthreads));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR|flags, 0664));
+	E(rdb_env_get_flags(env, &got));
+
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	data.mv_size = VALSIZE;
+	data.mv_data = vbuf;
+	memset(vbuf, 'v', sizeof(vbuf));
+	if (scattered) {
+		/* Something to scatter the updates over */
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		E(rdb_dbi_open(txn, NULL, 0, &dbi));
+		for (i = 0; i < KEYS; i++) {
+			mkkey(kbuf, i);
+			E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+		}
+		E(rdb_txn_commit(txn));
+	}
+	for (c = 0; c < commits; c++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		E(rdb_dbi_open(txn, NULL, 0, &dbi));
+		for (i = 0; i < items; i++) {
+			mkkey(kbuf, scattered ? rnd() % KEYS : next++);
+			E(rdb_put(txn, dbi, &key, &data, 0));
+		}
+		start = now();
+		E(rdb_txn_commit(txn));
+		t = now() - start;
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+	rdb_env_close(env);
+	remove(path);
+
+	if (got & RDB_IOURING)
+		strcpy(mode, "io_uring");
+	else
+		sprintf(mode, "write x%u", nthreads ? nthreads : 1);
+	printf("%-9s %-9s %6d items/commit %8.1f us/commit %8.1f us worst\n",
+		mode, scattered ? "scattered" : "append",
+		items, total * 1e6 / commits, worst * 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	int commits = argc > 2 ? atoi(argv[2]) : 50, scattered, items;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [commits]\n", argv[0]);
+		return 1;
+	}
+	for (scattered = 0; scattered < 2; scattered++) {
+		for (items = 100; items <= 100000; items *= 10) {
+			run(argv[1], 0, 0, commits, items, scattered);
+			run(argv[1], 0, 4, commits, items, scattered);
+			run(argv[1], RDB_IOURING, 0, commits, items, scattered);
+		}
+	}
+	return 0;
+}
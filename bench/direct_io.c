@@ -0,0 +1,207 @@
+/* direct_io.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Synced commits of scattered updates while reader threads make random
+ * gets, with pages written through the OS cache and with RDB_DIRECT, by
+ * one thread, several, or io_uring: commit latency, and the readers'
+ * latency percentiles.
+ * Usage: direct_io <dir> [commits]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	200
+#define KEYS	400000
+#define ITEMS	2000	/* per commit */
+#define READERS	4
+#define BUCKET	50	/* ns of get latency per histogram bucket */
+#define BUCKETS	20000
+#define RENEW	100	/* gets per read transaction */
+
+static RDB_env *env;
+static RDB_dbi dbi;
+static volatile int stop;
+
+struct reader {
+	pthread_t thr;
+	uint64_t seed;
+	size_t hist[BUCKETS + 1];	/* the last one for anything slower */
+};
+
+static uint64_t rnd(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void mkkey(unsigned char *buf, uint64_t i)
+{
+	int b;
+
+	for (b = 7; b >= 0; b--, i >>= 8)
+		buf[b] = i;
+}
+
+static void *reader(void *arg)
+{
+	struct reader *r = arg;
+	RDB_txn *txn;
+	RDB_val key, data;
+	unsigned char kbuf[8];
+	double start;
+	size_t b;
+	int rc, i;
+
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	while (!stop) {
+		for (i = 0; i < RENEW; i++) {
+			mkkey(kbuf, rnd(&r->seed) % KEYS);
+			start = now();
+			E(rdb_get(txn, dbi, &key, &data));
+			rc = ((volatile char *)data.mv_data)[VALSIZE - 1];
+			b = (now() - start) * 1e9 / BUCKET;
+			r->hist[b < BUCKETS ? b : BUCKETS]++;
+		}
+		rdb_txn_reset(txn);
+		E(rdb_txn_renew(txn));
+	}
+	rdb_txn_abort(txn);
+	return NULL;
+}
+
+/* The latency under which a fraction of the gets came in, in us */
+static double pct(const size_t *hist, size_t n, double frac)
+{
+	size_t b, sum = 0;
+
+	for (b = 0; b < BUCKETS && (sum += hist[b]) < n * frac; b++)
+		;
+	return (b + 1) * BUCKET / 1e3;
+}
+
+static void run(const char *dir, unsigned int flags, unsigned int nthreads,
+	int commits)
+{
+	int rc, c, i;
+	unsigned int got;
+	RDB_txn *txn;
+	RDB_val key, data;
+	unsigned char kbuf[8];
+	static char vbuf[VALSIZE];
+	static struct reader rd[READERS];
+	static size_t hist[BUCKETS + 1];
+	char path[256], mode[32];
+	uint64_t seed = 88172645463325252ULL;
+	size_t n, b;
+	double start, t, worst = 0, total = 0;
+
+	snprintf(path, sizeof(path), "%s/direct.rdb", dir);
+	remove(path);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, (size_t)4 << 30));
+	E(rdb_env_set_maxreaders(env, READERS + 2));
+	E(rdb_env_set_flushthreads(env, nthreads));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR|flags, 0664));
+	E(rdb_env_get_flags(env, &got));
+
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	data.mv_size = VALSIZE;
+	data.mv_data = vbuf;
+	memset(vbuf, 'v', sizeof(vbuf));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < KEYS; i++) {
+		mkkey(kbuf, i);
+		E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+	}
+	E(rdb_txn_commit(txn));
+
+	stop = 0;
+	for (i = 0; i < READERS; i++) {
+		memset(&rd[i], 0, sizeof(rd[i]));
+		rd[i].seed = seed + i * 7919;
+		CHECK(pthread_create(&rd[i].thr, NULL, reader, &rd[i]) == 0, "pthread_create");
+	}
+	for (c = 0; c < commits; c++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		for (i = 0; i < ITEMS; i++) {
+			mkkey(kbuf, rnd(&seed) % KEYS);
+			E(rdb_put(txn, dbi, &key, &data, 0));
+		}
+		start = now();
+		E(rdb_txn_commit(txn));
+		t = now() - start;
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+	stop = 1;
+	memset(hist, 0, sizeof(hist));
+	for (i = n = 0; i < READERS; i++) {
+		pthread_join(rd[i].thr, NULL);
+		for (b = 0; b <= BUCKETS; b++) {
+			hist[b] += rd[i].hist[b];
+			n += rd[i].hist[b];
+		}
+	}
+	rdb_env_close(env);
+	remove(path);
+
+	if (got & RDB_IOURING)
+		strcpy(mode, "io_uring");
+	else
+		sprintf(mode, "write x%u", nthreads ? nthreads : 1);
+	printf("%-6s %-9s %8.1f us/commit %8.1f us worst  %9zu gets: p50 %6.2f"
+		" p99 %6.2f p99.9 %7.2f us\n", (got & RDB_DIRECT) ? "direct" : "cached",
+		mode, total * 1e6 / commits, worst * 1e6, n, pct(hist, n, 0.5),
+		pct(hist, n, 0.99), pct(hist, n, 0.999));
+}
+
+int main(int argc, char *argv[])
+{
+	int commits = argc > 2 ? atoi(argv[2]) : 100;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [commits]\n", argv[0]);
+		return 1;
+	}
+	run(argv[1], 0, 0, commits);
+	run(argv[1], RDB_DIRECT, 0, commits);
+	run(argv[1], 0, 4, commits);
+	run(argv[1], RDB_DIRECT, 4, commits);
+	run(argv[1], RDB_IOURING, 0, commits);
+	run(argv[1], RDB_DIRECT|RDB_IOURING, 0, commits);
+	return 0;
+}
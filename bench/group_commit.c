@@ -0,0 +1,142 @@
+/* group_commit.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Threads making one small synced write each, over and over: with a
+ * write transaction apiece, and with rdb_group_commit(), each with and
+ * without RDB_PIPELINE.
+ * Usage: group_commit <dir> [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	100
+
+static RDB_env *env;
+static RDB_dbi dbi;
+static volatile int stop;
+static int grouped;
+
+struct worker {
+	pthread_t thr;
+	uint64_t id, writes;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int put(RDB_txn *txn, void *ctx)
+{
+	struct worker *w = ctx;
+	RDB_val key, data;
+	uint64_t k = w->id << 40 | w->writes;
+	char vbuf[VALSIZE];
+
+	memset(vbuf, 'v', sizeof(vbuf));
+	key.mv_size = sizeof(k);
+	key.mv_data = &k;
+	data.mv_size = sizeof(vbuf);
+	data.mv_data = vbuf;
+	return rdb_put(txn, dbi, &key, &data, 0);
+}
+
+static void *writer(void *arg)
+{
+	struct worker *w = arg;
+	RDB_txn *txn;
+	int rc;
+
+	while (!stop) {
+		if (grouped) {
+			E(rdb_group_commit(env, put, w));
+		} else {
+			E(rdb_txn_begin(env, NULL, 0, &txn));
+			E(put(txn, w));
+			E(rdb_txn_commit(txn));
+		}
+		w->writes++;
+	}
+	return NULL;
+}
+
+static void run(const char *dir, unsigned int flags, int nthreads, int seconds)
+{
+	int i, rc;
+	RDB_txn *txn;
+	struct worker *w;
+	char path[256];
+	uint64_t writes = 0;
+	double start;
+	struct timespec ts = { seconds, 0 };
+
+	snprintf(path, sizeof(path), "%s/group.rdb", dir);
+	remove(path);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, (size_t)1 << 30));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR|flags, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_txn_commit(txn));
+
+	w = calloc(nthreads, sizeof(*w));
+	stop = 0;
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		w[i].id = i;
+		CHECK(pthread_create(&w[i].thr, NULL, writer, &w[i]) == 0, "pthread_create");
+	}
+	nanosleep(&ts, NULL);
+	stop = 1;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(w[i].thr, NULL);
+		writes += w[i].writes;
+	}
+	start = now() - start;
+	free(w);
+	rdb_env_close(env);
+	remove(path);
+
+	printf("%-12s %-9s %4d threads %9.0f writes/s\n",
+		grouped ? "group commit" : "txn each",
+		(flags & RDB_PIPELINE) ? "pipelined" : "", nthreads, writes / start);
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = argc > 2 ? atoi(argv[2]) : 3, nthreads;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [seconds]\n", argv[0]);
+		return 1;
+	}
+	for (nthreads = 1; nthreads <= 64; nthreads *= 4) {
+		for (grouped = 0; grouped < 2; grouped++) {
+			run(argv[1], 0, nthreads, seconds);
+			run(argv[1], RDB_PIPELINE, nthreads, seconds);
+		}
+	}
+	return 0;
+}
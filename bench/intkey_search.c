@@ -0,0 +1,116 @@
+/* intkey_search.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Lookup cost in RDB_INTEGERKEY databases, for comparing builds
+ * with and without RDB_NO_INTERP. Usage: intkey_search <dir> [label]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()	__rdtsc()
+#else
+#define CYCLES()	0
+#endif
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	1000000
+#define LOOKUPS	4000000
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Timestamps a few microseconds apart, or squared for a skewed spread */
+static uint64_t keyval(int i, int skewed)
+{
+	return skewed ? (uint64_t)i * i * 7 : 1700000000000000ULL + (uint64_t)i * 1000 + i % 997;
+}
+
+static void run(RDB_env *env, const char *name, int skewed, const char *label)
+{
+	int i, rc;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key, data;
+	uint64_t k, t0, found = 0;
+	double start, secs;
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, name, RDB_CREATE|RDB_INTEGERKEY, &dbi));
+	key.mv_size = sizeof(k);
+	key.mv_data = &k;
+	data.mv_size = sizeof(i);
+	data.mv_data = &i;
+	for (i = 0; i < COUNT; i++) {
+		k = keyval(i, skewed);
+		E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	start = now();
+	t0 = CYCLES();
+	for (i = 0; i < LOOKUPS; i++) {
+		k = keyval(rnd() % COUNT, skewed);
+		rc = rdb_get(txn, dbi, &key, &data);
+		found += rc == RDB_SUCCESS;
+	}
+	t0 = CYCLES() - t0;
+	secs = now() - start;
+	CHECK(found == LOOKUPS, "missing keys");
+	printf("%-8s %-8s %8.1f ns/lookup %8.0f cycles/lookup\n", label, name,
+		secs * 1e9 / LOOKUPS, (double)t0 / LOOKUPS);
+	rdb_txn_abort(txn);
+}
+
+int main(int argc, char *argv[])
+{
+	int rc;
+	RDB_env *env;
+	const char *label = argc > 2 ? argv[2] : "";
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [label]\n", argv[0]);
+		return 1;
+	}
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 256UL * 1048576));
+	E(rdb_env_set_maxdbs(env, 4));
+	E(rdb_env_open(env, argv[1], RDB_NOSYNC, 0664));
+	run(env, "uniform", 0, label);
+	run(env, "skewed", 1, label);
+	rdb_env_close(env);
+	return 0;
+}
@@ -0,0 +1,178 @@
+/* page_sizes.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* The same data loaded with 4, 8, 16 and 32KB pages: small items for
+ * point reads and full scans, and large values for overflow chains.
+ * Usage: page_sizes <dir> [megabytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	100
+#define BIGMIN	3000
+#define BIGMAX	12000
+#define BATCH	10000
+#define LOOKUPS	1000000
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Big-endian, so that keys sort by number; odd multiplier scatters
+ * the insert order over the key space.
+ */
+static void mkkey(unsigned char *buf, uint64_t i)
+{
+	int b;
+
+	i *= 0x9e3779b97f4a7c15ULL;
+	for (b = 7; b >= 0; b--, i >>= 8)
+		buf[b] = i;
+}
+
+static size_t bigsize(size_t i)
+{
+	return BIGMIN + (i * 2654435761U) % (BIGMAX - BIGMIN);
+}
+
+static void run(const char *dir, unsigned int psize, size_t count, size_t nbig)
+{
+	int rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi small, big;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	RDB_stat st, bst;
+	struct stat sb;
+	unsigned char kbuf[8];
+	static char vbuf[BIGMAX];
+	char path[256];
+	size_t i, n;
+	double start, load, gets, scan, bigs;
+
+	snprintf(path, sizeof(path), "%s/%u.rdb", dir, psize);
+	remove(path);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_pagesize(env, psize));
+	E(rdb_env_set_mapsize(env, (count * (VALSIZE + 24) * 2 +
+		nbig * BIGMAX * 2) + (64 << 20)));
+	E(rdb_env_set_maxdbs(env, 2));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	memset(vbuf, 'v', sizeof(vbuf));
+	start = now();
+	for (i = 0; i < count || i < nbig; ) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		E(rdb_dbi_open(txn, "small", RDB_CREATE, &small));
+		E(rdb_dbi_open(txn, "big", RDB_CREATE, &big));
+		for (n = i + BATCH; i < n && (i < count || i < nbig); i++) {
+			mkkey(kbuf, i);
+			if (i < count) {
+				data.mv_size = VALSIZE;
+				data.mv_data = vbuf;
+				E(rdb_put(txn, small, &key, &data, 0));
+			}
+			if (i < nbig) {
+				data.mv_size = bigsize(i);
+				data.mv_data = vbuf;
+				E(rdb_put(txn, big, &key, &data, 0));
+			}
+		}
+		E(rdb_txn_commit(txn));
+	}
+	load = now() - start;
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_stat(txn, small, &st));
+	E(rdb_stat(txn, big, &bst));
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		mkkey(kbuf, rnd() % count);
+		E(rdb_get(txn, small, &key, &data));
+	}
+	gets = now() - start;
+
+	E(rdb_cursor_open(txn, small, &cursor));
+	start = now();
+	for (n = 0; (rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0; n++)
+		;
+	scan = now() - start;
+	CHECK(rc == RDB_NOTFOUND && n == count, "scan");
+	rdb_cursor_close(cursor);
+
+	key.mv_data = kbuf;
+	start = now();
+	for (i = 0; i < LOOKUPS / 10; i++) {
+		mkkey(kbuf, rnd() % nbig);
+		E(rdb_get(txn, big, &key, &data));
+		/* Touch the whole value, as a reader would */
+		for (n = 0; n < data.mv_size; n += 4096)
+			rc += ((volatile char *)data.mv_data)[n];
+	}
+	bigs = now() - start;
+	rdb_txn_abort(txn);
+	rdb_env_close(env);
+	CHECK(stat(path, &sb) == 0, "stat");
+
+	printf("%5uKB %6.2fs %7.1f ns/get %5.1f ns/item scan %7.1f ns/big get"
+		"  depth %u/%u, %zu overflow pages, %zu MB\n",
+		psize / 1024, load, gets * 1e9 / LOOKUPS, scan * 1e9 / count,
+		bigs * 1e9 / (LOOKUPS / 10), st.ms_depth, bst.ms_depth,
+		(size_t)bst.ms_overflow_pages, (size_t)sb.st_size / 1048576);
+	remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int psize;
+	size_t count, nbig, mb = argc > 2 ? strtoul(argv[2], NULL, 10) : 512;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [megabytes]\n", argv[0]);
+		return 1;
+	}
+	/* Half the data in small items, half in big values */
+	count = mb * 1048576 / 2 / (sizeof(uint64_t) + VALSIZE + 8);
+	nbig = mb * 1048576 / 2 / ((BIGMIN + BIGMAX) / 2);
+
+	printf("%zu small items, %zu big values\n", count, nbig);
+	for (psize = 4096; psize <= 32768; psize <<= 1)
+		run(argv[1], psize, count, nbig);
+	return 0;
+}
@@ -0,0 +1,162 @@
+/* random_reads.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Random point reads and short scans over a map larger than the CPU
+ * caches, with and without RDB_NOPREFETCH.
+ * Usage: random_reads <dir> [megabytes [thp|hugetlb]]
+ * The last argument maps the data with RDB_HUGEPAGE, or with RDB_HUGETLB
+ * for a dir on hugetlbfs; compare dTLB misses with perf stat.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	64
+#define LOOKUPS	2000000
+#define SCANS	200000
+#define SCANLEN	50
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Big-endian, so that keys sort by number; odd multiplier scatters
+ * the insert order over the key space.
+ */
+static void mkkey(unsigned char *buf, uint64_t i)
+{
+	int b;
+
+	i *= 0x9e3779b97f4a7c15ULL;
+	for (b = 7; b >= 0; b--, i >>= 8)
+		buf[b] = i;
+}
+
+static void run(RDB_env *env, RDB_dbi dbi, size_t count, int prefetch)
+{
+	int i, j, rc;
+	RDB_txn *txn;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	unsigned char kbuf[8];
+	size_t found = 0;
+	double start, gets, scans;
+
+	E(rdb_env_set_flags(env, RDB_NOPREFETCH, !prefetch));
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		mkkey(kbuf, rnd() % count);
+		found += rdb_get(txn, dbi, &key, &data) == RDB_SUCCESS;
+	}
+	gets = now() - start;
+	CHECK(found == LOOKUPS, "missing keys");
+
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	start = now();
+	for (i = 0; i < SCANS; i++) {
+		mkkey(kbuf, rnd() % count);
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		rc = rdb_cursor_get(cursor, &key, &data, RDB_SET_RANGE);
+		for (j = 0; j < SCANLEN && rc == RDB_SUCCESS; j++)
+			rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT);
+		CHECK(rc == RDB_SUCCESS || rc == RDB_NOTFOUND, "scan");
+	}
+	scans = now() - start;
+	rdb_cursor_close(cursor);
+	rdb_txn_abort(txn);
+
+	printf("%-11s %8.1f ns/get %10.1f ns/scan of %d\n",
+		prefetch ? "prefetch" : "noprefetch",
+		gets * 1e9 / LOOKUPS, scans * 1e9 / SCANS, SCANLEN);
+}
+
+int main(int argc, char *argv[])
+{
+	int rc, round;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key, data;
+	RDB_stat st;
+	RDB_envinfo info;
+	unsigned char kbuf[8], vbuf[VALSIZE];
+	unsigned int flags = RDB_NOSYNC;
+	size_t i, count, mb = argc > 2 ? strtoul(argv[2], NULL, 10) : 1024;
+
+	if (argc > 3 && !strcmp(argv[3], "thp"))
+		flags |= RDB_HUGEPAGE;
+	else if (argc > 3 && !strcmp(argv[3], "hugetlb"))
+		flags |= RDB_HUGETLB|RDB_WRITEMAP;
+	else if (argc > 3 || argc < 2) {
+		fprintf(stderr, "usage: %s dir [megabytes [thp|hugetlb]]\n", argv[0]);
+		return 1;
+	}
+	/* Leaves end up about 3/4 full, with a node header per item */
+	count = mb * 1048576 / ((sizeof(kbuf) + VALSIZE + 8) * 4 / 3);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, (mb * 2 + 64) * 1048576));
+	E(rdb_env_open(env, argv[1], flags, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	data.mv_size = sizeof(vbuf);
+	data.mv_data = vbuf;
+	memset(vbuf, 'v', sizeof(vbuf));
+	for (i = 0; i < count; i++) {
+		mkkey(kbuf, i);
+		E(rdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_env_stat(env, &st));
+	printf("%zu items, %zu MB of pages, depth %u\n", count,
+		(size_t)(st.ms_branch_pages + st.ms_leaf_pages) * st.ms_psize / 1048576,
+		st.ms_depth);
+	E(rdb_env_info(env, &info));
+	printf("%zu MB of the map in huge pages\n", info.me_hugemapped / 1048576);
+	/* Alternate, so neither mode gets a warmer cache */
+	for (round = 0; round < 2; round++) {
+		run(env, dbi, count, 0);
+		run(env, dbi, count, 1);
+	}
+	rdb_env_close(env);
+	return 0;
+}
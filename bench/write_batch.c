@@ -0,0 +1,163 @@
+/* write_batch.c - memory-mapped database benchmark */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Random puts and deletes on a loaded DB, in transactions of a few
+ * sizes, made one by one with rdb_put and rdb_del, and through a write
+ * batch: time per write, counting the building of the batch. Then the
+ * same for deletes of every key in a dense range, which empty leaves
+ * one after another.
+ * Usage: write_batch <dir> [transactions]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define VALSIZE	100
+#define KEYS	1000000
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void mkkey(unsigned char *buf, uint64_t i)
+{
+	int b;
+
+	for (b = 7; b >= 0; b--, i >>= 8)
+		buf[b] = i;
+}
+
+/* Returns the mean time per write, in ns */
+static double run(const char *dir, int batched, int range, int txns, int writes)
+{
+	int rc, t, i;
+	uint64_t first;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_batch *batch;
+	RDB_val key, data;
+	unsigned char kbuf[8];
+	static char vbuf[VALSIZE];
+	char path[256];
+	double start, total = 0;
+
+	snprintf(path, sizeof(path), "%s/batch.rdb", dir);
+	remove(path);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, (size_t)4 << 30));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+	E(rdb_batch_create(&batch));
+
+	key.mv_size = sizeof(kbuf);
+	key.mv_data = kbuf;
+	data.mv_size = VALSIZE;
+	data.mv_data = vbuf;
+	memset(vbuf, 'v', sizeof(vbuf));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < KEYS; i += 2) {
+		mkkey(kbuf, i);
+		E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+	}
+	E(rdb_txn_commit(txn));
+
+	/* Puts of new and old keys, and one delete in four. Or deletes
+	 * of all the loaded keys of a range, aborted to keep the DB full.
+	 */
+	for (t = 0; t < txns; t++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		start = now();
+		rdb_batch_reset(batch);
+		first = rnd() % (KEYS - 2 * writes) & ~1;
+		for (i = 0; i < writes; i++) {
+			if (range) {
+				mkkey(kbuf, first + 2 * i);
+				if (batched) {
+					E(rdb_batch_del(batch, dbi, &key, NULL));
+				} else {
+					E(rdb_del(txn, dbi, &key, NULL));
+				}
+				continue;
+			}
+			mkkey(kbuf, rnd() % KEYS);
+			if (batched) {
+				if (i % 4 == 3)
+					E(rdb_batch_del(batch, dbi, &key, NULL));
+				else
+					E(rdb_batch_put(batch, dbi, &key, &data, 0));
+			} else {
+				if (i % 4 == 3) {
+					rc = rdb_del(txn, dbi, &key, NULL);
+					CHECK(rc == 0 || rc == RDB_NOTFOUND, "rdb_del");
+				} else {
+					E(rdb_put(txn, dbi, &key, &data, 0));
+				}
+			}
+		}
+		if (batched)
+			E(rdb_batch_apply(txn, batch));
+		total += now() - start;
+		if (range)
+			rdb_txn_abort(txn);
+		else
+			E(rdb_txn_commit(txn));
+	}
+	rdb_batch_free(batch);
+	rdb_env_close(env);
+	remove(path);
+	return total * 1e9 / ((double)txns * writes);
+}
+
+int main(int argc, char *argv[])
+{
+	int txns = argc > 2 ? atoi(argv[2]) : 20, writes, range;
+	double single, batched;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dir [transactions]\n", argv[0]);
+		return 1;
+	}
+	for (range = 0; range < 2; range++) {
+		if (range)
+			printf("range deletes\n");
+		for (writes = 100; writes <= 100000; writes *= 10) {
+			single = run(argv[1], 0, range, txns, writes);
+			batched = run(argv[1], 1, range, txns, writes);
+			printf("%6d writes/txn  %8.1f ns/write single  %8.1f ns/write batched"
+				"  %5.2fx\n", writes, single, batched, single / batched);
+		}
+	}
+	return 0;
+}
@@ -239,6 +239,9 @@ typedef unsigned int	RDB_dbi;
 /** @brief Opaque structure for navigating through a database */
 typedef struct RDB_cursor RDB_cursor;
 
+/** @brief Opaque structure for a batch of writes, see #rdb_batch_apply() */
+typedef struct RDB_batch RDB_batch;
+
 /** @brief Generic structure used for passing keys and data in and out
  * of the database.
  *
@@ -279,8 +282,18 @@ typedef void (RDB_rel_func)(RDB_val *item, void *oldptr, void *newptr, void *rel
  */
 	/** mmap at a fixed address (experimental) */
 #define RDB_FIXEDMAP	0x01
+	/** write dirty pages to the data file around the OS cache */
+#define RDB_DIRECT		0x400
+	/** write commits through io_uring where the OS has it */
+#define RDB_IOURING		0x800
+	/** map the data file with huge pages, it must be on hugetlbfs */
+#define RDB_HUGETLB		0x1000
+	/** ask for transparent huge pages for the map */
+#define RDB_HUGEPAGE	0x2000
 	/** no environment directory */
 #define RDB_NOSUBDIR	0x4000
+	/** sync commits in a thread of their own, after the write lock is released */
+#define RDB_PIPELINE	0x8000
 	/** don't fsync after commit */
 #define RDB_NOSYNC		0x10000
 	/** read only */
@@ -299,6 +312,10 @@ typedef void (RDB_rel_func)(RDB_val *item, void *oldptr, void *newptr, void *rel
 #define RDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define RDB_NOMEMINIT	0x1000000
+	/** don't prefetch pages ahead of searches and cursor steps */
+#define RDB_NOPREFETCH	0x2000000
+	/** keep a list of the pages in memory, and read them back in at open */
+#define RDB_HOTLIST		0x4000000
 /** @} */
 
 /**	@defgroup	rdb_dbi_open	Database Flags
@@ -317,6 +334,12 @@ typedef void (RDB_rel_func)(RDB_val *item, void *oldptr, void *newptr, void *rel
 #define RDB_INTEGERDUP	0x20
 	/** with #RDB_DUPSORT, use reverse string dups */
 #define RDB_REVERSEDUP	0x40
+	/** store the key prefix shared by a branch page's nodes only once */
+#define RDB_PREFIXKEY	0x80
+	/** keep a Bloom filter of the keys to skip searches for absent ones */
+#define RDB_BLOOM		0x100
+	/** store keys in a hash table, for point lookups without a tree search */
+#define RDB_HASHED		0x200
 	/** create DB if not already existing */
 #define RDB_CREATE		0x40000
 /** @} */
@@ -354,6 +377,31 @@ typedef void (RDB_rel_func)(RDB_val *item, void *oldptr, void *newptr, void *rel
 #define RDB_CP_COMPACT	0x01
 /*	@} */
 
+/**	@defgroup rdb_advise	Access Hints
+ *	Hints for #rdb_dbi_advise() and #rdb_cursor_advise().
+ *	@{
+ */
+/** No special treatment, the OS default. */
+#define RDB_ADV_NORMAL	0
+/** Pages will be read in order, read ahead aggressively. */
+#define RDB_ADV_SEQUENTIAL	1
+/** Pages will be read in random order, don't read ahead. */
+#define RDB_ADV_RANDOM	2
+/** Pages will be needed soon, start reading them in. */
+#define RDB_ADV_WILLNEED	3
+/** Pages won't be needed for a while, let them go first when memory
+ * runs short. Needs MADV_COLD, Linux 5.4 or later.
+ */
+#define RDB_ADV_COLD	4
+/*	@} */
+
+/**	@defgroup rdb_warmup	Warm-up Flags
+ *	@{
+ */
+/** Only load branch pages, not leaves. */
+#define RDB_WARM_BRANCHONLY	0x01
+/*	@} */
+
 /** @brief Cursor Get operations.
  *
  *	This is the set of all operations for retrieving data
@@ -386,8 +434,11 @@ typedef enum RDB_cursor_op {
 	RDB_SET,				/**< Position at specified key */
 	RDB_SET_KEY,			/**< Position at specified key, return key + data */
 	RDB_SET_RANGE,			/**< Position at first key greater than or equal to specified key. */
-	RDB_PREV_MULTIPLE		/**< Position at previous page and return up to
+	RDB_PREV_MULTIPLE,		/**< Position at previous page and return up to
 								a page of duplicate data items. Only for #RDB_DUPFIXED */
+	RDB_SEEK_FORWARD		/**< Like #RDB_SET_RANGE, but start the search from the
+								current position. Fastest when successive keys
+								move forward a little at a time */
 } RDB_cursor_op;
 
 /** @defgroup  errors	Return Codes
@@ -444,8 +495,10 @@ typedef enum RDB_cursor_op {
 #define RDB_BAD_VALSIZE		(-30781)
 	/** The specified DBI was changed unexpectedly */
 #define RDB_BAD_DBI		(-30780)
+	/** Transaction committed and visible, but syncing it failed */
+#define RDB_NOT_DURABLE	(-30779)
 	/** The last defined error code */
-#define RDB_LAST_ERRCODE	RDB_BAD_DBI
+#define RDB_LAST_ERRCODE	RDB_NOT_DURABLE
 /** @} */
 
 /** @brief Statistics for a database in the environment */
@@ -465,10 +518,24 @@ typedef struct RDB_envinfo {
 	size_t	me_mapsize;				/**< Size of the data memory map */
 	size_t	me_last_pgno;			/**< ID of the last used page */
 	size_t	me_last_txnid;			/**< ID of the last committed transaction */
+	size_t	me_durable_txnid;		/**< ID of the last one whose meta page is in the data file */
 	unsigned int me_maxreaders;		/**< max reader slots in the environment */
 	unsigned int me_numreaders;		/**< max reader slots used in the environment */
+	size_t	me_pinned;				/**< bytes of branch pages locked by #rdb_dbi_pin() */
+	size_t	me_hugemapped;			/**< bytes of the map backed by huge pages, with #RDB_HUGEPAGE or #RDB_HUGETLB on Linux */
+	size_t	me_commits;				/**< write transactions committed by this handle */
+	size_t	me_commit_pages;		/**< pages they wrote, counting spills, not with #RDB_WRITEMAP */
+	size_t	me_commit_runs;			/**< runs of adjacent pages among those */
 } RDB_envinfo;
 
+/** @brief Progress of #rdb_env_warmup() */
+typedef struct RDB_warmup {
+	size_t	mw_pages;			/**< Pages loaded so far */
+	size_t	mw_total;			/**< Branch and leaf pages in all databases */
+	unsigned int mw_pass;		/**< 0 while loading branch pages, 1 for leaves */
+	unsigned int mw_seconds;	/**< Seconds since the start */
+} RDB_warmup;
+
 	/** @brief Return the RipDB library version information.
 	 *
 	 * @param[out] major if non-NULL, the library major version number is copied here
@@ -610,6 +677,74 @@ int  rdb_env_create(RDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #rdb_env_set_flags().
+	 *	<li>#RDB_NOPREFETCH
+	 *		Don't issue CPU prefetch hints. By default a cursor stepping through
+	 *		a leaf starts loading the next one a few items before the end, so
+	 *		that its cache and TLB misses overlap with the reads of the last
+	 *		items. This helps scans of maps larger than the CPU caches; for
+	 *		data that always stays in cache the hints are cheap but wasted.
+	 *		This flag may be changed at any time using #rdb_env_set_flags().
+	 *	<li>#RDB_HOTLIST
+	 *		Keep a list of the pages that are in the OS page cache, the
+	 *		working set, in a file next to the lock file, "hot.mdb" or
+	 *		with #RDB_NOSUBDIR the path with "-hot" appended. The list is
+	 *		sampled with mincore() by a write transaction's commit every ten
+	 *		minutes and when the environment is closed, and the pages in it
+	 *		are requested from the OS when the environment is opened, so a
+	 *		restart gets its working set back without reading cold data.
+	 *		See #rdb_env_hotlist_save(). Not supported on Windows.
+	 *	<li>#RDB_HUGEPAGE
+	 *		Ask the OS to back the map with transparent huge pages, with
+	 *		madvise(MADV_HUGEPAGE), and place the map on a huge page boundary.
+	 *		With fewer TLB entries needed to cover it, random reads of a big
+	 *		map miss the TLB less often. Whether the OS complies depends on
+	 *		its settings and on the filesystem the data file is on; see
+	 *		#RDB_envinfo.me_hugemapped for how much of the map it has done
+	 *		it for. No effect on Windows.
+	 *	<li>#RDB_HUGETLB
+	 *		Map the data file with MAP_HUGETLB. The file must be on a hugetlbfs
+	 *		mount, so it lives in memory: this suits databases that don't have
+	 *		to outlive a reboot, or a copy loaded at startup. The map size is
+	 *		rounded up to the huge page size, and so is the lock file, which
+	 *		is next to the data file. Since hugetlbfs files can't be written
+	 *		with write(), #RDB_WRITEMAP is required unless #RDB_RDONLY is
+	 *		used. Only supported on Linux.
+	 *	<li>#RDB_IOURING
+	 *		Write a commit's pages through an io_uring: a write for each run
+	 *		of adjacent pages, all submitted together, then the data sync,
+	 *		the meta page write and the meta sync as one linked chain. Large
+	 *		commits on fast storage spend much less time in system calls.
+	 *		If the kernel lacks io_uring (before Linux 5.5) or won't allow
+	 *		it, commits use write() as usual and #rdb_env_get_flags() leaves
+	 *		the flag out. Ignored with #RDB_WRITEMAP or #RDB_RDONLY, and on
+	 *		other OSs.
+	 *	<li>#RDB_DIRECT
+	 *		Write dirty pages through a second descriptor of the data file,
+	 *		opened with O_DIRECT (F_NOCACHE on macOS), so commits copy them
+	 *		straight from the transaction's buffers to the device instead
+	 *		of through the OS cache. The cache is then left to the pages
+	 *		readers use, and a big commit doesn't push them out. Readers
+	 *		still use the map; the OS drops cached copies of the pages
+	 *		written, so the map sees the new contents. A reader faults in
+	 *		a page a commit has just written from the device, though,
+	 *		rather than finding it cached. Meta pages are written as usual.
+	 *		If the filesystem won't do direct I/O the flag is dropped, as
+	 *		#rdb_env_get_flags() shows. Ignored with #RDB_WRITEMAP or
+	 *		#RDB_RDONLY, and on Windows.
+	 *	<li>#RDB_PIPELINE
+	 *		Let the next write transaction begin while a commit syncs.
+	 *		#rdb_txn_commit() writes the pages and publishes the commit
+	 *		as #rdb_txn_commit_async() does, releases the write lock, and
+	 *		then waits for the syncer, which syncs every commit queued by
+	 *		then at once and writes their meta pages in order. The commit
+	 *		is durable when the call returns, as before, but readers can
+	 *		see it a little earlier. If the sync fails, the commit stays
+	 *		made and visible anyway, and #rdb_txn_commit() returns
+	 *		#RDB_NOT_DURABLE rather than the error, so that it is not
+	 *		retried. This helps when several threads or processes write,
+	 *		each with small transactions. Ignored with
+	 *		#RDB_WRITEMAP, #RDB_NOSYNC or #RDB_NOLOCK.
+	 *		This flag may be changed at any time using #rdb_env_set_flags().
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -622,6 +757,8 @@ int  rdb_env_create(RDB_env **env);
 	 *	<li>ENOENT - the directory specified by the path parameter doesn't exist.
 	 *	<li>EACCES - the user didn't have permission to access the environment files.
 	 *	<li>EAGAIN - the environment was locked by another process.
+	 *	<li>EINVAL - #RDB_HUGETLB was used without #RDB_WRITEMAP, or for
+	 *	a data file that isn't on hugetlbfs.
 	 * </ul>
 	 */
 int  rdb_env_open(RDB_env *env, const char *path, unsigned int flags, rdb_mode_t mode);
@@ -717,6 +854,80 @@ int  rdb_env_stat(RDB_env *env, RDB_stat *stat);
 	 */
 int  rdb_env_info(RDB_env *env, RDB_envinfo *stat);
 
+	/** @brief A callback function used to report the progress of #rdb_env_warmup().
+	 *
+	 * @param[in] wu The progress so far.
+	 * @param[in] ctx An arbitrary context pointer for the callback.
+	 * @return 0 to go on, non-zero to stop the warm-up.
+	 */
+typedef int (RDB_warmup_func)(const RDB_warmup *wu, void *ctx);
+
+	/** @brief Load the pages of the environment into memory.
+	 *
+	 * After a restart, the first touch of each page through the map is a
+	 * synchronous read from disk, so a cold environment takes a long while
+	 * to reach its usual speed. This loads the pages ahead of time, with
+	 * a pool of threads: first the branch pages of every database, level
+	 * by level from the root, then their leaves. It works on a snapshot
+	 * in a read-only transaction of its own, and can run alongside other
+	 * transactions. Overflow pages and the sub-databases of #RDB_DUPSORT
+	 * items are not loaded.
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] flags Special options for the warm-up. This parameter
+	 * must be set to 0 or by bitwise OR'ing together one or more of the
+	 * values described here.
+	 * <ul>
+	 *	<li>#RDB_WARM_BRANCHONLY
+	 *		Stop after the branch pages. They are a small part of the
+	 *		environment, and needed by every search. Of an #RDB_HASHED
+	 *		database only the directory is loaded, not its buckets.
+	 * </ul>
+	 * @param[in] nthreads The number of threads to use, including the caller's.
+	 * 0 is taken as 1.
+	 * @param[in] budget Stop after loading about this many bytes, or 0 for no limit.
+	 * @param[in] timeout Stop after this many seconds, or 0 for no limit.
+	 * @param[in] func If non-NULL, a #RDB_warmup_func function that is called
+	 * in the caller's thread every so often with the progress.
+	 * @param[in] ctx Anything the progress function needs
+	 * @return A non-zero error value on failure and 0 on success. Stopping at
+	 * the budget counts as success. Some possible errors are:
+	 * <ul>
+	 *	<li>ETIMEDOUT - the time limit was reached.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 * If the progress function stops the warm-up, its return value is returned.
+	 */
+int  rdb_env_warmup(RDB_env *env, unsigned int flags, unsigned int nthreads,
+	size_t budget, unsigned int timeout, RDB_warmup_func *func, void *ctx);
+
+	/** @brief Save the list of the environment's pages that are in memory.
+	 *
+	 * The pages of the map that are in the OS page cache are found with
+	 * mincore() and written as runs of page numbers to the hot page list
+	 * file described under #RDB_HOTLIST. With that flag this is done
+	 * every so often anyway, this call is for taking a sample at a chosen
+	 * time. The environment need not have been opened with #RDB_HOTLIST.
+	 * @param[in] env An environment handle returned by #rdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  rdb_env_hotlist_save(RDB_env *env);
+
+	/** @brief Read in the pages of the environment's hot page list.
+	 *
+	 * The runs of pages in the list saved by #rdb_env_hotlist_save() are
+	 * requested from the OS with MADV_WILLNEED, which reads them in the
+	 * background. #rdb_env_open() does this with #RDB_HOTLIST.
+	 * @param[in] env An environment handle returned by #rdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @return A non-zero error value on failure and 0 on success. Having no
+	 * list is not a failure. Some possible errors are:
+	 * <ul>
+	 *	<li>#RDB_INVALID - the list is damaged, or for another page size.
+	 * </ul>
+	 */
+int  rdb_env_hotlist_replay(RDB_env *env);
+
 	/** @brief Flush the data buffers to disk.
 	 *
 	 * Data is always written to disk when #rdb_txn_commit() is called,
@@ -840,6 +1051,112 @@ int  rdb_env_get_fd(RDB_env *env, rdb_filehandle_t *fd);
 	 */
 int  rdb_env_set_mapsize(RDB_env *env, size_t size);
 
+	/** @brief Set the page size for a new environment.
+	 *
+	 * The page size is fixed when the environment is created. By default
+	 * it is the OS page size. Bigger pages make for shallower trees,
+	 * fewer overflow pages for large values, and fewer, bigger writes
+	 * at commit, at the cost of copying more for each page a transaction
+	 * changes. An existing environment keeps the page size it was created
+	 * with, which #rdb_env_stat() reports. To change it, dump the
+	 * environment with ripdb_dump and load it with ripdb_load -p.
+	 *
+	 * This function may only be called after #rdb_env_create() and before
+	 * #rdb_env_open().
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] size The page size in bytes: the OS page size times a
+	 * power of two, at most 32KB on most builds.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the environment is
+	 *   	already open.
+	 * </ul>
+	 */
+int  rdb_env_set_pagesize(RDB_env *env, unsigned int size);
+
+	/** @brief Allocate a transaction's new pages in runs.
+	 *
+	 * By default a page comes from the free pages of older transactions,
+	 * the lowest numbered first, wherever it is. The pages a transaction
+	 * changes then tend to be scattered over the file, and each one takes
+	 * a write of its own at commit. With a run length set, a transaction
+	 * takes the page following the last one it got when that one is free,
+	 * and otherwise starts a new run at the lowest free extent of at least
+	 * \b pages pages, or in new space at the end of the file when there
+	 * is no such extent. A run in new space ends after \b pages pages, and
+	 * the next one looks at the free pages again. Commits then make a few
+	 * big writes instead of many small ones. The price is space: while the
+	 * free pages are too scattered for runs the file grows, until enough
+	 * of them have come together; in a test of random updates it settled
+	 * at about 2.3 times the size with 16-page runs, and 3.5 times with
+	 * 64-page runs. When the map has no room left for a run, pages come
+	 * from the free pages one by one, as without runs.
+	 * #RDB_envinfo.me_commit_runs and me_commit_pages tell how well it works.
+	 *
+	 * This function may be called at any time.
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] pages The shortest extent to start a run in, at most 65536.
+	 * 0 or 1, the default, turns this off.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_env_set_allocrun(RDB_env *env, unsigned int pages);
+
+	/** @brief Start writing a big transaction's pages before it commits.
+	 *
+	 * Normally a write transaction keeps its dirty pages in memory until
+	 * it commits, unless there are too many to keep, and then writes all
+	 * of them at once and waits for the device. With a threshold set,
+	 * each time the transaction has dirtied that many more pages it
+	 * writes out the ones it is done with, which is all but the pages on
+	 * the paths of its open cursors and the roots, and has the OS start writing
+	 * them back right away (sync_file_range() on Linux). The sync at
+	 * commit then only waits for what is left. This suits transactions
+	 * that work through their keys in order, like a big load. Pages that
+	 * are changed again after being written are copied back and written
+	 * a second time. No effect with #RDB_WRITEMAP.
+	 *
+	 * This function may be called at any time.
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] pages How many pages a transaction may dirty before it
+	 * writes some out. 0, the default, turns this off.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_env_set_writeback(RDB_env *env, unsigned int pages);
+
+	/** @brief Set the number of threads that write a commit's pages.
+	 *
+	 * A transaction that changes a lot of data is written with one call
+	 * per run of adjacent pages, from the committing thread. With more
+	 * threads the sorted list of dirty pages is cut into that many
+	 * extents, and each thread writes one of them, so a device that can
+	 * serve many requests at once has them. The sync and the meta page
+	 * write follow once all of them are done. Transactions with fewer
+	 * than a thousand or so dirty pages per thread use fewer threads.
+	 * This has no effect with #RDB_WRITEMAP, which leaves the writing to
+	 * the OS, or when #RDB_IOURING is in use.
+	 *
+	 * This function may be called at any time; a commit that is already
+	 * writing is not affected.
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] n The number of threads, at most 64. 0 or 1, the default,
+	 * writes from the committing thread alone.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_env_set_flushthreads(RDB_env *env, unsigned int n);
+
 	/** @brief Set the maximum number of threads/reader slots for the environment.
 	 *
 	 * This defines the number of slots in the lock table that is used to track readers in the
@@ -999,6 +1316,10 @@ size_t rdb_txn_id(RDB_txn *txn);
 	 *	<li>ENOSPC - no more disk space.
 	 *	<li>EIO - a low-level I/O error occurred while writing.
 	 *	<li>ENOMEM - out of memory.
+	 *	<li>#RDB_NOT_DURABLE - with #RDB_PIPELINE, the transaction was
+	 *		committed and readers see it, but syncing it failed. Unlike
+	 *		the other errors, it must not be retried. The environment
+	 *		should be closed; #rdb_env_wait_durable() returns the cause.
 	 * </ul>
 	 */
 int  rdb_txn_commit(RDB_txn *txn);
@@ -1013,6 +1334,101 @@ int  rdb_txn_commit(RDB_txn *txn);
 	 */
 void rdb_txn_abort(RDB_txn *txn);
 
+	/** @brief A write for #rdb_group_commit().
+	 *
+	 * @param[in] txn A nested transaction to make the changes in. The
+	 * function must not commit or abort it.
+	 * @param[in] ctx The context passed to #rdb_group_commit().
+	 * @return 0 to keep the changes, anything else to roll them back.
+	 */
+typedef int (RDB_group_func)(RDB_txn *txn, void *ctx);
+
+	/** @brief Make a write as part of a group commit.
+	 *
+	 * Threads that each have a small write to make can share one commit,
+	 * and one sync, instead of taking turns. The calling thread queues
+	 * \b func and waits. The first thread to find no commit in progress
+	 * becomes the leader: it begins a write transaction, runs every write
+	 * queued by then, each in a nested transaction of its own, and commits.
+	 * A write that fails, or whose function returns non-zero, is rolled
+	 * back without affecting the others. Writes queued while the leader
+	 * commits go into the next group, led by the first of their threads.
+	 *
+	 * The function runs in the leader's thread, which may not be the
+	 * caller's, and should not block. The calling thread must not have a
+	 * write transaction of its own. Since nested transactions can't be
+	 * used with #RDB_WRITEMAP, neither can this.
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] func The write to make, see #RDB_group_func
+	 * @param[in] ctx An arbitrary pointer for the function's use
+	 * @return The function's non-zero result, or an error in making its
+	 * transaction or committing the group, or 0 once the write is durable
+	 * (as far as the environment's sync settings go). Some possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or #RDB_WRITEMAP is in use.
+	 *	<li>EACCES - the environment is read-only.
+	 *	<li>ENOSPC - no more disk space.
+	 *	<li>EIO - a low-level I/O error occurred while writing.
+	 * </ul>
+	 */
+int  rdb_group_commit(RDB_env *env, RDB_group_func *func, void *ctx);
+
+	/** @brief Called when a commit from #rdb_txn_commit_async() is durable.
+	 *
+	 * @param[in] txnid The ID of the committed transaction.
+	 * @param[in] rc 0 if the commit is durable, else the error that kept
+	 * it from being so. The commit stays visible until the environment
+	 * is closed, but may be lost in a crash.
+	 * @param[in] ctx The context passed to #rdb_txn_commit_async().
+	 */
+typedef void (RDB_commit_func)(size_t txnid, int rc, void *ctx);
+
+	/** @brief Commit a transaction now and make it durable later.
+	 *
+	 * The transaction's pages are written as by #rdb_txn_commit(), but
+	 * the commit is published to readers, in this and other processes,
+	 * and the write lock released without waiting for a sync. A thread
+	 * of the environment then syncs the data file and writes the meta
+	 * page, for as many commits as have queued up by then at once, and
+	 * calls \b func for each, in transaction ID order. Until then, the
+	 * space the commit frees is not reused, and a system crash loses it
+	 * along with any later commits. A synchronous commit meanwhile makes
+	 * all earlier ones durable too.
+	 *
+	 * The transaction handle is freed, as with #rdb_txn_commit(), also on
+	 * failure. Call #rdb_txn_id() first to learn the ID to wait for with
+	 * #rdb_env_wait_durable(); if the transaction changed nothing, the
+	 * callback gets the ID of the last commit before it. The callback runs in the syncer thread; it
+	 * must not close the environment, and should not block. This can't
+	 * be used with #RDB_WRITEMAP, #RDB_NOLOCK or nested transactions.
+	 * @param[in] txn A write transaction handle returned by #rdb_txn_begin()
+	 * @param[in] func A callback, or NULL
+	 * @param[in] ctx An arbitrary pointer for the callback's use
+	 * @return A non-zero error value on failure and 0 on success, when
+	 * the commit is visible. Some possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOSPC - no more disk space.
+	 *	<li>EIO - a low-level I/O error occurred while writing.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  rdb_txn_commit_async(RDB_txn *txn, RDB_commit_func *func, void *ctx);
+
+	/** @brief Wait until a commit is durable.
+	 *
+	 * @param[in] env An environment handle returned by #rdb_env_create()
+	 * @param[in] txnid A transaction ID from #rdb_txn_id(), of a commit
+	 * made with this handle or already durable.
+	 * @return 0 once the commit is durable, else an error value. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - \b txnid is not a commit this handle knows of.
+	 *	<li>EIO - a low-level I/O error occurred while syncing.
+	 * </ul>
+	 */
+int  rdb_env_wait_durable(RDB_env *env, size_t txnid);
+
 	/** @brief Reset a read-only transaction.
 	 *
 	 * Abort the transaction like #rdb_txn_abort(), but keep the transaction
@@ -1103,6 +1519,46 @@ int  rdb_txn_renew(RDB_txn *txn);
 	 *	<li>#RDB_REVERSEDUP
 	 *		This option specifies that duplicate data items should be compared as
 	 *		strings in reverse order.
+	 *	<li>#RDB_PREFIXKEY
+	 *		Store the key prefix shared by all nodes of a branch page only once,
+	 *		keeping just the remaining suffix in each node. This raises the fanout
+	 *		of long keys with common leading bytes. Leaf pages keep whole keys, so
+	 *		keys returned by cursors still point directly into the map and stay
+	 *		valid as described for #RDB_val. This flag may not be combined with
+	 *		#RDB_REVERSEKEY or #RDB_INTEGERKEY.
+	 *	<li>#RDB_BLOOM
+	 *		Keep a Bloom filter of the database's keys, updated along with the
+	 *		tree by every write. #rdb_get(), #rdb_get_batch() and the #RDB_SET
+	 *		and #RDB_SET_KEY cursor operations consult it first, and return
+	 *		#RDB_NOTFOUND without searching the tree for most absent keys.
+	 *		Deleting keys does not clear their bits; use #rdb_bloom_rebuild()
+	 *		or a compacting copy to refresh the filter. The filter is stored in
+	 *		a hidden database, whose handle also counts against
+	 *		#rdb_env_set_maxdbs(). Passing this flag with #RDB_CREATE for an
+	 *		existing database adds a filter built from its current keys.
+	 *		Handles opened before that, also in other processes, write to
+	 *		the filter from their next write transaction on.
+	 *		Not valid for the main database.
+	 *	<li>#RDB_HASHED
+	 *		Store the database as a linear hash table instead of a B+tree.
+	 *		A key's bucket is found by hashing its bytes and stepping down a
+	 *		directory of bucket pages, so #rdb_get(), #rdb_put() and
+	 *		#rdb_del() touch the directory and usually one leaf. The
+	 *		directory gets a level for each 256-fold growth of the table with
+	 *		4KB pages, and has about one page for each 256 leaves, so it
+	 *		stays in memory and can be kept there with #rdb_dbi_pin().
+	 *		Keys are unordered: cursors support only #RDB_FIRST, #RDB_NEXT,
+	 *		#RDB_NEXT_NODUP, #RDB_GET_CURRENT, #RDB_SET and #RDB_SET_KEY, and
+	 *		return #RDB_INCOMPATIBLE for other operations. A custom key
+	 *		comparison function must only consider identical keys equal.
+	 *		A write resets the other cursors on the database in the same
+	 *		transaction. #rdb_cursor_put() leaves its own cursor on the item,
+	 *		and #rdb_cursor_del() leaves it ready for #RDB_NEXT, but a scan
+	 *		that stores new keys may see some items twice. The table grows a
+	 *		bucket at a time as keys are added, and only shrinks when the
+	 *		database is emptied by #rdb_drop().
+	 *		This flag may not be combined with #RDB_DUPSORT or #RDB_PREFIXKEY,
+	 *		and is not valid for the main database.
 	 *	<li>#RDB_CREATE
 	 *		Create the named database if it doesn't exist. This option is not
 	 *		allowed in a read-only transaction or a read-only environment.
@@ -1170,6 +1626,81 @@ void rdb_dbi_close(RDB_env *env, RDB_dbi dbi);
 	 */
 int  rdb_drop(RDB_txn *txn, RDB_dbi dbi, int del);
 
+	/** @brief Rebuild the Bloom filter of a database.
+	 *
+	 * The filter of an #RDB_BLOOM database is resized for \b nkeys keys,
+	 * cleared, and refilled from the keys currently in the database. This
+	 * drops the bits of deleted keys, and restores the false positive rate
+	 * of a filter that has outgrown its original size.
+	 * @param[in] txn A transaction handle returned by #rdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] nkeys The number of keys to size the filter for,
+	 * or 0 to use the current number of items in the database.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#RDB_INCOMPATIBLE - the database has no Bloom filter.
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_bloom_rebuild(RDB_txn *txn, RDB_dbi dbi, size_t nkeys);
+
+	/** @brief Give the OS a hint about how part of a database will be accessed.
+	 *
+	 * The branch pages of the database are walked to find the pages that
+	 * hold keys from \b lo to \b hi, in this transaction's snapshot, and
+	 * the hint is passed on for them with madvise(). Leaf pages are not
+	 * read to do this. Overflow pages and the sub-databases of
+	 * #RDB_DUPSORT items are not covered.
+	 *
+	 * Hints are only hints: they never change what is read or written.
+	 * A hint the OS has no equivalent for is ignored, on Windows they all are.
+	 * Since the pages of a key range move as it is written to, a hint
+	 * given for it is only good until then.
+	 * @param[in] txn A transaction handle returned by #rdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] lo The lowest key of the range, or NULL to start at the first key.
+	 * @param[in] hi The highest key of the range, or NULL to end at the last key.
+	 * @param[in] advice One of the @ref rdb_advise values.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#RDB_INCOMPATIBLE - a key range was given for an #RDB_HASHED database.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_dbi_advise(RDB_txn *txn, RDB_dbi dbi, RDB_val *lo, RDB_val *hi, int advice);
+
+	/** @brief Keep the branch pages of a database locked in memory.
+	 *
+	 * All branch pages of the database are locked with mlock(), so that
+	 * a lookup faults in at most one leaf page, however short of memory
+	 * the system is. From then on every commit locks the branch pages it
+	 * writes for the database and unlocks the ones it frees, so the lock
+	 * follows the tree as it changes. Leaf pages, overflow pages and the
+	 * sub-databases of #RDB_DUPSORT items are never locked.
+	 *
+	 * This is the writer's job: it must be called in a write transaction,
+	 * and only commits from this environment handle maintain the pages.
+	 * It takes effect at once, even if the transaction is then aborted.
+	 * Pages stay locked after #rdb_dbi_close() until they are freed or
+	 * the environment is closed; unpin the database first to release them.
+	 * How much is locked is in #RDB_envinfo.me_pinned. Locked memory is
+	 * usually limited per process, e.g. by RLIMIT_MEMLOCK.
+	 * @param[in] txn A write transaction handle returned by #rdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] onoff Non-zero to lock the pages, zero to unlock them.
+	 * @return A non-zero error value on failure and 0 on success. Nothing
+	 * is locked on failure. Some possible errors are:
+	 * <ul>
+	 *	<li>ENOMEM - the pages couldn't be locked, e.g. over the limit.
+	 *	<li>EACCES - the transaction is read-only.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_dbi_pin(RDB_txn *txn, RDB_dbi dbi, int onoff);
+
 	/** @brief Set a custom key comparison function for a database.
 	 *
 	 * The comparison function is called whenever it is necessary to compare a
@@ -1278,6 +1809,33 @@ int  rdb_set_relctx(RDB_txn *txn, RDB_dbi dbi, void *ctx);
 	 */
 int  rdb_get(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_val *data);
 
+	/** @brief Get the items for many keys from a database.
+	 *
+	 * This is equivalent to calling #rdb_get() for each key, but the keys
+	 * are looked up in sorted order and each search resumes from the pages
+	 * the previous one visited instead of from the root. Pages that later
+	 * searches will need are prefetched while earlier ones are processed.
+	 * The \b keys array itself is not reordered.
+	 *
+	 * The same notes as for #rdb_get() apply to the returned values.
+	 * @param[in] txn A transaction handle returned by #rdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] keys An array of \b n keys to search for
+	 * @param[out] vals An array of \b n items to receive the data
+	 * @param[out] rcs An array of \b n result codes, each as #rdb_get()
+	 * would have returned for the corresponding key
+	 * @param[in] n The number of keys
+	 * @return A non-zero error value if the batch could not be processed,
+	 * and 0 otherwise, in which case the results are in \b rcs. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory for sorting the keys.
+	 * </ul>
+	 */
+int  rdb_get_batch(RDB_txn *txn, RDB_dbi dbi, RDB_val *keys, RDB_val *vals,
+	int *rcs, unsigned int n);
+
 	/** @brief Store items into a database.
 	 *
 	 * This function stores key/data pairs in the database. The default behavior
@@ -1313,7 +1871,8 @@ int  rdb_get(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_val *data);
 	 *	<li>#RDB_APPEND - append the given key/data pair to the end of the
 	 *		database. This option allows fast bulk loading when keys are
 	 *		already known to be in the correct order. Loading unsorted keys
-	 *		with this flag will cause a #RDB_KEYEXIST error.
+	 *		with this flag will cause a #RDB_KEYEXIST error. An #RDB_HASHED
+	 *		database has no order to append in, and ignores this flag.
 	 *	<li>#RDB_APPENDDUP - as above, but for sorted dup data.
 	 * </ul>
 	 * @return A non-zero error value on failure and 0 on success. Some possible
@@ -1352,6 +1911,102 @@ int  rdb_put(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_val *data,
 	 */
 int  rdb_del(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_val *data);
 
+	/** @brief Create a batch of writes.
+	 *
+	 * A batch collects puts and deletes, with copies of their keys and
+	 * data, for #rdb_batch_apply() to make in key order. It belongs to no
+	 * transaction, and may be applied any number of times.
+	 * @param[out] batch The address where the new handle will be stored
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  rdb_batch_create(RDB_batch **batch);
+
+	/** @brief Add a put to a batch.
+	 *
+	 * The key and data are copied into the batch.
+	 * @param[in] batch A batch handle returned by #rdb_batch_create()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] key The key to store
+	 * @param[in,out] data The data to store
+	 * @param[in] flags Special options for this operation, as for #rdb_put().
+	 * This parameter must be set to 0 or by bitwise OR'ing together one or
+	 * more of the values described here:
+	 * <ul>
+	 *	<li>#RDB_NODUPDATA, #RDB_NOOVERWRITE - as for #rdb_put(). If the item
+	 *		exists, the put is skipped.
+	 *	<li>#RDB_RESERVE - reserve room for data of size data->mv_size in the
+	 *		batch, and return its address in data->mv_data. The caller must
+	 *		fill it in before the batch is applied.
+	 * </ul>
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  rdb_batch_put(RDB_batch *batch, RDB_dbi dbi, RDB_val *key, RDB_val *data,
+	unsigned int flags);
+
+	/** @brief Add a delete to a batch.
+	 *
+	 * As with #rdb_del(), \b data names one duplicate of an #RDB_DUPSORT
+	 * database to delete, else all of the key's items go. Deleting an item
+	 * that doesn't exist is skipped.
+	 * @param[in] batch A batch handle returned by #rdb_batch_create()
+	 * @param[in] dbi A database handle returned by #rdb_dbi_open()
+	 * @param[in] key The key to delete
+	 * @param[in] data The data to delete, or NULL
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  rdb_batch_del(RDB_batch *batch, RDB_dbi dbi, RDB_val *key, RDB_val *data);
+
+	/** @brief Make the writes of a batch in a transaction.
+	 *
+	 * This is equivalent to calling #rdb_put() and #rdb_del() for each
+	 * write in the order they were added, but they are sorted by database
+	 * and key first, and made with one cursor per database. Each write's
+	 * search resumes from the pages the previous one visited instead of
+	 * from the root, so writes that land on the same leaf share its path.
+	 * Writes to the same key keep their order.
+	 *
+	 * The first failure, other than those the batch skips, stops it. The
+	 * writes before it stay made, as after a failed #rdb_put().
+	 * @param[in] txn A transaction handle returned by #rdb_txn_begin()
+	 * @param[in] batch A batch handle returned by #rdb_batch_create()
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#RDB_MAP_FULL - the database is full, see #rdb_env_set_mapsize().
+	 *	<li>#RDB_TXN_FULL - the transaction has too many dirty pages.
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory for sorting the writes.
+	 * </ul>
+	 */
+int  rdb_batch_apply(RDB_txn *txn, RDB_batch *batch);
+
+	/** @brief Empty a batch for reuse.
+	 *
+	 * @param[in] batch A batch handle returned by #rdb_batch_create()
+	 */
+void rdb_batch_reset(RDB_batch *batch);
+
+	/** @brief Free a batch.
+	 *
+	 * @param[in] batch A batch handle returned by #rdb_batch_create()
+	 */
+void rdb_batch_free(RDB_batch *batch);
+
 	/** @brief Create a cursor handle.
 	 *
 	 * A cursor is associated with a specific transaction and database.
@@ -1473,7 +2128,8 @@ int  rdb_cursor_get(RDB_cursor *cursor, RDB_val *key, RDB_val *data,
 	 *		database. No key comparisons are performed. This option allows
 	 *		fast bulk loading when keys are already known to be in the
 	 *		correct order. Loading unsorted keys with this flag will cause
-	 *		a #RDB_KEYEXIST error.
+	 *		a #RDB_KEYEXIST error. An #RDB_HASHED database has no order
+	 *		to append in, and ignores this flag.
 	 *	<li>#RDB_APPENDDUP - as above, but for sorted dup data.
 	 *	<li>#RDB_MULTIPLE - store multiple contiguous data elements in a
 	 *		single request. This flag may only be specified if the database
@@ -1535,6 +2191,23 @@ int  rdb_cursor_del(RDB_cursor *cursor, unsigned int flags);
 	 */
 int  rdb_cursor_count(RDB_cursor *cursor, size_t *countp);
 
+	/** @brief Give the OS a hint about how a cursor will move.
+	 *
+	 * With #RDB_ADV_SEQUENTIAL, whenever the cursor steps onto a new
+	 * leaf page, the OS is asked to read in the next few leaves in
+	 * the direction it is moving. This helps long scans of a database
+	 * that is not in memory. #RDB_ADV_NORMAL and #RDB_ADV_RANDOM turn
+	 * this off again. The hint is dropped by #rdb_cursor_renew().
+	 * @param[in] cursor A cursor handle returned by #rdb_cursor_open()
+	 * @param[in] advice #RDB_ADV_NORMAL, #RDB_ADV_SEQUENTIAL or #RDB_ADV_RANDOM.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  rdb_cursor_advise(RDB_cursor *cursor, int advice);
+
 	/** @brief Compare two data items according to a particular database.
 	 *
 	 * This returns a comparison as if the two data items were keys in the
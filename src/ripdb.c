@@ -88,6 +88,13 @@
 #define CACHEFLUSH(addr, bytes, cache)
 #endif
 
+#ifdef _WIN32
+#define RDB_BARRIER()	MemoryBarrier()
+#else
+/** Orders memory accesses to the lock file between processes */
+#define RDB_BARRIER()	__sync_synchronize()
+#endif
+
 #if defined(__linux) && !defined(RDB_FDATASYNC_WORKS)
 /** fdatasync is broken on ext3/ext4fs on older kernels, see
  *	description in #rdb_env_open2 comments. You can safely
@@ -154,6 +161,23 @@ typedef SSIZE_T	ssize_t;
 # error "Ambiguous shared-lock implementation"
 #endif
 
+/** Write runs of pages with pwritev() instead of lseek() and writev().
+ *	Saves a call per run, and lets the threads of a parallel
+ *	#rdb_page_flush() share the file descriptor.
+ */
+#if !defined(RDB_USE_PWRITEV) && (defined(__linux__) || defined(__FreeBSD__))
+# define RDB_USE_PWRITEV	1
+#endif
+
+/** Commit through io_uring with #RDB_IOURING. On by default where
+ *	the kernel headers have it, compile with -DRDB_USE_IOURING=0 to leave it out.
+ */
+#if !defined(RDB_USE_IOURING) && defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define RDB_USE_IOURING	1
+# endif
+#endif
+
 #ifdef USE_VALGRIND
 #include <valgrind/memcheck.h>
 #define VGMEMP_CREATE(h,r,z)    VALGRIND_CREATE_MEMPOOL(h,r,z)
@@ -193,6 +217,21 @@ typedef SSIZE_T	ssize_t;
 
 #if defined(__i386) || defined(__x86_64) || defined(_M_IX86)
 #define MISALIGNED_OK	1
+#endif
+
+	/** Use vector compares to search integer LEAF2 pages.
+	 *	Define RDB_NO_SIMD to build without them.
+	 */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(RDB_NO_SIMD)
+#define RDB_SIMD_SEARCH	1
+#include <immintrin.h>
+#endif
+
+	/** Use interpolation search on integer-keyed pages.
+	 *	Define RDB_NO_INTERP to build without it.
+	 */
+#ifndef RDB_NO_INTERP
+#define RDB_INTERP_SEARCH	1
 #endif
 
 #include "ripdb.h"
@@ -525,6 +564,13 @@ static int rdb_mid2l_append(RDB_ID2L ids, RDB_ID2 *id)
 	/** Features under development */
 #ifndef RDB_DEVEL
 #define RDB_DEVEL 0
+#endif
+
+	/** Hint that memory at \b addr will be read soon. Never faults. */
+#ifdef __GNUC__
+# define RDB_PREFETCH(addr)	__builtin_prefetch(addr, 0, 3)
+#else
+# define RDB_PREFETCH(addr)	((void)0)
 #endif
 
 	/** Wrapper around __func__, which is a C99 feature */
@@ -841,7 +887,7 @@ static txnid_t rdb_debug_start;
 	/**	The version number for a database's datafile format. */
 #define RDB_DATA_VERSION	 ((RDB_DEVEL) ? 999 : 1)
 	/**	The version number for a database's lockfile format. */
-#define RDB_LOCK_VERSION	 1
+#define RDB_LOCK_VERSION	 2
 
 	/**	@brief The max size of a key we can write, or 0 for computed max.
 	 *
@@ -863,6 +909,9 @@ static txnid_t rdb_debug_start;
 #define RDB_MAXKEYSIZE	 ((RDB_DEVEL) ? 0 : 511)
 #endif
 
+	/**	Size of a buffer that can hold any key, see #rdb_node_key(). */
+#define KEYBUF_SIZE	((RDB_MAXKEYSIZE) > 0 ? (RDB_MAXKEYSIZE) : MAX_PAGESIZE/2)
+
 	/**	The maximum size of a key we can write to the environment. */
 #if RDB_MAXKEYSIZE
 #define ENV_MAXKEY(env)	(RDB_MAXKEYSIZE)
@@ -1049,6 +1098,13 @@ typedef struct RDB_txbody {
 		 *	be determined by reading the main database meta pages.
 		 */
 	volatile txnid_t		mtb_txnid;
+		/** The ID of the last transaction whose meta page is in the data
+		 *	file. Commits from #rdb_txn_commit_async() are newer until the
+		 *	syncer has written theirs, and their meta pages are in the
+		 *	lock file meanwhile. Freed pages are not reused before this,
+		 *	so a crash leaves intact what the data file points at.
+		 */
+	volatile txnid_t		mtb_durable;
 		/** The number of slots that have been used in the reader table.
 		 *	This always records the maximum count, it is not decremented
 		 *	when readers release their slots.
@@ -1056,37 +1112,6 @@ typedef struct RDB_txbody {
 	volatile unsigned	mtb_numreaders;
 } RDB_txbody;
 
-	/** The actual reader table definition. */
-typedef struct RDB_txninfo {
-	union {
-		RDB_txbody mtb;
-#define mti_magic	mt1.mtb.mtb_magic
-#define mti_format	mt1.mtb.mtb_format
-#define mti_rmutex	mt1.mtb.mtb_rmutex
-#define mti_rmname	mt1.mtb.mtb_rmname
-#define mti_txnid	mt1.mtb.mtb_txnid
-#define mti_numreaders	mt1.mtb.mtb_numreaders
-		char pad[(sizeof(RDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
-	} mt1;
-	union {
-#if defined(_WIN32) || defined(RDB_USE_POSIX_SEM)
-		char mt2_wmname[MNAME_LEN];
-#define	mti_wmname	mt2.mt2_wmname
-#else
-		rdb_mutex_t	mt2_wmutex;
-#define mti_wmutex	mt2.mt2_wmutex
-#endif
-		char pad[(MNAME_LEN+CACHELINE-1) & ~(CACHELINE-1)];
-	} mt2;
-	RDB_reader	mti_readers[1];
-} RDB_txninfo;
-
-	/** Lockfile format signature: version, features and field layout */
-#define RDB_LOCK_FORMAT \
-	((uint32_t) \
-	 ((RDB_LOCK_VERSION) \
-	  /* Flags which describe functionality */ \
-	  + (((RDB_PIDLOCK) != 0) << 16)))
 /** @} */
 
 /** Common header for all page types. The page type depends on #mp_flags.
@@ -1127,6 +1152,7 @@ typedef struct RDB_page {
 #define	P_DIRTY		 0x10		/**< dirty page, also set for #P_SUBP pages */
 #define	P_LEAF2		 0x20		/**< for #RDB_DUPFIXED records */
 #define	P_SUBP		 0x40		/**< for #RDB_DUPSORT sub-pages */
+#define	P_PREFIX	 0x80		/**< branch page with a shared key prefix */
 #define	P_LOOSE		 0x4000		/**< page was dirtied then freed, can be reused */
 #define	P_KEEP		 0x8000		/**< leave this page alone during spill */
 /** @} */
@@ -1318,6 +1344,18 @@ typedef struct RDB_node {
 	 */
 #define LEAF2KEY(p, i, ks)	((char *)(p) + PAGEHDRSZ + ((i)*(ks)))
 
+	/** The length of the key prefix shared by all nodes of a branch page.
+	 *	On a #P_PREFIX page each node only holds the rest of its key.
+	 *	The prefix is stored once, at the end of the page.
+	 *	Leaf pages never get a prefix: a key returned from a leaf must
+	 *	stay valid until the end of a read-only transaction, see #RDB_val,
+	 *	and a key rebuilt in a cursor's buffer would not be.
+	 */
+#define PAGEPFXLEN(p)	(F_ISSET((p)->mp_flags, P_PREFIX) ? (p)->mp_pad : 0)
+
+	/** The address of the key prefix of a #P_PREFIX branch page. */
+#define PAGEPFX(env, p)	((char *)(p) + (env)->me_psize - EVEN((p)->mp_pad))
+
 	/** Set the \b node's key into \b keyptr, if requested. */
 #define RDB_GET_KEY(node, keyptr)	{ if ((keyptr) != NULL) { \
 	(keyptr)->mv_size = NODEKSZ(node); (keyptr)->mv_data = NODEKEY(node); } }
@@ -1327,7 +1365,8 @@ typedef struct RDB_node {
 
 	/** Information about a single database in the environment. */
 typedef struct RDB_db {
-	uint32_t	md_pad;		/**< also ksize for LEAF2 pages */
+	uint32_t	md_pad;		/**< also ksize for LEAF2 pages, or the
+								 *	bucket count of #RDB_HASHED DBs */
 	uint16_t	md_flags;	/**< @ref rdb_dbi_open */
 	uint16_t	md_depth;	/**< depth of this tree */
 	pgno_t		md_branch_pages;	/**< number of internal pages */
@@ -1341,7 +1380,7 @@ typedef struct RDB_db {
 #define PERSISTENT_FLAGS	(0xffff & ~(RDB_VALID))
 	/** #rdb_dbi_open() flags */
 #define VALID_FLAGS	(RDB_REVERSEKEY|RDB_DUPSORT|RDB_INTEGERKEY|RDB_DUPFIXED|\
-	RDB_INTEGERDUP|RDB_REVERSEDUP|RDB_CREATE)
+	RDB_INTEGERDUP|RDB_REVERSEDUP|RDB_PREFIXKEY|RDB_BLOOM|RDB_HASHED|RDB_CREATE)
 
 	/** Handle for the DB used to track free pages. */
 #define	FREE_DBI	0
@@ -1390,6 +1429,49 @@ typedef union RDB_metabuf {
 	} mb_metabuf;
 } RDB_metabuf;
 
+	/** The actual reader table definition.
+	 *	It comes after #RDB_meta, which it holds copies of.
+	 */
+typedef struct RDB_txninfo {
+	union {
+		RDB_txbody mtb;
+#define mti_magic	mt1.mtb.mtb_magic
+#define mti_format	mt1.mtb.mtb_format
+#define mti_rmutex	mt1.mtb.mtb_rmutex
+#define mti_rmname	mt1.mtb.mtb_rmname
+#define mti_txnid	mt1.mtb.mtb_txnid
+#define mti_durable	mt1.mtb.mtb_durable
+#define mti_numreaders	mt1.mtb.mtb_numreaders
+		char pad[(sizeof(RDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt1;
+	union {
+#if defined(_WIN32) || defined(RDB_USE_POSIX_SEM)
+		char mt2_wmname[MNAME_LEN];
+#define	mti_wmname	mt2.mt2_wmname
+#else
+		rdb_mutex_t	mt2_wmutex;
+#define mti_wmutex	mt2.mt2_wmutex
+#endif
+		char pad[(MNAME_LEN+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt2;
+	union {
+		/** Meta pages of commits newer than mti_durable, by txnid & 1.
+		 *	Readers take these instead of the ones in the data file.
+		 */
+		RDB_meta	mt3_metas[NUM_METAS];
+#define mti_metas	mt3.mt3_metas
+		char pad[(sizeof(RDB_meta)*NUM_METAS+CACHELINE-1) & ~(CACHELINE-1)];
+	} mt3;
+	RDB_reader	mti_readers[1];
+} RDB_txninfo;
+
+	/** Lockfile format signature: version, features and field layout */
+#define RDB_LOCK_FORMAT \
+	((uint32_t) \
+	 ((RDB_LOCK_VERSION) \
+	  /* Flags which describe functionality */ \
+	  + (((RDB_PIDLOCK) != 0) << 16)))
+
 	/** Auxiliary DB info.
 	 *	The information here is mostly static/read-only. There is
 	 *	only a single copy of this record in the environment.
@@ -1400,6 +1482,8 @@ typedef struct RDB_dbx {
 	RDB_cmp_func	*md_dcmp;	/**< function for comparing data items */
 	RDB_rel_func	*md_rel;	/**< user relocate function */
 	void		*md_relctx;		/**< user-provided context for md_rel */
+	RDB_dbi		md_bloom;		/**< DB holding the #RDB_BLOOM filter, or 0 */
+	int			md_pinned;		/**< branch pages are kept locked, #rdb_dbi_pin() */
 } RDB_dbx;
 
 	/** A database transaction.
@@ -1410,6 +1494,10 @@ struct RDB_txn {
 	/** Nested txn under this txn, set together with flag #RDB_TXN_HAS_CHILD */
 	RDB_txn		*mt_child;
 	pgno_t		mt_next_pgno;	/**< next unallocated page */
+	/** Next page of the current allocation run, or 0. See #rdb_env_set_allocrun(). */
+	pgno_t		mt_runnext;
+	/** End of the current allocation run if it is in new space */
+	pgno_t		mt_runend;
 	/** The ID of this transaction. IDs are integers incrementing from 1.
 	 *	Only committed write transactions increment the ID. If a transaction
 	 *	aborts, the ID may be re-used by the next writer.
@@ -1425,6 +1513,8 @@ struct RDB_txn {
 	RDB_page	*mt_loose_pgs;
 	/** Number of loose pages (#mt_loose_pgs) */
 	int			mt_loose_count;
+	/** Pages dirtied since the last writeback, see #rdb_env_set_writeback() */
+	unsigned int	mt_wbdirty;
 	/** The sorted list of dirty pages we temporarily wrote to disk
 	 *	because the dirty list was full. page numbers in here are
 	 *	shifted left by 1, deleted slots have the LSB set.
@@ -1533,7 +1623,10 @@ struct RDB_cursor {
 #define C_EOF	0x02			/**< No more data */
 #define C_SUB	0x04			/**< Cursor is a sub-cursor */
 #define C_DEL	0x08			/**< last op was a cursor_del */
+#define C_FINGER	0x10		/**< search from the current stack if possible */
+#define C_READAHEAD	0x20		/**< read leaves ahead, see #rdb_cursor_advise() */
 #define C_UNTRACK	0x40		/**< Un-track cursor when closing */
+#define C_NOREBAL	0x80		/**< leave a leaf the cursor stays on unbalanced, see #rdb_batch_run() */
 /** @} */
 	unsigned int	mc_flags;	/**< @ref rdb_cursor */
 	RDB_page	*mc_pg[CURSOR_STACK];	/**< stack of pushed pages */
@@ -1584,6 +1677,7 @@ struct RDB_env {
 	HANDLE		me_fd;		/**< The main data file */
 	HANDLE		me_lfd;		/**< The lock file */
 	HANDLE		me_mfd;		/**< For writing and syncing the meta pages */
+	HANDLE		me_dfd;		/**< For writing data pages with #RDB_DIRECT */
 	/** Failed to update the meta page. Probably an I/O error. */
 #define	RDB_FATAL_ERROR	0x80000000U
 	/** Some fields are initialized. */
@@ -1593,7 +1687,8 @@ struct RDB_env {
 	/** fdatasync is unreliable */
 #define	RDB_FSYNCONLY	0x08000000U
 	uint32_t 	me_flags;		/**< @ref rdb_env */
-	unsigned int	me_psize;	/**< DB page size, inited from me_os_psize */
+	unsigned int	me_psize;	/**< DB page size, inited from me_os_psize
+								 *	or #rdb_env_set_pagesize() */
 	unsigned int	me_os_psize;	/**< OS page size, from #GET_PAGESIZE */
 	unsigned int	me_maxreaders;	/**< size of the reader table */
 	/** Max #RDB_txninfo.%mti_numreaders of interest to #rdb_env_close() */
@@ -1628,6 +1723,36 @@ struct RDB_env {
 	int			me_maxfree_1pg;
 	/** Max size of a node on a page */
 	unsigned int	me_nodemax;
+	/** log2 of the fanout of an #RDB_HASHED directory page */
+	unsigned int	me_hashbits;
+	time_t		me_hotsaved;	/**< when the hot page list was last sampled */
+	/** Sorted list of the pages locked by #rdb_dbi_pin(), or NULL */
+	RDB_IDL		me_pinned;
+	size_t		me_pinbytes;	/**< bytes locked, for #rdb_env_info() */
+#if RDB_USE_IOURING
+	struct RDB_ring	*me_ring;	/**< commit queue for #RDB_IOURING, or NULL */
+#endif
+	unsigned int	me_flushthreads;	/**< see #rdb_env_set_flushthreads() */
+	unsigned int	me_allocrun;	/**< see #rdb_env_set_allocrun() */
+	unsigned int	me_writeback;	/**< see #rdb_env_set_writeback() */
+	size_t		me_commits;		/**< for #rdb_env_info() */
+	size_t		me_commit_pages;
+	size_t		me_commit_runs;
+	pthread_mutex_t	me_gmutex;	/**< protects the group commit queue */
+	/** Writes queued by #rdb_group_commit(), oldest first */
+	struct RDB_gwait	*me_ghead, *me_gtail;
+	int		me_gleader;		/**< a group is being committed */
+	pthread_mutex_t	me_smutex;	/**< protects the syncer's queue and state */
+	pthread_cond_t	me_scond;	/**< wakes the syncer */
+	pthread_t	me_sthr;		/**< the syncer, if me_sstate */
+	int		me_sstate;		/**< 0 no syncer, 1 running, 2 told to stop */
+	/** Commits from #rdb_txn_commit_async() to sync, oldest first */
+	struct RDB_syncreq	*me_shead, *me_stail;
+	/** Threads in #rdb_env_wait_durable() */
+	struct RDB_swait	*me_swait;
+	txnid_t		me_squeued;		/**< last txnid queued for the syncer */
+	txnid_t		me_sdone;		/**< last txnid the syncer made durable */
+	int		me_serror;		/**< the syncer's first error, which sticks */
 #if !(RDB_MAXKEYSIZE)
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
@@ -1652,6 +1777,9 @@ typedef struct RDB_ntxn {
 	RDB_pgstate	mnt_pgstate;	/**< parent transaction's saved freestate */
 } RDB_ntxn;
 
+	/** seconds between samples of the hot page list at commit, see #RDB_HOTLIST */
+#define RDB_HOTLIST_INTERVAL	600
+
 	/** max number of pages to commit in one writev() call */
 #define RDB_COMMIT_PAGES	 64
 #if defined(IOV_MAX) && IOV_MAX < RDB_COMMIT_PAGES
@@ -1662,6 +1790,15 @@ typedef struct RDB_ntxn {
 	/** max bytes to write in one call */
 #define MAX_WRITE		(0x40000000U >> (sizeof(ssize_t) == 4))
 
+	/** True if #rdb_txn_commit() leaves the sync to the syncer, see #RDB_PIPELINE */
+#define RDB_PIPELINED(env) \
+	(((env)->me_flags & (RDB_PIPELINE|RDB_WRITEMAP|RDB_NOSYNC)) == RDB_PIPELINE && \
+	 (env)->me_txns)
+
+	/** True if commits from #rdb_txn_commit_async() wait for the syncer */
+#define RDB_PENDING(env) \
+	((env)->me_txns && (env)->me_txns->mti_durable != (env)->me_txns->mti_txnid)
+
 	/** Check \b txn and \b dbi arguments to a function */
 #define TXN_DBI_EXIST(txn, dbi, validity) \
 	((txn) && (dbi)<(txn)->mt_numdbs && ((txn)->mt_dbflags[dbi] & (validity)))
@@ -1694,6 +1831,7 @@ static int  rdb_page_search_root(RDB_cursor *mc,
 #define RDB_PS_ROOTONLY	2
 #define RDB_PS_FIRST	4
 #define RDB_PS_LAST		8
+#define RDB_PS_STEP		16
 static int  rdb_page_search(RDB_cursor *mc,
 			    RDB_val *key, int flags);
 static int	rdb_page_merge(RDB_cursor *csrc, RDB_cursor *cdst);
@@ -1704,7 +1842,15 @@ static int	rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata,
 
 static int  rdb_env_read_header(RDB_env *env, RDB_meta *meta);
 static RDB_meta *rdb_env_pick_meta(const RDB_env *env);
+static RDB_meta *rdb_txn_meta(const RDB_env *env, txnid_t txnid);
 static int  rdb_env_write_meta(RDB_txn *txn);
+static void rdb_sync_queue(RDB_env *env, RDB_txn *txn, struct RDB_syncreq *sr);
+#if RDB_USE_IOURING
+static int  rdb_ring_commit(RDB_txn *txn);
+#endif
+static int  rdb_env_madvise(RDB_env *env, pgno_t pgno, pgno_t count, int advice);
+static int  rdb_pin_changes(RDB_txn *txn, RDB_IDL *pins, RDB_IDL *unpins);
+static int  rdb_pin_apply(RDB_env *env, RDB_IDL pins, RDB_IDL unpins, int strict);
 #if defined(RDB_USE_POSIX_MUTEX) && !defined(RDB_ROBUST_SUPPORTED) /* Drop unused excl arg */
 # define rdb_env_close0(env, excl) rdb_env_close1(env)
 #endif
@@ -1719,11 +1865,13 @@ static int	rdb_node_move(RDB_cursor *csrc, RDB_cursor *cdst, int fromleft);
 static int  rdb_node_read(RDB_cursor *mc, RDB_node *leaf, RDB_val *data);
 static size_t	rdb_leaf_size(RDB_env *env, RDB_val *key, RDB_val *data);
 static size_t	rdb_branch_size(RDB_env *env, RDB_val *key);
+static void	rdb_node_key(RDB_env *env, RDB_page *mp, RDB_node *node, RDB_val *key, char *buf);
 
 static int	rdb_rebalance(RDB_cursor *mc);
 static int	rdb_update_key(RDB_cursor *mc, RDB_val *key);
 
 static void	rdb_cursor_pop(RDB_cursor *mc);
+static void	rdb_cursor_copy(const RDB_cursor *csrc, RDB_cursor *cdst);
 static int	rdb_cursor_push(RDB_cursor *mc, RDB_page *mp);
 
 static int	_rdb_cursor_del(RDB_cursor *mc, unsigned int flags);
@@ -1745,8 +1893,12 @@ static void	rdb_xcursor_init1(RDB_cursor *mc, RDB_node *node);
 static void	rdb_xcursor_init2(RDB_cursor *mc, RDB_xcursor *src_mx, int force);
 
 static int	rdb_drop0(RDB_cursor *mc, int subs);
+static int	rdb_dbi_open0(RDB_txn *txn, RDB_val *name, unsigned int flags, RDB_dbi *dbi);
 static void rdb_default_cmp(RDB_txn *txn, RDB_dbi dbi);
 static int rdb_reader_check0(RDB_env *env, int rlocked, int *dead);
+#ifdef RDB_SIMD_SEARCH
+static void rdb_simd_init(void);
+#endif
 
 /** @cond */
 static RDB_cmp_func	rdb_cmp_memn, rdb_cmp_memnr, rdb_cmp_int, rdb_cmp_cint, rdb_cmp_long;
@@ -1800,6 +1952,7 @@ static char *const rdb_errstr[] = {
 	"RDB_BAD_TXN: Transaction must abort, has a child, or is invalid",
 	"RDB_BAD_VALSIZE: Unsupported size of key/DB name/data, or wrong DUPFIXED size",
 	"RDB_BAD_DBI: The specified DBI handle was closed/changed unexpectedly",
+	"RDB_NOT_DURABLE: Transaction committed, but syncing it failed",
 };
 
 char *
@@ -2108,6 +2261,8 @@ rdb_dcmp(RDB_txn *txn, RDB_dbi dbi, const RDB_val *a, const RDB_val *b)
 
 /** Allocate memory for a page.
  * Re-use old malloc'd pages first for singletons, otherwise just malloc.
+ * With #RDB_DIRECT the pages go straight from here to the device, so
+ * they are aligned on OS pages, and so are the ones on the reuse list.
  * Set #RDB_TXN_ERROR on failure.
  */
 static RDB_page *
@@ -2133,7 +2288,14 @@ rdb_page_malloc(RDB_txn *txn, unsigned num)
 		sz *= num;
 		off = sz - psize;
 	}
-	if ((ret = malloc(sz)) != NULL) {
+#ifndef _WIN32
+	if (env->me_flags & RDB_DIRECT) {
+		if (posix_memalign((void **)&ret, env->me_os_psize, sz))
+			ret = NULL;
+	} else
+#endif
+		ret = malloc(sz);
+	if (ret != NULL) {
 		VGMEMP_ALLOC(env, ret, sz);
 		if (!(env->me_flags & RDB_NOMEMINIT)) {
 			memset((char *)ret + off, 0, psize);
@@ -2326,6 +2488,11 @@ static int rdb_page_flush(RDB_txn *txn, int keep);
  * going thru all of the work of #rdb_page_touch(). Such references are
  * handled by #rdb_page_unspill().
  *
+ * With #rdb_env_set_writeback() pages are also spilled once the dirty
+ * list holds that many, all but the kept ones at once, and the OS is
+ * asked to start writing them back. A big txn then keeps the device
+ * busy as it goes, and its commit only waits for the rest.
+ *
  * Also note, we never spill DB root pages, nor pages of active cursors,
  * because we'll need these back again soon anyway. And in nested txns,
  * we can't spill a page in a child txn if it was already spilled in a
@@ -2343,10 +2510,12 @@ static int
 rdb_page_spill(RDB_cursor *m0, RDB_val *key, RDB_val *data)
 {
 	RDB_txn *txn = m0->mc_txn;
+	RDB_env *env = txn->mt_env;
 	RDB_page *dp;
 	RDB_ID2L dl = txn->mt_u.dirty_list;
 	unsigned int i, j, need;
-	int rc;
+	pgno_t wbfrom = 0, wbto = 0;
+	int rc, wb;
 
 	if (m0->mc_flags & C_SUB)
 		return RDB_SUCCESS;
@@ -2362,7 +2531,12 @@ rdb_page_spill(RDB_cursor *m0, RDB_val *key, RDB_val *data)
 	i += i;	/* double it for good measure */
 	need = i;
 
-	if (txn->mt_dirty_room > i)
+	/* Kept and loose pages stay on the dirty list, so count the
+	 * pages dirtied since the last writeback instead of its length
+	 */
+	wb = env->me_writeback && txn->mt_wbdirty >= env->me_writeback &&
+		!(env->me_flags & RDB_WRITEMAP);
+	if (txn->mt_dirty_room > i && !wb)
 		return RDB_SUCCESS;
 
 	if (!txn->mt_spill_pgs) {
@@ -2392,7 +2566,10 @@ rdb_page_spill(RDB_cursor *m0, RDB_val *key, RDB_val *data)
 	 * of the dirty pages. Testing revealed this to be a good tradeoff,
 	 * better than 1/2, 1/4, or 1/10.
 	 */
-	if (need < RDB_IDL_UM_MAX / 8)
+	if (wb) {
+		need = dl[0].mid;
+		txn->mt_wbdirty = 0;
+	} else if (need < RDB_IDL_UM_MAX / 8)
 		need = RDB_IDL_UM_MAX / 8;
 
 	/* Save the page IDs of all the pages we're flushing */
@@ -2425,10 +2602,25 @@ rdb_page_spill(RDB_cursor *m0, RDB_val *key, RDB_val *data)
 	}
 	rdb_ridl_sort(txn->mt_spill_pgs);
 
+	if (wb && i < dl[0].mid) {
+		dp = dl[dl[0].mid].mptr;
+		wbfrom = dl[i+1].mid;
+		wbto = dl[dl[0].mid].mid + (IS_OVERFLOW(dp) ? dp->mp_pages : 1);
+	}
+
 	/* Flush the spilled part of dirty list */
 	if ((rc = rdb_page_flush(txn, i)) != RDB_SUCCESS)
 		goto done;
 
+#ifdef SYNC_FILE_RANGE_WRITE
+	/* Start writeback without waiting for it. Direct writes are
+	 * already on their way.
+	 */
+	if (wbto && !(env->me_flags & RDB_DIRECT))
+		(void) sync_file_range(env->me_fd, (off_t)wbfrom * env->me_psize,
+			(off_t)(wbto - wbfrom) * env->me_psize, SYNC_FILE_RANGE_WRITE);
+#endif
+
 	/* Reset any dirty pages we kept that page_flush didn't see */
 	rc = rdb_pages_xkeep(m0, P_DIRTY|P_KEEP, i);
 
@@ -2437,7 +2629,9 @@ done:
 	return rc;
 }
 
-/** Find oldest txnid still referenced. Expects txn->mt_txnid > 0. */
+/** Find oldest txnid still referenced, by readers or by the data file's
+ *	meta pages. Expects txn->mt_txnid > 0.
+ */
 static txnid_t
 rdb_find_oldest(RDB_txn *txn)
 {
@@ -2452,6 +2646,19 @@ rdb_find_oldest(RDB_txn *txn)
 					oldest = mr;
 			}
 		}
+		/* Nor what a crash would go back to */
+		mr = txn->mt_env->me_txns->mti_durable;
+		if (oldest > mr)
+			oldest = mr;
+		/* Nor the tree of the data file's older meta page, which a
+		 * torn write of the newer one falls back to. After a batch of
+		 * async commits it can be older than mti_durable - 1.
+		 */
+		mr = txn->mt_env->me_metas[0]->mm_txnid;
+		if (mr > txn->mt_env->me_metas[1]->mm_txnid)
+			mr = txn->mt_env->me_metas[1]->mm_txnid;
+		if (oldest > mr + 1)
+			oldest = mr + 1;
 	}
 	return oldest;
 }
@@ -2473,6 +2680,7 @@ rdb_page_dirty(RDB_txn *txn, RDB_page *mp)
 	rc = insert(txn->mt_u.dirty_list, &mid);
 	rdb_tassert(txn, rc == 0);
 	txn->mt_dirty_room--;
+	txn->mt_wbdirty++;
 }
 
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
@@ -2534,6 +2742,25 @@ rdb_page_alloc(RDB_cursor *mc, int num, RDB_page **mp)
 		goto fail;
 	}
 
+	/* Keep a run going if its next page is free, else look for an
+	 * extent long enough to start a new one in. A run in new space
+	 * stops after #me_allocrun pages, to look at the freelist again.
+	 */
+	if (num == 1 && env->me_allocrun > 1) {
+		if (txn->mt_runnext == txn->mt_next_pgno &&
+			txn->mt_runnext < txn->mt_runend &&
+			txn->mt_next_pgno + env->me_allocrun < env->me_maxpg)
+			goto new_pages;
+		if (txn->mt_runnext && mop_len) {
+			i = rdb_ridl_search(mop, txn->mt_runnext);
+			if (i <= mop_len && mop[i] == txn->mt_runnext) {
+				pgno = mop[i];
+				goto search_done;
+			}
+		}
+		n2 = env->me_allocrun - 1;
+	}
+
 	for (op = RDB_FIRST;; op = RDB_NEXT) {
 		RDB_val key, data;
 		RDB_node *leaf;
@@ -2625,13 +2852,32 @@ rdb_page_alloc(RDB_cursor *mc, int num, RDB_page **mp)
 		mop_len = mop[0];
 	}
 
+	/* No free extent is long enough for a run: start it in new space,
+	 * unless the map is running out of that.
+	 */
+	if (n2 != (unsigned)num - 1) {
+		if (mop_len && txn->mt_next_pgno + env->me_allocrun >= env->me_maxpg) {
+			i = mop_len;
+			pgno = mop[i];
+			goto search_done;
+		}
+		txn->mt_runend = txn->mt_next_pgno + env->me_allocrun;
+	}
+
+new_pages:
 	/* Use new pages from the map when nothing suitable in the freeDB */
 	i = 0;
 	pgno = txn->mt_next_pgno;
 	if (pgno + num >= env->me_maxpg) {
-			DPUTS("DB size maxed out");
-			rc = RDB_MAP_FULL;
-			goto fail;
+		/* A single page may still be free */
+		if (num == 1 && mop_len) {
+			i = mop_len;
+			pgno = mop[i];
+			goto search_done;
+		}
+		DPUTS("DB size maxed out");
+		rc = RDB_MAP_FULL;
+		goto fail;
 	}
 
 search_done:
@@ -2651,6 +2897,7 @@ search_done:
 	} else {
 		txn->mt_next_pgno = pgno + num;
 	}
+	txn->mt_runnext = pgno + num;
 	np->mp_pgno = pgno;
 	rdb_page_dirty(txn, np);
 	*mp = np;
@@ -3089,7 +3336,14 @@ rdb_txn_renew0(RDB_txn *txn)
 				meta = rdb_env_pick_meta(env);
 				r->mr_txnid = meta->mm_txnid;
 			} else {
-				meta = env->me_metas[r->mr_txnid & 1];
+				meta = rdb_txn_meta(env, r->mr_txnid);
+				/* The lock file's copy of an older commit's meta page
+				 * is reused by the one after next, take a newer one
+				 */
+				while (meta->mm_txnid < r->mr_txnid) {
+					r->mr_txnid = ti->mti_txnid;
+					meta = rdb_txn_meta(env, r->mr_txnid);
+				}
 			}
 			txn->mt_txnid = r->mr_txnid;
 			txn->mt_u.reader = r;
@@ -3101,7 +3355,7 @@ rdb_txn_renew0(RDB_txn *txn)
 			if (LOCK_MUTEX(rc, env, env->me_wmutex))
 				return rc;
 			txn->mt_txnid = ti->mti_txnid;
-			meta = env->me_metas[txn->mt_txnid & 1];
+			meta = rdb_txn_meta(env, txn->mt_txnid);
 		} else {
 			meta = rdb_env_pick_meta(env);
 			txn->mt_txnid = meta->mm_txnid;
@@ -3114,6 +3368,9 @@ rdb_txn_renew0(RDB_txn *txn)
 		txn->mt_child = NULL;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
+		txn->mt_wbdirty = 0;
+		txn->mt_runnext = 0;
+		txn->mt_runend = 0;
 		txn->mt_dirty_room = RDB_IDL_UM_MAX;
 		txn->mt_u.dirty_list = env->me_dirty_list;
 		txn->mt_u.dirty_list[0].mid = 0;
@@ -3292,7 +3549,7 @@ static void
 rdb_dbis_update(RDB_txn *txn, int keep)
 {
 	int i;
-	RDB_dbi n = txn->mt_numdbs;
+	RDB_dbi j, n = txn->mt_numdbs;
 	RDB_env *env = txn->mt_env;
 	unsigned char *tdbflags = txn->mt_dbflags;
 
@@ -3308,6 +3565,10 @@ rdb_dbis_update(RDB_txn *txn, int keep)
 					env->me_dbflags[i] = 0;
 					env->me_dbiseqs[i]++;
 					free(ptr);
+					/* A filter opened in this txn goes away with it */
+					for (j = CORE_DBS; j < n; j++)
+						if (env->me_dbxs[j].md_bloom == (RDB_dbi)i)
+							env->me_dbxs[j].md_bloom = 0;
 				}
 			}
 		}
@@ -3646,60 +3907,38 @@ rdb_freelist_save(RDB_txn *txn)
 	return rc;
 }
 
-/** Flush (some) dirty pages to the map, after clearing their dirty flag.
- * @param[in] txn the transaction that's being committed
- * @param[in] keep number of initial pages in dirty_list to keep dirty.
+/** Write the dirty pages in a slice of a dirty list.
+ *	Runs of adjacent pages go out in one call, up to
+ *	#RDB_COMMIT_PAGES pages and #MAX_WRITE bytes at a time.
+ * @param[in] env the environment handle
+ * @param[in] dl the dirty list
+ * @param[in] lo the first entry to write
+ * @param[in] hi one past the last entry; entries with mid 0 are skipped
  * @return 0 on success, non-zero on failure.
  */
 static int
-rdb_page_flush(RDB_txn *txn, int keep)
+rdb_page_write(RDB_env *env, RDB_ID2L dl, int lo, int hi)
 {
-	RDB_env		*env = txn->mt_env;
-	RDB_ID2L	dl = txn->mt_u.dirty_list;
-	unsigned	psize = env->me_psize, j;
-	int			i, pagecount = dl[0].mid, rc;
+	unsigned	psize = env->me_psize;
+	int			i, rc;
 	size_t		size = 0, pos = 0;
 	pgno_t		pgno = 0;
 	RDB_page	*dp = NULL;
 #ifdef _WIN32
 	OVERLAPPED	ov;
 #else
+	HANDLE		fd = (env->me_flags & RDB_DIRECT) ? env->me_dfd : env->me_fd;
 	struct iovec iov[RDB_COMMIT_PAGES];
 	ssize_t		wpos = 0, wsize = 0, wres;
 	size_t		next_pos = 1; /* impossible pos, so pos != next_pos */
 	int			n = 0;
 #endif
 
-	j = i = keep;
-
-	if (env->me_flags & RDB_WRITEMAP) {
-		/* Clear dirty flags */
-		while (++i <= pagecount) {
-			dp = dl[i].mptr;
-			/* Don't flush this page yet */
-			if (dp->mp_flags & (P_LOOSE|P_KEEP)) {
-				dp->mp_flags &= ~P_KEEP;
-				dl[++j] = dl[i];
+	for (i = lo - 1;;) {
+		if (++i < hi) {
+			if (!(pgno = dl[i].mid))
 				continue;
-			}
-			dp->mp_flags &= ~P_DIRTY;
-		}
-		goto done;
-	}
-
-	/* Write the pages */
-	for (;;) {
-		if (++i <= pagecount) {
 			dp = dl[i].mptr;
-			/* Don't flush this page yet */
-			if (dp->mp_flags & (P_LOOSE|P_KEEP)) {
-				dp->mp_flags &= ~P_KEEP;
-				dl[i].mid = 0;
-				continue;
-			}
-			pgno = dl[i].mid;
-			/* clear dirty flag */
-			dp->mp_flags &= ~P_DIRTY;
 			pos = pgno * psize;
 			size = psize;
 			if (IS_OVERFLOW(dp)) size *= dp->mp_pages;
@@ -3730,20 +3969,20 @@ rdb_page_flush(RDB_txn *txn, int keep)
 retry_write:
 				/* Write previous page(s) */
 #ifdef RDB_USE_PWRITEV
-				wres = pwritev(env->me_fd, iov, n, wpos);
+				wres = pwritev(fd, iov, n, wpos);
 #else
 				if (n == 1) {
-					wres = pwrite(env->me_fd, iov[0].iov_base, wsize, wpos);
+					wres = pwrite(fd, iov[0].iov_base, wsize, wpos);
 				} else {
 retry_seek:
-					if (lseek(env->me_fd, wpos, SEEK_SET) == -1) {
+					if (lseek(fd, wpos, SEEK_SET) == -1) {
 						rc = ErrCode();
 						if (rc == EINTR)
 							goto retry_seek;
 						DPRINTF(("lseek: %s", strerror(rc)));
 						return rc;
 					}
-					wres = writev(env->me_fd, iov, n);
+					wres = writev(fd, iov, n);
 				}
 #endif
 				if (wres != wsize) {
@@ -3760,7 +3999,7 @@ retry_seek:
 				}
 				n = 0;
 			}
-			if (i > pagecount)
+			if (i >= hi)
 				break;
 			wpos = pos;
 			wsize = 0;
@@ -3773,6 +4012,148 @@ retry_seek:
 		n++;
 #endif	/* _WIN32 */
 	}
+	return RDB_SUCCESS;
+}
+
+#if defined(_WIN32) || defined(RDB_USE_PWRITEV)
+	/** Fewest dirty pages for each thread of a parallel #rdb_page_flush() */
+#define RDB_FLUSH_PERTHREAD	1024
+	/** Most threads #rdb_env_set_flushthreads() takes */
+#define RDB_FLUSH_MAXTHREADS	64
+
+/** A slice of the dirty list for one thread of a parallel flush */
+typedef struct rdb_wslice {
+	RDB_env		*ws_env;
+	RDB_ID2L	ws_dl;
+	int			ws_lo, ws_hi;
+	int			ws_rc;
+} rdb_wslice;
+
+static THREAD_RET CALL_CONV
+rdb_page_writethr(void *arg)
+{
+	rdb_wslice *ws = arg;
+
+	ws->ws_rc = rdb_page_write(ws->ws_env, ws->ws_dl, ws->ws_lo, ws->ws_hi);
+	return (THREAD_RET)0;
+}
+
+/** Write a slice of the dirty list with several threads.
+ *	The slice is cut into extents of about the same number of bytes,
+ *	each written by a thread of its own with positioned writes, so the
+ *	device sees that many streams of requests at once. The caller's
+ *	thread takes the last extent.
+ * @param[in] env the environment handle
+ * @param[in] dl the dirty list
+ * @param[in] lo the first entry to write
+ * @param[in] hi one past the last entry
+ * @param[in] nthreads how many threads to use
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_page_write_par(RDB_env *env, RDB_ID2L dl, int lo, int hi, int nthreads)
+{
+	rdb_wslice ws[RDB_FLUSH_MAXTHREADS];
+	pthread_t thr[RDB_FLUSH_MAXTHREADS];
+	RDB_page *dp;
+	size_t total = 0, sum = 0;
+	int i, n, started, rc;
+
+	for (i = lo; i < hi; i++) {
+		if (!dl[i].mid)
+			continue;
+		dp = dl[i].mptr;
+		total += IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+	}
+	n = 0;
+	i = lo;
+	do {
+		ws[n].ws_env = env;
+		ws[n].ws_dl = dl;
+		ws[n].ws_lo = i;
+		for (; i < hi && (n == nthreads - 1 || sum < total / nthreads * (n + 1)); i++) {
+			if (!dl[i].mid)
+				continue;
+			dp = dl[i].mptr;
+			sum += IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+		}
+		ws[n].ws_hi = i;
+		ws[n].ws_rc = RDB_SUCCESS;
+	} while (++n < nthreads);
+	for (started = 0; started < nthreads - 1; started++)
+		if (THREAD_CREATE(thr[started], rdb_page_writethr, &ws[started]))
+			break;
+	/* Whatever didn't get a thread is written here */
+	rc = rdb_page_write(env, dl, ws[started].ws_lo, hi);
+	for (n = 0; n < started; n++) {
+		THREAD_FINISH(thr[n]);
+		if (!rc)
+			rc = ws[n].ws_rc;
+	}
+	return rc;
+}
+#endif
+
+/** Flush (some) dirty pages to the map, after clearing their dirty flag.
+ * @param[in] txn the transaction that's being committed
+ * @param[in] keep number of initial pages in dirty_list to keep dirty.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_page_flush(RDB_txn *txn, int keep)
+{
+	RDB_env		*env = txn->mt_env;
+	RDB_ID2L	dl = txn->mt_u.dirty_list;
+	unsigned	j;
+	int			i, pagecount = dl[0].mid, rc;
+	pgno_t		n, next = 0;
+	RDB_page	*dp = NULL;
+
+	j = i = keep;
+
+	if (env->me_flags & RDB_WRITEMAP) {
+		/* Clear dirty flags */
+		while (++i <= pagecount) {
+			dp = dl[i].mptr;
+			/* Don't flush this page yet */
+			if (dp->mp_flags & (P_LOOSE|P_KEEP)) {
+				dp->mp_flags &= ~P_KEEP;
+				dl[++j] = dl[i];
+				continue;
+			}
+			dp->mp_flags &= ~P_DIRTY;
+		}
+		goto done;
+	}
+
+	while (++i <= pagecount) {
+		dp = dl[i].mptr;
+		/* Don't flush this page yet */
+		if (dp->mp_flags & (P_LOOSE|P_KEEP)) {
+			dp->mp_flags &= ~P_KEEP;
+			dl[i].mid = 0;
+			continue;
+		}
+		/* clear dirty flag */
+		dp->mp_flags &= ~P_DIRTY;
+		n = IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+		env->me_commit_runs += dl[i].mid != next;
+		env->me_commit_pages += n;
+		next = dl[i].mid + n;
+	}
+
+	/* Write the pages */
+#if defined(_WIN32) || defined(RDB_USE_PWRITEV)
+	i = (pagecount - keep) / RDB_FLUSH_PERTHREAD;
+	if (i > (int)env->me_flushthreads)
+		i = env->me_flushthreads;
+	if (i > 1)
+		rc = rdb_page_write_par(env, dl, keep + 1, pagecount + 1, i);
+	else
+#endif
+		rc = rdb_page_write(env, dl, keep + 1, pagecount + 1);
+	if (rc)
+		return rc;
 
 	/* MIPS has cache coherency issues, this is a no-op everywhere else
 	 * Note: for any size >= on-chip cache size, entire on-chip cache is
@@ -3798,12 +4179,18 @@ done:
 	return RDB_SUCCESS;
 }
 
+/** Commit a transaction.
+ * @param[in] txn the transaction
+ * @param[in] sr for #rdb_txn_commit_async(), queued on success, else NULL
+ * @return 0 on success, non-zero on failure.
+ */
 static int
-_rdb_txn_commit(RDB_txn *txn)
+_rdb_txn_commit(RDB_txn *txn, struct RDB_syncreq *sr)
 {
-	int		rc;
+	int		rc, hotsave = 0;
 	unsigned int i, end_mode;
 	RDB_env	*env;
+	RDB_IDL	pins = NULL, unpins = NULL;
 
 	if (txn == NULL)
 		return EINVAL;
@@ -3812,7 +4199,7 @@ _rdb_txn_commit(RDB_txn *txn)
 	end_mode = RDB_END_EMPTY_COMMIT|RDB_END_UPDATE|RDB_END_SLOT|RDB_END_FREE;
 
 	if (txn->mt_child) {
-		rc = _rdb_txn_commit(txn->mt_child);
+		rc = _rdb_txn_commit(txn->mt_child, NULL);
 		if (rc)
 			goto fail;
 	}
@@ -3955,6 +4342,7 @@ _rdb_txn_commit(RDB_txn *txn)
 			;
 		*lp = txn->mt_loose_pgs;
 		parent->mt_loose_count += txn->mt_loose_count;
+		parent->mt_wbdirty += txn->mt_wbdirty;
 
 		parent->mt_child = NULL;
 		rdb_ridl_free(((RDB_ntxn *)txn)->mnt_pgstate.mf_pghead);
@@ -4000,6 +4388,10 @@ _rdb_txn_commit(RDB_txn *txn)
 		}
 	}
 
+	/* Needs the dirty list and free list as the txn left them */
+	if (env->me_pinned && (rc = rdb_pin_changes(txn, &pins, &unpins)))
+		goto fail;
+
 	rc = rdb_freelist_save(txn);
 	if (rc)
 		goto fail;
@@ -4012,17 +4404,47 @@ _rdb_txn_commit(RDB_txn *txn)
 	rdb_audit(txn);
 #endif
 
+	if (sr) {
+		if ((rc = rdb_page_flush(txn, 0)))
+			goto fail;
+		rdb_sync_queue(env, txn, sr);
+	} else
+#if RDB_USE_IOURING
+	/* The ring writes its meta page without waiting for the syncer */
+	if (env->me_ring && !RDB_PENDING(env)) {
+		if ((rc = rdb_ring_commit(txn)))
+			goto fail;
+	} else
+#endif
 	if ((rc = rdb_page_flush(txn, 0)) ||
 		(rc = rdb_env_sync(env, 0)) ||
 		(rc = rdb_env_write_meta(txn)))
 		goto fail;
 	end_mode = RDB_END_COMMITTED|RDB_END_UPDATE;
+	env->me_commits++;
+	if (pins || unpins)
+		(void) rdb_pin_apply(env, pins, unpins, 0);
+	if ((env->me_flags & RDB_HOTLIST) &&
+		time(NULL) - env->me_hotsaved >= RDB_HOTLIST_INTERVAL) {
+		/* Claim it now, save it once the writer lock is released */
+		env->me_hotsaved = time(NULL);
+		hotsave = 1;
+	}
 
 done:
+	/* Nothing written, but earlier commits may be pending */
+	if (sr && (end_mode & RDB_END_OPMASK) == RDB_END_EMPTY_COMMIT)
+		rdb_sync_queue(env, NULL, sr);
+	rdb_ridl_free(pins);
+	rdb_ridl_free(unpins);
 	rdb_txn_end(txn, end_mode);
+	if (hotsave)
+		(void) rdb_env_hotlist_save(env);
 	return RDB_SUCCESS;
 
 fail:
+	rdb_ridl_free(pins);
+	rdb_ridl_free(unpins);
 	_rdb_txn_abort(txn);
 	return rc;
 }
@@ -4030,18 +4452,478 @@ fail:
 int
 rdb_txn_commit(RDB_txn *txn)
 {
+	RDB_env *env;
+	txnid_t txnid;
+	int rc;
+
 	RDB_TRACE(("%p", txn));
-	return _rdb_txn_commit(txn);
+	if (!txn || txn->mt_parent || (txn->mt_flags & RDB_TXN_RDONLY) ||
+		!RDB_PIPELINED(txn->mt_env) ||
+		(!txn->mt_child && !txn->mt_u.dirty_list[0].mid &&
+		 !(txn->mt_flags & (RDB_TXN_DIRTY|RDB_TXN_SPILLS))))
+		return _rdb_txn_commit(txn, NULL);
+
+	/* Let the next writer in while the syncer syncs this one */
+	env = txn->mt_env;
+	txnid = txn->mt_txnid;
+	if ((rc = rdb_txn_commit_async(txn, NULL, NULL)) != RDB_SUCCESS)
+		return rc;
+	/* Emptied by an open child, it queued the commit before it instead */
+	pthread_mutex_lock(&env->me_smutex);
+	if (txnid > env->me_squeued)
+		txnid = env->me_squeued;
+	pthread_mutex_unlock(&env->me_smutex);
+	/* Readers see it already, it must not look uncommitted */
+	if (rdb_env_wait_durable(env, txnid) != RDB_SUCCESS)
+		return RDB_NOT_DURABLE;
+	return RDB_SUCCESS;
 }
 
-/** Read the environment parameters of a DB environment before
- * mapping it into memory.
- * @param[in] env the environment handle
- * @param[out] meta address of where to store the meta information
- * @return 0 on success, non-zero on failure.
+/** @defgroup group	Group commit
+ *	Writers from #rdb_group_commit() queue up on the environment;
+ *	one of them commits for all of them.
+ *	@{
  */
-static int ESECT
-rdb_env_read_header(RDB_env *env, RDB_meta *meta)
+	/** States of an #RDB_gwait */
+enum {
+	RDB_GW_QUEUED,	/**< waiting for a leader */
+	RDB_GW_LEAD,	/**< its thread is to lead the next group */
+	RDB_GW_DONE		/**< gw_rc is final */
+};
+
+/** A write waiting in the group commit queue, on its thread's stack */
+typedef struct RDB_gwait {
+	struct RDB_gwait	*gw_next;
+	RDB_group_func	*gw_func;
+	void		*gw_ctx;
+	int			gw_rc;
+	int			gw_state;
+	pthread_cond_t	gw_cond;	/**< signaled when gw_state changes */
+} RDB_gwait;
+
+/** Run a group of writes in one transaction and commit it.
+ * @param[in] env the environment handle
+ * @param[in] gw the first write of the group, which sets each gw_rc
+ */
+static void
+rdb_group_run(RDB_env *env, RDB_gwait *gw)
+{
+	RDB_txn *txn, *child;
+	RDB_gwait *g;
+	int rc;
+
+	rc = rdb_txn_begin(env, NULL, 0, &txn);
+	for (g = gw; g; g = g->gw_next) {
+		if (rc) {
+			g->gw_rc = rc;
+			continue;
+		}
+		if ((g->gw_rc = rdb_txn_begin(env, txn, 0, &child)) == RDB_SUCCESS) {
+			if ((g->gw_rc = g->gw_func(child, g->gw_ctx)) != RDB_SUCCESS)
+				rdb_txn_abort(child);
+			else
+				g->gw_rc = rdb_txn_commit(child);
+		}
+	}
+	if (rc)
+		return;
+	rc = rdb_txn_commit(txn);
+	if (rc) {
+		for (g = gw; g; g = g->gw_next)
+			if (!g->gw_rc)
+				g->gw_rc = rc;
+	}
+}
+
+int
+rdb_group_commit(RDB_env *env, RDB_group_func *func, void *ctx)
+{
+	RDB_gwait gw, *g, *next;
+
+	if (!env || !func)
+		return EINVAL;
+	if (env->me_flags & RDB_RDONLY)
+		return EACCES;
+	if (env->me_flags & RDB_WRITEMAP)
+		return EINVAL;
+	if (env->me_flags & RDB_FATAL_ERROR)
+		return RDB_PANIC;
+
+	gw.gw_next = NULL;
+	gw.gw_func = func;
+	gw.gw_ctx = ctx;
+	gw.gw_rc = RDB_SUCCESS;
+	gw.gw_state = RDB_GW_QUEUED;
+#ifdef _WIN32
+	if (!(gw.gw_cond = CreateEvent(NULL, FALSE, FALSE, NULL)))
+		return ErrCode();
+#else
+	if ((gw.gw_rc = pthread_cond_init(&gw.gw_cond, NULL)) != 0)
+		return gw.gw_rc;
+#endif
+
+	pthread_mutex_lock(&env->me_gmutex);
+	if (env->me_gtail)
+		env->me_gtail->gw_next = &gw;
+	else
+		env->me_ghead = &gw;
+	env->me_gtail = &gw;
+	if (!env->me_gleader) {
+		env->me_gleader = 1;
+		gw.gw_state = RDB_GW_LEAD;
+	}
+	while (gw.gw_state == RDB_GW_QUEUED)
+		pthread_cond_wait(&gw.gw_cond, &env->me_gmutex);
+
+	if (gw.gw_state == RDB_GW_LEAD) {
+		/* Everything queued so far is ours, starting with gw */
+		env->me_ghead = env->me_gtail = NULL;
+		pthread_mutex_unlock(&env->me_gmutex);
+		rdb_group_run(env, &gw);
+		pthread_mutex_lock(&env->me_gmutex);
+		for (g = gw.gw_next; g; g = next) {
+			next = g->gw_next;
+			g->gw_state = RDB_GW_DONE;
+			pthread_cond_signal(&g->gw_cond);
+		}
+		/* Hand the next group to the first thread in it */
+		if ((g = env->me_ghead) != NULL) {
+			g->gw_state = RDB_GW_LEAD;
+			pthread_cond_signal(&g->gw_cond);
+		} else {
+			env->me_gleader = 0;
+		}
+	}
+	pthread_mutex_unlock(&env->me_gmutex);
+
+#ifdef _WIN32
+	CloseHandle(gw.gw_cond);
+#else
+	pthread_cond_destroy(&gw.gw_cond);
+#endif
+	return gw.gw_rc;
+}
+/** @} */
+
+/** @defgroup syncer	Asynchronous commits
+ *	#rdb_txn_commit_async() writes a commit's pages, puts a copy of its
+ *	meta page in the lock file for readers to find, and queues it for a
+ *	thread of the environment. That thread syncs the data file once for
+ *	everything queued, writes the newest meta page to the data file and
+ *	runs the callbacks. #RDB_txninfo.%mti_durable keeps page_alloc from
+ *	reusing pages that the data file's meta pages still point at.
+ *	@{
+ */
+/** A commit waiting for the syncer */
+typedef struct RDB_syncreq {
+	struct RDB_syncreq	*sr_next;
+	txnid_t		sr_txnid;
+	RDB_commit_func	*sr_func;
+	void		*sr_ctx;
+	RDB_meta	sr_meta;	/**< to write, mm_txnid 0 if it wrote nothing */
+} RDB_syncreq;
+
+/** A thread in #rdb_env_wait_durable(), on its stack */
+typedef struct RDB_swait {
+	struct RDB_swait	*sw_next;
+	txnid_t		sw_txnid;
+	int			sw_done;
+	pthread_cond_t	sw_cond;	/**< signaled when sw_done is set */
+} RDB_swait;
+
+/** Publish a commit and queue it for the syncer. Called with the
+ * writer lock held, once the commit's pages are written.
+ * @param[in] env the environment handle
+ * @param[in] txn the transaction, or NULL if it wrote nothing
+ * @param[in] sr the request, which the syncer frees
+ */
+static void
+rdb_sync_queue(RDB_env *env, RDB_txn *txn, RDB_syncreq *sr)
+{
+	RDB_txninfo *ti = env->me_txns;
+	RDB_meta *mp;
+
+	sr->sr_next = NULL;
+	sr->sr_meta.mm_txnid = 0;
+	if (txn) {
+		sr->sr_meta = *rdb_txn_meta(env, txn->mt_txnid - 1);
+		/* Persist any increases of mapsize config */
+		if (sr->sr_meta.mm_mapsize < env->me_mapsize)
+			sr->sr_meta.mm_mapsize = env->me_mapsize;
+		sr->sr_meta.mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
+		sr->sr_meta.mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+		sr->sr_meta.mm_last_pg = txn->mt_next_pgno - 1;
+		sr->sr_meta.mm_txnid = txn->mt_txnid;
+
+		/* Readers match mm_txnid before they use the rest, so it
+		 * goes last, and mti_txnid after it
+		 */
+		mp = &ti->mti_metas[txn->mt_txnid & 1];
+		mp->mm_txnid = 0;
+		RDB_BARRIER();
+		memcpy(mp, &sr->sr_meta, offsetof(RDB_meta, mm_txnid));
+		RDB_BARRIER();
+		mp->mm_txnid = txn->mt_txnid;
+		RDB_BARRIER();
+		ti->mti_txnid = txn->mt_txnid;
+	}
+	sr->sr_txnid = ti->mti_txnid;
+
+	pthread_mutex_lock(&env->me_smutex);
+	if (env->me_stail)
+		env->me_stail->sr_next = sr;
+	else
+		env->me_shead = sr;
+	env->me_stail = sr;
+	env->me_squeued = sr->sr_txnid;
+	pthread_cond_signal(&env->me_scond);
+	pthread_mutex_unlock(&env->me_smutex);
+}
+
+/** Write a meta page from the lock file to the data file, once the
+ * pages it points at are synced.
+ *	The reader mutex keeps a synchronous commit from writing a newer
+ *	meta page to the same slot in between the check and the write,
+ *	so only the write to the page cache is done under it. The sync
+ *	waits outside, where readers can still take their slots, and the
+ *	mutex is taken again to publish #RDB_txninfo.%mti_durable.
+ * @param[in] env the environment handle
+ * @param[in] meta the meta page
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_sync_meta(RDB_env *env, RDB_meta *meta)
+{
+	RDB_meta *mp = env->me_metas[meta->mm_txnid & 1];
+	RDB_meta old;
+	off_t off;
+	char *ptr;
+	int rc, rc2, len;
+#ifdef _WIN32
+	OVERLAPPED ov;
+	DWORD n;
+#else
+	ssize_t n;
+#endif
+
+	if (LOCK_MUTEX(rc, env, env->me_rmutex))
+		return rc;
+	/* A synchronous commit may have written a newer one already */
+	if (meta->mm_txnid <= env->me_txns->mti_durable)
+		goto done;
+
+	old = *mp;
+	off = offsetof(RDB_meta, mm_mapsize);
+	ptr = (char *)meta + off;
+	len = sizeof(RDB_meta) - off;
+	off += (char *)mp - env->me_map;
+#ifdef _WIN32
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = off;
+	rc = WriteFile(env->me_fd, ptr, len, &n, &ov) ? (n == (DWORD)len ? 0 : EIO) : ErrCode();
+#else
+	while ((n = pwrite(env->me_fd, ptr, len, off)) < 0 && ErrCode() == EINTR)
+		;
+	rc = n == len ? 0 : n < 0 ? ErrCode() : EIO;
+#endif
+	if (rc)
+		goto fail;
+	UNLOCK_MUTEX(env->me_rmutex);
+
+	if (!(env->me_flags & (RDB_NOSYNC|RDB_NOMETASYNC)) && RDB_FDATASYNC(env->me_fd))
+		rc = ErrCode();
+	if (LOCK_MUTEX(rc2, env, env->me_rmutex)) {
+		env->me_flags |= RDB_FATAL_ERROR;
+		return rc ? rc : rc2;
+	}
+	if (rc) {
+		/* Unless a newer one is there now, as below */
+		if (mp->mm_txnid == meta->mm_txnid)
+			goto fail;
+		env->me_flags |= RDB_FATAL_ERROR;
+		goto done;
+	}
+	CACHEFLUSH(env->me_map + off, len, DCACHE);
+	if (env->me_txns->mti_durable < meta->mm_txnid)
+		env->me_txns->mti_durable = meta->mm_txnid;
+	goto done;
+
+fail:
+	/* As in rdb_env_write_meta(): the pagecache may have the new
+	 * meta, write the old one back to prevent it from being used.
+	 */
+	ptr = (char *)&old + offsetof(RDB_meta, mm_mapsize);
+#ifdef _WIN32
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = off;
+	WriteFile(env->me_fd, ptr, len, NULL, &ov);
+#else
+	if (pwrite(env->me_fd, ptr, len, off) < 0)
+		DPUTS("meta page rollback failed");
+#endif
+	env->me_flags |= RDB_FATAL_ERROR;
+done:
+	UNLOCK_MUTEX(env->me_rmutex);
+	return rc;
+}
+
+/** The syncer thread: syncs whatever is queued, then reports it.
+ * @param[in] arg the environment handle
+ */
+static THREAD_RET CALL_CONV
+rdb_env_syncer(void *arg)
+{
+	RDB_env *env = arg;
+	RDB_syncreq *head, *last, *sr, *next;
+	RDB_swait *sw, **swp;
+	txnid_t upto;
+	int rc;
+
+	pthread_mutex_lock(&env->me_smutex);
+	for (;;) {
+		while (!env->me_shead && env->me_sstate == 1)
+			pthread_cond_wait(&env->me_scond, &env->me_smutex);
+		if (!(head = env->me_shead))
+			break;
+		/* Everything queued so far shares one sync */
+		upto = env->me_stail->sr_txnid;
+		env->me_shead = env->me_stail = NULL;
+		rc = env->me_serror;
+		pthread_mutex_unlock(&env->me_smutex);
+
+		for (last = NULL, sr = head; sr; sr = sr->sr_next)
+			if (sr->sr_meta.mm_txnid)
+				last = sr;
+		if (!rc) {
+			rc = rdb_env_sync(env, 0);
+			if (rc)
+				env->me_flags |= RDB_FATAL_ERROR;
+			else if (last)
+				rc = rdb_sync_meta(env, &last->sr_meta);
+		}
+
+		pthread_mutex_lock(&env->me_smutex);
+		if (rc) {
+			if (!env->me_serror)
+				env->me_serror = rc;
+		} else {
+			env->me_sdone = upto;
+		}
+		for (swp = &env->me_swait; (sw = *swp) != NULL; ) {
+			if (sw->sw_txnid <= env->me_sdone || env->me_serror) {
+				*swp = sw->sw_next;
+				sw->sw_done = 1;
+				pthread_cond_signal(&sw->sw_cond);
+			} else {
+				swp = &sw->sw_next;
+			}
+		}
+		pthread_mutex_unlock(&env->me_smutex);
+
+		for (sr = head; sr; sr = next) {
+			next = sr->sr_next;
+			if (sr->sr_func)
+				sr->sr_func(sr->sr_txnid, rc, sr->sr_ctx);
+			free(sr);
+		}
+		pthread_mutex_lock(&env->me_smutex);
+	}
+	pthread_mutex_unlock(&env->me_smutex);
+	return (THREAD_RET)0;
+}
+
+int
+rdb_txn_commit_async(RDB_txn *txn, RDB_commit_func *func, void *ctx)
+{
+	RDB_env *env;
+	RDB_syncreq *sr;
+	int rc;
+
+	RDB_TRACE(("%p", txn));
+	if (!txn)
+		return EINVAL;
+	env = txn->mt_env;
+	if (txn->mt_parent || (txn->mt_flags & RDB_TXN_RDONLY) ||
+		!env->me_txns || (env->me_flags & RDB_WRITEMAP)) {
+		rc = EINVAL;
+		goto fail;
+	}
+	if ((sr = malloc(sizeof(RDB_syncreq))) == NULL) {
+		rc = ENOMEM;
+		goto fail;
+	}
+	sr->sr_func = func;
+	sr->sr_ctx = ctx;
+
+	/* Only writers start it, and this one holds the writer lock */
+	if (!env->me_sstate) {
+		env->me_sstate = 1;
+		if ((rc = THREAD_CREATE(env->me_sthr, rdb_env_syncer, env)) != 0) {
+			env->me_sstate = 0;
+			free(sr);
+			goto fail;
+		}
+	}
+	rc = _rdb_txn_commit(txn, sr);
+	if (rc)
+		free(sr);
+	return rc;
+
+fail:
+	_rdb_txn_abort(txn);
+	return rc;
+}
+
+int
+rdb_env_wait_durable(RDB_env *env, size_t txnid)
+{
+	RDB_swait sw;
+	int rc;
+
+	if (!env)
+		return EINVAL;
+	pthread_mutex_lock(&env->me_smutex);
+	if (txnid <= env->me_sdone ||
+		(env->me_txns && txnid <= env->me_txns->mti_durable)) {
+		rc = RDB_SUCCESS;
+	} else if (env->me_serror) {
+		rc = env->me_serror;
+	} else if (txnid > env->me_squeued) {
+		rc = EINVAL;
+	} else {
+		sw.sw_txnid = txnid;
+		sw.sw_done = 0;
+#ifdef _WIN32
+		rc = (sw.sw_cond = CreateEvent(NULL, FALSE, FALSE, NULL)) ? 0 : ErrCode();
+#else
+		rc = pthread_cond_init(&sw.sw_cond, NULL);
+#endif
+		if (rc == 0) {
+			sw.sw_next = env->me_swait;
+			env->me_swait = &sw;
+			while (!sw.sw_done)
+				pthread_cond_wait(&sw.sw_cond, &env->me_smutex);
+			rc = txnid <= env->me_sdone ? RDB_SUCCESS : env->me_serror;
+#ifdef _WIN32
+			CloseHandle(sw.sw_cond);
+#else
+			pthread_cond_destroy(&sw.sw_cond);
+#endif
+		}
+	}
+	pthread_mutex_unlock(&env->me_smutex);
+	return rc;
+}
+/** @} */
+
+/** Read the environment parameters of a DB environment before
+ * mapping it into memory.
+ * @param[in] env the environment handle
+ * @param[out] meta address of where to store the meta information
+ * @return 0 on success, non-zero on failure.
+ */
+static int ESECT
+rdb_env_read_header(RDB_env *env, RDB_meta *meta)
 {
 	RDB_metabuf	pbuf;
 	RDB_page	*p;
@@ -4156,6 +5038,12 @@ rdb_env_init_meta(RDB_env *env, RDB_meta *meta)
 	q->mp_flags = P_META;
 	*(RDB_meta *)METADATA(q) = *meta;
 
+	if (env->me_flags & RDB_HUGETLB) {
+		/* hugetlbfs has no write(), but the map is writable by now */
+		memcpy(env->me_map, p, psize * NUM_METAS);
+		free(p);
+		return RDB_SUCCESS;
+	}
 	DO_PWRITE(rc, env->me_fd, p, psize * NUM_METAS, len, 0);
 	if (!rc)
 		rc = ErrCode();
@@ -4179,7 +5067,7 @@ rdb_env_write_meta(RDB_txn *txn)
 	unsigned flags;
 	size_t mapsize;
 	off_t off;
-	int rc, len, toggle;
+	int rc, len, toggle, pending = 0;
 	char *ptr;
 	HANDLE mfd;
 #ifdef _WIN32
@@ -4195,7 +5083,7 @@ rdb_env_write_meta(RDB_txn *txn)
 	env = txn->mt_env;
 	flags = env->me_flags;
 	mp = env->me_metas[toggle];
-	mapsize = env->me_metas[toggle ^ 1]->mm_mapsize;
+	mapsize = rdb_txn_meta(env, txn->mt_txnid - 1)->mm_mapsize;
 	/* Persist any increases of mapsize config */
 	if (mapsize < env->me_mapsize)
 		mapsize = env->me_mapsize;
@@ -4246,6 +5134,10 @@ rdb_env_write_meta(RDB_txn *txn)
 	 * also syncs to disk.  Avoids a separate fdatasync() call.)
 	 */
 	mfd = (flags & (RDB_NOSYNC|RDB_NOMETASYNC)) ? env->me_fd : env->me_mfd;
+	/* The syncer may be writing an older commit's meta page */
+	pending = RDB_PENDING(env);
+	if (pending && LOCK_MUTEX(rc, env, env->me_rmutex))
+		return rc;
 #ifdef _WIN32
 	{
 		memset(&ov, 0, sizeof(ov));
@@ -4280,6 +5172,8 @@ retry_write:
 #endif
 fail:
 		env->me_flags |= RDB_FATAL_ERROR;
+		if (pending)
+			UNLOCK_MUTEX(env->me_rmutex);
 		return rc;
 	}
 	/* MIPS has cache coherency issues, this is a no-op everywhere else */
@@ -4292,77 +5186,515 @@ done:
 	 * how stale their view of these values is.
 	 */
 	if (env->me_txns)
-		env->me_txns->mti_txnid = txn->mt_txnid;
+		env->me_txns->mti_txnid = env->me_txns->mti_durable = txn->mt_txnid;
+	if (pending)
+		UNLOCK_MUTEX(env->me_rmutex);
 
 	return RDB_SUCCESS;
 }
 
-/** Check both meta pages to see which one is newer.
- * @param[in] env the environment handle
- * @return newest #RDB_meta.
+#if RDB_USE_IOURING
+/** @defgroup ring	io_uring commits
+ *	With #RDB_IOURING a commit queues one write per run of adjacent
+ *	dirty pages, and submits them all with one system call instead of
+ *	one call per run. Once they're done, the data sync, the meta page
+ *	write and the meta sync go out as a single linked chain, which the
+ *	kernel runs in order and cuts short at the first failure.
+ *	The ring is only used by the writer; spilled pages and
+ *	#rdb_env_sync() still take the usual path.
+ *	@{
  */
-static RDB_meta *
-rdb_env_pick_meta(const RDB_env *env)
-{
-	RDB_meta *const *metas = env->me_metas;
-	return metas[ metas[0]->mm_txnid < metas[1]->mm_txnid ];
-}
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+	/** Submission queue size of an #RDB_ring */
+#define RDB_RING_ENTRIES	256
+	/** iovecs for the writes queued at once on an #RDB_ring */
+#define RDB_RING_IOVS		4096
+	/** Tags a completion as one of the meta page's */
+#define RDB_RING_META		(1ULL << 63)
+
+/** An io_uring and the mappings of its queues */
+typedef struct RDB_ring {
+	int		rr_fd;
+	unsigned	rr_entries;		/**< SQ size */
+	unsigned	rr_queued;		/**< SQEs not yet submitted */
+	unsigned	rr_niov;		/**< iovecs they use */
+	unsigned	*rr_sqtail, *rr_sqmask, *rr_sqarray;
+	unsigned	*rr_cqhead, *rr_cqtail, *rr_cqmask;
+	struct io_uring_sqe	*rr_sqes;
+	struct io_uring_cqe	*rr_cqes;
+	void	*rr_sqmap, *rr_cqmap;	/**< the same with IORING_FEAT_SINGLE_MMAP */
+	size_t	rr_sqsize, rr_cqsize;
+	struct iovec	rr_iov[RDB_RING_IOVS];
+} RDB_ring;
 
-int ESECT
-rdb_env_create(RDB_env **env)
+static void ESECT
+rdb_ring_close(RDB_env *env)
 {
-	RDB_env *e;
-
-	e = calloc(1, sizeof(RDB_env));
-	if (!e)
-		return ENOMEM;
-
-	e->me_maxreaders = DEFAULT_READERS;
-	e->me_maxdbs = e->me_numdbs = CORE_DBS;
-	e->me_fd = INVALID_HANDLE_VALUE;
-	e->me_lfd = INVALID_HANDLE_VALUE;
-	e->me_mfd = INVALID_HANDLE_VALUE;
-#ifdef RDB_USE_POSIX_SEM
-	e->me_rmutex = SEM_FAILED;
-	e->me_wmutex = SEM_FAILED;
-#endif
-	e->me_pid = getpid();
-	GET_PAGESIZE(e->me_os_psize);
-	VGMEMP_CREATE(e,0,0);
-	*env = e;
-	RDB_TRACE(("%p", e));
-	return RDB_SUCCESS;
-}
+	RDB_ring *r = env->me_ring;
 
+	if (!r)
+		return;
+	if (r->rr_sqes)
+		munmap(r->rr_sqes, r->rr_entries * sizeof(struct io_uring_sqe));
+	if (r->rr_cqmap && r->rr_cqmap != r->rr_sqmap)
+		munmap(r->rr_cqmap, r->rr_cqsize);
+	if (r->rr_sqmap)
+		munmap(r->rr_sqmap, r->rr_sqsize);
+	close(r->rr_fd);
+	free(r);
+	env->me_ring = NULL;
+}
+
+/** Set up the ring for #RDB_IOURING.
+ * @param[in] env the environment handle
+ * @return 0 on success, non-zero if the kernel can't do it.
+ */
 static int ESECT
-rdb_env_map(RDB_env *env, void *addr)
+rdb_ring_open(RDB_env *env)
 {
-	RDB_page *p;
-	unsigned int flags = env->me_flags;
-#ifdef _WIN32
-	int rc;
-	HANDLE mh;
-	LONG sizelo, sizehi;
-	size_t msize;
+	struct io_uring_params p;
+	RDB_ring *r;
+	char *sq, *cq;
+	int fd, rc;
 
-	if (flags & RDB_RDONLY) {
-		/* Don't set explicit map size, use whatever exists */
-		msize = 0;
-		sizelo = 0;
-		sizehi = 0;
+	memset(&p, 0, sizeof(p));
+	fd = syscall(__NR_io_uring_setup, RDB_RING_ENTRIES, &p);
+	if (fd < 0)
+		return ErrCode();
+	/* Linked requests and stable submissions came with 5.5 */
+	if ((p.features & (IORING_FEAT_NODROP|IORING_FEAT_SUBMIT_STABLE)) !=
+		(IORING_FEAT_NODROP|IORING_FEAT_SUBMIT_STABLE)) {
+		close(fd);
+		return ENOTSUP;
+	}
+	if ((r = calloc(1, sizeof(RDB_ring))) == NULL) {
+		close(fd);
+		return ENOMEM;
+	}
+	r->rr_fd = fd;
+	r->rr_entries = p.sq_entries;
+	env->me_ring = r;
+
+	r->rr_sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->rr_cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && r->rr_sqsize < r->rr_cqsize)
+		r->rr_sqsize = r->rr_cqsize;
+	sq = mmap(NULL, r->rr_sqsize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto fail;
+	r->rr_sqmap = sq;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
 	} else {
-		msize = env->me_mapsize;
-		sizelo = msize & 0xffffffff;
-		sizehi = msize >> 16 >> 16; /* only needed on Win64 */
-
-		/* Windows won't create mappings for zero length files.
-		 * and won't map more than the file size.
-		 * Just set the maxsize right now.
-		 */
-		if (!(flags & RDB_WRITEMAP) && (SetFilePointer(env->me_fd, sizelo, &sizehi, 0) != (DWORD)sizelo
-			|| !SetEndOfFile(env->me_fd)
-			|| SetFilePointer(env->me_fd, 0, NULL, 0) != 0))
-			return ErrCode();
+		cq = mmap(NULL, r->rr_cqsize, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto fail;
+	}
+	r->rr_cqmap = cq;
+	r->rr_sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (r->rr_sqes == MAP_FAILED) {
+		r->rr_sqes = NULL;
+		goto fail;
+	}
+	r->rr_sqtail = (unsigned *)(sq + p.sq_off.tail);
+	r->rr_sqmask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->rr_sqarray = (unsigned *)(sq + p.sq_off.array);
+	r->rr_cqhead = (unsigned *)(cq + p.cq_off.head);
+	r->rr_cqtail = (unsigned *)(cq + p.cq_off.tail);
+	r->rr_cqmask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->rr_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return RDB_SUCCESS;
+
+fail:
+	rc = ErrCode();
+	rdb_ring_close(env);
+	return rc;
+}
+
+/** Queue a request. The caller makes sure there's room.
+ * @param[in] r the ring
+ * @param[in] op IORING_OP_WRITEV or IORING_OP_FSYNC
+ * @param[in] fd the file
+ * @param[in] iov the iovecs to write, which stay put until completion
+ * @param[in] n the number of iovecs
+ * @param[in] off the file offset
+ * @param[in] data the result expected, maybe tagged #RDB_RING_META
+ * @return the request, for more flags.
+ */
+static struct io_uring_sqe *
+rdb_ring_queue(RDB_ring *r, int op, HANDLE fd, struct iovec *iov, unsigned n,
+	off_t off, uint64_t data)
+{
+	unsigned tail = *r->rr_sqtail, i = tail & *r->rr_sqmask;
+	struct io_uring_sqe *sqe = &r->rr_sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)iov;
+	sqe->len = n;
+	sqe->off = off;
+	sqe->user_data = data;
+	r->rr_sqarray[i] = i;
+	__atomic_store_n(r->rr_sqtail, tail + 1, __ATOMIC_RELEASE);
+	r->rr_queued++;
+	return sqe;
+}
+
+/** Submit everything queued and wait for all of it to complete.
+ * @param[in] r the ring
+ * @param[out] metarc the first error of a #RDB_RING_META request, or 0
+ * @return the first error of any request, or 0.
+ */
+static int
+rdb_ring_submit(RDB_ring *r, int *metarc)
+{
+	unsigned n = r->rr_queued, sub = 0, done = 0, head, tail;
+	struct io_uring_cqe *cqe;
+	int rc = 0, err, res;
+
+	*metarc = 0;
+	while (done < n) {
+		res = syscall(__NR_io_uring_enter, r->rr_fd, n - sub, n - done,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+		if (res < 0) {
+			err = ErrCode();
+			if (err == EINTR)
+				continue;
+			DPRINTF(("io_uring_enter: %s", strerror(err)));
+			return err;
+		}
+		sub += res;
+		head = *r->rr_cqhead;
+		tail = __atomic_load_n(r->rr_cqtail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, done++) {
+			cqe = &r->rr_cqes[head & *r->rr_cqmask];
+			if (cqe->res == (int)(cqe->user_data & ~RDB_RING_META))
+				continue;
+			if (cqe->res < 0) {
+				err = -cqe->res;
+				DPRINTF(("io_uring request: %s", strerror(err)));
+			} else {
+				err = EIO;
+				DPUTS("short write, filesystem full?");
+			}
+			if (!rc)
+				rc = err;
+			if ((cqe->user_data & RDB_RING_META) && !*metarc)
+				*metarc = err;
+		}
+		__atomic_store_n(r->rr_cqhead, head, __ATOMIC_RELEASE);
+	}
+	r->rr_queued = 0;
+	r->rr_niov = 0;
+	return rc;
+}
+
+/** Write out a transaction's dirty pages and its meta page through the ring.
+ *	This does what #rdb_page_flush(), #rdb_env_sync() and #rdb_env_write_meta()
+ *	do for a commit. Pages stay on the dirty list until #rdb_txn_end().
+ * @param[in] txn the transaction that's being committed
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_ring_commit(RDB_txn *txn)
+{
+	RDB_env		*env = txn->mt_env;
+	RDB_ring	*r = env->me_ring;
+	RDB_ID2L	dl = txn->mt_u.dirty_list;
+	RDB_page	*dp = NULL;
+	RDB_meta	meta, *mp;
+	struct io_uring_sqe *sqe;
+	struct iovec *iov = r->rr_iov;
+	unsigned	psize = env->me_psize, flags = env->me_flags, fsflags;
+	int			i, n = 0, pagecount = dl[0].mid, rc, metarc;
+	size_t		size = 0, pos = 0, next_pos = 1, wpos = 0, wsize = 0;
+	off_t		off;
+
+	/* Coalesce runs of pages as rdb_page_flush() does, but queue the
+	 * writes instead of making them, and submit when the ring is full.
+	 */
+	for (i = 0;;) {
+		if (++i <= pagecount) {
+			dp = dl[i].mptr;
+			if (dp->mp_flags & (P_LOOSE|P_KEEP)) {
+				dp->mp_flags &= ~P_KEEP;
+				continue;
+			}
+			dp->mp_flags &= ~P_DIRTY;
+			pos = dl[i].mid * psize;
+			size = psize;
+			if (IS_OVERFLOW(dp)) size *= dp->mp_pages;
+			env->me_commit_runs += pos != next_pos;
+			env->me_commit_pages += size / psize;
+		}
+		if (pos!=next_pos || n==RDB_COMMIT_PAGES || wsize+size>MAX_WRITE) {
+			if (n) {
+				rdb_ring_queue(r, IORING_OP_WRITEV,
+					(flags & RDB_DIRECT) ? env->me_dfd : env->me_fd,
+					iov, n, wpos, wsize);
+				r->rr_niov += n;
+				n = 0;
+			}
+			if (i > pagecount)
+				break;
+			if (r->rr_queued == r->rr_entries ||
+				r->rr_niov + RDB_COMMIT_PAGES > RDB_RING_IOVS) {
+				if ((rc = rdb_ring_submit(r, &metarc)))
+					goto fail;
+			}
+			iov = r->rr_iov + r->rr_niov;
+			wpos = pos;
+			wsize = 0;
+		}
+		DPRINTF(("committing page %"Z"u", dl[i].mid));
+		next_pos = pos + size;
+		iov[n].iov_len = size;
+		iov[n].iov_base = (char *)dp;
+		wsize += size;
+		n++;
+	}
+	/* All pages must have made it before the meta may point at them.
+	 * Linking the writes to the sync instead would serialize them.
+	 */
+	if (r->rr_queued && (rc = rdb_ring_submit(r, &metarc)))
+		goto fail;
+	CACHEFLUSH(env->me_map, txn->mt_next_pgno * env->me_psize, DCACHE);
+
+	mp = env->me_metas[txn->mt_txnid & 1];
+	meta.mm_mapsize = rdb_txn_meta(env, txn->mt_txnid - 1)->mm_mapsize;
+	/* Persist any increases of mapsize config */
+	if (meta.mm_mapsize < env->me_mapsize)
+		meta.mm_mapsize = env->me_mapsize;
+	meta.mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
+	meta.mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+	meta.mm_last_pg = txn->mt_next_pgno - 1;
+	meta.mm_txnid = txn->mt_txnid;
+	off = offsetof(RDB_meta, mm_mapsize);
+	iov = r->rr_iov;
+	iov->iov_base = (char *)&meta + off;
+	iov->iov_len = sizeof(RDB_meta) - off;
+	off += (char *)mp - env->me_map;
+
+	fsflags = IORING_FSYNC_DATASYNC;
+#ifdef BROKEN_FDATASYNC
+	if (flags & RDB_FSYNCONLY)
+		fsflags = 0;
+#endif
+	if (!(flags & RDB_NOSYNC)) {
+		sqe = rdb_ring_queue(r, IORING_OP_FSYNC, env->me_fd, NULL, 0, 0, 0);
+		sqe->fsync_flags = fsflags;
+		sqe->flags = IOSQE_IO_LINK;
+	}
+	sqe = rdb_ring_queue(r, IORING_OP_WRITEV, env->me_fd, iov, 1, off,
+		RDB_RING_META | iov->iov_len);
+	if (!(flags & (RDB_NOSYNC|RDB_NOMETASYNC))) {
+		sqe->flags = IOSQE_IO_LINK;
+		sqe = rdb_ring_queue(r, IORING_OP_FSYNC, env->me_fd, NULL, 0, 0, RDB_RING_META);
+		sqe->fsync_flags = fsflags;
+	}
+	rc = rdb_ring_submit(r, &metarc);
+	if (metarc && metarc != ECANCELED) {
+		/* As in rdb_env_write_meta(): the pagecache may have the new
+		 * meta, write some old data back to prevent it from being used.
+		 */
+		meta.mm_last_pg = mp->mm_last_pg;
+		meta.mm_txnid = mp->mm_txnid;
+		if (pwrite(env->me_fd, iov->iov_base, iov->iov_len, off) < 0)
+			DPUTS("meta page rollback failed");
+		env->me_flags |= RDB_FATAL_ERROR;
+		return metarc;
+	}
+	if (rc)
+		goto fail;
+	CACHEFLUSH(env->me_map + off, iov->iov_len, DCACHE);
+	if (env->me_txns)
+		env->me_txns->mti_txnid = env->me_txns->mti_durable = txn->mt_txnid;
+	return RDB_SUCCESS;
+
+fail:
+	/* Requests may be left queued or in flight */
+	if (r->rr_queued)
+		env->me_flags |= RDB_FATAL_ERROR;
+	return rc;
+}
+/** @} */
+#endif /* RDB_USE_IOURING */
+
+/** Check both meta pages to see which one is newer.
+ * @param[in] env the environment handle
+ * @return newest #RDB_meta.
+ */
+static RDB_meta *
+rdb_env_pick_meta(const RDB_env *env)
+{
+	RDB_meta *const *metas = env->me_metas;
+	return metas[ metas[0]->mm_txnid < metas[1]->mm_txnid ];
+}
+
+/** Find the meta page of the latest commit, which with
+ * #rdb_txn_commit_async() may not be in the data file yet.
+ * @param[in] env the environment handle
+ * @return its #RDB_meta.
+ */
+static RDB_meta *
+rdb_env_last_meta(const RDB_env *env)
+{
+	RDB_meta *meta = rdb_env_pick_meta(env);
+
+	if (env->me_txns && env->me_txns->mti_txnid > meta->mm_txnid)
+		meta = rdb_txn_meta(env, env->me_txns->mti_txnid);
+	return meta;
+}
+
+/** Find the meta page of a committed transaction: the copy in the lock
+ * file while #rdb_txn_commit_async() has it there, else the data file's.
+ * @param[in] env the environment handle
+ * @param[in] txnid the transaction, no older than the latest durable one
+ * @return its #RDB_meta.
+ */
+static RDB_meta *
+rdb_txn_meta(const RDB_env *env, txnid_t txnid)
+{
+	RDB_txninfo *ti = env->me_txns;
+	RDB_meta *mp;
+
+	if (ti && txnid) {
+		mp = &ti->mti_metas[txnid & 1];
+		/* Pairs with the barriers in rdb_sync_queue() */
+		RDB_BARRIER();
+		if (mp->mm_txnid == txnid)
+			return mp;
+	}
+	return env->me_metas[txnid & 1];
+}
+
+int ESECT
+rdb_env_create(RDB_env **env)
+{
+	RDB_env *e;
+	int rc;
+
+	e = calloc(1, sizeof(RDB_env));
+	if (!e)
+		return ENOMEM;
+
+	e->me_maxreaders = DEFAULT_READERS;
+	e->me_maxdbs = e->me_numdbs = CORE_DBS;
+	e->me_fd = INVALID_HANDLE_VALUE;
+	e->me_lfd = INVALID_HANDLE_VALUE;
+	e->me_mfd = INVALID_HANDLE_VALUE;
+	e->me_dfd = INVALID_HANDLE_VALUE;
+#ifdef RDB_USE_POSIX_SEM
+	e->me_rmutex = SEM_FAILED;
+	e->me_wmutex = SEM_FAILED;
+#endif
+#ifdef _WIN32
+	rc = (e->me_gmutex = CreateMutex(NULL, FALSE, NULL)) ? 0 : ErrCode();
+	if (!rc) {
+		rc = (e->me_smutex = CreateMutex(NULL, FALSE, NULL)) ? 0 : ErrCode();
+		if (!rc) {
+			rc = (e->me_scond = CreateEvent(NULL, FALSE, FALSE, NULL)) ? 0 : ErrCode();
+			if (rc)
+				CloseHandle(e->me_smutex);
+		}
+		if (rc)
+			CloseHandle(e->me_gmutex);
+	}
+#else
+	rc = pthread_mutex_init(&e->me_gmutex, NULL);
+	if (!rc) {
+		rc = pthread_mutex_init(&e->me_smutex, NULL);
+		if (!rc) {
+			rc = pthread_cond_init(&e->me_scond, NULL);
+			if (rc)
+				pthread_mutex_destroy(&e->me_smutex);
+		}
+		if (rc)
+			pthread_mutex_destroy(&e->me_gmutex);
+	}
+#endif
+	if (rc) {
+		free(e);
+		return rc;
+	}
+	e->me_pid = getpid();
+	GET_PAGESIZE(e->me_os_psize);
+#ifdef RDB_SIMD_SEARCH
+	rdb_simd_init();
+#endif
+	VGMEMP_CREATE(e,0,0);
+	*env = e;
+	RDB_TRACE(("%p", e));
+	return RDB_SUCCESS;
+}
+
+#ifdef MADV_HUGEPAGE
+	/** Alignment for a map with #RDB_HUGEPAGE: the size of a huge page
+	 *	on most architectures. The OS can only give a range of the map
+	 *	huge pages if it starts on a multiple of their size.
+	 */
+#define RDB_HUGEPAGE_ALIGN	(2U << 20)
+#endif
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+#include <sys/vfs.h>
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC	0x958458f6
+#endif
+/** Get the page size of a file on hugetlbfs, for #RDB_HUGETLB.
+ * @param[in] fd The file.
+ * @param[out] size The size of its pages.
+ * @return 0 on success, EINVAL if the file isn't on hugetlbfs.
+ */
+static int ESECT
+rdb_fd_hugepage(HANDLE fd, size_t *size)
+{
+	struct statfs st;
+
+	if (fstatfs(fd, &st))
+		return ErrCode();
+	if (st.f_type != HUGETLBFS_MAGIC)
+		return EINVAL;
+	*size = st.f_bsize;
+	return RDB_SUCCESS;
+}
+#endif
+
+static int ESECT
+rdb_env_map(RDB_env *env, void *addr)
+{
+	RDB_page *p;
+	unsigned int flags = env->me_flags;
+#ifdef _WIN32
+	int rc;
+	HANDLE mh;
+	LONG sizelo, sizehi;
+	size_t msize;
+
+	if (flags & RDB_RDONLY) {
+		/* Don't set explicit map size, use whatever exists */
+		msize = 0;
+		sizelo = 0;
+		sizehi = 0;
+	} else {
+		msize = env->me_mapsize;
+		sizelo = msize & 0xffffffff;
+		sizehi = msize >> 16 >> 16; /* only needed on Win64 */
+
+		/* Windows won't create mappings for zero length files.
+		 * and won't map more than the file size.
+		 * Just set the maxsize right now.
+		 */
+		if (!(flags & RDB_WRITEMAP) && (SetFilePointer(env->me_fd, sizelo, &sizehi, 0) != (DWORD)sizelo
+			|| !SetEndOfFile(env->me_fd)
+			|| SetFilePointer(env->me_fd, 0, NULL, 0) != 0))
+			return ErrCode();
 	}
 
 	mh = CreateFileMapping(env->me_fd, NULL, flags & RDB_WRITEMAP ?
@@ -4384,17 +5716,53 @@ rdb_env_map(RDB_env *env, void *addr)
 	if (flags & RDB_NOSYNC)
 		mmap_flags |= MAP_NOSYNC;
 #endif
+	if (flags & RDB_HUGETLB) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+		size_t hpsize;
+		int rc = rdb_fd_hugepage(env->me_fd, &hpsize);
+		if (rc)
+			return rc;
+		/* hugetlbfs only takes whole pages, for the file and the map */
+		env->me_mapsize = (env->me_mapsize + hpsize - 1) & ~(hpsize - 1);
+		mmap_flags |= MAP_HUGETLB;
+#else
+		return ENOTSUP;
+#endif
+	}
 	if (flags & RDB_WRITEMAP) {
 		prot |= PROT_WRITE;
 		if (ftruncate(env->me_fd, env->me_mapsize) < 0)
 			return ErrCode();
 	}
+#ifdef RDB_HUGEPAGE_ALIGN
+	if ((flags & RDB_HUGEPAGE) && !addr) {
+		/* Reserve some slack, and map the file over the aligned part */
+		size_t len = env->me_mapsize + RDB_HUGEPAGE_ALIGN;
+		char *p = mmap(NULL, len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED) {
+			char *q = (char *)(((size_t)p + RDB_HUGEPAGE_ALIGN - 1) &
+				~(size_t)(RDB_HUGEPAGE_ALIGN - 1));
+			if (q > p)
+				munmap(p, q - p);
+			munmap(q + env->me_mapsize, p + len - (q + env->me_mapsize));
+			addr = q;
+			mmap_flags |= MAP_FIXED;
+		}
+	}
+#endif
 	env->me_map = mmap(addr, env->me_mapsize, prot, mmap_flags,
 		env->me_fd, 0);
 	if (env->me_map == MAP_FAILED) {
+		int rc = ErrCode();
+		if (mmap_flags & MAP_FIXED)
+			munmap(addr, env->me_mapsize);
 		env->me_map = NULL;
-		return ErrCode();
+		return rc;
 	}
+#ifdef RDB_HUGEPAGE_ALIGN
+	if (flags & RDB_HUGEPAGE)
+		(void) madvise(env->me_map, env->me_mapsize, MADV_HUGEPAGE);
+#endif
 
 	if (flags & RDB_NORDAHEAD) {
 		/* Turn off readahead. It's harmful when the DB is larger than RAM. */
@@ -4435,7 +5803,13 @@ rdb_env_set_mapsize(RDB_env *env, size_t size)
 		void *old;
 		if (env->me_txn)
 			return EINVAL;
-		meta = rdb_env_pick_meta(env);
+		/* Let this process's syncer finish with the old map. If
+		 * it failed, it has stopped, and its error shows up elsewhere.
+		 */
+		if (env->me_squeued)
+			(void)rdb_env_wait_durable(env, env->me_squeued);
+		/* Commits may be ahead of the data file's meta pages */
+		meta = rdb_env_last_meta(env);
 		if (!size)
 			size = meta->mm_mapsize;
 		{
@@ -4450,6 +5824,8 @@ rdb_env_set_mapsize(RDB_env *env, size_t size)
 		rc = rdb_env_map(env, old);
 		if (rc)
 			return rc;
+		/* It may have been rounded up */
+		size = env->me_mapsize;
 	}
 	env->me_mapsize = size;
 	if (env->me_psize)
@@ -4458,6 +5834,48 @@ rdb_env_set_mapsize(RDB_env *env, size_t size)
 	return RDB_SUCCESS;
 }
 
+int ESECT
+rdb_env_set_pagesize(RDB_env *env, unsigned int size)
+{
+	if (env->me_map || size < env->me_os_psize || size > MAX_PAGESIZE ||
+		(size & (size - 1)))
+		return EINVAL;
+	env->me_psize = size;
+	RDB_TRACE(("%p, %u", env, size));
+	return RDB_SUCCESS;
+}
+
+int ESECT
+rdb_env_set_flushthreads(RDB_env *env, unsigned int n)
+{
+	if (!env)
+		return EINVAL;
+#if defined(_WIN32) || defined(RDB_USE_PWRITEV)
+	if (n > RDB_FLUSH_MAXTHREADS)
+		return EINVAL;
+	env->me_flushthreads = n;
+#endif
+	return RDB_SUCCESS;
+}
+
+int ESECT
+rdb_env_set_allocrun(RDB_env *env, unsigned int pages)
+{
+	if (!env || pages > 65536)
+		return EINVAL;
+	env->me_allocrun = pages;
+	return RDB_SUCCESS;
+}
+
+int ESECT
+rdb_env_set_writeback(RDB_env *env, unsigned int pages)
+{
+	if (!env)
+		return EINVAL;
+	env->me_writeback = pages;
+	return RDB_SUCCESS;
+}
+
 int ESECT
 rdb_env_set_maxdbs(RDB_env *env, RDB_dbi dbs)
 {
@@ -4584,6 +6002,7 @@ enum rdb_fopen_type {
 	RDB_O_RDWR  = O_RDWR  |O_CREAT,                    /**< for me_fd */
 	RDB_O_META  = O_WRONLY|RDB_DSYNC     |RDB_CLOEXEC, /**< for me_mfd */
 	RDB_O_COPY  = O_WRONLY|O_CREAT|O_EXCL|RDB_CLOEXEC, /**< for #rdb_env_copy() */
+	RDB_O_DIRECT= O_WRONLY               |RDB_CLOEXEC, /**< for me_dfd */
 	/** Bitmask for open() flags in enum #rdb_fopen_type.  The other bits
 	 * distinguish otherwise-equal RDB_O_* constants from each other.
 	 */
@@ -4623,7 +6042,8 @@ rdb_fopen(const RDB_env *env, RDB_name *fname,
 	 * RDB_O_RDWR.  RDB_O_COPY must not overwrite an existing file.
 	 *
 	 * With RDB_O_COPY we do not want the OS to cache the writes, since
-	 * the source data is already in the OS cache.
+	 * the source data is already in the OS cache.  RDB_O_DIRECT is the
+	 * same for data pages, and fails unless the OS agrees.
 	 *
 	 * The lockfile needs FD_CLOEXEC (close file descriptor on exec*())
 	 * to avoid the flock() issues noted under Caveats in ripdb.h.
@@ -4683,6 +6103,21 @@ rdb_fopen(const RDB_env *env, RDB_name *fname,
 				(void) fcntl(fd, F_SETFL, flags | O_DIRECT);
 # endif
 		}
+# if defined(F_NOCACHE) || defined(O_DIRECT)
+		if (which == RDB_O_DIRECT) {
+#  ifdef F_NOCACHE	/* __APPLE__ */
+			if (fcntl(fd, F_NOCACHE, 1) == -1)
+#  else
+			if ((flags = fcntl(fd, F_GETFL)) == -1 ||
+				fcntl(fd, F_SETFL, flags | O_DIRECT) == -1)
+#  endif
+			{
+				rc = ErrCode();
+				(void) close(fd);
+				fd = INVALID_HANDLE_VALUE;
+			}
+		}
+# endif
 	}
 #endif	/* !_WIN32 */
 
@@ -4767,7 +6202,9 @@ rdb_env_open2(RDB_env *env)
 			return i;
 		DPUTS("new mdbenv");
 		newenv = 1;
-		env->me_psize = env->me_os_psize;
+		/* Unless #rdb_env_set_pagesize() picked one */
+		if (!env->me_psize)
+			env->me_psize = env->me_os_psize;
 		if (env->me_psize > MAX_PAGESIZE)
 			env->me_psize = MAX_PAGESIZE;
 		memset(&meta, 0, sizeof(meta));
@@ -4791,13 +6228,14 @@ rdb_env_open2(RDB_env *env)
 	}
 	meta.mm_mapsize = env->me_mapsize;
 
-	if (newenv && !(flags & RDB_FIXEDMAP)) {
+	if (newenv && !(flags & (RDB_FIXEDMAP|RDB_HUGETLB))) {
 		/* rdb_env_map() may grow the datafile.  Write the metapages
 		 * first, so the file will be valid if initialization fails.
 		 * Except with FIXEDMAP, since we do not yet know mm_address.
 		 * We could fill in mm_address later, but then a different
 		 * program might end up doing that - one with a memory layout
 		 * and map address which does not suit the main program.
+		 * Nor with HUGETLB, which can only write through the map.
 		 */
 		rc = rdb_env_init_meta(env, &meta);
 		if (rc)
@@ -4824,6 +6262,8 @@ rdb_env_open2(RDB_env *env)
 #if !(RDB_MAXKEYSIZE)
 	env->me_maxkey = env->me_nodemax - (NODESIZE + sizeof(RDB_db));
 #endif
+	for (env->me_hashbits = 1; ((NODESIZE + sizeof(indx_t)) << (env->me_hashbits + 1))
+		<= env->me_psize - PAGEHDRSZ; env->me_hashbits++) ;
 	env->me_maxpg = env->me_mapsize / env->me_psize;
 
 #if RDB_DEBUG
@@ -4927,7 +6367,7 @@ rdb_env_share_locks(RDB_env *env, int *excl)
 	int rc = 0;
 	RDB_meta *meta = rdb_env_pick_meta(env);
 
-	env->me_txns->mti_txnid = meta->mm_txnid;
+	env->me_txns->mti_txnid = env->me_txns->mti_durable = meta->mm_txnid;
 
 #ifdef _WIN32
 	{
@@ -5152,6 +6592,14 @@ rdb_env_setup_locks(RDB_env *env, RDB_name *fname, int mode, int *excl)
 	if (size == -1) goto fail_errno;
 #endif
 	rsize = (env->me_maxreaders-1) * sizeof(RDB_reader) + sizeof(RDB_txninfo);
+#if defined(__linux__) && defined(MAP_HUGETLB)
+	if (env->me_flags & RDB_HUGETLB) {
+		/* Next to the data file, so maybe on hugetlbfs too */
+		size_t hpsize;
+		if (!rdb_fd_hugepage(env->me_lfd, &hpsize))
+			rsize = (rsize + hpsize - 1) & ~(off_t)(hpsize - 1);
+	}
+#endif
 	if (size < rsize && *excl > 0) {
 #ifdef _WIN32
 		if (SetFilePointer(env->me_lfd, rsize, NULL, FILE_BEGIN) != (DWORD)rsize
@@ -5275,6 +6723,8 @@ rdb_env_setup_locks(RDB_env *env, RDB_name *fname, int mode, int *excl)
 		env->me_txns->mti_magic = RDB_MAGIC;
 		env->me_txns->mti_format = RDB_LOCK_FORMAT;
 		env->me_txns->mti_txnid = 0;
+		env->me_txns->mti_durable = 0;
+		memset(env->me_txns->mti_metas, 0, sizeof(env->me_txns->mti_metas));
 		env->me_txns->mti_numreaders = 0;
 
 	} else {
@@ -5317,9 +6767,11 @@ fail:
 	 *	at runtime. Changing other flags requires closing the
 	 *	environment and re-opening it with the new flags.
 	 */
-#define	CHANGEABLE	(RDB_NOSYNC|RDB_NOMETASYNC|RDB_MAPASYNC|RDB_NOMEMINIT)
+#define	CHANGEABLE	(RDB_NOSYNC|RDB_NOMETASYNC|RDB_MAPASYNC|RDB_NOMEMINIT|\
+	RDB_NOPREFETCH|RDB_PIPELINE)
 #define	CHANGELESS	(RDB_FIXEDMAP|RDB_NOSUBDIR|RDB_RDONLY| \
-	RDB_WRITEMAP|RDB_NOTLS|RDB_NOLOCK|RDB_NORDAHEAD)
+	RDB_WRITEMAP|RDB_NOTLS|RDB_NOLOCK|RDB_NORDAHEAD|RDB_HOTLIST| \
+	RDB_HUGEPAGE|RDB_HUGETLB|RDB_IOURING|RDB_DIRECT)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
@@ -5336,6 +6788,10 @@ rdb_env_open(RDB_env *env, const char *path, unsigned int flags, rdb_mode_t mode
 
 	flags |= env->me_flags;
 
+	/* hugetlbfs files can only be written through the map */
+	if ((flags & (RDB_HUGETLB|RDB_WRITEMAP|RDB_RDONLY)) == RDB_HUGETLB)
+		return EINVAL;
+
 	rc = rdb_fname_init(path, flags, &fname);
 	if (rc)
 		return rc;
@@ -5390,6 +6846,23 @@ rdb_env_open(RDB_env *env, const char *path, unsigned int flags, rdb_mode_t mode
 			if (rc)
 				goto leave;
 		}
+		if (flags & RDB_DIRECT) {
+#if !defined(_WIN32) && (defined(O_DIRECT) || defined(F_NOCACHE))
+			/* Writes through it drop the OS's cached copies of the
+			 * pages, so the map stays coherent. Windows makes no such
+			 * promise for unbuffered handles and mapped views.
+			 */
+			if ((flags & (RDB_RDONLY|RDB_WRITEMAP)) ||
+				rdb_fopen(env, &fname, RDB_O_DIRECT, mode, &env->me_dfd))
+#endif
+				env->me_flags &= ~RDB_DIRECT;	/* through the cache */
+		}
+		if (flags & RDB_IOURING) {
+#if RDB_USE_IOURING
+			if ((flags & (RDB_RDONLY|RDB_WRITEMAP)) || rdb_ring_open(env))
+#endif
+				env->me_flags &= ~RDB_IOURING;	/* plain write() it is */
+		}
 		DPRINTF(("opened dbenv %p", (void *) env));
 		if (excl > 0) {
 			rc = rdb_env_share_locks(env, &excl);
@@ -5415,6 +6888,11 @@ rdb_env_open(RDB_env *env, const char *path, unsigned int flags, rdb_mode_t mode
 				rc = ENOMEM;
 			}
 		}
+		if (!rc && (flags & RDB_HOTLIST)) {
+			/* Just a hint, the first sample waits a full interval */
+			(void) rdb_env_hotlist_replay(env);
+			env->me_hotsaved = time(NULL);
+		}
 	}
 
 leave:
@@ -5449,6 +6927,12 @@ rdb_env_close0(RDB_env *env, int excl)
 	free(env->me_dirty_list);
 	free(env->me_txn0);
 	rdb_ridl_free(env->me_free_pgs);
+	rdb_ridl_free(env->me_pinned);
+	env->me_pinned = NULL;
+	env->me_pinbytes = 0;
+#if RDB_USE_IOURING
+	rdb_ring_close(env);
+#endif
 
 	if (env->me_flags & RDB_ENV_TXKEY) {
 		pthread_key_delete(env->me_txkey);
@@ -5468,6 +6952,8 @@ rdb_env_close0(RDB_env *env, int excl)
 	}
 	if (env->me_mfd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_mfd);
+	if (env->me_dfd != INVALID_HANDLE_VALUE)
+		(void) close(env->me_dfd);
 	if (env->me_fd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_fd);
 	if (env->me_txns) {
@@ -5532,6 +7018,16 @@ rdb_env_close(RDB_env *env)
 		return;
 
 	RDB_TRACE(("%p", env));
+	if (env->me_sstate) {
+		/* The syncer finishes the queue before it stops */
+		pthread_mutex_lock(&env->me_smutex);
+		env->me_sstate = 2;
+		pthread_cond_signal(&env->me_scond);
+		pthread_mutex_unlock(&env->me_smutex);
+		THREAD_FINISH(env->me_sthr);
+	}
+	if ((env->me_flags & RDB_HOTLIST) && env->me_map)
+		(void) rdb_env_hotlist_save(env);
 	VGMEMP_DESTROY(env);
 	while ((dp = env->me_dpages) != NULL) {
 		VGMEMP_DEFINED(&dp->mp_next, sizeof(dp->mp_next));
@@ -5540,9 +7036,212 @@ rdb_env_close(RDB_env *env)
 	}
 
 	rdb_env_close0(env, 0);
+#ifdef _WIN32
+	CloseHandle(env->me_gmutex);
+	CloseHandle(env->me_smutex);
+	CloseHandle(env->me_scond);
+#else
+	pthread_mutex_destroy(&env->me_gmutex);
+	pthread_mutex_destroy(&env->me_smutex);
+	pthread_cond_destroy(&env->me_scond);
+#endif
 	free(env);
 }
 
+/** @defgroup hotlist	Hot page lists
+ *	The list is a #RDB_hothdr followed by pairs of first page number
+ *	and page count, in the byte order of the data file.
+ *	@{
+ */
+	/** Identifies a hot page list file */
+#define RDB_HOTLIST_MAGIC	0x484f544cU
+	/** Pages checked per mincore() call */
+#define RDB_HOTLIST_CHUNK	65536
+
+	/** Header of a hot page list file. */
+typedef struct RDB_hothdr {
+	uint32_t	mh_magic;	/**< #RDB_HOTLIST_MAGIC */
+	uint32_t	mh_psize;	/**< page size the list was taken with */
+	pgno_t		mh_nruns;	/**< number of runs that follow */
+} RDB_hothdr;
+
+#ifndef _WIN32
+#ifdef __linux__
+typedef unsigned char rdb_mincore_t;
+#else
+typedef char rdb_mincore_t;
+#endif
+
+/** Name of the hot page list file, with \b suffix appended. */
+static char * ESECT
+rdb_hotlist_name(RDB_env *env, const char *suffix)
+{
+	const char *name = (env->me_flags & RDB_NOSUBDIR) ? "-hot" : "/hot.mdb";
+	char *buf = malloc(strlen(env->me_path) + strlen(name) + strlen(suffix) + 1);
+
+	if (buf)
+		sprintf(buf, "%s%s%s", env->me_path, name, suffix);
+	return buf;
+}
+
+static int ESECT
+rdb_hotlist_write(int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	ssize_t w;
+
+	while (len) {
+		w = write(fd, ptr, len);
+		if (w < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return ErrCode();
+		}
+		ptr += w;
+		len -= w;
+	}
+	return RDB_SUCCESS;
+}
+#endif
+
+int ESECT
+rdb_env_hotlist_save(RDB_env *env)
+{
+#ifdef _WIN32
+	return ERROR_NOT_SUPPORTED;
+#else
+	RDB_hothdr hdr;
+	rdb_mincore_t *vec = NULL;
+	pgno_t *runs = NULL, nruns = 0, size = 0, pg, last, n, i;
+	char *name = NULL, *tmp = NULL;
+	char sfx[48];
+	struct stat st;
+	int fd, rc = RDB_SUCCESS;
+
+	if (env == NULL || !env->me_map)
+		return EINVAL;
+	env->me_hotsaved = time(NULL);
+
+	last = rdb_env_last_meta(env)->mm_last_pg + 1;
+	vec = malloc((size_t)RDB_HOTLIST_CHUNK * env->me_psize / env->me_os_psize + 1);
+	if (!vec)
+		return ENOMEM;
+	for (pg = 0; pg < last; pg += n) {
+		n = last - pg;
+		if (n > RDB_HOTLIST_CHUNK)
+			n = RDB_HOTLIST_CHUNK;
+		if (mincore(env->me_map + pg * env->me_psize, n * env->me_psize, vec)) {
+			rc = ErrCode();
+			goto done;
+		}
+		for (i = 0; i < n; i++) {
+			if (!(vec[i * env->me_psize / env->me_os_psize] & 1))
+				continue;
+			if (nruns && runs[2*nruns-2] + runs[2*nruns-1] == pg + i) {
+				runs[2*nruns-1]++;
+				continue;
+			}
+			if (nruns == size) {
+				pgno_t *r;
+				size = size ? size * 2 : 1024;
+				if (!(r = realloc(runs, size * 2 * sizeof(pgno_t)))) {
+					rc = ENOMEM;
+					goto done;
+				}
+				runs = r;
+			}
+			runs[2*nruns] = pg + i;
+			runs[2*nruns+1] = 1;
+			nruns++;
+		}
+	}
+
+	/* Write a new file and rename it over the old one, so that a
+	 * concurrent replay never sees a partial list. Commits in other
+	 * threads may be saving too, each gets its own temporary file.
+	 */
+	sprintf(sfx, ".%lu.%lu", (unsigned long)getpid(),
+		(unsigned long)pthread_self());
+	if (!(name = rdb_hotlist_name(env, "")) || !(tmp = rdb_hotlist_name(env, sfx))) {
+		rc = ENOMEM;
+		goto done;
+	}
+	if (fstat(env->me_fd, &st))
+		st.st_mode = 0644;
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|RDB_CLOEXEC, st.st_mode & 0777);
+	if (fd < 0) {
+		rc = ErrCode();
+		goto done;
+	}
+	hdr.mh_magic = RDB_HOTLIST_MAGIC;
+	hdr.mh_psize = env->me_psize;
+	hdr.mh_nruns = nruns;
+	if (!(rc = rdb_hotlist_write(fd, &hdr, sizeof(hdr))))
+		rc = rdb_hotlist_write(fd, runs, nruns * 2 * sizeof(pgno_t));
+	if (!rc && close(fd))
+		rc = ErrCode();
+	else if (rc)
+		close(fd);
+	if (!rc && rename(tmp, name))
+		rc = ErrCode();
+	if (rc)
+		unlink(tmp);
+
+done:
+	free(vec);
+	free(runs);
+	free(name);
+	free(tmp);
+	return rc;
+#endif
+}
+
+int ESECT
+rdb_env_hotlist_replay(RDB_env *env)
+{
+#ifdef _WIN32
+	return ERROR_NOT_SUPPORTED;
+#else
+	RDB_hothdr hdr;
+	pgno_t runs[2*512], i, n, cnt;
+	char *name;
+	ssize_t r;
+	int fd, rc = RDB_SUCCESS;
+
+	if (env == NULL || !env->me_map)
+		return EINVAL;
+	if (!(name = rdb_hotlist_name(env, "")))
+		return ENOMEM;
+	fd = open(name, O_RDONLY|RDB_CLOEXEC);
+	free(name);
+	if (fd < 0)
+		return (rc = ErrCode()) == ENOENT ? RDB_SUCCESS : rc;
+
+	while ((r = read(fd, &hdr, sizeof(hdr))) < 0 && ErrCode() == EINTR) ;
+	if (r != sizeof(hdr) || hdr.mh_magic != RDB_HOTLIST_MAGIC ||
+		hdr.mh_psize != env->me_psize) {
+		rc = r < 0 ? ErrCode() : RDB_INVALID;
+		goto done;
+	}
+	for (n = hdr.mh_nruns; n; n -= cnt) {
+		cnt = n < 512 ? n : 512;
+		while ((r = read(fd, runs, cnt * 2 * sizeof(pgno_t))) < 0 && ErrCode() == EINTR) ;
+		if (r != (ssize_t)(cnt * 2 * sizeof(pgno_t))) {
+			rc = r < 0 ? ErrCode() : RDB_INVALID;
+			break;
+		}
+		for (i = 0; i < cnt; i++)
+			if ((rc = rdb_env_madvise(env, runs[2*i], runs[2*i+1], RDB_ADV_WILLNEED)))
+				goto done;
+	}
+
+done:
+	close(fd);
+	return rc;
+#endif
+}
+/** @} */
+
 /** Compare two items pointing at aligned size_t's */
 static int
 rdb_cmp_long(const RDB_val *a, const RDB_val *b)
@@ -5638,6 +7337,309 @@ rdb_cmp_memnr(const RDB_val *a, const RDB_val *b)
 	return len_diff<0 ? -1 : len_diff;
 }
 
+#ifdef RDB_SIMD_SEARCH
+/** @defgroup simdsearch	Vector search of integer LEAF2 pages
+ *	#RDB_DUPFIXED|#RDB_INTEGERDUP sub-pages hold sorted arrays of 4- or
+ *	8-byte unsigned integers. Instead of probing them one at a time through
+ *	the comparator, binary-search down to a small window and then count
+ *	the entries below the key with vector compares. Since the array is
+ *	sorted, that count is the lower-bound index.
+ *	@{
+ */
+	/** Size in bytes of the window scanned with vector compares */
+#define RDB_SIMD_WINDOW	128
+
+	/** CPU support detected by #rdb_simd_init(): 0 = none, 1 = SSE4.2, 2 = AVX2 */
+static int rdb_simd_level;
+
+static void ESECT
+rdb_simd_init(void)
+{
+	static int inited;
+	int level = 0;
+
+	if (inited)
+		return;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("popcnt")) {
+		if (__builtin_cpu_supports("avx2"))
+			level = 2;
+		else if (__builtin_cpu_supports("sse4.2"))
+			level = 1;
+	}
+	rdb_simd_level = level;
+	inited = 1;
+}
+
+/** Count the 32-bit unsigned entries at \b p less than \b key, using SSE */
+__attribute__((target("sse4.2,popcnt")))
+static unsigned int
+rdb_simd_count32_sse(const char *p, unsigned int n, uint32_t key)
+{
+	const __m128i bias = _mm_set1_epi32((int)0x80000000);
+	__m128i k = _mm_xor_si128(_mm_set1_epi32((int)key), bias);
+	unsigned int i = 0, cnt = 0;
+	uint32_t v;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i*4)), bias);
+		cnt += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, x))));
+	}
+	for (; i < n; i++) {
+		memcpy(&v, p + i*4, 4);
+		cnt += v < key;
+	}
+	return cnt;
+}
+
+/** Count the 64-bit unsigned entries at \b p less than \b key, using SSE4.2 */
+__attribute__((target("sse4.2,popcnt")))
+static unsigned int
+rdb_simd_count64_sse(const char *p, unsigned int n, uint64_t key)
+{
+	const __m128i bias = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+	__m128i k = _mm_xor_si128(_mm_set1_epi64x((long long)key), bias);
+	unsigned int i = 0, cnt = 0;
+	uint64_t v;
+
+	for (; i + 2 <= n; i += 2) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i*8)), bias);
+		cnt += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, x))));
+	}
+	for (; i < n; i++) {
+		memcpy(&v, p + i*8, 8);
+		cnt += v < key;
+	}
+	return cnt;
+}
+
+/** Count the 32-bit unsigned entries at \b p less than \b key, using AVX2 */
+__attribute__((target("avx2,popcnt")))
+static unsigned int
+rdb_simd_count32_avx2(const char *p, unsigned int n, uint32_t key)
+{
+	const __m256i bias = _mm256_set1_epi32((int)0x80000000);
+	__m256i k = _mm256_xor_si256(_mm256_set1_epi32((int)key), bias);
+	unsigned int i = 0, cnt = 0;
+	uint32_t v;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i*4)), bias);
+		cnt += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, x))));
+	}
+	for (; i < n; i++) {
+		memcpy(&v, p + i*4, 4);
+		cnt += v < key;
+	}
+	return cnt;
+}
+
+/** Count the 64-bit unsigned entries at \b p less than \b key, using AVX2 */
+__attribute__((target("avx2,popcnt")))
+static unsigned int
+rdb_simd_count64_avx2(const char *p, unsigned int n, uint64_t key)
+{
+	const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+	__m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), bias);
+	unsigned int i = 0, cnt = 0;
+	uint64_t v;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i*8)), bias);
+		cnt += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, x))));
+	}
+	for (; i < n; i++) {
+		memcpy(&v, p + i*8, 8);
+		cnt += v < key;
+	}
+	return cnt;
+}
+
+/** Find the lower bound of an integer key in a LEAF2 page.
+ *	Only called for 4-byte #rdb_cmp_int and 8-byte #rdb_cmp_long pages,
+ *	when #rdb_simd_level is nonzero.
+ * @param[in] mp the LEAF2 page.
+ * @param[in] ksize the key size, 4 or 8.
+ * @param[in] key the key to search for.
+ * @param[out] exactp set to 1 if the entry found equals the key.
+ * @return the index of the smallest entry larger or equal to the key,
+ *	or NUMKEYS(mp) if there is none.
+ */
+static unsigned int
+rdb_leaf2_search_simd(RDB_page *mp, unsigned int ksize, RDB_val *key, int *exactp)
+{
+	const char *base = LEAF2KEY(mp, 0, ksize);
+	unsigned int nkeys = NUMKEYS(mp), low = 0, high = nkeys, mid, i;
+	unsigned int window = RDB_SIMD_WINDOW / ksize;
+
+	/* Invariant: entries below low are less than the key,
+	 * entries at high and above are not.
+	 */
+	if (ksize == sizeof(uint32_t)) {
+		uint32_t k, v;
+		memcpy(&k, key->mv_data, sizeof(k));
+		while (high - low > window) {
+			mid = (low + high) >> 1;
+			memcpy(&v, base + mid*4, 4);
+			if (v < k)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		i = low + (rdb_simd_level > 1
+			? rdb_simd_count32_avx2(base + low*4, high - low, k)
+			: rdb_simd_count32_sse(base + low*4, high - low, k));
+		if (i < nkeys)
+			memcpy(&v, base + i*4, 4);
+		*exactp = i < nkeys && v == k;
+	} else {
+		uint64_t k, v;
+		memcpy(&k, key->mv_data, sizeof(k));
+		while (high - low > window) {
+			mid = (low + high) >> 1;
+			memcpy(&v, base + mid*8, 8);
+			if (v < k)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		i = low + (rdb_simd_level > 1
+			? rdb_simd_count64_avx2(base + low*8, high - low, k)
+			: rdb_simd_count64_sse(base + low*8, high - low, k));
+		if (i < nkeys)
+			memcpy(&v, base + i*8, 8);
+		*exactp = i < nkeys && v == k;
+	}
+	return i;
+}
+/** @} */
+#endif /* RDB_SIMD_SEARCH */
+
+	/** Read an unsigned integer key of \b size bytes, 4 or 8 */
+static uint64_t
+rdb_int_key(const void *p, size_t size)
+{
+	if (size == sizeof(uint32_t)) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	} else {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+}
+
+/** Lower-bound search of 4- or 8-byte unsigned integer keys, over
+ *	\b n nodes of a page starting at index \b base. The key compare is
+ *	only a couple of loads, so the range is halved with a conditional
+ *	move instead of a branch.
+ * @return the index of the first node not less than the key. *rcp is
+ *	set to 0 if that node equals the key, otherwise to -1, also when
+ *	the index is past the range.
+ */
+static unsigned int
+rdb_lbound_int(RDB_page *mp, RDB_val *key, unsigned int base, unsigned int n, int *rcp)
+{
+	size_t ksize = key->mv_size;
+	uint64_t k = rdb_int_key(key->mv_data, ksize), v;
+	unsigned int half, end = base + n;
+
+	while (n > 1) {
+		half = n >> 1;
+		v = rdb_int_key(NODEKEY(NODEPTR(mp, base + half)), ksize);
+		base = v < k ? base + half : base;
+		n -= half;
+	}
+	v = rdb_int_key(NODEKEY(NODEPTR(mp, base)), ksize);
+	if (v < k) {
+		if (++base >= end) {
+			*rcp = -1;
+			return base;
+		}
+		v = rdb_int_key(NODEKEY(NODEPTR(mp, base)), ksize);
+	}
+	*rcp = v == k ? 0 : -1;
+	return base;
+}
+
+#ifdef RDB_INTERP_SEARCH
+/** @defgroup interpsearch	Interpolation search of integer-keyed pages
+ *	Keys such as timestamps and sequence numbers tend to be spread
+ *	evenly, so the position of a key within a page can be estimated
+ *	from the values at the ends of the search range. A couple of such
+ *	probes usually leave only a handful of nodes for the binary search.
+ *	@{
+ */
+	/** Smallest search range worth interpolating over */
+#define RDB_INTERP_MIN	16
+	/** Most interpolation probes per page */
+#define RDB_INTERP_ROUNDS	3
+
+/** Narrow the binary search range of a page with integer keys.
+ *	On return the nodes below *lowp sort before the key, the nodes
+ *	above *highp sort after it, and the range is not empty.
+ *	Gives up on interpolating as soon as a probe fails to halve the
+ *	range, since the keys are then too skewed for it to pay off.
+ * @param[in] mp the leaf or branch page, not LEAF2.
+ * @param[in] key the key to search for.
+ * @param[in,out] lowp the index of the first node to search.
+ * @param[in,out] highp the index of the last node to search.
+ */
+static void
+rdb_interp_narrow(RDB_page *mp, RDB_val *key, int *lowp, int *highp)
+{
+	int lo = *lowp, hi = *highp, pos, span, round;
+	size_t ksize = key->mv_size;
+	uint64_t k, lv, hv, v;
+	RDB_node *node;
+
+	if (hi - lo < RDB_INTERP_MIN ||
+		(ksize != sizeof(uint32_t) && ksize != sizeof(uint64_t)))
+		return;
+	node = NODEPTR(mp, lo);
+	if (NODEKSZ(node) != ksize)
+		return;
+	k = rdb_int_key(key->mv_data, ksize);
+	lv = rdb_int_key(NODEKEY(node), ksize);
+	hv = rdb_int_key(NODEKEY(NODEPTR(mp, hi)), ksize);
+	if (k <= lv) {
+		*highp = lo;
+		return;
+	}
+	if (k >= hv) {
+		*lowp = hi;
+		return;
+	}
+
+	/* From here on node lo is less than the key and node hi greater */
+	for (round = 0; round < RDB_INTERP_ROUNDS && hi - lo > RDB_INTERP_MIN; round++) {
+		span = hi - lo;
+		pos = lo + 1 + (int)((double)(k - lv) / (double)(hv - lv) * (span - 1));
+		if (pos >= hi)
+			pos = hi - 1;
+		v = rdb_int_key(NODEKEY(NODEPTR(mp, pos)), ksize);
+		DPRINTF(("interpolated index %d in %d..%d", pos, lo, hi));
+		if (v == k) {
+			*lowp = *highp = pos;
+			return;
+		}
+		if (v < k) {
+			lo = pos;
+			lv = v;
+		} else {
+			hi = pos;
+			hv = v;
+		}
+		if ((hi - lo) * 2 > span)
+			break;
+	}
+	*lowp = lo + 1;
+	*highp = hi;
+}
+/** @} */
+#endif /* RDB_INTERP_SEARCH */
+
 /** Search for key within a page, using binary search.
  * Returns the smallest entry larger or equal to the key.
  * If exactp is non-null, stores whether the found entry was an exact match
@@ -5653,8 +7655,10 @@ rdb_node_search(RDB_cursor *mc, RDB_val *key, int *exactp)
 	int		 rc = 0;
 	RDB_page *mp = mc->mc_pg[mc->mc_top];
 	RDB_node	*node = NULL;
-	RDB_val	 nodekey;
+	RDB_val	 nodekey, sfx;
 	RDB_cmp_func *cmp;
+	unsigned int plen = 0;
+	char	*fbuf = NULL, pbuf[KEYBUF_SIZE];
 	DKBUF;
 
 	nkeys = NUMKEYS(mp);
@@ -5677,9 +7681,54 @@ rdb_node_search(RDB_cursor *mc, RDB_val *key, int *exactp)
 			cmp = rdb_cmp_int;
 	}
 
+	/* On a prefix-compressed branch page, compare the shared prefix
+	 * once and then search the node suffixes with the rest of the key.
+	 * Other comparators get whole keys rebuilt in pbuf.
+	 */
+	if (F_ISSET(mp->mp_flags, P_PREFIX) && nkeys > 1) {
+		char *pfx = PAGEPFX(mc->mc_txn->mt_env, mp);
+		plen = mp->mp_pad;
+		if (cmp == rdb_cmp_memn) {
+			rc = memcmp(key->mv_data, pfx, key->mv_size < plen ? key->mv_size : plen);
+			if (!rc && key->mv_size < plen)
+				rc = -1;
+			if (rc) {
+				/* The key sorts before or after every node */
+				if (rc < 0) {
+					i = 1;
+					high = 0;
+				} else {
+					i = nkeys - 1;
+					low = nkeys;
+				}
+				node = NODEPTR(mp, i);
+			} else {
+				sfx.mv_size = key->mv_size - plen;
+				sfx.mv_data = (char *)key->mv_data + plen;
+				key = &sfx;
+			}
+		} else {
+			memcpy(pbuf, pfx, plen);
+			fbuf = pbuf;
+		}
+	}
+
 	if (IS_LEAF2(mp)) {
 		nodekey.mv_size = mc->mc_db->md_pad;
 		node = NODEPTR(mp, 0);	/* fake */
+#ifdef RDB_SIMD_SEARCH
+		if (rdb_simd_level &&
+			((cmp == rdb_cmp_int && nodekey.mv_size == sizeof(uint32_t)) ||
+			 (cmp == rdb_cmp_long && nodekey.mv_size == sizeof(uint64_t)))) {
+			int exact;
+			i = rdb_leaf2_search_simd(mp, nodekey.mv_size, key, &exact);
+			DPRINTF(("found leaf index %u, exact %i", i, exact));
+			if (exactp)
+				*exactp = exact;
+			mc->mc_ki[mc->mc_top] = i;
+			return i < nkeys ? node : NULL;
+		}
+#endif
 		while (low <= high) {
 			i = (low + high) >> 1;
 			nodekey.mv_data = LEAF2KEY(mp, i, nodekey.mv_size);
@@ -5694,12 +7743,33 @@ rdb_node_search(RDB_cursor *mc, RDB_val *key, int *exactp)
 				high = i - 1;
 		}
 	} else {
+		/* Integer keys are searched without calling cmp. That loop
+		 * only reads 4- or 8-byte keys.
+		 */
+		int intkey = (cmp == rdb_cmp_cint || cmp == rdb_cmp_int ||
+			cmp == rdb_cmp_long) && (key->mv_size == sizeof(uint32_t) ||
+			key->mv_size == sizeof(uint64_t));
+#ifdef RDB_INTERP_SEARCH
+		if (intkey)
+			rdb_interp_narrow(mp, key, &low, &high);
+#endif
+		if (intkey && !fbuf && low <= high) {
+			i = rdb_lbound_int(mp, key, low, high - low + 1, &rc);
+			DPRINTF(("found %s index %u, rc = %i",
+			    IS_LEAF(mp) ? "leaf" : "branch", i, rc));
+			node = NODEPTR(mp, i);
+		} else
 		while (low <= high) {
 			i = (low + high) >> 1;
 
 			node = NODEPTR(mp, i);
 			nodekey.mv_size = NODEKSZ(node);
 			nodekey.mv_data = NODEKEY(node);
+			if (fbuf) {
+				memcpy(fbuf + plen, nodekey.mv_data, nodekey.mv_size);
+				nodekey.mv_data = fbuf;
+				nodekey.mv_size += plen;
+			}
 
 			rc = cmp(key, &nodekey);
 #if RDB_DEBUG
@@ -5850,6 +7920,190 @@ done:
 	return RDB_SUCCESS;
 }
 
+	/** How many items before the end of a leaf a cursor stepping
+	 *	through it starts loading the next leaf.
+	 */
+#define RDB_PREFETCH_LEAD	8
+
+/** Start loading the parts of a page that a cursor reads first,
+ *	so that their cache and TLB misses overlap: the header, the
+ *	start of the index, and the middle of the nodes.
+ *	Nothing is done with #RDB_NOPREFETCH.
+ * @param[in] env The environment.
+ * @param[in] mp The page.
+ */
+static void
+rdb_page_prefetch(RDB_env *env, RDB_page *mp)
+{
+	if (env->me_flags & RDB_NOPREFETCH)
+		return;
+	RDB_PREFETCH(mp);
+	RDB_PREFETCH((char *)mp + 64);
+	RDB_PREFETCH((char *)mp + env->me_psize / 2);
+	RDB_PREFETCH((char *)mp + env->me_psize * 3 / 4);
+}
+
+/** Start loading the leaf a cursor will step to next, when it nears
+ *	the end of its current one. Only a sibling under the same parent
+ *	is loaded, reaching a cousin would mean reading more branch pages.
+ *	The hint goes to the page in the map, which for a page dirtied by
+ *	a write txn is wasted but harmless.
+ * @param[in] mc The cursor, on a leaf.
+ * @param[in] move_right Non-zero for the right sibling, else the left.
+ */
+static void
+rdb_cursor_prefetch(RDB_cursor *mc, int move_right)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp;
+	unsigned int nkeys, ki;
+	pgno_t pgno;
+
+	if (!mc->mc_top || (env->me_flags & RDB_NOPREFETCH))
+		return;
+	nkeys = NUMKEYS(mc->mc_pg[mc->mc_top]);
+	ki = mc->mc_ki[mc->mc_top];
+	/* Once per leaf, or right away on a short one */
+	if ((move_right ? nkeys - ki : ki + 1) !=
+		(nkeys < RDB_PREFETCH_LEAD ? nkeys : RDB_PREFETCH_LEAD))
+		return;
+	mp = mc->mc_pg[mc->mc_top-1];
+	ki = mc->mc_ki[mc->mc_top-1];
+	if (move_right ? ki + 1u >= NUMKEYS(mp) : !ki)
+		return;
+	pgno = NODEPGNO(NODEPTR(mp, move_right ? ki + 1 : ki - 1));
+	if (pgno < mc->mc_txn->mt_next_pgno)
+		rdb_page_prefetch(env, (RDB_page *)(env->me_map + env->me_psize * pgno));
+}
+
+	/** How many leaves a cursor with #RDB_ADV_SEQUENTIAL asks the OS
+	 *	to read in ahead of it at a time.
+	 */
+#define RDB_READAHEAD_LEAVES	16
+
+#if defined(MADV_NORMAL)
+# define RDB_MADV(x)	MADV_##x
+#elif defined(POSIX_MADV_NORMAL)
+# define RDB_MADV(x)	POSIX_MADV_##x
+#endif
+
+/** Pass an @ref rdb_advise hint for a run of pages on to the OS.
+ *	Hints the OS has no equivalent for are ignored.
+ * @param[in] env The environment.
+ * @param[in] pgno The first page of the run.
+ * @param[in] count The number of pages in the run.
+ * @param[in] advice The hint.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_env_madvise(RDB_env *env, pgno_t pgno, pgno_t count, int advice)
+{
+#ifdef RDB_MADV
+	size_t off = (size_t)pgno * env->me_psize;
+	size_t len = (size_t)count * env->me_psize;
+	size_t skew = off & (env->me_os_psize - 1);
+	int how;
+
+	switch (advice) {
+	case RDB_ADV_NORMAL:		how = RDB_MADV(NORMAL); break;
+	case RDB_ADV_SEQUENTIAL:	how = RDB_MADV(SEQUENTIAL); break;
+	case RDB_ADV_RANDOM:		how = RDB_MADV(RANDOM); break;
+	case RDB_ADV_WILLNEED:		how = RDB_MADV(WILLNEED); break;
+#ifdef MADV_COLD
+	case RDB_ADV_COLD:			how = MADV_COLD; break;
+#endif
+	default:
+		return RDB_SUCCESS;
+	}
+	if (off >= env->me_mapsize)
+		return RDB_SUCCESS;
+	if (len > env->me_mapsize - off)
+		len = env->me_mapsize - off;
+	/* Pages smaller than the OS's may not start on one of its pages */
+	off -= skew;
+	len += skew;
+#ifdef MADV_NORMAL
+	if (madvise(env->me_map + off, len, how))
+		return ErrCode();
+#else
+	return posix_madvise(env->me_map + off, len, how);
+#endif
+#endif /* RDB_MADV */
+	return RDB_SUCCESS;
+}
+
+/** A run of pages with consecutive numbers, collected to be passed
+ *	to #rdb_env_madvise() with one call.
+ */
+typedef struct RDB_advrun {
+	pgno_t		ar_pgno;	/**< lowest page number in the run */
+	pgno_t		ar_count;	/**< number of pages, 0 if none yet */
+	int			ar_advice;	/**< the hint for the run */
+} RDB_advrun;
+
+/** Add a page to a run, or pass the run on and start a new one
+ *	if the page isn't next to it on either side.
+ * @param[in] env The environment.
+ * @param[in,out] ar The run.
+ * @param[in] pgno The page to add.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_advrun_add(RDB_env *env, RDB_advrun *ar, pgno_t pgno)
+{
+	int rc;
+
+	if (ar->ar_count) {
+		if (pgno == ar->ar_pgno + ar->ar_count) {
+			ar->ar_count++;
+			return RDB_SUCCESS;
+		}
+		if (pgno + 1 == ar->ar_pgno) {
+			ar->ar_pgno--;
+			ar->ar_count++;
+			return RDB_SUCCESS;
+		}
+		if ((rc = rdb_env_madvise(env, ar->ar_pgno, ar->ar_count, ar->ar_advice)))
+			return rc;
+	}
+	ar->ar_pgno = pgno;
+	ar->ar_count = 1;
+	return RDB_SUCCESS;
+}
+
+/** Ask the OS to read in the next #RDB_READAHEAD_LEAVES leaves of a
+ *	cursor with #RDB_ADV_SEQUENTIAL. This is done whenever the cursor
+ *	steps onto a leaf at a multiple of that distance from the edge of
+ *	its parent it started out from, so each leaf is asked for once.
+ *	Only leaves under the same parent are covered.
+ * @param[in] mc The cursor, just moved onto a leaf.
+ * @param[in] move_right Non-zero if it is moving right, else left.
+ */
+static void
+rdb_cursor_readahead(RDB_cursor *mc, int move_right)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp = mc->mc_pg[mc->mc_top-1];
+	unsigned int i, n, nkeys = NUMKEYS(mp), ki = mc->mc_ki[mc->mc_top-1];
+	RDB_advrun ar;
+	pgno_t pgno;
+
+	if ((move_right ? ki : nkeys - 1 - ki) % RDB_READAHEAD_LEAVES)
+		return;
+	n = move_right ? nkeys - 1 - ki : ki;
+	if (n > RDB_READAHEAD_LEAVES)
+		n = RDB_READAHEAD_LEAVES;
+	ar.ar_count = 0;
+	ar.ar_advice = RDB_ADV_WILLNEED;
+	for (i = 1; i <= n; i++) {
+		pgno = NODEPGNO(NODEPTR(mp, move_right ? ki + i : ki - i));
+		if (pgno < mc->mc_txn->mt_next_pgno)
+			rdb_advrun_add(env, &ar, pgno);
+	}
+	if (ar.ar_count)
+		rdb_env_madvise(env, ar.ar_pgno, ar.ar_count, ar.ar_advice);
+}
+
 /** Finish #rdb_page_search() / #rdb_page_search_lowest().
  *	The cursor is at the root page, set up the rest of it.
  */
@@ -5916,6 +8170,8 @@ ready:
 				return rc;
 			mp = mc->mc_pg[mc->mc_top];
 		}
+		if (flags & RDB_PS_STEP)
+			return RDB_SUCCESS;
 	}
 
 	if (!IS_LEAF(mp)) {
@@ -5955,16 +8211,96 @@ rdb_page_search_lowest(RDB_cursor *mc)
 	return rdb_page_search_root(mc, NULL, RDB_PS_FIRST);
 }
 
-/** Search for the page a given key should be in.
- * Push it and its parent pages on the cursor stack.
- * @param[in,out] mc the cursor for this operation.
- * @param[in] key the key to search for, or NULL for first/last page.
- * @param[in] flags If RDB_PS_MODIFY is set, visited pages in the DB
- *   are touched (updated with new page numbers).
- *   If RDB_PS_FIRST or RDB_PS_LAST is set, find first or last leaf.
- *   This is used by #rdb_cursor_first() and #rdb_cursor_last().
- *   If RDB_PS_ROOTONLY set, just fetch root node, no further lookups.
- * @return 0 on success, non-zero on failure.
+/** Find the lowest page on the cursor stack whose range covers a key.
+ * The stack must be the result of an earlier search for a key that
+ * sorts at or before \b key, so only the upper bound of each page's
+ * range needs checking. That bound is the separator to the right of
+ * the nearest ancestor index that has one.
+ * @param[in] mc the cursor for this operation.
+ * @param[in] key the key to search for.
+ * @return the stack level of the page.
+ */
+static unsigned int
+rdb_finger_level(RDB_cursor *mc, RDB_val *key)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp;
+	RDB_val sep;
+	unsigned int c = mc->mc_top;
+	int i;
+	char buf[KEYBUF_SIZE];
+
+	for (i = mc->mc_top - 1; i >= 0; i--) {
+		mp = mc->mc_pg[i];
+		if (mc->mc_ki[i] + 1u < NUMKEYS(mp)) {
+			rdb_node_key(env, mp, NODEPTR(mp, mc->mc_ki[i] + 1), &sep, buf);
+			if (mc->mc_dbx->md_cmp(key, &sep) < 0)
+				break;
+			c = i;
+		}
+	}
+	return c;
+}
+
+/** Check that a key sorts within the range of the leaf on top of the
+ * cursor stack, at or after its lower bound. That bound is the separator
+ * at the nearest ancestor index that isn't 0, and it can sort below
+ * the leaf's first key, e.g. after that key was deleted or when the
+ * separator was shortened.
+ * @param[in] mc the cursor for this operation.
+ * @param[in] key the key to check.
+ * @return non-zero if \b key is at or past the lower bound.
+ */
+static int
+rdb_finger_start(RDB_cursor *mc, RDB_val *key)
+{
+	RDB_page *mp;
+	RDB_val sep;
+	int i;
+	char buf[KEYBUF_SIZE];
+
+	for (i = mc->mc_top - 1; i >= 0; i--) {
+		if (mc->mc_ki[i]) {
+			mp = mc->mc_pg[i];
+			rdb_node_key(mc->mc_txn->mt_env, mp,
+				NODEPTR(mp, mc->mc_ki[i]), &sep, buf);
+			return mc->mc_dbx->md_cmp(key, &sep) >= 0;
+		}
+	}
+	/* The leftmost leaf has no lower bound */
+	return 1;
+}
+
+/** Search for the page a key should be in, starting from the pages
+ * a previous search left on the cursor stack. Used for cursors with
+ * #C_FINGER set, whose searches come in ascending key order.
+ * @param[in,out] mc the cursor for this operation.
+ * @param[in] key the key to search for.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_page_search_finger(RDB_cursor *mc, RDB_val *key)
+{
+	unsigned int c = rdb_finger_level(mc, key);
+
+	if (c == mc->mc_top)
+		return RDB_SUCCESS;
+	DPRINTF(("resuming search at level %u of %u", c, mc->mc_top));
+	mc->mc_top = c;
+	mc->mc_snum = c + 1;
+	return rdb_page_search_root(mc, key, 0);
+}
+
+/** Search for the page a given key should be in.
+ * Push it and its parent pages on the cursor stack.
+ * @param[in,out] mc the cursor for this operation.
+ * @param[in] key the key to search for, or NULL for first/last page.
+ * @param[in] flags If RDB_PS_MODIFY is set, visited pages in the DB
+ *   are touched (updated with new page numbers).
+ *   If RDB_PS_FIRST or RDB_PS_LAST is set, find first or last leaf.
+ *   This is used by #rdb_cursor_first() and #rdb_cursor_last().
+ *   If RDB_PS_ROOTONLY set, just fetch root node, no further lookups.
+ * @return 0 on success, non-zero on failure.
  */
 static int
 rdb_page_search(RDB_cursor *mc, RDB_val *key, int flags)
@@ -6005,8 +8341,9 @@ rdb_page_search(RDB_cursor *mc, RDB_val *key, int flags)
 						sizeof(uint16_t));
 					/* The txn may not know this DBI, or another process may
 					 * have dropped and recreated the DB with other flags.
+					 * A filter added since is taken up as the record says.
 					 */
-					if ((mc->mc_db->md_flags & PERSISTENT_FLAGS) != flags)
+					if ((mc->mc_db->md_flags ^ flags) & PERSISTENT_FLAGS & ~RDB_BLOOM)
 						return RDB_INCOMPATIBLE;
 					memcpy(mc->mc_db, data.mv_data, sizeof(RDB_db));
 				}
@@ -6114,41 +8451,1065 @@ release:
 		if (rc)
 			return rc;
 	}
-	mc->mc_db->md_overflow_pages -= ovpages;
-	return 0;
+	mc->mc_db->md_overflow_pages -= ovpages;
+	return 0;
+}
+
+/** Return the data associated with a given node.
+ * @param[in] mc The cursor for this operation.
+ * @param[in] leaf The node being read.
+ * @param[out] data Updated to point to the node's data.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_node_read(RDB_cursor *mc, RDB_node *leaf, RDB_val *data)
+{
+	RDB_page	*omp;		/* overflow page */
+	pgno_t		 pgno;
+	int rc;
+
+	if (!F_ISSET(leaf->mn_flags, F_BIGDATA)) {
+		data->mv_size = NODEDSZ(leaf);
+		data->mv_data = NODEDATA(leaf);
+		return RDB_SUCCESS;
+	}
+
+	/* Read overflow data.
+	 */
+	data->mv_size = NODEDSZ(leaf);
+	memcpy(&pgno, NODEDATA(leaf), sizeof(pgno));
+	if ((rc = rdb_page_get(mc, pgno, &omp, NULL)) != 0) {
+		DPRINTF(("read overflow page %"Z"u failed", pgno));
+		return rc;
+	}
+	data->mv_data = METADATA(omp);
+
+	return RDB_SUCCESS;
+}
+
+/** @defgroup bloom	Bloom filters of #RDB_BLOOM databases
+ *	The filter of a DB lives in a hidden INTEGERKEY DB named after it,
+ *	whose items are the filter's blocks, each filling an overflow page.
+ *	Writes to the filter are thus copy-on-write like any other data.
+ *	A key sets #RDB_BLOOM_K bits in a single cache line of one block,
+ *	so a lookup touches just one line of the filter.
+ *	@{
+ */
+	/** Filter bits per key, for a false positive rate around 1% */
+#define RDB_BLOOM_BITS	10
+	/** Bits set per key */
+#define RDB_BLOOM_K	6
+	/** Fewest keys a filter is sized for */
+#define RDB_BLOOM_MINKEYS	65536
+	/** Size of a filter block, one overflow page */
+#define BLOOM_BLKSZ(env)	((env)->me_psize - PAGEHDRSZ)
+	/** Suffix of the name of a filter DB, after a NUL
+	 *	so that it cannot clash with a user's DB name.
+	 */
+#define BLOOM_SUFFIX	"\0bloom"
+
+/** Hash a key, for Bloom filters and #RDB_HASHED buckets. */
+static uint64_t
+rdb_key_hash(const RDB_val *key)
+{
+	const unsigned char *p = key->mv_data;
+	size_t n = key->mv_size;
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ n, w;
+
+	for (; n >= sizeof(w); n -= sizeof(w), p += sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	w = 0;
+	memcpy(&w, p, n);
+	h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 32);
+}
+
+/** Test or set the bits of a key in a filter block.
+ * @param[in] env The environment.
+ * @param[in] h The key's hash.
+ * @param[in] blk The block.
+ * @param[in] set Non-zero to set the bits.
+ * @return Non-zero if all the bits were already set.
+ */
+static int
+rdb_bloom_bits(RDB_env *env, uint64_t h, void *blk, int set)
+{
+	uint64_t *line, g, b;
+	unsigned int i, nlines = BLOOM_BLKSZ(env) / 64;
+	int all = 1;
+
+	/* The low half picks the line, the block came from the high half */
+	line = (uint64_t *)blk + (((uint32_t)h * (uint64_t)nlines) >> 32) * 8;
+	g = (h ^ (h >> 31)) * 0x94d049bb133111ebULL;
+	for (i = 0; i < RDB_BLOOM_K; i++, g >>= 9) {
+		b = (uint64_t)1 << (g & 63);
+		if (!(line[(g >> 6) & 7] & b)) {
+			all = 0;
+			if (!set)
+				break;
+			line[(g >> 6) & 7] |= b;
+		}
+	}
+	return all;
+}
+
+/** Return the filter DB of a DB, or 0 if it has none. */
+static RDB_dbi
+rdb_bloom_dbi(RDB_txn *txn, RDB_dbi dbi)
+{
+	RDB_dbi b = txn->mt_dbxs[dbi].md_bloom;
+	if (b && b < txn->mt_numdbs && (txn->mt_dbflags[b] & DB_VALID))
+		return b;
+	return 0;
+}
+
+/** Find the filter block that holds a key's bits.
+ * @param[in,out] bc A cursor on the filter DB, left on the block.
+ * @param[in] h The key's hash.
+ * @param[out] key Set to the block's key, in \b blk.
+ * @param[out] blk The block's number.
+ * @param[out] data Set to the block.
+ * @return 0 on success, #RDB_NOTFOUND if the filter is empty,
+ * non-zero on failure.
+ */
+static int
+rdb_bloom_block(RDB_cursor *bc, uint64_t h, RDB_val *key, unsigned int *blk,
+	RDB_val *data)
+{
+	int rc, exact = 0;
+
+	if (!bc->mc_db->md_entries)
+		return RDB_NOTFOUND;
+	*blk = ((h >> 32) * bc->mc_db->md_entries) >> 32;
+	key->mv_size = sizeof(*blk);
+	key->mv_data = blk;
+	rc = rdb_cursor_set(bc, key, data, RDB_SET, &exact);
+	if (rc == RDB_SUCCESS && data->mv_size != BLOOM_BLKSZ(bc->mc_txn->mt_env)) {
+		bc->mc_txn->mt_flags |= RDB_TXN_ERROR;
+		rc = RDB_CORRUPTED;
+	}
+	return rc;
+}
+
+/** Check a key against the Bloom filter of a DB.
+ * @return 0 if the key is surely not in the DB, non-zero if it may be.
+ */
+static int
+rdb_bloom_check(RDB_txn *txn, RDB_dbi dbi, RDB_val *key)
+{
+	RDB_cursor bc;
+	RDB_val bkey, data;
+	RDB_dbi b;
+	uint64_t h;
+	unsigned int blk;
+
+	if (!txn->mt_dbxs[dbi].md_bloom || !(b = rdb_bloom_dbi(txn, dbi)))
+		return 1;
+	/* Let the real search report bad keys */
+	if (key->mv_size - 1 >= ENV_MAXKEY(txn->mt_env))
+		return 1;
+	h = rdb_key_hash(key);
+	rdb_cursor_init(&bc, txn, b, NULL);
+	if (rdb_bloom_block(&bc, h, &bkey, &blk, &data) != RDB_SUCCESS)
+		return 1;
+	return rdb_bloom_bits(txn->mt_env, h, data.mv_data, 0);
+}
+
+/** Add a key to the Bloom filter of a DB.
+ *	A block already dirty in this txn is updated in place,
+ *	otherwise it is written anew with the key's bits set.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_bloom_add(RDB_txn *txn, RDB_dbi dbi, RDB_val *key)
+{
+	RDB_env *env = txn->mt_env;
+	RDB_cursor bc;
+	RDB_val bkey, data;
+	RDB_node *leaf;
+	RDB_page *omp;
+	RDB_dbi b;
+	pgno_t pg;
+	uint64_t h;
+	unsigned int blk;
+	int rc, level;
+	void *buf;
+
+	if (!(b = rdb_bloom_dbi(txn, dbi)) || key->mv_size - 1 >= ENV_MAXKEY(env))
+		return RDB_SUCCESS;
+	h = rdb_key_hash(key);
+	rdb_cursor_init(&bc, txn, b, NULL);
+	rc = rdb_bloom_block(&bc, h, &bkey, &blk, &data);
+	if (rc)
+		return rc == RDB_NOTFOUND ? RDB_SUCCESS : rc;
+	if (rdb_bloom_bits(env, h, data.mv_data, 0))
+		return RDB_SUCCESS;
+
+	leaf = NODEPTR(bc.mc_pg[bc.mc_top], bc.mc_ki[bc.mc_top]);
+	memcpy(&pg, NODEDATA(leaf), sizeof(pg));
+	if ((rc = rdb_page_get(&bc, pg, &omp, &level)) != 0)
+		return rc;
+	if ((omp->mp_flags & P_DIRTY) && (level == 1 || !txn->mt_parent)) {
+		rdb_bloom_bits(env, h, METADATA(omp), 1);
+		return RDB_SUCCESS;
+	}
+
+	if ((buf = malloc(data.mv_size)) == NULL)
+		return ENOMEM;
+	memcpy(buf, data.mv_data, data.mv_size);
+	rdb_bloom_bits(env, h, buf, 1);
+	data.mv_data = buf;
+	bc.mc_next = txn->mt_cursors[b];
+	txn->mt_cursors[b] = &bc;
+	rc = _rdb_cursor_put(&bc, &bkey, &data, RDB_CURRENT);
+	txn->mt_cursors[b] = bc.mc_next;
+	free(buf);
+	return rc;
+}
+
+/** Size a DB's Bloom filter and fill it with the DB's keys.
+ * @param[in] txn A write transaction.
+ * @param[in] dbi A DB with a filter.
+ * @param[in] nkeys The number of keys to size the filter for, or 0
+ * for the number of items in the DB.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_bloom_init(RDB_txn *txn, RDB_dbi dbi, size_t nkeys)
+{
+	RDB_env *env = txn->mt_env;
+	RDB_cursor *mc;
+	RDB_val key, data;
+	RDB_dbi b = txn->mt_dbxs[dbi].md_bloom;
+	size_t per = (size_t)BLOOM_BLKSZ(env) * 8 / RDB_BLOOM_BITS;
+	unsigned int i, n;
+	int rc;
+
+	rc = rdb_cursor_open(txn, dbi, &mc);
+	if (rc)
+		return rc;
+	/* Opening the cursor refreshed a stale DB record */
+	if (!nkeys)
+		nkeys = txn->mt_dbs[dbi].md_entries;
+	if (nkeys < RDB_BLOOM_MINKEYS)
+		nkeys = RDB_BLOOM_MINKEYS;
+	n = nkeys / per < UINT_MAX ? nkeys / per + 1 : UINT_MAX;
+
+	rc = rdb_drop(txn, b, 0);
+	if (rc)
+		goto leave;
+	data.mv_size = BLOOM_BLKSZ(env);
+	if ((data.mv_data = calloc(1, data.mv_size)) == NULL) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	key.mv_size = sizeof(i);
+	key.mv_data = &i;
+	for (i = 0; i < n && !rc; i++)
+		rc = rdb_put(txn, b, &key, &data, RDB_APPEND);
+	free(data.mv_data);
+
+	while (!rc && !(rc = rdb_cursor_get(mc, &key, &data, RDB_NEXT_NODUP)))
+		rc = rdb_bloom_add(txn, dbi, &key);
+	if (rc == RDB_NOTFOUND)
+		rc = RDB_SUCCESS;
+leave:
+	rdb_cursor_close(mc);
+	return rc;
+}
+
+/** Open the Bloom filter DB of a DB, creating and filling it
+ *	in write transactions if it's missing. A read-only transaction
+ *	without a filter just searches the tree for every key.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_bloom_open(RDB_txn *txn, RDB_dbi dbi)
+{
+	RDB_val name;
+	RDB_dbi b;
+	int rc, rdonly = F_ISSET(txn->mt_flags, RDB_TXN_RDONLY);
+	size_t len = txn->mt_dbxs[dbi].md_name.mv_size;
+
+	name.mv_size = len + sizeof(BLOOM_SUFFIX) - 1;
+	if ((name.mv_data = malloc(name.mv_size)) == NULL)
+		return ENOMEM;
+	memcpy(name.mv_data, txn->mt_dbxs[dbi].md_name.mv_data, len);
+	memcpy((char *)name.mv_data + len, BLOOM_SUFFIX, sizeof(BLOOM_SUFFIX) - 1);
+	rc = rdb_dbi_open0(txn, &name, rdonly ? 0 : RDB_CREATE|RDB_INTEGERKEY, &b);
+	free(name.mv_data);
+	if (rc)
+		return (rc == RDB_NOTFOUND && rdonly) ? RDB_SUCCESS : rc;
+
+	txn->mt_dbxs[dbi].md_bloom = b;
+	if (!rdonly) {
+		RDB_cursor bc;
+		/* Refresh a stale record before looking at it */
+		rdb_cursor_init(&bc, txn, b, NULL);
+		if (!txn->mt_dbs[b].md_entries)
+			rc = rdb_bloom_init(txn, dbi, 0);
+	}
+	return rc;
+}
+
+/** Add a key to the Bloom filter of a DB before writing it, if the
+ *	DB has one. The DB's record decides, not this process's handle:
+ *	another process may have added the filter since the DB was opened
+ *	here, and then it's opened now.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_bloom_put(RDB_txn *txn, RDB_dbi dbi, RDB_val *key)
+{
+	int rc;
+
+	if (txn->mt_dbflags[dbi] & DB_STALE) {
+		RDB_cursor mc;
+		RDB_xcursor mx;
+		rdb_cursor_init(&mc, txn, dbi, &mx);
+	}
+	if (!(txn->mt_dbs[dbi].md_flags & RDB_BLOOM))
+		return RDB_SUCCESS;
+	if (!rdb_bloom_dbi(txn, dbi) && (rc = rdb_bloom_open(txn, dbi)) != RDB_SUCCESS)
+		return rc;
+	return rdb_bloom_add(txn, dbi, key);
+}
+
+int
+rdb_bloom_rebuild(RDB_txn *txn, RDB_dbi dbi, size_t nkeys)
+{
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & (RDB_TXN_RDONLY|RDB_TXN_BLOCKED))
+		return (txn->mt_flags & RDB_TXN_RDONLY) ? EACCES : RDB_BAD_TXN;
+
+	if (!(txn->mt_dbs[dbi].md_flags & RDB_BLOOM) || !rdb_bloom_dbi(txn, dbi))
+		return RDB_INCOMPATIBLE;
+
+	return rdb_bloom_init(txn, dbi, nkeys);
+}
+/** @} */
+
+/** @defgroup hashed	#RDB_HASHED databases
+ *	A hashed DB is a linear hash table. Its buckets are B+trees of
+ *	their own, usually a single leaf page each, and the number of
+ *	buckets is kept in the DB record's %md_pad. The buckets hang off
+ *	a radix tree of branch pages with keyless nodes, the directory,
+ *	where each digit of a bucket's number picks the node to follow on
+ *	one level. A table of a single bucket has no directory.
+ *
+ *	Whenever a write adds a leaf page to a bucket, the next buckets in
+ *	turn are split, and their items whose hash has the next bit set
+ *	move to new buckets at the end. Buckets are worked on by plain cursors
+ *	whose %mc_db is a stand-in record for the bucket's tree, so pages
+ *	are split, merged and copied on write as in any other DB.
+ *	@{
+ */
+	/** The number of buckets of a hashed DB */
+#define HASH_NBUCKETS(db)	((db)->md_pad)
+	/** Most buckets a table is split into */
+#define HASH_MAXBUCKETS	0x80000000U
+	/** Buckets split for each leaf page a write adds. The buckets
+	 *	not yet split in a round hold twice the items of the others,
+	 *	and with one split per leaf about 40% of lookups ended up in
+	 *	buckets of two levels. With three it's about 5%, for the same
+	 *	number of leaves.
+	 */
+#define HASH_SPLITS	3
+
+	/** A cursor on one bucket of a hashed DB */
+typedef struct RDB_hbucket {
+	RDB_cursor	hb_mc;		/**< the cursor, on #hb_db */
+	/** The bucket's tree. Its counters start at zero, and
+	 *	#rdb_hash_bcount() adds them to the DB's.
+	 */
+	RDB_db		hb_db;
+	size_t		hb_num;		/**< the bucket's number */
+	pgno_t		hb_root;	/**< the bucket's root in the directory */
+} RDB_hbucket;
+
+static int	rdb_cursor_touch(RDB_cursor *mc);
+
+/** Return the bucket a hash falls in, in a table of \b n buckets. */
+static size_t
+rdb_hash_bucket(uint64_t h, size_t n)
+{
+	size_t mask = 1, b;
+
+	while (mask < n)
+		mask <<= 1;
+	b = h & (mask - 1);
+	/* The upper half of this round isn't all split off yet */
+	if (b >= n)
+		b &= (mask >> 1) - 1;
+	return b;
+}
+
+/** Return the number of directory levels of a table of \b n buckets. */
+static unsigned int
+rdb_hash_depth(RDB_env *env, size_t n)
+{
+	unsigned int d = 0;
+
+	for (n = n > 1 ? n - 1 : 0; n; n >>= env->me_hashbits)
+		d++;
+	return d;
+}
+
+/** Return the number of directory pages of a table of \b n buckets. */
+static size_t
+rdb_hash_dirpages(RDB_env *env, size_t n)
+{
+	size_t total = 0;
+	unsigned int d = rdb_hash_depth(env, n);
+
+	for (; d; d--) {
+		n = (n + ((size_t)1 << env->me_hashbits) - 1) >> env->me_hashbits;
+		total += n;
+	}
+	return total;
+}
+
+/** Push the directory pages above a bucket on a cursor's stack.
+ *	The top page's index is left on the bucket's node.
+ * @param[in,out] mc A cursor on a hashed DB.
+ * @param[in] b The bucket.
+ * @param[out] pgno Set to the bucket's root page.
+ * @return 0 on success, #RDB_NOTFOUND if the table is empty,
+ * non-zero on failure.
+ */
+static int
+rdb_hash_dir(RDB_cursor *mc, size_t b, pgno_t *pgno)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp;
+	unsigned int i, mask = (1U << env->me_hashbits) - 1;
+	indx_t x;
+	int rc;
+
+	if ((rc = rdb_page_search(mc, NULL, RDB_PS_ROOTONLY)) != 0)
+		return rc;
+	if (!(i = rdb_hash_depth(env, HASH_NBUCKETS(mc->mc_db)))) {
+		mc->mc_snum = 0;
+		*pgno = mc->mc_db->md_root;
+		return RDB_SUCCESS;
+	}
+	for (;;) {
+		mp = mc->mc_pg[mc->mc_top];
+		x = (b >> (--i * env->me_hashbits)) & mask;
+		if (!IS_BRANCH(mp) || x >= NUMKEYS(mp)) {
+			mc->mc_txn->mt_flags |= RDB_TXN_ERROR;
+			return RDB_CORRUPTED;
+		}
+		mc->mc_ki[mc->mc_top] = x;
+		*pgno = NODEPGNO(NODEPTR(mp, x));
+		if (!i)
+			return RDB_SUCCESS;
+		if ((rc = rdb_page_get(mc, *pgno, &mp, NULL)) != 0 ||
+			(rc = rdb_cursor_push(mc, mp)) != 0)
+			return rc;
+	}
+}
+
+/** Set up a cursor on a bucket of a hashed DB.
+ * @param[in] txn A transaction handle.
+ * @param[in] dbi A hashed DB.
+ * @param[in] b The bucket.
+ * @param[in] root The bucket's root page, or #P_INVALID for a new tree.
+ * @param[out] hb The bucket's cursor.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_hash_binit(RDB_txn *txn, RDB_dbi dbi, size_t b, pgno_t root,
+	RDB_hbucket *hb)
+{
+	RDB_page *mp;
+	int rc;
+
+	hb->hb_db.md_pad = 0;
+	hb->hb_db.md_flags = txn->mt_dbs[dbi].md_flags & ~RDB_HASHED;
+	hb->hb_db.md_depth = 0;
+	hb->hb_db.md_branch_pages = 0;
+	hb->hb_db.md_leaf_pages = 0;
+	hb->hb_db.md_overflow_pages = 0;
+	hb->hb_db.md_entries = 0;
+	hb->hb_db.md_root = root;
+	hb->hb_num = b;
+	hb->hb_root = root;
+	rdb_cursor_init(&hb->hb_mc, txn, dbi, NULL);
+	hb->hb_mc.mc_db = &hb->hb_db;
+
+	/* Splits and merges rely on the tree's depth */
+	while (root != P_INVALID) {
+		hb->hb_db.md_depth++;
+		if ((rc = rdb_page_get(&hb->hb_mc, root, &mp, NULL)) != 0)
+			return rc;
+		root = IS_BRANCH(mp) ? NODEPGNO(NODEPTR(mp, 0)) : P_INVALID;
+	}
+	return RDB_SUCCESS;
+}
+
+/** Set up a cursor on the bucket of a key in a hashed DB.
+ *	In an empty table this is a new tree, for the first bucket.
+ */
+static int
+rdb_hash_bopen(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_hbucket *hb)
+{
+	RDB_cursor mc;
+	pgno_t root = P_INVALID;
+	size_t b = 0;
+	int rc;
+
+	rdb_cursor_init(&mc, txn, dbi, NULL);
+	if (HASH_NBUCKETS(mc.mc_db)) {
+		b = rdb_hash_bucket(rdb_key_hash(key), HASH_NBUCKETS(mc.mc_db));
+		if ((rc = rdb_hash_dir(&mc, b, &root)) != 0)
+			return rc;
+	}
+	return rdb_hash_binit(txn, dbi, b, root, hb);
+}
+
+/** Add the changes to a bucket's counters to its DB's.
+ *	A bucket whose tree was emptied gets a new empty leaf,
+ *	so that every node of the directory has a page.
+ */
+static int
+rdb_hash_bcount(RDB_hbucket *hb)
+{
+	RDB_cursor *mc = &hb->hb_mc;
+	RDB_db *db = &mc->mc_txn->mt_dbs[mc->mc_dbi];
+	RDB_page *np;
+	int rc;
+
+	if (hb->hb_db.md_root == P_INVALID) {
+		/* #rdb_rebalance() zeroed the count, instead of taking
+		 * off the one leaf it freed.
+		 */
+		if (hb->hb_root != P_INVALID)
+			hb->hb_db.md_leaf_pages = (pgno_t)-1;
+		if ((rc = rdb_page_new(mc, P_LEAF, 1, &np)) != 0)
+			return rc;
+		hb->hb_db.md_root = np->mp_pgno;
+		hb->hb_db.md_depth = 1;
+	}
+	db->md_branch_pages += hb->hb_db.md_branch_pages;
+	db->md_leaf_pages += hb->hb_db.md_leaf_pages;
+	db->md_overflow_pages += hb->hb_db.md_overflow_pages;
+	db->md_entries += hb->hb_db.md_entries;
+	hb->hb_db.md_branch_pages = 0;
+	hb->hb_db.md_leaf_pages = 0;
+	hb->hb_db.md_overflow_pages = 0;
+	hb->hb_db.md_entries = 0;
+	return RDB_SUCCESS;
+}
+
+/** Store the root page of a bucket in the directory of a hashed DB.
+ * @param[in] mc A fresh cursor on the DB.
+ * @param[in] b The bucket.
+ * @param[in] pgno The bucket's root page.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_hash_setroot(RDB_cursor *mc, size_t b, pgno_t pgno)
+{
+	RDB_db *db = mc->mc_db;
+	pgno_t old;
+	int rc;
+
+	if (!HASH_NBUCKETS(db)) {
+		/* The first bucket of the table */
+		HASH_NBUCKETS(db) = 1;
+		db->md_depth = 1;
+		db->md_root = pgno;
+		*mc->mc_dbflag |= DB_DIRTY;
+		return RDB_SUCCESS;
+	}
+	if ((rc = rdb_page_spill(mc, NULL, NULL)) != 0 ||
+		(rc = rdb_hash_dir(mc, b, &old)) != 0 ||
+		(rc = rdb_cursor_touch(mc)) != 0)
+		return rc;
+	if (mc->mc_snum)
+		SETPGNO(NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]), pgno);
+	else
+		db->md_root = pgno;
+	return RDB_SUCCESS;
+}
+
+/** Finish a write to a bucket of a hashed DB. */
+static int
+rdb_hash_bdone(RDB_hbucket *hb)
+{
+	RDB_cursor mc;
+	int rc;
+
+	if ((rc = rdb_hash_bcount(hb)) != 0 ||
+		hb->hb_db.md_root == hb->hb_root)
+		return rc;
+	rdb_cursor_init(&mc, hb->hb_mc.mc_txn, hb->hb_mc.mc_dbi, NULL);
+	if ((rc = rdb_hash_setroot(&mc, hb->hb_num, hb->hb_db.md_root)) == 0)
+		hb->hb_root = hb->hb_db.md_root;
+	return rc;
+}
+
+/** Add a bucket at the end of the directory of a hashed DB,
+ *	adding a level on top if the directory is full.
+ * @param[in] mc A fresh cursor on the DB.
+ * @param[in] pgno The new bucket's root page.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_hash_grow(RDB_cursor *mc, pgno_t pgno)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_db *db = mc->mc_db;
+	RDB_page *mp, *np = NULL;
+	size_t n = HASH_NBUCKETS(db);
+	unsigned int i, d = rdb_hash_depth(env, n + 1);
+	unsigned int mask = (1U << env->me_hashbits) - 1;
+	indx_t x;
+	int rc;
+
+	if ((rc = rdb_page_spill(mc, NULL, NULL)) != 0)
+		return rc;
+	if (d > rdb_hash_depth(env, n)) {
+		/* The directory is full, the old one becomes the first child */
+		if ((rc = rdb_cursor_touch(mc)) != 0 ||
+			(rc = rdb_page_new(mc, P_BRANCH, 1, &np)) != 0 ||
+			(rc = rdb_cursor_push(mc, np)) != 0 ||
+			(rc = rdb_node_add(mc, 0, NULL, NULL, db->md_root, 0)) != 0)
+			return rc;
+		db->md_root = np->mp_pgno;
+	} else if ((rc = rdb_page_search(mc, NULL, RDB_PS_ROOTONLY)) != 0 ||
+		(rc = rdb_cursor_touch(mc)) != 0) {
+		return rc;
+	}
+
+	for (i = d; i--; ) {
+		mp = mc->mc_pg[mc->mc_top];
+		x = (n >> (i * env->me_hashbits)) & mask;
+		mc->mc_ki[mc->mc_top] = x;
+		if (i && x < NUMKEYS(mp)) {
+			if ((rc = rdb_page_get(mc, NODEPGNO(NODEPTR(mp, x)), &np, NULL)) != 0 ||
+				(rc = rdb_cursor_push(mc, np)) != 0 ||
+				(rc = rdb_page_touch(mc)) != 0)
+				return rc;
+			continue;
+		}
+		if (x != NUMKEYS(mp)) {
+			mc->mc_txn->mt_flags |= RDB_TXN_ERROR;
+			return RDB_CORRUPTED;
+		}
+		/* The rest of the path is new */
+		if (i && (rc = rdb_page_new(mc, P_BRANCH, 1, &np)) != 0)
+			return rc;
+		if ((rc = rdb_node_add(mc, x, NULL, NULL, i ? np->mp_pgno : pgno, 0)) != 0)
+			return rc;
+		if (i && (rc = rdb_cursor_push(mc, np)) != 0)
+			return rc;
+	}
+	HASH_NBUCKETS(db) = n + 1;
+	db->md_depth = d + 1;
+	return RDB_SUCCESS;
+}
+
+/** Free the pages of a tree of a hashed DB, its directory or a bucket.
+ * @param[in] mc A cursor on the tree's DB, whose counters are updated.
+ * @param[in] pgno The tree's root page.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_hash_free(RDB_cursor *mc, pgno_t pgno)
+{
+	RDB_txn *txn = mc->mc_txn;
+	RDB_page *mp, *omp;
+	RDB_node *ni;
+	pgno_t pg;
+	unsigned int i, n;
+	int rc;
+
+	if (pgno == P_INVALID)
+		return RDB_SUCCESS;
+	if ((rc = rdb_page_get(mc, pgno, &mp, NULL)) != 0)
+		return rc;
+	n = NUMKEYS(mp);
+	for (i = 0; i < n; i++) {
+		ni = NODEPTR(mp, i);
+		if (IS_BRANCH(mp)) {
+			if ((rc = rdb_hash_free(mc, NODEPGNO(ni))) != 0)
+				return rc;
+		} else if (ni->mn_flags & F_BIGDATA) {
+			memcpy(&pg, NODEDATA(ni), sizeof(pg));
+			if ((rc = rdb_page_get(mc, pg, &omp, NULL)) != 0 ||
+				(rc = rdb_ridl_append_range(&txn->mt_free_pgs,
+					pg, omp->mp_pages)) != 0)
+				return rc;
+			mc->mc_db->md_overflow_pages -= omp->mp_pages;
+		}
+	}
+	if (IS_BRANCH(mp)) {
+		mc->mc_db->md_branch_pages--;
+	} else {
+		mc->mc_db->md_leaf_pages--;
+		mc->mc_db->md_entries -= n;
+	}
+	return rdb_ridl_append(&txn->mt_free_pgs, pgno);
+}
+
+/** Unposition the cursors of a hashed DB, before a write moves its items. */
+static void
+rdb_hash_reset(RDB_txn *txn, RDB_dbi dbi)
+{
+	RDB_cursor *m2;
+
+	for (m2 = txn->mt_cursors[dbi]; m2; m2 = m2->mc_next) {
+		m2->mc_flags &= ~(C_INITIALIZED|C_EOF|C_DEL);
+		m2->mc_snum = 0;
+		m2->mc_top = 0;
+		m2->mc_pg[0] = NULL;
+	}
+}
+
+/** Split the next bucket of a hashed DB.
+ *	Its items are copied to two new trees in key order, the one
+ *	for a new bucket at the end taking those whose hash has the
+ *	bit of this round of splits set.
+ * @param[in] txn A transaction handle.
+ * @param[in] dbi A hashed DB.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_hash_split(RDB_txn *txn, RDB_dbi dbi)
+{
+	RDB_hbucket hb[3];	/* the bucket, and its two halves */
+	RDB_cursor mc, *list = txn->mt_cursors[dbi];
+	RDB_page *mp;
+	RDB_val key, data;
+	size_t n = HASH_NBUCKETS(&txn->mt_dbs[dbi]), half, s;
+	pgno_t root;
+	int i, rc;
+
+	if (n >= HASH_MAXBUCKETS)
+		return RDB_SUCCESS;
+	for (half = 1; half << 1 <= n; half <<= 1)
+		;
+	s = n - half;
+	rdb_cursor_init(&mc, txn, dbi, NULL);
+	if ((rc = rdb_hash_dir(&mc, s, &root)) != 0 ||
+		(rc = rdb_hash_binit(txn, dbi, s, root, &hb[0])) != 0 ||
+		(rc = rdb_hash_binit(txn, dbi, s, P_INVALID, &hb[1])) != 0 ||
+		(rc = rdb_hash_binit(txn, dbi, n, P_INVALID, &hb[2])) != 0 ||
+		(rc = rdb_page_get(&hb[0].hb_mc, root, &mp, NULL)) != 0)
+		goto fail;
+
+	/* Track the three, so that spilling leaves their pages alone */
+	for (i = 0; i < 3; i++) {
+		hb[i].hb_mc.mc_next = txn->mt_cursors[dbi];
+		txn->mt_cursors[dbi] = &hb[i].hb_mc;
+	}
+	rc = NUMKEYS(mp) ? rdb_cursor_first(&hb[0].hb_mc, &key, &data) : RDB_NOTFOUND;
+	while (rc == RDB_SUCCESS) {
+		i = (rdb_key_hash(&key) & half) ? 2 : 1;
+		rc = _rdb_cursor_put(&hb[i].hb_mc, &key, &data, RDB_APPEND);
+		if (rc == RDB_SUCCESS)
+			rc = rdb_cursor_next(&hb[0].hb_mc, &key, &data, RDB_NEXT);
+	}
+	txn->mt_cursors[dbi] = list;
+	if (rc != RDB_NOTFOUND ||
+		(rc = rdb_hash_free(&hb[0].hb_mc, root)) != 0)
+		goto fail;
+
+	for (i = 0; i < 3; i++)
+		if ((rc = rdb_hash_bcount(&hb[i])) != 0)
+			goto fail;
+	rdb_cursor_init(&mc, txn, dbi, NULL);
+	if ((rc = rdb_hash_setroot(&mc, s, hb[1].hb_db.md_root)) != 0)
+		goto fail;
+	rdb_cursor_init(&mc, txn, dbi, NULL);
+	if ((rc = rdb_hash_grow(&mc, hb[2].hb_db.md_root)) == 0)
+		return RDB_SUCCESS;
+
+fail:
+	txn->mt_flags |= RDB_TXN_ERROR;
+	return rc;
+}
+
+/** Find a key in a hashed DB.
+ *	On a miss in a bucket, the cursor is left where the key would go.
+ * @param[in,out] mc A cursor on the DB.
+ * @param[in] key The key to look up.
+ * @param[out] data The key's data, if not NULL.
+ * @return 0 on success, #RDB_NOTFOUND if the key is absent,
+ * non-zero on failure.
+ */
+static int
+rdb_hash_seek(RDB_cursor *mc, RDB_val *key, RDB_val *data)
+{
+	RDB_node *leaf;
+	RDB_page *mp;
+	pgno_t pgno;
+	int exact = 0, rc;
+
+	if (key->mv_size == 0 || key->mv_size > ENV_MAXKEY(mc->mc_txn->mt_env))
+		return RDB_BAD_VALSIZE;
+	mc->mc_flags &= ~(C_INITIALIZED|C_EOF|C_DEL);
+	if (!HASH_NBUCKETS(mc->mc_db))
+		return RDB_NOTFOUND;
+	if ((rc = rdb_hash_dir(mc,
+			rdb_hash_bucket(rdb_key_hash(key), HASH_NBUCKETS(mc->mc_db)), &pgno)) != 0 ||
+		(rc = rdb_page_get(mc, pgno, &mp, NULL)) != 0 ||
+		(rc = rdb_cursor_push(mc, mp)) != 0 ||
+		(rc = rdb_page_search_root(mc, key, 0)) != 0)
+		return rc;
+	leaf = rdb_node_search(mc, key, &exact);
+	if (!leaf || !exact) {
+		mc->mc_flags &= ~C_INITIALIZED;
+		return RDB_NOTFOUND;
+	}
+	return data ? rdb_node_read(mc, leaf, data) : RDB_SUCCESS;
+}
+
+/** Store an item in a hashed DB, splitting a bucket if it grew a page.
+ *	The arguments are as for #rdb_put().
+ */
+static int
+rdb_hash_put(RDB_txn *txn, RDB_dbi dbi, RDB_val *key, RDB_val *data,
+	unsigned int flags)
+{
+	RDB_hbucket hb;
+	RDB_cursor mc;
+	pgno_t leaves;
+	int i, rc;
+
+	if ((rc = rdb_hash_bopen(txn, dbi, key, &hb)) != 0)
+		return rc;
+	rdb_hash_reset(txn, dbi);
+	hb.hb_mc.mc_next = txn->mt_cursors[dbi];
+	txn->mt_cursors[dbi] = &hb.hb_mc;
+	rc = _rdb_cursor_put(&hb.hb_mc, key, data,
+		flags & ~(RDB_APPEND|RDB_APPENDDUP));
+	txn->mt_cursors[dbi] = hb.hb_mc.mc_next;
+	if (rc)
+		return rc;
+
+	/* A new table's first leaf is no reason to split */
+	leaves = hb.hb_root != P_INVALID ? hb.hb_db.md_leaf_pages : 0;
+	if ((rc = rdb_hash_bdone(&hb)) == 0 && leaves) {
+		for (i = 0; i < HASH_SPLITS && rc == RDB_SUCCESS; i++)
+			rc = rdb_hash_split(txn, dbi);
+		if (rc == RDB_SUCCESS && (flags & RDB_RESERVE)) {
+			/* The reserved space may have moved */
+			rdb_cursor_init(&mc, txn, dbi, NULL);
+			rc = rdb_hash_seek(&mc, key, data);
+		}
+	}
+	if (rc)
+		txn->mt_flags |= RDB_TXN_ERROR;
+	return rc;
+}
+
+/** Delete a key from a hashed DB. */
+static int
+rdb_hash_del(RDB_txn *txn, RDB_dbi dbi, RDB_val *key)
+{
+	RDB_hbucket hb;
+	int exact = 0, rc;
+
+	if ((rc = rdb_hash_bopen(txn, dbi, key, &hb)) != 0)
+		return rc;
+	if (hb.hb_root == P_INVALID)
+		return RDB_NOTFOUND;
+	if ((rc = rdb_cursor_set(&hb.hb_mc, key, NULL, RDB_SET, &exact)) != 0)
+		return rc;
+	rdb_hash_reset(txn, dbi);
+	hb.hb_mc.mc_next = txn->mt_cursors[dbi];
+	txn->mt_cursors[dbi] = &hb.hb_mc;
+	rc = _rdb_cursor_del(&hb.hb_mc, 0);
+	txn->mt_cursors[dbi] = hb.hb_mc.mc_next;
+	if (rc == RDB_SUCCESS && (rc = rdb_hash_bdone(&hb)) != 0)
+		txn->mt_flags |= RDB_TXN_ERROR;
+	return rc;
+}
+
+/** Move a cursor on a hashed DB to the next item at or after
+ *	its position, across the directory and buckets.
+ */
+static int
+rdb_hash_walk(RDB_cursor *mc)
+{
+	RDB_page *mp;
+	int rc;
+
+	for (;;) {
+		mp = mc->mc_pg[mc->mc_top];
+		if (mc->mc_ki[mc->mc_top] >= NUMKEYS(mp)) {
+			if (!mc->mc_top) {
+				mc->mc_flags |= C_INITIALIZED|C_EOF;
+				return RDB_NOTFOUND;
+			}
+			rdb_cursor_pop(mc);
+			mc->mc_ki[mc->mc_top]++;
+		} else if (IS_LEAF(mp)) {
+			mc->mc_flags |= C_INITIALIZED;
+			mc->mc_flags &= ~C_EOF;
+			return RDB_SUCCESS;
+		} else if ((rc = rdb_page_get(mc,
+				NODEPGNO(NODEPTR(mp, mc->mc_ki[mc->mc_top])), &mp, NULL)) != 0 ||
+			(rc = rdb_cursor_push(mc, mp)) != 0) {
+			return rc;
+		}
+	}
+}
+
+/** #rdb_cursor_get() for a hashed DB. */
+static int
+rdb_hash_cursor_get(RDB_cursor *mc, RDB_val *key, RDB_val *data,
+	RDB_cursor_op op)
+{
+	RDB_page *mp;
+	RDB_node *leaf;
+	int rc;
+
+	switch (op) {
+	case RDB_GET_CURRENT:
+		if (!(mc->mc_flags & C_INITIALIZED))
+			return EINVAL;
+		break;
+	case RDB_SET:
+	case RDB_SET_KEY:
+		if (key == NULL)
+			return EINVAL;
+		if (!rdb_bloom_check(mc->mc_txn, mc->mc_dbi, key)) {
+			mc->mc_flags &= ~(C_INITIALIZED|C_EOF|C_DEL);
+			return RDB_NOTFOUND;
+		}
+		if ((rc = rdb_hash_seek(mc, key, NULL)) != 0)
+			return rc;
+		if (op == RDB_SET)
+			key = NULL;
+		break;
+	case RDB_FIRST:
+		mc->mc_flags &= ~(C_INITIALIZED|C_EOF|C_DEL);
+		if ((rc = rdb_page_search(mc, NULL, RDB_PS_ROOTONLY)) != 0)
+			return rc;
+		mc->mc_ki[0] = 0;
+		if ((rc = rdb_hash_walk(mc)) != 0)
+			return rc;
+		break;
+	case RDB_NEXT:
+	case RDB_NEXT_NODUP:
+		if (!(mc->mc_flags & C_INITIALIZED))
+			return rdb_hash_cursor_get(mc, key, data, RDB_FIRST);
+		if (mc->mc_flags & C_EOF)
+			return RDB_NOTFOUND;
+		/* After a delete the cursor is on the next item already */
+		if (mc->mc_flags & C_DEL)
+			mc->mc_flags ^= C_DEL;
+		else
+			mc->mc_ki[mc->mc_top]++;
+		if ((rc = rdb_hash_walk(mc)) != 0)
+			return rc;
+		break;
+	default:
+		DPRINTF(("unhandled/unimplemented cursor operation %u on hashed DB", op));
+		return RDB_INCOMPATIBLE;
+	}
+
+	mp = mc->mc_pg[mc->mc_top];
+	if (mc->mc_ki[mc->mc_top] >= NUMKEYS(mp))
+		return RDB_NOTFOUND;
+	leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
+	RDB_GET_KEY(leaf, key);
+	return data ? rdb_node_read(mc, leaf, data) : RDB_SUCCESS;
 }
 
-/** Return the data associated with a given node.
- * @param[in] mc The cursor for this operation.
- * @param[in] leaf The node being read.
- * @param[out] data Updated to point to the node's data.
- * @return 0 on success, non-zero on failure.
+/** Copy the key under a cursor on a hashed DB, which a write may move.
+ *	The copy must be freed with free().
  */
 static int
-rdb_node_read(RDB_cursor *mc, RDB_node *leaf, RDB_val *data)
+rdb_hash_curkey(RDB_cursor *mc, RDB_val *key)
 {
-	RDB_page	*omp;		/* overflow page */
-	pgno_t		 pgno;
+	RDB_page *mp;
+	RDB_node *leaf;
+
+	if (!(mc->mc_flags & C_INITIALIZED))
+		return EINVAL;
+	mp = mc->mc_pg[mc->mc_top];
+	if (mc->mc_ki[mc->mc_top] >= NUMKEYS(mp))
+		return RDB_NOTFOUND;
+	leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
+	if ((key->mv_data = malloc(NODEKSZ(leaf))) == NULL)
+		return ENOMEM;
+	key->mv_size = NODEKSZ(leaf);
+	memcpy(key->mv_data, NODEKEY(leaf), key->mv_size);
+	return RDB_SUCCESS;
+}
+
+/** #rdb_cursor_put() for a hashed DB. The cursor is left on the item. */
+static int
+rdb_hash_cursor_put(RDB_cursor *mc, RDB_val *key, RDB_val *data,
+	unsigned int flags)
+{
+	RDB_txn *txn = mc->mc_txn;
+	RDB_val kcopy;
 	int rc;
 
-	if (!F_ISSET(leaf->mn_flags, F_BIGDATA)) {
-		data->mv_size = NODEDSZ(leaf);
-		data->mv_data = NODEDATA(leaf);
-		return RDB_SUCCESS;
+	if (txn->mt_flags & (RDB_TXN_RDONLY|RDB_TXN_BLOCKED))
+		return (txn->mt_flags & RDB_TXN_RDONLY) ? EACCES : RDB_BAD_TXN;
+	if (data == NULL)
+		return EINVAL;
+	kcopy.mv_data = NULL;
+	if (flags & RDB_CURRENT) {
+		if ((rc = rdb_hash_curkey(mc, &kcopy)) != 0)
+			return rc;
+		key = &kcopy;
+		flags &= ~RDB_CURRENT;
+	} else if (key == NULL) {
+		return EINVAL;
 	}
+	rc = rdb_hash_put(txn, mc->mc_dbi, key, data, flags);
+	if (rc == RDB_SUCCESS || rc == RDB_KEYEXIST) {
+		int rc2 = rdb_hash_seek(mc, key, NULL);
+		if (rc2)
+			rc = rc2;
+	}
+	free(kcopy.mv_data);
+	return rc;
+}
 
-	/* Read overflow data.
-	 */
-	data->mv_size = NODEDSZ(leaf);
-	memcpy(&pgno, NODEDATA(leaf), sizeof(pgno));
-	if ((rc = rdb_page_get(mc, pgno, &omp, NULL)) != 0) {
-		DPRINTF(("read overflow page %"Z"u failed", pgno));
+/** #rdb_cursor_del() for a hashed DB. Like other cursors, the
+ *	cursor then steps with #RDB_NEXT to the item after the deleted one.
+ */
+static int
+rdb_hash_cursor_del(RDB_cursor *mc)
+{
+	RDB_txn *txn = mc->mc_txn;
+	RDB_val key;
+	int rc;
+
+	if (txn->mt_flags & (RDB_TXN_RDONLY|RDB_TXN_BLOCKED))
+		return (txn->mt_flags & RDB_TXN_RDONLY) ? EACCES : RDB_BAD_TXN;
+	if ((rc = rdb_hash_curkey(mc, &key)) != 0)
 		return rc;
+	rc = rdb_hash_del(txn, mc->mc_dbi, &key);
+	if (rc == RDB_SUCCESS) {
+		rc = rdb_hash_seek(mc, &key, NULL);
+		if (rc == RDB_NOTFOUND) {
+			mc->mc_flags |= C_INITIALIZED|C_DEL;
+			rc = RDB_SUCCESS;
+		} else if (rc == RDB_SUCCESS) {
+			rc = RDB_CORRUPTED;
+		}
 	}
-	data->mv_data = METADATA(omp);
-
-	return RDB_SUCCESS;
+	free(key.mv_data);
+	return rc;
 }
+/** @} */
 
 int
 rdb_get(RDB_txn *txn, RDB_dbi dbi,
@@ -6167,10 +9528,168 @@ rdb_get(RDB_txn *txn, RDB_dbi dbi,
 	if (txn->mt_flags & RDB_TXN_BLOCKED)
 		return RDB_BAD_TXN;
 
+	if (!rdb_bloom_check(txn, dbi, key))
+		return RDB_NOTFOUND;
+
+	if (txn->mt_dbs[dbi].md_flags & RDB_HASHED) {
+		rdb_cursor_init(&mc, txn, dbi, NULL);
+		return rdb_hash_seek(&mc, key, data);
+	}
 	rdb_cursor_init(&mc, txn, dbi, &mx);
 	return rdb_cursor_set(&mc, key, data, RDB_SET, &exact);
 }
 
+	/** How many keys #rdb_get_batch() descends the tree with at once */
+#define RDB_BATCH_GROUP	8
+
+/** Sort the indices of a batch of keys, stably.
+ * @param[in] cmp the key comparison function.
+ * @param[in] keys the keys.
+ * @param[in,out] idx the indices of the keys to sort.
+ * @param[in] tmp scratch space for \b n indices.
+ * @param[in] n the number of indices.
+ */
+static void
+rdb_batch_sort(RDB_cmp_func *cmp, RDB_val *keys, unsigned int *idx,
+	unsigned int *tmp, unsigned int n)
+{
+	unsigned int w, lo, mid, hi, a, b, k;
+
+	/* Bottom-up merge sort, keys usually arrive partly sorted */
+	for (w = 1; w < n; w <<= 1) {
+		for (lo = 0; lo < n - w; lo += w << 1) {
+			mid = lo + w;
+			hi = mid + w < n ? mid + w : n;
+			if (cmp(&keys[idx[mid-1]], &keys[idx[mid]]) <= 0)
+				continue;
+			for (a = lo, b = mid, k = lo; k < hi; k++) {
+				if (a < mid && (b >= hi || cmp(&keys[idx[a]], &keys[idx[b]]) <= 0))
+					tmp[k] = idx[a++];
+				else
+					tmp[k] = idx[b++];
+			}
+			memcpy(idx + lo, tmp + lo, (hi - lo) * sizeof(unsigned int));
+		}
+	}
+}
+
+int
+rdb_get_batch(RDB_txn *txn, RDB_dbi dbi, RDB_val *keys, RDB_val *vals,
+	int *rcs, unsigned int n)
+{
+	RDB_cursor	mc, fc, gc[RDB_BATCH_GROUP];
+	RDB_xcursor	mx;
+	RDB_val	*key;
+	unsigned int i, j, g, gn, m, c, *idx, sbuf[2*64];
+	int exact, more, rc;
+
+	DPRINTF(("===> get batch db %u, %u keys", dbi, n));
+
+	if (!n)
+		return RDB_SUCCESS;
+	if (!keys || !vals || !rcs || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & RDB_TXN_BLOCKED)
+		return RDB_BAD_TXN;
+
+	if (n <= 64) {
+		idx = sbuf;
+	} else if ((idx = malloc(2 * n * sizeof(unsigned int))) == NULL) {
+		return ENOMEM;
+	}
+
+	/* Leave out keys the comparators can't handle,
+	 * and those the Bloom filter says are absent.
+	 */
+	for (i = 0, m = 0; i < n; i++) {
+		if (keys[i].mv_size == 0 || keys[i].mv_size > ENV_MAXKEY(txn->mt_env))
+			rcs[i] = RDB_BAD_VALSIZE;
+		else if (!rdb_bloom_check(txn, dbi, &keys[i]))
+			rcs[i] = RDB_NOTFOUND;
+		else
+			idx[m++] = i;
+	}
+	rdb_cursor_init(&mc, txn, dbi, &mx);
+	if (mc.mc_db->md_flags & RDB_HASHED) {
+		/* Each key is a bucket of its own, nothing to share */
+		for (i = 0; i < m; i++)
+			rcs[idx[i]] = rdb_hash_seek(&mc, &keys[idx[i]], &vals[idx[i]]);
+		if (idx != sbuf)
+			free(idx);
+		return RDB_SUCCESS;
+	}
+	/* The group cursors only walk the main tree */
+	fc = mc;
+	fc.mc_xcursor = NULL;
+	for (g = 0; g < RDB_BATCH_GROUP; g++)
+		gc[g] = fc;
+	rdb_batch_sort(mc.mc_dbx->md_cmp, keys, idx, idx + n, m);
+
+	for (i = 0; i < m; i += gn) {
+		gn = m - i < RDB_BATCH_GROUP ? m - i : RDB_BATCH_GROUP;
+
+		/* Each search starts from the lowest page it shares
+		 * with the last search of the previous group.
+		 */
+		for (g = 0; g < gn; g++) {
+			j = idx[i + g];
+			if (fc.mc_flags & C_INITIALIZED) {
+				rdb_cursor_copy(&fc, &gc[g]);
+				c = rdb_finger_level(&gc[g], &keys[j]);
+				gc[g].mc_top = c;
+				gc[g].mc_snum = c + 1;
+				rcs[j] = RDB_SUCCESS;
+			} else {
+				rcs[j] = rdb_page_search(&gc[g], &keys[j], RDB_PS_ROOTONLY);
+			}
+		}
+
+		/* Descend the whole group a level at a time. Each step
+		 * prefetches its child page, so the group's cache and TLB
+		 * misses overlap.
+		 */
+		do {
+			more = 0;
+			for (g = 0; g < gn; g++) {
+				j = idx[i + g];
+				if (rcs[j] || !IS_BRANCH(gc[g].mc_pg[gc[g].mc_top]))
+					continue;
+				rc = rdb_page_search_root(&gc[g], &keys[j], RDB_PS_STEP);
+				if (rc) {
+					rcs[j] = rc;
+					continue;
+				}
+				more = 1;
+			}
+		} while (more);
+
+		for (g = 0; g < gn; g++) {
+			j = idx[i + g];
+			if (rcs[j])
+				continue;
+			key = &keys[j];
+			if (!IS_LEAF(gc[g].mc_pg[gc[g].mc_top])) {
+				txn->mt_flags |= RDB_TXN_ERROR;
+				rcs[j] = RDB_CORRUPTED;
+				continue;
+			}
+			rdb_cursor_copy(&gc[g], &mc);
+			mc.mc_flags |= C_INITIALIZED|C_FINGER;
+			exact = 0;
+			rcs[j] = rdb_cursor_set(&mc, key, &vals[j], RDB_SET, &exact);
+			if (rcs[j] == RDB_SUCCESS || rcs[j] == RDB_NOTFOUND) {
+				rdb_cursor_copy(&mc, &fc);
+				fc.mc_flags |= C_INITIALIZED;
+			}
+		}
+	}
+
+	if (idx != sbuf)
+		free(idx);
+	return RDB_SUCCESS;
+}
+
 /** Find a sibling for a page.
  * Replaces the page at the top of the cursor's stack with the
  * specified sibling, if one exists.
@@ -6224,6 +9743,8 @@ rdb_cursor_sibling(RDB_cursor *mc, int move_right)
 	rdb_cursor_push(mc, mp);
 	if (!move_right)
 		mc->mc_ki[mc->mc_top] = NUMKEYS(mp)-1;
+	if ((mc->mc_flags & C_READAHEAD) && IS_LEAF(mp))
+		rdb_cursor_readahead(mc, move_right);
 
 	return RDB_SUCCESS;
 }
@@ -6285,6 +9806,7 @@ rdb_cursor_next(RDB_cursor *mc, RDB_val *key, RDB_val *data, RDB_cursor_op op)
 		DPRINTF(("next page is %"Z"u, key index %u", mp->mp_pgno, mc->mc_ki[mc->mc_top]));
 	} else
 		mc->mc_ki[mc->mc_top]++;
+	rdb_cursor_prefetch(mc, 1);
 
 skip:
 	DPRINTF(("==> cursor points to page %"Z"u with %u keys, key index %u",
@@ -6366,6 +9888,7 @@ rdb_cursor_prev(RDB_cursor *mc, RDB_val *key, RDB_val *data, RDB_cursor_op op)
 		DPRINTF(("prev page is %"Z"u, key index %u", mp->mp_pgno, mc->mc_ki[mc->mc_top]));
 	} else
 		mc->mc_ki[mc->mc_top]--;
+	rdb_cursor_prefetch(mc, 0);
 
 	DPRINTF(("==> cursor points to page %"Z"u with %u keys, key index %u",
 	    rdb_dbg_pgno(mp), NUMKEYS(mp), mc->mc_ki[mc->mc_top]));
@@ -6400,7 +9923,7 @@ static int
 rdb_cursor_set(RDB_cursor *mc, RDB_val *key, RDB_val *data,
     RDB_cursor_op op, int *exactp)
 {
-	int		 rc;
+	int		 rc, resume = 0;
 	RDB_page	*mp;
 	RDB_node	*leaf = NULL;
 	DKBUF;
@@ -6428,6 +9951,8 @@ rdb_cursor_set(RDB_cursor *mc, RDB_val *key, RDB_val *data,
 			RDB_GET_KEY2(leaf, nodekey);
 		}
 		rc = mc->mc_dbx->md_cmp(key, &nodekey);
+		resume = rc > 0 || (rc < 0 && (mc->mc_flags & C_FINGER) &&
+			rdb_finger_start(mc, key));
 		if (rc == 0) {
 			/* Probably happens rarely, but first node on the page
 			 * was the one we wanted.
@@ -6505,7 +10030,13 @@ rdb_cursor_set(RDB_cursor *mc, RDB_val *key, RDB_val *data,
 		mc->mc_pg[0] = 0;
 	}
 
-	rc = rdb_page_search(mc, key, 0);
+	/* Only a key within or past the range of the current leaf can
+	 * resume from the current stack, see #rdb_finger_level().
+	 */
+	if (resume && (mc->mc_flags & C_FINGER))
+		rc = rdb_page_search_finger(mc, key);
+	else
+		rc = rdb_page_search(mc, key, 0);
 	if (rc != RDB_SUCCESS)
 		return rc;
 
@@ -6695,6 +10226,9 @@ rdb_cursor_get(RDB_cursor *mc, RDB_val *key, RDB_val *data,
 	if (mc->mc_txn->mt_flags & RDB_TXN_BLOCKED)
 		return RDB_BAD_TXN;
 
+	if (mc->mc_db->md_flags & RDB_HASHED)
+		return rdb_hash_cursor_get(mc, key, data, op);
+
 	switch (op) {
 	case RDB_GET_CURRENT:
 		if (!(mc->mc_flags & C_INITIALIZED)) {
@@ -6740,11 +10274,25 @@ rdb_cursor_get(RDB_cursor *mc, RDB_val *key, RDB_val *data,
 	case RDB_SET_RANGE:
 		if (key == NULL) {
 			rc = EINVAL;
+		} else if (op != RDB_SET_RANGE &&
+			!rdb_bloom_check(mc->mc_txn, mc->mc_dbi, key)) {
+			/* Surely absent, leave the cursor unpositioned */
+			mc->mc_flags &= ~(C_INITIALIZED|C_EOF);
+			rc = RDB_NOTFOUND;
 		} else {
 			rc = rdb_cursor_set(mc, key, data, op,
 				op == RDB_SET_RANGE ? NULL : &exact);
 		}
 		break;
+	case RDB_SEEK_FORWARD:
+		if (key == NULL) {
+			rc = EINVAL;
+		} else {
+			mc->mc_flags |= C_FINGER;
+			rc = rdb_cursor_set(mc, key, data, RDB_SET_RANGE, NULL);
+			mc->mc_flags &= ~C_FINGER;
+		}
+		break;
 	case RDB_GET_MULTIPLE:
 		if (data == NULL || !(mc->mc_flags & C_INITIALIZED)) {
 			rc = EINVAL;
@@ -7441,7 +10989,15 @@ rdb_cursor_put(RDB_cursor *mc, RDB_val *key, RDB_val *data,
 {
 	DKBUF;
 	DDBUF;
-	int rc = _rdb_cursor_put(mc, key, data, flags);
+	int rc = RDB_SUCCESS;
+	/* Filter first, the put may return pointers into dirty pages */
+	if (mc && key && !(flags & RDB_CURRENT) &&
+		!(mc->mc_txn->mt_flags & (RDB_TXN_RDONLY|RDB_TXN_BLOCKED)))
+		rc = rdb_bloom_put(mc->mc_txn, mc->mc_dbi, key);
+	if (rc == RDB_SUCCESS)
+		rc = (mc->mc_db->md_flags & RDB_HASHED) ?
+			rdb_hash_cursor_put(mc, key, data, flags) :
+			_rdb_cursor_put(mc, key, data, flags);
 	RDB_TRACE(("%p, %"Z"u[%s], %"Z"u%s, %u",
 		mc, key ? key->mv_size:0, DKEY(key), data ? data->mv_size:0,
 			data ? rdb_dval(mc->mc_txn, mc->mc_dbi, data, dbuf):"", flags));
@@ -7556,6 +11112,8 @@ rdb_cursor_del(RDB_cursor *mc, unsigned int flags)
 {
 	RDB_TRACE(("%p, %u",
 		mc, flags));
+	if (mc->mc_db->md_flags & RDB_HASHED)
+		return rdb_hash_cursor_del(mc);
 	return _rdb_cursor_del(mc, flags);
 }
 
@@ -7645,6 +11203,157 @@ rdb_branch_size(RDB_env *env, RDB_val *key)
 	return sz + sizeof(indx_t);
 }
 
+/** Return the length of the common prefix of two byte strings. */
+static unsigned int
+rdb_prefix_common(const void *a, size_t alen, const void *b, size_t blen)
+{
+	const unsigned char *p = a, *q = b;
+	size_t i, len = alen < blen ? alen : blen;
+
+	for (i = 0; i < len && p[i] == q[i]; i++) ;
+	return i;
+}
+
+/** Get the whole key of a node.
+ * On a #P_PREFIX branch page the page's prefix and the node's
+ * suffix are joined in \b buf, otherwise the key is returned
+ * in place.
+ * @param[in] env The environment handle.
+ * @param[in] mp The page holding the node.
+ * @param[in] node The node.
+ * @param[out] key The key of the node.
+ * @param[in] buf A buffer of #KEYBUF_SIZE bytes.
+ */
+static void
+rdb_node_key(RDB_env *env, RDB_page *mp, RDB_node *node, RDB_val *key, char *buf)
+{
+	unsigned int plen = PAGEPFXLEN(mp);
+
+	key->mv_size = NODEKSZ(node);
+	key->mv_data = NODEKEY(node);
+	if (plen) {
+		memcpy(buf, PAGEPFX(env, mp), plen);
+		memcpy(buf + plen, key->mv_data, key->mv_size);
+		key->mv_data = buf;
+		key->mv_size += plen;
+	}
+}
+
+/** Calculate how much a #P_PREFIX branch page grows if its prefix
+ * is cut to \b len bytes. Every node's suffix gets longer by the
+ * bytes removed from the prefix.
+ * @param[in] mp The branch page.
+ * @param[in] len The new prefix length.
+ * @return The number of extra bytes needed.
+ */
+static int
+rdb_prefix_growth(RDB_page *mp, unsigned int len)
+{
+	unsigned int i, nkeys = NUMKEYS(mp), delta = mp->mp_pad - len;
+	int grow = (int)EVEN(len) - (int)EVEN(mp->mp_pad);
+	RDB_node *node;
+
+	for (i = 0; i < nkeys; i++) {
+		node = NODEPTR(mp, i);
+		grow += EVEN(NODESIZE + node->mn_ksize + delta) - EVEN(NODESIZE + node->mn_ksize);
+	}
+	return grow;
+}
+
+/** Calculate the room needed to add \b key to a branch page.
+ * If the key doesn't start with the page's prefix, the prefix
+ * must first be cut to the common part, which also costs room.
+ * @param[in] env The environment handle.
+ * @param[in] mp The branch page.
+ * @param[in] key The key for the new node.
+ * @param[out] lenp The prefix length the page needs for this key.
+ * @return The number of bytes needed.
+ */
+static size_t
+rdb_branch_room(RDB_env *env, RDB_page *mp, RDB_val *key, unsigned int *lenp)
+{
+	unsigned int plen = PAGEPFXLEN(mp), len = plen;
+	size_t sz;
+
+	*lenp = plen;
+	if (!plen)
+		return rdb_branch_size(env, key);
+	if (key && key->mv_size)
+		len = rdb_prefix_common(PAGEPFX(env, mp), plen, key->mv_data, key->mv_size);
+	*lenp = len;
+	/* An empty key is stored as no key, it takes no suffix */
+	sz = EVEN(NODESIZE + (key && key->mv_size ? key->mv_size - len : 0)) +
+		sizeof(indx_t);
+	if (len < plen)
+		sz += rdb_prefix_growth(mp, len);
+	return sz;
+}
+
+/** Set up an empty branch page to hold a key prefix.
+ * @param[in] env The environment handle.
+ * @param[in] mp The empty branch page.
+ * @param[in] pfx The prefix.
+ * @param[in] len The length of the prefix, or zero for none.
+ */
+static void
+rdb_prefix_init(RDB_env *env, RDB_page *mp, const void *pfx, unsigned int len)
+{
+	mp->mp_lower = (PAGEHDRSZ-PAGEBASE);
+	mp->mp_upper = env->me_psize - PAGEBASE;
+	if (len) {
+		mp->mp_flags |= P_PREFIX;
+		mp->mp_pad = len;
+		mp->mp_upper -= EVEN(len);
+		memcpy(PAGEPFX(env, mp), pfx, len);
+	} else {
+		mp->mp_flags &= ~P_PREFIX;
+		mp->mp_pad = 0;
+	}
+}
+
+/** Cut the key prefix of a #P_PREFIX branch page to \b len bytes,
+ * moving the removed bytes into the front of every node's suffix.
+ * The caller must have checked that the page has room for this,
+ * see #rdb_prefix_growth().
+ * Set #RDB_TXN_ERROR on failure.
+ * @param[in] mc A cursor on the page's database.
+ * @param[in] mp The branch page to rewrite.
+ * @param[in] len The new prefix length.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_prefix_shrink(RDB_cursor *mc, RDB_page *mp, unsigned int len)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *copy;
+	RDB_node *node, *src;
+	char *pfx;
+	unsigned int i, nkeys = NUMKEYS(mp), plen = mp->mp_pad, delta = plen - len;
+	indx_t ofs;
+
+	DPRINTF(("cut prefix of page %"Z"u from %u to %u bytes", mp->mp_pgno, plen, len));
+	if ((copy = rdb_page_malloc(mc->mc_txn, 1)) == NULL)
+		return ENOMEM;
+	memcpy(copy, mp, env->me_psize);
+	pfx = PAGEPFX(env, copy);
+
+	rdb_prefix_init(env, mp, pfx, len);
+	for (i = 0; i < nkeys; i++) {
+		src = NODEPTR(copy, i);
+		ofs = MP_UPPER(mp) - EVEN(NODESIZE + src->mn_ksize + delta);
+		MP_PTRS(mp)[i] = ofs;
+		MP_UPPER(mp) = ofs;
+		MP_LOWER(mp) += sizeof(indx_t);
+		node = NODEPTR(mp, i);
+		memcpy(node, src, NODESIZE);
+		node->mn_ksize = src->mn_ksize + delta;
+		memcpy(NODEKEY(node), pfx + len, delta);
+		memcpy((char *)NODEKEY(node) + delta, NODEKEY(src), src->mn_ksize);
+	}
+	rdb_page_free(env, copy);
+	return RDB_SUCCESS;
+}
+
 /** Add a node to the page pointed to by the cursor.
  * Set #RDB_TXN_ERROR on failure.
  * @param[in] mc The cursor for this operation.
@@ -7673,6 +11382,7 @@ rdb_node_add(RDB_cursor *mc, indx_t indx,
 	RDB_page	*mp = mc->mc_pg[mc->mc_top];
 	RDB_page	*ofp = NULL;		/* overflow page */
 	void		*ndata;
+	RDB_val		 sfx;
 	DKBUF;
 
 	rdb_cassert(mc, MP_UPPER(mp) >= MP_LOWER(mp));
@@ -7699,6 +11409,27 @@ rdb_node_add(RDB_cursor *mc, indx_t indx,
 		return RDB_SUCCESS;
 	}
 
+	if (key && key->mv_size && PAGEPFXLEN(mp)) {
+		/* Store only the suffix, after cutting the page prefix
+		 * down to what the new key has in common with it.
+		 */
+		unsigned int len;
+		node_size = rdb_branch_room(mc->mc_txn->mt_env, mp, key, &len);
+		if (node_size > SIZELEFT(mp)) {
+			room = SIZELEFT(mp);
+			goto full;
+		}
+		if (len < mp->mp_pad) {
+			int rc = rdb_prefix_shrink(mc, mp, len);
+			if (rc)
+				return rc;
+		}
+		sfx.mv_size = key->mv_size - len;
+		sfx.mv_data = (char *)key->mv_data + len;
+		key = &sfx;
+		node_size = NODESIZE;
+	}
+
 	room = (ssize_t)SIZELEFT(mp) - (ssize_t)sizeof(indx_t);
 	if (key != NULL)
 		node_size += key->mv_size;
@@ -8113,6 +11844,26 @@ rdb_cursor_count(RDB_cursor *mc, size_t *countp)
 	return RDB_SUCCESS;
 }
 
+int
+rdb_cursor_advise(RDB_cursor *mc, int advice)
+{
+	if (mc == NULL)
+		return EINVAL;
+
+	switch (advice) {
+	case RDB_ADV_SEQUENTIAL:
+		mc->mc_flags |= C_READAHEAD;
+		break;
+	case RDB_ADV_NORMAL:
+	case RDB_ADV_RANDOM:
+		mc->mc_flags &= ~C_READAHEAD;
+		break;
+	default:
+		return EINVAL;
+	}
+	return RDB_SUCCESS;
+}
+
 void
 rdb_cursor_close(RDB_cursor *mc)
 {
@@ -8155,8 +11906,10 @@ rdb_update_key(RDB_cursor *mc, RDB_val *key)
 	RDB_node		*node;
 	char			*base;
 	size_t			 len;
-	int				 delta, ksize, oksize;
+	int				 delta, ksize, oksize, full = 0;
+	unsigned int	 plen;
 	indx_t			 ptr, i, numkeys, indx;
+	RDB_val			 sfx;
 	DKBUF;
 
 	indx = mc->mc_ki[mc->mc_top];
@@ -8177,22 +11930,45 @@ rdb_update_key(RDB_cursor *mc, RDB_val *key)
 	}
 #endif
 
+	/* On a prefix-compressed page only the suffix is stored. If the
+	 * new key doesn't share the whole prefix, cut the prefix first.
+	 */
+	sfx = *key;
+	if (key->mv_size && (plen = PAGEPFXLEN(mp))) {
+		unsigned int cut = rdb_prefix_common(PAGEPFX(mc->mc_txn->mt_env, mp), plen,
+			key->mv_data, key->mv_size);
+		if (cut < plen) {
+			if (rdb_prefix_growth(mp, cut) + (int)EVEN(key->mv_size - cut) -
+				(int)EVEN(node->mn_ksize + plen - cut) > (int)SIZELEFT(mp)) {
+				full = 1;
+			} else {
+				int rc = rdb_prefix_shrink(mc, mp, cut);
+				if (rc)
+					return rc;
+				node = NODEPTR(mp, indx);
+				ptr = mp->mp_ptrs[indx];
+			}
+		}
+		sfx.mv_size = key->mv_size - cut;
+		sfx.mv_data = (char *)key->mv_data + cut;
+	}
+
 	/* Sizes must be 2-byte aligned. */
-	ksize = EVEN(key->mv_size);
+	ksize = EVEN(sfx.mv_size);
 	oksize = EVEN(node->mn_ksize);
 	delta = ksize - oksize;
 
+	if (full || (delta > 0 && SIZELEFT(mp) < delta)) {
+		pgno_t pgno;
+		/* not enough space left, do a delete and split */
+		DPRINTF(("Not enough room, delta = %d, splitting...", delta));
+		pgno = NODEPGNO(node);
+		rdb_node_del(mc, 0);
+		return rdb_page_split(mc, key, NULL, pgno, RDB_SPLIT_REPLACE);
+	}
+
 	/* Shift node contents if EVEN(key length) changed. */
 	if (delta) {
-		if (delta > 0 && SIZELEFT(mp) < delta) {
-			pgno_t pgno;
-			/* not enough space left, do a delete and split */
-			DPRINTF(("Not enough room, delta = %d, splitting...", delta));
-			pgno = NODEPGNO(node);
-			rdb_node_del(mc, 0);
-			return rdb_page_split(mc, key, NULL, pgno, RDB_SPLIT_REPLACE);
-		}
-
 		numkeys = NUMKEYS(mp);
 		for (i = 0; i < numkeys; i++) {
 			if (mp->mp_ptrs[i] <= ptr)
@@ -8208,11 +11984,11 @@ rdb_update_key(RDB_cursor *mc, RDB_val *key)
 	}
 
 	/* But even if no shift was needed, update ksize */
-	if (node->mn_ksize != key->mv_size)
-		node->mn_ksize = key->mv_size;
+	if (node->mn_ksize != sfx.mv_size)
+		node->mn_ksize = sfx.mv_size;
 
-	if (key->mv_size)
-		memcpy(NODEKEY(node), key->mv_data, key->mv_size);
+	if (sfx.mv_size)
+		memcpy(NODEKEY(node), sfx.mv_data, sfx.mv_size);
 
 	return RDB_SUCCESS;
 }
@@ -8247,6 +12023,7 @@ rdb_node_move(RDB_cursor *csrc, RDB_cursor *cdst, int fromleft)
 	RDB_cursor mn;
 	int			 rc;
 	unsigned short flags;
+	char		 fkbuf[KEYBUF_SIZE];
 
 	DKBUF;
 
@@ -8285,8 +12062,8 @@ rdb_node_move(RDB_cursor *csrc, RDB_cursor *cdst, int fromleft)
 			csrc->mc_snum = snum--;
 			csrc->mc_top = snum;
 		} else {
-			key.mv_size = NODEKSZ(srcnode);
-			key.mv_data = NODEKEY(srcnode);
+			rdb_node_key(csrc->mc_txn->mt_env, csrc->mc_pg[csrc->mc_top],
+				srcnode, &key, fkbuf);
 		}
 		data.mv_size = NODEDSZ(srcnode);
 		data.mv_data = NODEDATA(srcnode);
@@ -8400,8 +12177,8 @@ rdb_node_move(RDB_cursor *csrc, RDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(csrc->mc_pg[csrc->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(csrc->mc_pg[csrc->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				rdb_node_key(csrc->mc_txn->mt_env, csrc->mc_pg[csrc->mc_top],
+					srcnode, &key, fkbuf);
 			}
 			DPRINTF(("update separator for source page %"Z"u to [%s]",
 				csrc->mc_pg[csrc->mc_top]->mp_pgno, DKEY(&key)));
@@ -8431,8 +12208,8 @@ rdb_node_move(RDB_cursor *csrc, RDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(cdst->mc_pg[cdst->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(cdst->mc_pg[cdst->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				rdb_node_key(cdst->mc_txn->mt_env, cdst->mc_pg[cdst->mc_top],
+					srcnode, &key, fkbuf);
 			}
 			DPRINTF(("update separator for destination page %"Z"u to [%s]",
 				cdst->mc_pg[cdst->mc_top]->mp_pgno, DKEY(&key)));
@@ -8476,6 +12253,7 @@ rdb_page_merge(RDB_cursor *csrc, RDB_cursor *cdst)
 	unsigned	 nkeys;
 	int			 rc;
 	indx_t		 i, j;
+	char		 fkbuf[KEYBUF_SIZE];
 
 	psrc = csrc->mc_pg[csrc->mc_top];
 	pdst = cdst->mc_pg[cdst->mc_top];
@@ -8525,8 +12303,7 @@ rdb_page_merge(RDB_cursor *csrc, RDB_cursor *cdst)
 					key.mv_data = NODEKEY(s2);
 				}
 			} else {
-				key.mv_size = srcnode->mn_ksize;
-				key.mv_data = NODEKEY(srcnode);
+				rdb_node_key(csrc->mc_txn->mt_env, psrc, srcnode, &key, fkbuf);
 			}
 
 			data.mv_size = NODEDSZ(srcnode);
@@ -8792,8 +12569,11 @@ rdb_rebalance(RDB_cursor *mc)
 	/* If the neighbor page is above threshold and has enough keys,
 	 * move one key from it. Otherwise we should try to merge them.
 	 * (A branch page must never have less than 2 keys.)
+	 * A batch sweeping through a range would delete a moved key right
+	 * away, so it always merges an empty page.
 	 */
-	if (PAGEFILL(mc->mc_txn->mt_env, mn.mc_pg[mn.mc_top]) >= thresh && NUMKEYS(mn.mc_pg[mn.mc_top]) > minkeys) {
+	if (PAGEFILL(mc->mc_txn->mt_env, mn.mc_pg[mn.mc_top]) >= thresh && NUMKEYS(mn.mc_pg[mn.mc_top]) > minkeys &&
+		(NUMKEYS(mc->mc_pg[mc->mc_top]) || !(mc->mc_flags & C_NOREBAL))) {
 		rc = rdb_node_move(&mn, mc, fromleft);
 		if (fromleft) {
 			/* if we inserted on left, bump position up */
@@ -8854,7 +12634,11 @@ rdb_cursor_del0(RDB_cursor *mc)
 			}
 		}
 	}
-	rc = rdb_rebalance(mc);
+	/* A batch rebalances the leaf once, when its sweep moves on */
+	if ((mc->mc_flags & C_NOREBAL) && ki < NUMKEYS(mp))
+		rc = RDB_SUCCESS;
+	else
+		rc = rdb_rebalance(mc);
 	if (rc)
 		goto fail;
 
@@ -8942,6 +12726,8 @@ rdb_del(RDB_txn *txn, RDB_dbi dbi,
 	RDB_TRACE(("%p, %u, %"Z"u[%s], %"Z"u%s",
 		txn, dbi, key ? key->mv_size:0, DKEY(key), data ? data->mv_size:0,
 		data ? rdb_dval(txn, dbi, data, dbuf):""));
+	if (txn->mt_dbs[dbi].md_flags & RDB_HASHED)
+		return rdb_hash_del(txn, dbi, key);
 	return rdb_del0(txn, dbi, key, data, 0);
 }
 
@@ -8985,7 +12771,144 @@ rdb_del0(RDB_txn *txn, RDB_dbi dbi,
 		rc = _rdb_cursor_del(&mc, flags);
 		txn->mt_cursors[dbi] = mc.mc_next;
 	}
-	return rc;
+	return rc;
+}
+
+/** Size of a branch page holding nodes \b a to \b b of \b keys,
+ * with node \b a keyless and a prefix of \b plen bytes.
+ */
+static int
+rdb_prefix_half(RDB_val *keys, int a, int b, unsigned int plen)
+{
+	int i, sz = NODESIZE + (b - a + 1) * sizeof(indx_t) + EVEN(plen);
+
+	for (i = a + 1; i <= b; i++)
+		sz += EVEN(NODESIZE + keys[i].mv_size - plen);
+	return sz;
+}
+
+/** Choose the split point of a branch page of an #RDB_PREFIXKEY database.
+ * Each half will get the longest prefix its keys share, so the halves
+ * are sized as they will be stored. The first node of each half has
+ * no key. Sets up the prefixes of the left and right pages.
+ * @param[in] mc Cursor pointing to the page being split.
+ * @param[in] copy The temporary page for the left half. Its node
+ *	offsets are those of the page, with a gap at \b newindx.
+ * @param[in] rp The new right page.
+ * @param[in] newindx The index of the new key.
+ * @param[in] newkey The new key.
+ * @param[out] keysp The whole keys of all nodes including the new one,
+ *	in a single allocation for the caller to free().
+ * @param[out] splitp The index of the first node of the right page.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_prefix_split(RDB_cursor *mc, RDB_page *copy, RDB_page *rp,
+	int newindx, RDB_val *newkey, RDB_val **keysp, int *splitp)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp = mc->mc_pg[mc->mc_top];
+	RDB_node *node;
+	RDB_val *keys;
+	unsigned short *lpfx, *rpfx;
+	unsigned int plen = PAGEPFXLEN(mp), len;
+	int i, d, s, s0, lo, hi, nkeys = NUMKEYS(mp);
+	int pmax = env->me_psize - PAGEHDRSZ;
+	char *ptr;
+
+	keys = malloc((nkeys + 1) * (sizeof(RDB_val) + 2 * sizeof(unsigned short)) +
+		nkeys * plen + env->me_psize);
+	if (!keys)
+		return ENOMEM;
+	lpfx = (unsigned short *)(keys + nkeys + 1);
+	rpfx = lpfx + nkeys + 1;
+	ptr = (char *)(rpfx + nkeys + 1);
+	for (i = 0; i <= nkeys; i++) {
+		if (i == newindx) {
+			keys[i] = *newkey;
+			continue;
+		}
+		node = (RDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
+		if (plen)
+			memcpy(ptr, PAGEPFX(env, mp), plen);
+		memcpy(ptr + plen, NODEKEY(node), NODEKSZ(node));
+		keys[i].mv_data = ptr;
+		keys[i].mv_size = plen + NODEKSZ(node);
+		ptr += keys[i].mv_size;
+	}
+
+	/* lpfx[s] is the prefix shared by keys 1..s-1 of the left half,
+	 * rpfx[s] the one shared by keys s+1..nkeys of the right half.
+	 */
+	lpfx[0] = lpfx[1] = 0;
+	for (s = 2; s <= nkeys; s++) {
+		len = rdb_prefix_common(keys[1].mv_data, keys[1].mv_size,
+			keys[s-1].mv_data, keys[s-1].mv_size);
+		lpfx[s] = (s == 2 || len < lpfx[s-1]) ? len : lpfx[s-1];
+	}
+	rpfx[nkeys] = 0;
+	for (s = nkeys - 1; s >= 0; s--) {
+		len = rdb_prefix_common(keys[nkeys].mv_data, keys[nkeys].mv_size,
+			keys[s+1].mv_data, keys[s+1].mv_size);
+		rpfx[s] = (s == nkeys - 1 || len < rpfx[s+1]) ? len : rpfx[s+1];
+	}
+
+	/* Keep at least two nodes on each side when possible. When
+	 * appending, bias the split so the new page is emptier.
+	 */
+	if (nkeys >= 3) {
+		lo = 2;
+		hi = nkeys - 1;
+	} else {
+		lo = 1;
+		hi = nkeys;
+	}
+	s0 = newindx >= nkeys ? hi : (nkeys + 1) / 2;
+	if (s0 < lo)
+		s0 = lo;
+	for (d = 0; s0 - d >= lo || s0 + d <= hi; d++) {
+		for (i = 0; i < 2; i++) {
+			s = i ? s0 - d : s0 + d;
+			if ((i && !d) || s < lo || s > hi)
+				continue;
+			if (rdb_prefix_half(keys, 0, s - 1, lpfx[s]) <= pmax &&
+				rdb_prefix_half(keys, s, nkeys, rpfx[s]) <= pmax)
+				goto found;
+		}
+	}
+	free(keys);
+	mc->mc_txn->mt_flags |= RDB_TXN_ERROR;
+	return RDB_PAGE_FULL;
+
+found:
+	DPRINTF(("prefix split at %d, prefixes %u/%u", s, lpfx[s], rpfx[s]));
+	rdb_prefix_init(env, copy, keys[1].mv_data, lpfx[s]);
+	rdb_prefix_init(env, rp, keys[nkeys].mv_data, rpfx[s]);
+	*keysp = keys;
+	*splitp = s;
+	return RDB_SUCCESS;
+}
+
+/** Shorten the separator pushed up by a leaf split.
+ * With #rdb_cmp_memn() ordering, any key greater than the last
+ * key of the left page and not greater than the first key of
+ * the right page routes searches the same way, so the parent
+ * only needs the shortest such prefix of the right page's key.
+ * This only holds for leaves: a branch's last node covers keys
+ * up to its separator, not just its own key.
+ * @param[in] left The last key of the left page.
+ * @param[in,out] sep The first key of the right page, truncated.
+ */
+static void
+rdb_sep_shorten(const RDB_val *left, RDB_val *sep)
+{
+	const unsigned char *l = left->mv_data, *r = sep->mv_data;
+	size_t i, len = left->mv_size < sep->mv_size ? left->mv_size : sep->mv_size;
+
+	for (i = 0; i < len && l[i] == r[i]; i++) ;
+	/* Keep the whole key unless it really sorts after the left one */
+	if (i < sep->mv_size && (i == left->mv_size || l[i] < r[i]))
+		sep->mv_size = i + 1;
 }
 
 /** Split a page and insert a new node.
@@ -9011,9 +12934,11 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 	RDB_env 	*env = mc->mc_txn->mt_env;
 	RDB_node	*node;
 	RDB_val	 sepkey, rkey, xdata, *rdata = &xdata;
+	RDB_val	*keys = NULL;
 	RDB_page	*copy = NULL;
 	RDB_page	*mp, *rp, *pp;
 	int ptop;
+	unsigned int plen;
 	RDB_cursor	mn;
 	DKBUF;
 
@@ -9026,7 +12951,7 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 	    DKEY(newkey), mc->mc_ki[mc->mc_top], nkeys));
 
 	/* Create a right sibling. */
-	if ((rc = rdb_page_new(mc, mp->mp_flags, 1, &rp)))
+	if ((rc = rdb_page_new(mc, mp->mp_flags & ~P_PREFIX, 1, &rp)))
 		return rc;
 	rp->mp_pad = mp->mp_pad;
 	DPRINTF(("new right sibling: page %"Z"u", rp->mp_pgno));
@@ -9076,6 +13001,13 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 		mn.mc_ki[mn.mc_top] = 0;
 		sepkey = *newkey;
 		split_indx = newindx;
+		if (IS_LEAF(mp) && !IS_LEAF2(mp) && nkeys &&
+			mc->mc_dbx->md_cmp == rdb_cmp_memn) {
+			node = NODEPTR(mp, nkeys-1);
+			rkey.mv_size = node->mn_ksize;
+			rkey.mv_data = NODEKEY(node);
+			rdb_sep_shorten(&rkey, &sepkey);
+		}
 		nkeys = 0;
 	} else {
 
@@ -9140,7 +13072,7 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 				goto done;
 			}
 			copy->mp_pgno  = mp->mp_pgno;
-			copy->mp_flags = mp->mp_flags;
+			copy->mp_flags = mp->mp_flags & ~P_PREFIX;
 			copy->mp_lower = (PAGEHDRSZ-PAGEBASE);
 			copy->mp_upper = env->me_psize - PAGEBASE;
 
@@ -9166,8 +13098,16 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 			 * spot on the page (and thus, onto the new page), bias
 			 * the split so the new page is emptier than the old page.
 			 * This yields better packing during sequential inserts.
+			 *
+			 * Branch pages of #RDB_PREFIXKEY DBs are sized by their
+			 * compressed keys instead, see #rdb_prefix_split().
 			 */
-			if (nkeys < keythresh || nsize > pmax/16 || newindx >= nkeys) {
+			if (IS_BRANCH(mp) &&
+				((mc->mc_db->md_flags & RDB_PREFIXKEY) || PAGEPFXLEN(mp))) {
+				rc = rdb_prefix_split(mc, copy, rp, newindx, newkey, &keys, &split_indx);
+				if (rc)
+					goto done;
+			} else if (nkeys < keythresh || nsize > pmax/16 || newindx >= nkeys) {
 				/* Find split point */
 				psize = 0;
 				if (newindx <= split_indx || newindx >= nkeys) {
@@ -9198,7 +13138,9 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 					}
 				}
 			}
-			if (split_indx == newindx) {
+			if (keys) {
+				sepkey = keys[split_indx];
+			} else if (split_indx == newindx) {
 				sepkey.mv_size = newkey->mv_size;
 				sepkey.mv_data = newkey->mv_data;
 			} else {
@@ -9206,6 +13148,17 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 				sepkey.mv_size = node->mn_ksize;
 				sepkey.mv_data = NODEKEY(node);
 			}
+			if (IS_LEAF(mp) && split_indx > 0 &&
+				mc->mc_dbx->md_cmp == rdb_cmp_memn) {
+				if (split_indx - 1 == newindx) {
+					rkey = *newkey;
+				} else {
+					node = (RDB_node *)((char *)mp + copy->mp_ptrs[split_indx-1] + PAGEBASE);
+					rkey.mv_size = node->mn_ksize;
+					rkey.mv_data = NODEKEY(node);
+				}
+				rdb_sep_shorten(&rkey, &sepkey);
+			}
 		}
 	}
 
@@ -9213,7 +13166,7 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 
 	/* Copy separator key to the parent.
 	 */
-	if (SIZELEFT(mn.mc_pg[ptop]) < rdb_branch_size(env, &sepkey)) {
+	if (SIZELEFT(mn.mc_pg[ptop]) < rdb_branch_room(env, mn.mc_pg[ptop], &sepkey, &plen)) {
 		int snum = mc->mc_snum;
 		mn.mc_snum--;
 		mn.mc_top--;
@@ -9280,8 +13233,12 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 				mc->mc_ki[mc->mc_top] = j;
 			} else {
 				node = (RDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
-				rkey.mv_data = NODEKEY(node);
-				rkey.mv_size = node->mn_ksize;
+				if (keys) {
+					rkey = keys[i];
+				} else {
+					rkey.mv_data = NODEKEY(node);
+					rkey.mv_size = node->mn_ksize;
+				}
 				if (IS_LEAF(mp)) {
 					xdata.mv_data = NODEDATA(node);
 					xdata.mv_size = NODEDSZ(node);
@@ -9316,6 +13273,10 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 		mp->mp_upper = copy->mp_upper;
 		memcpy(NODEPTR(mp, nkeys-1), NODEPTR(copy, nkeys-1),
 			env->me_psize - copy->mp_upper - PAGEBASE);
+		if (keys) {
+			mp->mp_flags = (mp->mp_flags & ~P_PREFIX) | (copy->mp_flags & P_PREFIX);
+			mp->mp_pad = copy->mp_pad;
+		}
 
 		/* reset back to original page */
 		if (newindx < split_indx) {
@@ -9412,6 +13373,7 @@ rdb_page_split(RDB_cursor *mc, RDB_val *newkey, RDB_val *newdata, pgno_t newpgno
 done:
 	if (copy)					/* tmp page */
 		rdb_page_free(env, copy);
+	free(keys);
 	if (rc)
 		mc->mc_txn->mt_flags |= RDB_TXN_ERROR;
 	return rc;
@@ -9438,6 +13400,11 @@ rdb_put(RDB_txn *txn, RDB_dbi dbi,
 
 	RDB_TRACE(("%p, %u, %"Z"u[%s], %"Z"u%s, %u",
 		txn, dbi, key ? key->mv_size:0, DKEY(key), data->mv_size, rdb_dval(txn, dbi, data, dbuf), flags));
+	/* Filter first, the put may return pointers into dirty pages */
+	if ((rc = rdb_bloom_put(txn, dbi, key)) != RDB_SUCCESS)
+		return rc;
+	if (txn->mt_dbs[dbi].md_flags & RDB_HASHED)
+		return rdb_hash_put(txn, dbi, key, data, flags);
 	rdb_cursor_init(&mc, txn, dbi, &mx);
 	mc.mc_next = txn->mt_cursors[dbi];
 	txn->mt_cursors[dbi] = &mc;
@@ -9446,6 +13413,332 @@ rdb_put(RDB_txn *txn, RDB_dbi dbi,
 	return rc;
 }
 
+/** @defgroup batch	Write batches
+ *	An #RDB_batch keeps its writes, with copies of their keys and data,
+ *	until #rdb_batch_apply() sorts them by DB and key and makes them with
+ *	one cursor per DB. The cursor has #C_FINGER set for each write, so
+ *	its search resumes from the pages the previous one left on the stack.
+ *	@{
+ */
+	/** Bytes per block of the copies in an #RDB_batch */
+#define RDB_BATCH_BLOCK	65536
+
+	/** #RDB_bop.%bo_flags of a delete */
+#define RDB_BATCH_DEL	0x80000000U
+
+/** A block of copied keys and data */
+typedef struct RDB_bblock {
+	struct RDB_bblock	*bb_next;
+	size_t		bb_size;	/**< bytes in bb_data */
+	size_t		bb_used;
+	char		bb_data[1];
+} RDB_bblock;
+
+/** A write in a batch */
+typedef struct RDB_bop {
+	RDB_dbi		bo_dbi;
+	unsigned int	bo_flags;	/**< put flags, or #RDB_BATCH_DEL */
+	RDB_val		bo_key;
+	RDB_val		bo_data;	/**< mv_data is NULL for a delete of all items */
+} RDB_bop;
+
+struct RDB_batch {
+	RDB_bop		*mb_ops;
+	unsigned int	mb_count;
+	unsigned int	mb_room;	/**< size of mb_ops */
+	RDB_bblock	*mb_blocks;	/**< the one being filled first */
+};
+
+int
+rdb_batch_create(RDB_batch **batch)
+{
+	RDB_batch *b;
+
+	if (!batch)
+		return EINVAL;
+	if ((b = calloc(1, sizeof(RDB_batch))) == NULL)
+		return ENOMEM;
+	*batch = b;
+	return RDB_SUCCESS;
+}
+
+/** Allocate room for a copy in a batch. Blocks never move, so
+ * #RDB_RESERVE can hand out the address.
+ * @param[in] b the batch
+ * @param[in] len the number of bytes
+ * @return the room, or NULL if out of memory.
+ */
+static void *
+rdb_batch_alloc(RDB_batch *b, size_t len)
+{
+	RDB_bblock *bb = b->mb_blocks;
+	size_t size;
+	char *ptr;
+
+	len = (len + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+	if (!bb || bb->bb_size - bb->bb_used < len) {
+		size = len > RDB_BATCH_BLOCK / 4 ? len : RDB_BATCH_BLOCK;
+		if ((bb = malloc(offsetof(RDB_bblock, bb_data) + size)) == NULL)
+			return NULL;
+		bb->bb_size = size;
+		bb->bb_used = 0;
+		if (size == len && b->mb_blocks) {
+			/* A big item of its own, keep filling the current block */
+			bb->bb_next = b->mb_blocks->bb_next;
+			b->mb_blocks->bb_next = bb;
+		} else {
+			bb->bb_next = b->mb_blocks;
+			b->mb_blocks = bb;
+		}
+	}
+	ptr = bb->bb_data + bb->bb_used;
+	bb->bb_used += len;
+	return ptr;
+}
+
+/** Add a write to a batch.
+ * @param[in] b the batch
+ * @param[in] dbi the DB
+ * @param[in] flags the put flags, or #RDB_BATCH_DEL
+ * @param[in] key the key
+ * @param[in,out] data the data, or NULL. With #RDB_RESERVE its
+ *	mv_data is set to the room for it.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_batch_add(RDB_batch *b, RDB_dbi dbi, unsigned int flags, RDB_val *key,
+	RDB_val *data)
+{
+	RDB_bop *op;
+	unsigned int room;
+
+	if (b->mb_count == b->mb_room) {
+		room = b->mb_room ? b->mb_room * 2 : 64;
+		if ((op = realloc(b->mb_ops, room * sizeof(RDB_bop))) == NULL)
+			return ENOMEM;
+		b->mb_ops = op;
+		b->mb_room = room;
+	}
+	op = &b->mb_ops[b->mb_count];
+	op->bo_dbi = dbi;
+	op->bo_flags = flags & ~RDB_RESERVE;
+	op->bo_key.mv_size = key->mv_size;
+	if ((op->bo_key.mv_data = rdb_batch_alloc(b, key->mv_size)) == NULL)
+		return ENOMEM;
+	memcpy(op->bo_key.mv_data, key->mv_data, key->mv_size);
+	op->bo_data.mv_size = 0;
+	op->bo_data.mv_data = NULL;
+	if (data) {
+		op->bo_data.mv_size = data->mv_size;
+		if ((op->bo_data.mv_data = rdb_batch_alloc(b, data->mv_size)) == NULL)
+			return ENOMEM;
+		if (flags & RDB_RESERVE)
+			data->mv_data = op->bo_data.mv_data;
+		else
+			memcpy(op->bo_data.mv_data, data->mv_data, data->mv_size);
+	}
+	b->mb_count++;
+	return RDB_SUCCESS;
+}
+
+int
+rdb_batch_put(RDB_batch *batch, RDB_dbi dbi, RDB_val *key, RDB_val *data,
+	unsigned int flags)
+{
+	if (!batch || !key || !data)
+		return EINVAL;
+	if (flags & ~(RDB_NOOVERWRITE|RDB_NODUPDATA|RDB_RESERVE))
+		return EINVAL;
+	return rdb_batch_add(batch, dbi, flags, key, data);
+}
+
+int
+rdb_batch_del(RDB_batch *batch, RDB_dbi dbi, RDB_val *key, RDB_val *data)
+{
+	if (!batch || !key)
+		return EINVAL;
+	return rdb_batch_add(batch, dbi, RDB_BATCH_DEL, key, data);
+}
+
+/** Make the sorted writes of one DB.
+ * Deletes don't rebalance the leaf the cursor stays on, see #C_NOREBAL.
+ * A sweep through a dense range would otherwise move or merge nodes on
+ * every delete once the leaf drops below the fill threshold. The leaf
+ * is rebalanced once, before the next write goes past its last key.
+ * @param[in] txn the transaction
+ * @param[in] dbi the DB
+ * @param[in] ops the batch's writes
+ * @param[in] idx the indices of this DB's writes, in key order
+ * @param[in] n the number of indices
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_batch_run(RDB_txn *txn, RDB_dbi dbi, RDB_bop *ops, unsigned int *idx,
+	unsigned int n)
+{
+	RDB_cursor mc;
+	RDB_xcursor mx;
+	RDB_bop *op;
+	RDB_page *mp;
+	RDB_node *leaf;
+	RDB_val data, *dp, lkey;
+	unsigned int i, hashed, dupsort, unbal = 0;
+	int rc = RDB_SUCCESS, exact;
+
+	hashed = txn->mt_dbs[dbi].md_flags & RDB_HASHED;
+	dupsort = txn->mt_dbs[dbi].md_flags & RDB_DUPSORT;
+	if (!hashed) {
+		rdb_cursor_init(&mc, txn, dbi, &mx);
+		/* Tracked, so splits and rebalances keep it in place.
+		 * C_UNTRACK marks it as listed in mt_cursors, as in rdb_del().
+		 */
+		mc.mc_flags |= C_UNTRACK|C_NOREBAL;
+		mc.mc_next = txn->mt_cursors[dbi];
+		txn->mt_cursors[dbi] = &mc;
+	}
+	for (i = 0; i < n && !rc; i++) {
+		op = &ops[idx[i]];
+		data = op->bo_data;
+		if (unbal) {
+			mp = mc.mc_pg[mc.mc_top];
+			leaf = NODEPTR(mp, NUMKEYS(mp) - 1);
+			lkey.mv_size = NODEKSZ(leaf);
+			lkey.mv_data = NODEKEY(leaf);
+			if (mc.mc_dbx->md_cmp(&op->bo_key, &lkey) > 0) {
+				unbal = 0;
+				if ((rc = rdb_rebalance(&mc)) != RDB_SUCCESS)
+					break;
+			}
+		}
+		if (op->bo_flags & RDB_BATCH_DEL) {
+			dp = dupsort && data.mv_data ? &data : NULL;
+			if (hashed) {
+				rc = rdb_hash_del(txn, dbi, &op->bo_key);
+			} else {
+				exact = 0;
+				mc.mc_flags |= C_FINGER;
+				rc = rdb_cursor_set(&mc, &op->bo_key, dp,
+					dp ? RDB_GET_BOTH : RDB_SET, &exact);
+				mc.mc_flags &= ~C_FINGER;
+				if (rc == RDB_SUCCESS &&
+					(rc = _rdb_cursor_del(&mc, dp ? 0 : RDB_NODUPDATA)) == RDB_SUCCESS &&
+					!(mc.mc_flags & C_EOF) &&
+					mc.mc_ki[mc.mc_top] < NUMKEYS(mc.mc_pg[mc.mc_top]))
+					unbal = 1;
+			}
+			if (rc == RDB_NOTFOUND)
+				rc = RDB_SUCCESS;
+		} else {
+			if ((rc = rdb_bloom_put(txn, dbi, &op->bo_key)) != RDB_SUCCESS)
+				break;
+			if (hashed) {
+				rc = rdb_hash_put(txn, dbi, &op->bo_key, &data, op->bo_flags);
+			} else {
+				mc.mc_flags |= C_FINGER;
+				rc = _rdb_cursor_put(&mc, &op->bo_key, &data, op->bo_flags);
+				mc.mc_flags &= ~C_FINGER;
+			}
+			if (rc == RDB_KEYEXIST)
+				rc = RDB_SUCCESS;
+		}
+	}
+	if (unbal && !rc)
+		rc = rdb_rebalance(&mc);
+	if (!hashed)
+		txn->mt_cursors[dbi] = mc.mc_next;
+	return rc;
+}
+
+int
+rdb_batch_apply(RDB_txn *txn, RDB_batch *batch)
+{
+	RDB_bop *ops;
+	RDB_val *keys;
+	RDB_dbi dbi;
+	unsigned int i, n, lo, *idx, *end;
+	int rc = RDB_SUCCESS;
+
+	if (!txn || !batch)
+		return EINVAL;
+	RDB_TRACE(("%p, %p, %u writes", txn, batch, batch->mb_count));
+	if (txn->mt_flags & (RDB_TXN_RDONLY|RDB_TXN_BLOCKED))
+		return (txn->mt_flags & RDB_TXN_RDONLY) ? EACCES : RDB_BAD_TXN;
+	ops = batch->mb_ops;
+	n = batch->mb_count;
+	for (i = 0; i < n; i++)
+		if (!TXN_DBI_EXIST(txn, ops[i].bo_dbi, DB_USRVALID))
+			return EINVAL;
+	if (!n)
+		return RDB_SUCCESS;
+
+	keys = malloc(n * sizeof(RDB_val) + 2 * n * sizeof(unsigned int));
+	end = calloc(txn->mt_numdbs + 1, sizeof(unsigned int));
+	if (!keys || !end) {
+		free(keys);
+		free(end);
+		return ENOMEM;
+	}
+	idx = (unsigned int *)(keys + n);
+
+	/* Group the writes by DB, keeping their order */
+	for (i = 0; i < n; i++) {
+		keys[i] = ops[i].bo_key;
+		end[ops[i].bo_dbi + 1]++;
+	}
+	for (dbi = 1; dbi <= txn->mt_numdbs; dbi++)
+		end[dbi] += end[dbi - 1];
+	for (i = 0; i < n; i++)
+		idx[end[ops[i].bo_dbi]++] = i;
+
+	/* Now end[dbi] is where its group ends */
+	for (dbi = 0, lo = 0; dbi < txn->mt_numdbs && !rc; lo = end[dbi++]) {
+		if (end[dbi] == lo)
+			continue;
+		rdb_batch_sort(txn->mt_dbxs[dbi].md_cmp, keys, idx + lo, idx + n,
+			end[dbi] - lo);
+		rc = rdb_batch_run(txn, dbi, ops, idx + lo, end[dbi] - lo);
+	}
+	free(keys);
+	free(end);
+	return rc;
+}
+
+void
+rdb_batch_reset(RDB_batch *batch)
+{
+	RDB_bblock *bb, *keep, *next;
+
+	if (!batch)
+		return;
+	batch->mb_count = 0;
+	if ((bb = batch->mb_blocks) == NULL)
+		return;
+	/* Keep the first block, if it's a regular one */
+	keep = bb->bb_size == RDB_BATCH_BLOCK ? bb : NULL;
+	if (keep) {
+		bb = keep->bb_next;
+		keep->bb_next = NULL;
+		keep->bb_used = 0;
+	}
+	for (; bb; bb = next) {
+		next = bb->bb_next;
+		free(bb);
+	}
+	batch->mb_blocks = keep;
+}
+
+void
+rdb_batch_free(RDB_batch *batch)
+{
+	if (!batch)
+		return;
+	rdb_batch_reset(batch);
+	free(batch->mb_blocks);
+	free(batch->mb_ops);
+	free(batch);
+}
+/** @} */
+
 #ifndef RDB_WBUF
 #define RDB_WBUF	(1024*1024)
 #endif
@@ -9598,8 +13891,10 @@ rdb_env_cwalk(rdb_copy *my, pgno_t *pg, int flags)
 	if (rc)
 		return rc;
 
-	/* Make cursor pages writable */
-	buf = ptr = malloc(my->mc_env->me_psize * mc.mc_snum);
+	/* Make cursor pages writable. Leaves of #RDB_HASHED DBs
+	 * are not all at the same depth, so make room for any.
+	 */
+	buf = ptr = malloc(my->mc_env->me_psize * (CURSOR_STACK+1));
 	if (buf == NULL)
 		return ENOMEM;
 
@@ -9610,7 +13905,7 @@ rdb_env_cwalk(rdb_copy *my, pgno_t *pg, int flags)
 	}
 
 	/* This is writable space for a leaf page. Usually not needed. */
-	leaf = (RDB_page *)ptr;
+	leaf = (RDB_page *)(buf + my->mc_env->me_psize * CURSOR_STACK);
 
 	toggle = my->mc_toggle;
 	while (mc.mc_snum > 0) {
@@ -9696,6 +13991,7 @@ again:
 					/* Whenever we advance to a sibling branch page,
 					 * we must proceed all the way down to its first leaf.
 					 */
+					mc.mc_pg[mc.mc_top] = (RDB_page *)(buf + my->mc_env->me_psize * mc.mc_top);
 					rdb_page_copy(mc.mc_pg[mc.mc_top], mp, my->mc_env->me_psize);
 					goto again;
 				} else
@@ -9865,10 +14161,11 @@ static int ESECT
 rdb_env_copyfd0(RDB_env *env, HANDLE fd)
 {
 	RDB_txn *txn = NULL;
+	RDB_meta *mm;
 	rdb_mutexref_t wmutex = NULL;
-	int rc;
+	int rc, i;
 	size_t wsize, w3;
-	char *ptr;
+	char *ptr, *mbuf = NULL;
 #ifdef _WIN32
 	DWORD len, w2;
 #define DO_WRITE(rc, fd, ptr, w2, len)	rc = WriteFile(fd, ptr, w2, &len, NULL)
@@ -9903,6 +14200,32 @@ rdb_env_copyfd0(RDB_env *env, HANDLE fd)
 
 	wsize = env->me_psize * NUM_METAS;
 	ptr = env->me_map;
+	/* A commit that is not yet durable has its meta only in the lock
+	 * file, and once it is, the older tree the data file's metas point
+	 * to may be reused while we copy. Give the copy ours in both slots.
+	 * The buffer is aligned like the map, for O_DIRECT.
+	 */
+	mm = rdb_txn_meta(env, txn->mt_txnid);
+	if (mm != env->me_metas[txn->mt_txnid & 1]) {
+#ifdef _WIN32
+		mbuf = _aligned_malloc(wsize, env->me_os_psize);
+#elif defined(HAVE_MEMALIGN)
+		mbuf = memalign(env->me_os_psize, wsize);
+#else
+		if (posix_memalign((void **)&mbuf, env->me_os_psize, wsize))
+			mbuf = NULL;
+#endif
+		if (mbuf == NULL) {
+			rc = ENOMEM;
+			if (wmutex)
+				UNLOCK_MUTEX(wmutex);
+			goto leave;
+		}
+		memcpy(mbuf, env->me_map, wsize);
+		for (i = 0; i < NUM_METAS; i++)
+			*(RDB_meta *)METADATA((RDB_page *)(mbuf + i * env->me_psize)) = *mm;
+		ptr = mbuf;
+	}
 	w2 = wsize;
 	while (w2 > 0) {
 		DO_WRITE(rc, fd, ptr, w2, len);
@@ -9926,6 +14249,7 @@ rdb_env_copyfd0(RDB_env *env, HANDLE fd)
 	if (rc)
 		goto leave;
 
+	ptr = env->me_map + wsize;
 	w3 = txn->mt_next_pgno * env->me_psize;
 	{
 		size_t fsize = 0;
@@ -9957,6 +14281,11 @@ rdb_env_copyfd0(RDB_env *env, HANDLE fd)
 
 leave:
 	_rdb_txn_abort(txn);
+#ifdef _WIN32
+	if (mbuf) _aligned_free(mbuf);
+#else
+	free(mbuf);
+#endif
 	return rc;
 }
 
@@ -10088,37 +14417,424 @@ rdb_stat0(RDB_env *env, RDB_db *db, RDB_stat *arg)
 	return RDB_SUCCESS;
 }
 
-int ESECT
-rdb_env_stat(RDB_env *env, RDB_stat *arg)
+int ESECT
+rdb_env_stat(RDB_env *env, RDB_stat *arg)
+{
+	RDB_meta *meta;
+
+	if (env == NULL || arg == NULL)
+		return EINVAL;
+
+	meta = rdb_env_last_meta(env);
+
+	return rdb_stat0(env, &meta->mm_dbs[MAIN_DBI], arg);
+}
+
+/** Count the bytes of the map that are backed by huge pages, from
+ *	the kernel's accounting for the map in /proc/self/smaps. The map
+ *	may be split up there, e.g. by locked ranges.
+ * @param[in] env The environment.
+ * @return The number of bytes, 0 if unknown.
+ */
+static size_t ESECT
+rdb_env_hugemapped(RDB_env *env)
+{
+#ifdef __linux__
+	static const char *const fields[] = {
+		"AnonHugePages:", "ShmemPmdMapped:", "FilePmdMapped:",
+		"Shared_Hugetlb:", "Private_Hugetlb:"
+	};
+	char line[256], *map = env->me_map, *end = map + env->me_mapsize;
+	unsigned long lo, hi;
+	size_t len, total = 0;
+	int i, ours = 0;
+	FILE *fp;
+
+	if (!map || !(fp = fopen("/proc/self/smaps", "r")))
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		/* A mapping's first line is its address range */
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+			ours = (char *)lo >= map && (char *)lo < end;
+			continue;
+		}
+		if (!ours)
+			continue;
+		for (i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+			len = strlen(fields[i]);
+			if (!strncmp(line, fields[i], len)) {
+				total += strtoul(line + len, NULL, 10) * 1024;
+				break;
+			}
+		}
+	}
+	fclose(fp);
+	return total;
+#else
+	return 0;
+#endif
+}
+
+int ESECT
+rdb_env_info(RDB_env *env, RDB_envinfo *arg)
+{
+	RDB_meta *meta;
+
+	if (env == NULL || arg == NULL)
+		return EINVAL;
+
+	arg->me_durable_txnid = rdb_env_pick_meta(env)->mm_txnid;
+	meta = rdb_env_last_meta(env);
+	arg->me_mapaddr = meta->mm_address;
+	arg->me_last_pgno = meta->mm_last_pg;
+	arg->me_last_txnid = meta->mm_txnid;
+
+	arg->me_mapsize = env->me_mapsize;
+	arg->me_maxreaders = env->me_maxreaders;
+	arg->me_numreaders = env->me_txns ? env->me_txns->mti_numreaders : 0;
+	arg->me_pinned = env->me_pinbytes;
+	/* Reading smaps is slow, only do it when there is something to see */
+	arg->me_hugemapped = (env->me_flags & (RDB_HUGEPAGE|RDB_HUGETLB)) ?
+		rdb_env_hugemapped(env) : 0;
+	arg->me_commits = env->me_commits;
+	arg->me_commit_pages = env->me_commit_pages;
+	arg->me_commit_runs = env->me_commit_runs;
+	return RDB_SUCCESS;
+}
+
+/** @defgroup warmup	Environment warm-up
+ *	#rdb_env_warmup() loads a snapshot's pages one tree level at a time,
+ *	for all DBs at once. The pages of a level are handed out to the
+ *	threads in chunks, and the branch pages they find make up the next
+ *	level. The lowest branch pages are kept aside, and their children
+ *	are the leaves loaded in the last pass.
+ *	@{
+ */
+	/** Pages of a level handed to a thread at a time */
+#define RDB_WARM_CHUNK	32
+
+	/** A page for #rdb_env_warmup() to load. */
+typedef struct RDB_wpage {
+	pgno_t		wp_pgno;
+	unsigned int	wp_depth;	/**< tree levels from here down, 0 if unknown */
+} RDB_wpage;
+
+	/** A growable list of pages. */
+typedef struct rdb_wlist {
+	RDB_wpage	*wl_pages;
+	size_t		wl_num;
+	size_t		wl_size;
+} rdb_wlist;
+
+	/** State shared by the #rdb_env_warmup() threads. */
+typedef struct rdb_warm {
+	RDB_env		*wm_env;
+	RDB_txn		*wm_txn;
+	pthread_mutex_t	wm_mutex;	/**< protects everything below */
+	rdb_wlist	wm_todo;	/**< pages of the current level or pass */
+	size_t		wm_next;	/**< next page of #wm_todo to hand out */
+	rdb_wlist	wm_more;	/**< branch pages of the next level */
+	rdb_wlist	wm_parents;	/**< branch pages right above the leaves */
+	RDB_warmup	wm_stat;
+	size_t		wm_budget;	/**< max pages to load, 0 for no limit */
+	time_t		wm_start;
+	unsigned int	wm_timeout;
+	RDB_warmup_func	*wm_func;
+	void		*wm_ctx;
+	int			wm_error;	/**< set to stop all threads */
+} rdb_warm;
+
+static int ESECT
+rdb_wlist_add(rdb_wlist *wl, pgno_t pgno, unsigned int depth)
+{
+	if (wl->wl_num == wl->wl_size) {
+		size_t size = wl->wl_size ? wl->wl_size * 2 : 1024;
+		RDB_wpage *wp = realloc(wl->wl_pages, size * sizeof(RDB_wpage));
+		if (!wp)
+			return ENOMEM;
+		wl->wl_pages = wp;
+		wl->wl_size = size;
+	}
+	wl->wl_pages[wl->wl_num].wp_pgno = pgno;
+	wl->wl_pages[wl->wl_num++].wp_depth = depth;
+	return RDB_SUCCESS;
+}
+
+	/** Fault in a page, one read per OS page. */
+static void ESECT
+rdb_warm_touch(RDB_env *env, pgno_t pgno)
+{
+	volatile char *p = env->me_map + (size_t)pgno * env->me_psize;
+	unsigned int off;
+
+	for (off = 0; off < env->me_psize; off += env->me_os_psize)
+		(void)p[off];
+}
+
+	/** Fault in a page, and the pages under it if it's a branch. Only
+	 *	the buckets of hashed DBs reach here with more than one level.
+	 * @return The number of pages loaded.
+	 */
+static size_t ESECT
+rdb_warm_tree(RDB_env *env, pgno_t pgno, pgno_t last)
+{
+	RDB_page *mp = (RDB_page *)(env->me_map + (size_t)pgno * env->me_psize);
+	unsigned int i, nkeys;
+	size_t n = 1;
+
+	rdb_warm_touch(env, pgno);
+	if (IS_BRANCH(mp)) {
+		nkeys = NUMKEYS(mp);
+		for (i = 0; i < nkeys; i++)
+			if ((pgno = NODEPGNO(NODEPTR(mp, i))) < last)
+				n += rdb_warm_tree(env, pgno, last);
+	}
+	return n;
+}
+
+	/** Load a page of the todo list. In the branch pass this is a page
+	 *	of the current level, in the leaf pass one of the branch pages
+	 *	whose leaves are to be loaded.
+	 */
+static int ESECT
+rdb_warm_page(rdb_warm *wm, RDB_wpage *wp)
+{
+	RDB_env *env = wm->wm_env;
+	pgno_t pgno, last = wm->wm_txn->mt_next_pgno;
+	RDB_page *mp = (RDB_page *)(env->me_map + (size_t)wp->wp_pgno * env->me_psize);
+	RDB_advrun ar;
+	unsigned int i, nkeys;
+	size_t n = 0;
+	int rc = RDB_SUCCESS;
+
+	if (wm->wm_stat.mw_pass) {
+		nkeys = NUMKEYS(mp);
+		ar.ar_count = 0;
+		ar.ar_advice = RDB_ADV_WILLNEED;
+		for (i = 0; i < nkeys; i++)
+			if ((pgno = NODEPGNO(NODEPTR(mp, i))) < last)
+				rdb_advrun_add(env, &ar, pgno);
+		if (ar.ar_count)
+			rdb_env_madvise(env, ar.ar_pgno, ar.ar_count, ar.ar_advice);
+		for (i = 0; i < nkeys; i++)
+			if ((pgno = NODEPGNO(NODEPTR(mp, i))) < last)
+				n += rdb_warm_tree(env, pgno, last);
+		pthread_mutex_lock(&wm->wm_mutex);
+		wm->wm_stat.mw_pages += n;
+		pthread_mutex_unlock(&wm->wm_mutex);
+		return RDB_SUCCESS;
+	}
+
+	rdb_warm_touch(env, wp->wp_pgno);
+	pthread_mutex_lock(&wm->wm_mutex);
+	wm->wm_stat.mw_pages++;
+	if (IS_BRANCH(mp)) {
+		/* A bucket root of a hashed DB counts as a leaf, even when
+		 * it's a branch
+		 */
+		if (wp->wp_depth <= 2) {
+			rc = rdb_wlist_add(&wm->wm_parents, wp->wp_pgno, 2);
+		} else {
+			nkeys = NUMKEYS(mp);
+			for (i = 0; i < nkeys && !rc; i++) {
+				pgno = NODEPGNO(NODEPTR(mp, i));
+				if (pgno < last)
+					rc = rdb_wlist_add(&wm->wm_more, pgno, wp->wp_depth - 1);
+			}
+		}
+	}
+	pthread_mutex_unlock(&wm->wm_mutex);
+	return rc;
+}
+
+	/** Report progress from the caller's thread, and check the time limit. */
+static int ESECT
+rdb_warm_report(rdb_warm *wm)
+{
+	RDB_warmup wu;
+
+	pthread_mutex_lock(&wm->wm_mutex);
+	wm->wm_stat.mw_seconds = time(NULL) - wm->wm_start;
+	wu = wm->wm_stat;
+	pthread_mutex_unlock(&wm->wm_mutex);
+	if (wm->wm_timeout && wu.mw_seconds >= wm->wm_timeout)
+		return ETIMEDOUT;
+	return wm->wm_func ? wm->wm_func(&wu, wm->wm_ctx) : RDB_SUCCESS;
+}
+
+	/** Load chunks of the todo list until it runs out or the warm-up stops.
+	 * @param[in] wm The shared state.
+	 * @param[in] caller Non-zero in the caller's thread, which reports progress.
+	 */
+static void ESECT
+rdb_warm_run(rdb_warm *wm, int caller)
+{
+	RDB_env *env = wm->wm_env;
+	RDB_advrun ar;
+	size_t i, end;
+	int rc = RDB_SUCCESS;
+
+	for (;;) {
+		pthread_mutex_lock(&wm->wm_mutex);
+		if (rc && !wm->wm_error)
+			wm->wm_error = rc;
+		if (wm->wm_error || wm->wm_next >= wm->wm_todo.wl_num ||
+			(wm->wm_budget && wm->wm_stat.mw_pages >= wm->wm_budget)) {
+			pthread_mutex_unlock(&wm->wm_mutex);
+			break;
+		}
+		i = wm->wm_next;
+		/* A page of the leaf pass brings a whole page of leaves */
+		end = i + (wm->wm_stat.mw_pass ? 1 : RDB_WARM_CHUNK);
+		if (end > wm->wm_todo.wl_num)
+			end = wm->wm_todo.wl_num;
+		wm->wm_next = end;
+		pthread_mutex_unlock(&wm->wm_mutex);
+
+		if (!wm->wm_stat.mw_pass) {
+			/* Let the OS read the rest of the chunk while we wait */
+			size_t j;
+			ar.ar_count = 0;
+			ar.ar_advice = RDB_ADV_WILLNEED;
+			for (j = i; j < end; j++)
+				rdb_advrun_add(env, &ar, wm->wm_todo.wl_pages[j].wp_pgno);
+			if (ar.ar_count)
+				rdb_env_madvise(env, ar.ar_pgno, ar.ar_count, ar.ar_advice);
+		}
+		for (; i < end && !rc; i++)
+			rc = rdb_warm_page(wm, &wm->wm_todo.wl_pages[i]);
+		if (!rc && caller)
+			rc = rdb_warm_report(wm);
+	}
+}
+
+	/** Add the root of a DB to the first level. */
+static int ESECT
+rdb_warm_root(rdb_warm *wm, RDB_db *db)
+{
+	if (db->md_root == P_INVALID)
+		return RDB_SUCCESS;
+	wm->wm_stat.mw_total += db->md_branch_pages + db->md_leaf_pages;
+	/* The buckets of a hashed DB differ in depth, so they all take
+	 * the level under the directory, and are loaded in the leaf pass
+	 */
+	return rdb_wlist_add(&wm->wm_todo, db->md_root, (db->md_flags & RDB_HASHED) ?
+		rdb_hash_depth(wm->wm_env, HASH_NBUCKETS(db)) + 1 : db->md_depth);
+}
+
+static THREAD_RET ESECT CALL_CONV
+rdb_env_warmthr(void *arg)
 {
-	RDB_meta *meta;
-
-	if (env == NULL || arg == NULL)
-		return EINVAL;
+	rdb_warm_run(arg, 0);
+	return (THREAD_RET)0;
+}
 
-	meta = rdb_env_pick_meta(env);
+	/** Load the todo list with up to \b nthreads threads. */
+static void ESECT
+rdb_warm_level(rdb_warm *wm, pthread_t *thr, unsigned int nthreads)
+{
+	unsigned int i, n;
 
-	return rdb_stat0(env, &meta->mm_dbs[MAIN_DBI], arg);
+	wm->wm_next = 0;
+	for (n = 0; n < nthreads - 1; n++)
+		if (THREAD_CREATE(thr[n], rdb_env_warmthr, wm))
+			break;
+	rdb_warm_run(wm, 1);
+	for (i = 0; i < n; i++)
+		THREAD_FINISH(thr[i]);
 }
 
 int ESECT
-rdb_env_info(RDB_env *env, RDB_envinfo *arg)
+rdb_env_warmup(RDB_env *env, unsigned int flags, unsigned int nthreads,
+	size_t budget, unsigned int timeout, RDB_warmup_func *func, void *ctx)
 {
-	RDB_meta *meta;
+	rdb_warm wm = {0};
+	rdb_wlist wl;
+	RDB_txn *txn = NULL;
+	RDB_cursor mc;
+	RDB_val key, data;
+	RDB_node *node;
+	RDB_db db;
+	pthread_t *thr = NULL;
+	int rc;
 
-	if (env == NULL || arg == NULL)
+	if (env == NULL || !env->me_map || (flags & ~RDB_WARM_BRANCHONLY))
 		return EINVAL;
+	if (!nthreads)
+		nthreads = 1;
 
-	meta = rdb_env_pick_meta(env);
-	arg->me_mapaddr = meta->mm_address;
-	arg->me_last_pgno = meta->mm_last_pg;
-	arg->me_last_txnid = meta->mm_txnid;
+#ifdef _WIN32
+	if (!(wm.wm_mutex = CreateMutex(NULL, FALSE, NULL)))
+		return ErrCode();
+#else
+	if ((rc = pthread_mutex_init(&wm.wm_mutex, NULL)) != 0)
+		return rc;
+#endif
+	if (nthreads > 1 && !(thr = malloc((nthreads - 1) * sizeof(pthread_t)))) {
+		rc = ENOMEM;
+		goto done;
+	}
+	rc = rdb_txn_begin(env, NULL, RDB_RDONLY, &txn);
+	if (rc)
+		goto done;
+	wm.wm_env = env;
+	wm.wm_txn = txn;
+	wm.wm_budget = (budget + env->me_psize - 1) / env->me_psize;
+	wm.wm_timeout = timeout;
+	wm.wm_func = func;
+	wm.wm_ctx = ctx;
+	wm.wm_start = time(NULL);
+
+	/* The roots of the main DB and of all named DBs make the first level */
+	rc = rdb_warm_root(&wm, &txn->mt_dbs[MAIN_DBI]);
+	if (!rc && !(txn->mt_dbs[MAIN_DBI].md_flags & RDB_DUPSORT)) {
+		rdb_cursor_init(&mc, txn, MAIN_DBI, NULL);
+		while ((rc = rdb_cursor_get(&mc, &key, &data, RDB_NEXT)) == 0) {
+			node = NODEPTR(mc.mc_pg[mc.mc_top], mc.mc_ki[mc.mc_top]);
+			if (!(node->mn_flags & F_SUBDATA) || data.mv_size != sizeof(RDB_db))
+				continue;
+			memcpy(&db, data.mv_data, sizeof(RDB_db));
+			if ((rc = rdb_warm_root(&wm, &db)) != 0)
+				break;
+		}
+		if (rc == RDB_NOTFOUND)
+			rc = RDB_SUCCESS;
+	}
+	if (rc)
+		goto done;
 
-	arg->me_mapsize = env->me_mapsize;
-	arg->me_maxreaders = env->me_maxreaders;
-	arg->me_numreaders = env->me_txns ? env->me_txns->mti_numreaders : 0;
-	return RDB_SUCCESS;
+	while (wm.wm_todo.wl_num && !wm.wm_error) {
+		rdb_warm_level(&wm, thr, nthreads);
+		wl = wm.wm_todo;
+		wm.wm_todo = wm.wm_more;
+		wm.wm_more = wl;
+		wm.wm_more.wl_num = 0;
+	}
+	if (!(flags & RDB_WARM_BRANCHONLY) && !wm.wm_error) {
+		wm.wm_stat.mw_pass = 1;
+		wl = wm.wm_todo;
+		wm.wm_todo = wm.wm_parents;
+		wm.wm_parents = wl;
+		rdb_warm_level(&wm, thr, nthreads);
+	}
+	rc = wm.wm_error;
+	if (!rc && func)
+		rdb_warm_report(&wm);
+
+done:
+	_rdb_txn_abort(txn);
+	free(wm.wm_todo.wl_pages);
+	free(wm.wm_more.wl_pages);
+	free(wm.wm_parents.wl_pages);
+	free(thr);
+#ifdef _WIN32
+	CloseHandle(wm.wm_mutex);
+#else
+	pthread_mutex_destroy(&wm.wm_mutex);
+#endif
+	return rc;
 }
+/** @} */
 
 /** Set the default comparison functions for a database.
  * Called immediately after a database is opened to set the defaults.
@@ -10145,22 +14861,25 @@ rdb_default_cmp(RDB_txn *txn, RDB_dbi dbi)
 
 int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *dbi)
 {
-	RDB_val key, data;
-	RDB_dbi i;
-	RDB_cursor mc;
-	RDB_db dummy;
-	int rc, dbflag, exact;
-	unsigned int unused = 0, seq;
-	char *namedup;
-	size_t len;
+	RDB_val key;
 
 	if (flags & ~VALID_FLAGS)
 		return EINVAL;
+	/* Prefixes are only shared by keys compared from the front */
+	if ((flags & RDB_PREFIXKEY) && (flags & (RDB_REVERSEKEY|RDB_INTEGERKEY)))
+		return EINVAL;
+	if ((flags & RDB_HASHED) && (flags & (RDB_DUPSORT|RDB_PREFIXKEY)))
+		return EINVAL;
 	if (txn->mt_flags & RDB_TXN_BLOCKED)
 		return RDB_BAD_TXN;
 
 	/* main DB? */
 	if (!name) {
+		/* Its filter would need a home outside the main DB,
+		 * and it holds the records of the other DBs in order.
+		 */
+		if (flags & (RDB_BLOOM|RDB_HASHED))
+			return EINVAL;
 		*dbi = MAIN_DBI;
 		if (flags & PERSISTENT_FLAGS) {
 			uint16_t f2 = flags & PERSISTENT_FLAGS;
@@ -10175,27 +14894,70 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 		return RDB_SUCCESS;
 	}
 
+	key.mv_size = strlen(name);
+	key.mv_data = (void *)name;
+	return rdb_dbi_open0(txn, &key, flags, dbi);
+}
+
+/** Open a named database.
+ *	Names of hidden DBs contain a NUL, and are only opened here.
+ * @param[in] txn A transaction handle.
+ * @param[in] name The name of the DB.
+ * @param[in] flags Flags as for #rdb_dbi_open().
+ * @param[out] dbi Set to the DB's handle.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_dbi_open0(RDB_txn *txn, RDB_val *name, unsigned int flags, RDB_dbi *dbi)
+{
+	RDB_val key, data;
+	RDB_dbi i;
+	RDB_cursor mc;
+	RDB_db dummy;
+	int rc, dbflag, exact;
+	unsigned int unused = 0, nfree, seq;
+	uint16_t mdflags;
+	char *namedup;
+	size_t len = name->mv_size;
+
 	if (txn->mt_dbxs[MAIN_DBI].md_cmp == NULL) {
 		rdb_default_cmp(txn, MAIN_DBI);
 	}
 
 	/* Is the DB already open? */
-	len = strlen(name);
+	nfree = txn->mt_env->me_maxdbs - txn->mt_numdbs;
 	for (i=CORE_DBS; i<txn->mt_numdbs; i++) {
 		if (!txn->mt_dbxs[i].md_name.mv_size) {
 			/* Remember this free slot */
 			if (!unused) unused = i;
+			nfree++;
 			continue;
 		}
 		if (len == txn->mt_dbxs[i].md_name.mv_size &&
-			!strncmp(name, txn->mt_dbxs[i].md_name.mv_data, len)) {
+			!memcmp(name->mv_data, txn->mt_dbxs[i].md_name.mv_data, len)) {
 			*dbi = i;
+			/* Adding a filter to a DB that is already open */
+			if ((flags & (RDB_BLOOM|RDB_CREATE)) == (RDB_BLOOM|RDB_CREATE) &&
+				!F_ISSET(txn->mt_flags, RDB_TXN_RDONLY) &&
+				!rdb_bloom_dbi(txn, i)) {
+				if (txn->mt_dbflags[i] & DB_STALE) {
+					RDB_xcursor mx;
+					/* Refresh the record before changing it */
+					rdb_cursor_init(&mc, txn, i, &mx);
+				}
+				if (!(txn->mt_dbs[i].md_flags & RDB_BLOOM)) {
+					txn->mt_dbs[i].md_flags |= RDB_BLOOM;
+					txn->mt_dbflags[i] |= DB_DIRTY;
+					txn->mt_flags |= RDB_TXN_DIRTY;
+				}
+				return rdb_bloom_open(txn, i);
+			}
 			return RDB_SUCCESS;
 		}
 	}
 
 	/* If no free slot and max hit, fail */
-	if (!unused && txn->mt_numdbs >= txn->mt_env->me_maxdbs)
+	if (!nfree)
 		return RDB_DBS_FULL;
 
 	/* Cannot mix named databases with some mainDB flags */
@@ -10205,8 +14967,7 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 	/* Find the DB info */
 	dbflag = DB_NEW|DB_VALID|DB_USRVALID;
 	exact = 0;
-	key.mv_size = len;
-	key.mv_data = (void *)name;
+	key = *name;
 	rdb_cursor_init(&mc, txn, MAIN_DBI, NULL);
 	rc = rdb_cursor_set(&mc, &key, &data, RDB_SET, &exact);
 	if (rc == RDB_SUCCESS) {
@@ -10214,16 +14975,28 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 		RDB_node *node = NODEPTR(mc.mc_pg[mc.mc_top], mc.mc_ki[mc.mc_top]);
 		if ((node->mn_flags & (F_DUPDATA|F_SUBDATA)) != F_SUBDATA)
 			return RDB_INCOMPATIBLE;
+		memcpy(&mdflags, (char *)data.mv_data + offsetof(RDB_db, md_flags),
+			sizeof(uint16_t));
 	} else {
 		if (rc != RDB_NOTFOUND || !(flags & RDB_CREATE))
 			return rc;
 		if (F_ISSET(txn->mt_flags, RDB_TXN_RDONLY))
 			return EACCES;
-	}
+		mdflags = flags & PERSISTENT_FLAGS;
+	}
+	/* Adding a filter to an existing DB takes a write txn */
+	if ((flags & (RDB_BLOOM|RDB_CREATE)) == (RDB_BLOOM|RDB_CREATE) &&
+		!F_ISSET(txn->mt_flags, RDB_TXN_RDONLY))
+		mdflags |= RDB_BLOOM;
+	/* The filter is a second DB */
+	if ((mdflags & RDB_BLOOM) && nfree < 2)
+		return RDB_DBS_FULL;
 
 	/* Done here so we cannot fail after creating a new DB */
-	if ((namedup = strdup(name)) == NULL)
+	if ((namedup = malloc(len + 1)) == NULL)
 		return ENOMEM;
+	memcpy(namedup, name->mv_data, len);
+	namedup[len] = '\0';
 
 	if (rc) {
 		/* RDB_NOTFOUND and RDB_CREATE: Create new DB */
@@ -10231,7 +15004,7 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 		data.mv_data = &dummy;
 		memset(&dummy, 0, sizeof(dummy));
 		dummy.md_root = P_INVALID;
-		dummy.md_flags = flags & PERSISTENT_FLAGS;
+		dummy.md_flags = mdflags;
 		WITH_CURSOR_TRACKING(mc,
 			rc = _rdb_cursor_put(&mc, &key, &data, F_SUBDATA));
 		dbflag |= DB_DIRTY;
@@ -10245,6 +15018,7 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 		txn->mt_dbxs[slot].md_name.mv_data = namedup;
 		txn->mt_dbxs[slot].md_name.mv_size = len;
 		txn->mt_dbxs[slot].md_rel = NULL;
+		txn->mt_dbxs[slot].md_bloom = 0;
 		txn->mt_dbflags[slot] = dbflag;
 		/* txn-> and env-> are the same in read txns, use
 		 * tmp variable to avoid undefined assignment
@@ -10258,7 +15032,16 @@ int rdb_dbi_open(RDB_txn *txn, const char *name, unsigned int flags, RDB_dbi *db
 		if (!unused) {
 			txn->mt_numdbs++;
 		}
-		RDB_TRACE(("%p, %s, %u = %u", txn, name, flags, slot));
+		RDB_TRACE(("%p, %s, %u = %u", txn, namedup, flags, slot));
+
+		if (mdflags & RDB_BLOOM) {
+			if (!(txn->mt_dbs[slot].md_flags & RDB_BLOOM)) {
+				txn->mt_dbs[slot].md_flags |= RDB_BLOOM;
+				txn->mt_dbflags[slot] |= DB_DIRTY;
+				txn->mt_flags |= RDB_TXN_DIRTY;
+			}
+			rc = rdb_bloom_open(txn, slot);
+		}
 	}
 
 	return rc;
@@ -10290,12 +15073,18 @@ void rdb_dbi_close(RDB_env *env, RDB_dbi dbi)
 	ptr = env->me_dbxs[dbi].md_name.mv_data;
 	/* If there was no name, this was already closed */
 	if (ptr) {
+		RDB_dbi b = env->me_dbxs[dbi].md_bloom;
 		RDB_TRACE(("%p, %u", env, dbi));
 		env->me_dbxs[dbi].md_name.mv_data = NULL;
 		env->me_dbxs[dbi].md_name.mv_size = 0;
+		env->me_dbxs[dbi].md_bloom = 0;
+		env->me_dbxs[dbi].md_pinned = 0;
 		env->me_dbflags[dbi] = 0;
 		env->me_dbiseqs[dbi]++;
 		free(ptr);
+		/* The filter DB goes with it */
+		if (b)
+			rdb_dbi_close(env, b);
 	}
 }
 
@@ -10308,6 +15097,361 @@ int rdb_dbi_flags(RDB_txn *txn, RDB_dbi dbi, unsigned int *flags)
 	return RDB_SUCCESS;
 }
 
+/** Pass an access hint for the pages under the cursor's current page
+ *	that hold keys from \b lo to \b hi on to the OS, see #rdb_dbi_advise().
+ *	Leaves are not read, their numbers are taken from their parents.
+ * @param[in] mc The cursor, on a page of the tree.
+ * @param[in] lo The lowest key, or NULL for no lower bound.
+ * @param[in] hi The highest key, or NULL for no upper bound.
+ * @param[in,out] ar The run of pages collected so far.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_advise_tree(RDB_cursor *mc, RDB_val *lo, RDB_val *hi, RDB_advrun *ar)
+{
+	RDB_env *env = mc->mc_txn->mt_env;
+	RDB_page *mp = mc->mc_pg[mc->mc_top], *child;
+	RDB_node *node;
+	unsigned int i, first, last;
+	int rc, exact, leaves;
+	pgno_t pgno;
+
+	if ((rc = rdb_advrun_add(env, ar, mp->mp_pgno)) || !IS_BRANCH(mp))
+		return rc;
+
+	first = 0;
+	last = NUMKEYS(mp) - 1;
+	/* Pick the children the same way #rdb_page_search_root() does */
+	if (lo && (node = rdb_node_search(mc, lo, &exact))) {
+		first = mc->mc_ki[mc->mc_top];
+		if (!exact && first)
+			first--;
+	} else if (lo) {
+		first = last;
+	}
+	if (hi && (node = rdb_node_search(mc, hi, &exact))) {
+		last = mc->mc_ki[mc->mc_top];
+		if (!exact && last)
+			last--;
+	}
+
+	/* Hashed DBs have buckets of differing depth */
+	leaves = !(mc->mc_db->md_flags & RDB_HASHED) &&
+		mc->mc_snum + 1u >= mc->mc_db->md_depth;
+	for (i = first; i <= last; i++) {
+		pgno = NODEPGNO(NODEPTR(mp, i));
+		if (leaves) {
+			rc = rdb_advrun_add(env, ar, pgno);
+		} else {
+			if ((rc = rdb_page_get(mc, pgno, &child, NULL)) != 0)
+				return rc;
+			mc->mc_ki[mc->mc_top] = i;
+			if ((rc = rdb_cursor_push(mc, child)) != 0)
+				return rc;
+			rc = rdb_advise_tree(mc, i == first ? lo : NULL,
+				i == last ? hi : NULL, ar);
+			rdb_cursor_pop(mc);
+		}
+		if (rc)
+			return rc;
+	}
+	return RDB_SUCCESS;
+}
+
+int
+rdb_dbi_advise(RDB_txn *txn, RDB_dbi dbi, RDB_val *lo, RDB_val *hi, int advice)
+{
+	RDB_cursor mc;
+	RDB_xcursor mx;
+	RDB_advrun ar;
+	int rc;
+
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID) ||
+		advice < RDB_ADV_NORMAL || advice > RDB_ADV_COLD)
+		return EINVAL;
+
+	if (txn->mt_flags & RDB_TXN_BLOCKED)
+		return RDB_BAD_TXN;
+
+	/* A hashed DB's pages are in no key order */
+	if ((lo || hi) && (txn->mt_dbs[dbi].md_flags & RDB_HASHED))
+		return RDB_INCOMPATIBLE;
+
+	rdb_cursor_init(&mc, txn, dbi, &mx);
+	rc = rdb_page_search(&mc, NULL, RDB_PS_ROOTONLY);
+	if (rc)
+		return rc == RDB_NOTFOUND ? RDB_SUCCESS : rc;
+
+	ar.ar_count = 0;
+	ar.ar_advice = advice;
+	rc = rdb_advise_tree(&mc, lo, hi, &ar);
+	if (!rc && ar.ar_count)
+		rc = rdb_env_madvise(txn->mt_env, ar.ar_pgno, ar.ar_count, advice);
+	return rc;
+}
+
+/** @defgroup pinning	Branch page pinning
+ *	#rdb_dbi_pin() locks the branch pages of a DB in memory. The env
+ *	keeps a sorted list of every page it locked. A commit collects the
+ *	branch pages it wrote for pinned DBs and the locked pages it freed,
+ *	and once the commit is durable those are locked and unlocked, so
+ *	the list follows the trees as copy-on-write moves their pages.
+ *	@{
+ */
+/** Lock a page in memory, or unlock it.
+ *	With pages smaller than the OS's, this takes in their neighbours.
+ * @param[in] env The environment.
+ * @param[in] pgno The page.
+ * @param[in] lock Non-zero to lock the page, zero to unlock it.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_page_mlock(RDB_env *env, pgno_t pgno, int lock)
+{
+	size_t off = (size_t)pgno * env->me_psize;
+	size_t skew = off & (env->me_os_psize - 1);
+	char *ptr = env->me_map + off - skew;
+	size_t len = env->me_psize + skew;
+
+#ifdef _WIN32
+	if (!(lock ? VirtualLock(ptr, len) : VirtualUnlock(ptr, len)))
+		return ErrCode();
+#else
+	if (lock ? mlock(ptr, len) : munlock(ptr, len))
+		return ErrCode();
+#endif
+	return RDB_SUCCESS;
+}
+
+/** Check if a write txn, or one of its parents, wrote a page.
+ *	Those pages may not be in the data file yet.
+ */
+static int
+rdb_page_written(RDB_txn *txn, pgno_t pgno)
+{
+	RDB_ID2L dl;
+	pgno_t pn = pgno << 1;
+	unsigned int x;
+
+	if (txn->mt_flags & RDB_TXN_RDONLY)
+		return 0;
+	for (; txn; txn = txn->mt_parent) {
+		dl = txn->mt_u.dirty_list;
+		x = rdb_mid2l_search(dl, pgno);
+		if (x <= dl[0].mid && dl[x].mid == pgno)
+			return 1;
+		if (txn->mt_spill_pgs) {
+			x = rdb_ridl_search(txn->mt_spill_pgs, pn);
+			if (x <= txn->mt_spill_pgs[0] && txn->mt_spill_pgs[x] == pn)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/** Collect the branch pages under the cursor's current page.
+ *	Leaves are not read, as in #rdb_advise_tree().
+ * @param[in] mc The cursor, on a page of the tree.
+ * @param[in] written If set, only walk the pages the txn wrote. Those
+ *	are all reached through other pages it wrote, starting at the root.
+ *	Otherwise walk the whole tree, but leave those pages out.
+ * @param[in,out] pins The list to append the pages to.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_pin_tree(RDB_cursor *mc, int written, RDB_IDL *pins)
+{
+	RDB_txn *txn = mc->mc_txn;
+	RDB_db *db = mc->mc_db;
+	RDB_page *mp = mc->mc_pg[mc->mc_top], *child;
+	unsigned int i, dir;
+	pgno_t pgno;
+	int rc;
+
+	if (!IS_BRANCH(mp))
+		return RDB_SUCCESS;
+	if ((written || !rdb_page_written(txn, mp->mp_pgno)) &&
+		(rc = rdb_ridl_append(pins, mp->mp_pgno)))
+		return rc;
+	if (!(db->md_flags & RDB_HASHED)) {
+		if (mc->mc_snum + 1u >= db->md_depth)
+			return RDB_SUCCESS;
+	} else if (!written) {
+		/* The directory has a known depth, the buckets under it don't.
+		 * Their roots are only read if some bucket has branch pages,
+		 * and in a bucket the first child tells if the rest are leaves.
+		 */
+		dir = rdb_hash_depth(txn->mt_env, HASH_NBUCKETS(db));
+		if (mc->mc_snum == dir && db->md_branch_pages <=
+			rdb_hash_dirpages(txn->mt_env, HASH_NBUCKETS(db)))
+			return RDB_SUCCESS;
+		if (mc->mc_snum > dir) {
+			if ((rc = rdb_page_get(mc, NODEPGNO(NODEPTR(mp, 0)), &child, NULL)) != 0)
+				return rc;
+			if (!IS_BRANCH(child))
+				return RDB_SUCCESS;
+		}
+	}
+
+	for (i = 0; i < NUMKEYS(mp); i++) {
+		pgno = NODEPGNO(NODEPTR(mp, i));
+		if (written && !rdb_page_written(txn, pgno))
+			continue;
+		if ((rc = rdb_page_get(mc, pgno, &child, NULL)) != 0)
+			return rc;
+		mc->mc_ki[mc->mc_top] = i;
+		if ((rc = rdb_cursor_push(mc, child)) != 0)
+			return rc;
+		rc = rdb_pin_tree(mc, written, pins);
+		rdb_cursor_pop(mc);
+		if (rc)
+			return rc;
+	}
+	return RDB_SUCCESS;
+}
+
+/** Collect what a commit changes for pinned DBs: the branch pages
+ *	it wrote for them, and the locked pages it freed.
+ * @param[in] txn A top-level write txn, about to save its free list.
+ * @param[out] pins The pages to lock, allocated if there are any.
+ * @param[out] unpins The pages to unlock, allocated if there are any.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+rdb_pin_changes(RDB_txn *txn, RDB_IDL *pins, RDB_IDL *unpins)
+{
+	RDB_env *env = txn->mt_env;
+	RDB_IDL pl = env->me_pinned, fl = txn->mt_free_pgs;
+	RDB_cursor mc;
+	RDB_xcursor mx;
+	unsigned int i, x;
+	int rc;
+
+	for (i = MAIN_DBI; i < txn->mt_numdbs; i++) {
+		if (!env->me_dbxs[i].md_pinned || !(txn->mt_dbflags[i] & DB_DIRTY) ||
+			!rdb_page_written(txn, txn->mt_dbs[i].md_root))
+			continue;
+		if (!*pins && !(*pins = rdb_ridl_alloc(RDB_IDL_UM_MAX)))
+			return ENOMEM;
+		rdb_cursor_init(&mc, txn, i, &mx);
+		if ((rc = rdb_page_search(&mc, NULL, RDB_PS_ROOTONLY)) ||
+			(rc = rdb_pin_tree(&mc, 1, pins)))
+			return rc;
+	}
+
+	for (i = 1; i <= fl[0] && pl[0]; i++) {
+		x = rdb_ridl_search(pl, fl[i]);
+		if (x > pl[0] || pl[x] != fl[i])
+			continue;
+		if (!*unpins && !(*unpins = rdb_ridl_alloc(RDB_IDL_DB_MAX)))
+			return ENOMEM;
+		if ((rc = rdb_ridl_append(unpins, fl[i])))
+			return rc;
+	}
+	return RDB_SUCCESS;
+}
+
+/** Unlock pages and lock others, and update the list of locked pages.
+ * @param[in] env The environment.
+ * @param[in,out] pins Pages to lock, or NULL. Pages already locked
+ *	are skipped. The list is sorted and left with the pages locked.
+ * @param[in,out] unpins Pages to unlock, or NULL. Pages that aren't
+ *	locked are skipped. The list is sorted.
+ * @param[in] strict If set, lock either all of \b pins or none of them.
+ *	Otherwise lock as many as possible.
+ * @return 0 on success, otherwise the first error.
+ */
+static int
+rdb_pin_apply(RDB_env *env, RDB_IDL pins, RDB_IDL unpins, int strict)
+{
+	RDB_IDL pl = env->me_pinned;
+	unsigned int i, j, k, x;
+	int rc = RDB_SUCCESS, err;
+
+	if (unpins && unpins[0]) {
+		rdb_ridl_sort(unpins);
+		for (i = j = k = 1; i <= pl[0]; i++) {
+			while (k <= unpins[0] && unpins[k] > pl[i])
+				k++;
+			if (k <= unpins[0] && unpins[k] == pl[i])
+				(void) rdb_page_mlock(env, pl[i], 0);
+			else
+				pl[j++] = pl[i];
+		}
+		pl[0] = j - 1;
+	}
+
+	if (pins && pins[0]) {
+		rdb_ridl_sort(pins);
+		for (i = j = 1; i <= pins[0]; i++) {
+			x = rdb_ridl_search(pl, pins[i]);
+			if (x <= pl[0] && pl[x] == pins[i])
+				continue;
+			if (!(err = rdb_page_mlock(env, pins[i], 1)))
+				pins[j++] = pins[i];
+			else if (!rc)
+				rc = err;
+			if (rc && strict)
+				break;
+		}
+		pins[0] = j - 1;
+		if (rdb_ridl_need(&env->me_pinned, pins[0])) {
+			rc = ENOMEM;
+			strict = 1;
+		}
+		if (rc && strict) {
+			for (i = 1; i <= pins[0]; i++)
+				(void) rdb_page_mlock(env, pins[i], 0);
+			pins[0] = 0;
+		}
+		rdb_ridl_xmerge(env->me_pinned, pins);
+	}
+	env->me_pinbytes = env->me_pinned[0] * env->me_psize;
+	return rc;
+}
+
+int
+rdb_dbi_pin(RDB_txn *txn, RDB_dbi dbi, int onoff)
+{
+	RDB_env *env;
+	RDB_cursor mc;
+	RDB_xcursor mx;
+	RDB_IDL pages;
+	int rc;
+
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (F_ISSET(txn->mt_flags, RDB_TXN_RDONLY))
+		return EACCES;
+
+	if (txn->mt_flags & RDB_TXN_BLOCKED)
+		return RDB_BAD_TXN;
+
+	env = txn->mt_env;
+	if (!onoff == !env->me_dbxs[dbi].md_pinned)
+		return RDB_SUCCESS;
+	if (!env->me_pinned && !(env->me_pinned = rdb_ridl_alloc(RDB_IDL_DB_MAX)))
+		return ENOMEM;
+	if (!(pages = rdb_ridl_alloc(RDB_IDL_UM_MAX)))
+		return ENOMEM;
+
+	rdb_cursor_init(&mc, txn, dbi, &mx);
+	rc = rdb_page_search(&mc, NULL, RDB_PS_ROOTONLY);
+	if (rc == RDB_SUCCESS)
+		rc = rdb_pin_tree(&mc, 0, &pages);
+	else if (rc == RDB_NOTFOUND)
+		rc = RDB_SUCCESS;
+	if (rc == RDB_SUCCESS)
+		rc = onoff ? rdb_pin_apply(env, pages, NULL, 1) :
+			rdb_pin_apply(env, NULL, pages, 1);
+	if (rc == RDB_SUCCESS)
+		env->me_dbxs[dbi].md_pinned = onoff != 0;
+	rdb_ridl_free(pages);
+	return rc;
+}
+/** @} */
+
 /** Add all the DB's pages to the free list.
  * @param[in] mc Cursor on the DB to free.
  * @param[in] subs non-Zero to check for sub-DBs in this DB.
@@ -10426,7 +15570,12 @@ int rdb_drop(RDB_txn *txn, RDB_dbi dbi, int del)
 		return rc;
 
 	RDB_TRACE(("%u, %d", dbi, del));
-	rc = rdb_drop0(mc, mc->mc_db->md_flags & RDB_DUPSORT);
+	if (mc->mc_db->md_flags & RDB_HASHED) {
+		if ((rc = rdb_hash_free(mc, mc->mc_db->md_root)) != 0)
+			txn->mt_flags |= RDB_TXN_ERROR;
+	} else {
+		rc = rdb_drop0(mc, mc->mc_db->md_flags & RDB_DUPSORT);
+	}
 	/* Invalidate the dropped DB's cursors */
 	for (m2 = txn->mt_cursors[dbi]; m2; m2 = m2->mc_next)
 		m2->mc_flags &= ~(C_INITIALIZED|C_EOF);
@@ -10435,6 +15584,9 @@ int rdb_drop(RDB_txn *txn, RDB_dbi dbi, int del)
 
 	/* Can't delete the main DB */
 	if (del && dbi >= CORE_DBS) {
+		RDB_dbi b = rdb_bloom_dbi(txn, dbi);
+		if (b && (rc = rdb_drop(txn, b, 1)) != RDB_SUCCESS)
+			goto leave;
 		rc = rdb_del0(txn, MAIN_DBI, &mc->mc_dbx->md_name, NULL, F_SUBDATA);
 		if (!rc) {
 			txn->mt_dbflags[dbi] = DB_STALE;
@@ -10451,8 +15603,13 @@ int rdb_drop(RDB_txn *txn, RDB_dbi dbi, int del)
 		txn->mt_dbs[dbi].md_overflow_pages = 0;
 		txn->mt_dbs[dbi].md_entries = 0;
 		txn->mt_dbs[dbi].md_root = P_INVALID;
+		if (txn->mt_dbs[dbi].md_flags & RDB_HASHED)
+			HASH_NBUCKETS(&txn->mt_dbs[dbi]) = 0;
 
 		txn->mt_flags |= RDB_TXN_DIRTY;
+		/* Start the filter over too */
+		if (rdb_bloom_dbi(txn, dbi))
+			rc = rdb_bloom_init(txn, dbi, 0);
 	}
 leave:
 	rdb_cursor_close(mc);
@@ -10663,9 +15820,14 @@ rdb_mutex_failed(RDB_env *env, rdb_mutexref_t mutex, int rc)
 		if (!rlocked) {
 			/* Keep mti_txnid updated, otherwise next writer can
 			 * overwrite data which latest meta page refers to.
+			 * Commits still in the lock file stand, their pages
+			 * were written before they were published.
 			 */
 			meta = rdb_env_pick_meta(env);
-			env->me_txns->mti_txnid = meta->mm_txnid;
+			if (env->me_txns->mti_txnid < meta->mm_txnid)
+				env->me_txns->mti_txnid = meta->mm_txnid;
+			if (env->me_txns->mti_durable < meta->mm_txnid)
+				env->me_txns->mti_durable = meta->mm_txnid;
 			/* env is hosed if the dead thread was ours */
 			if (env->me_txn) {
 				env->me_flags |= RDB_FATAL_ERROR;
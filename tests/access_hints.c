@@ -0,0 +1,146 @@
+/* access_hints.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_dbi_advise and rdb_cursor_advise: hints must be
+ * accepted for any range and never change what a scan returns.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	60000
+
+static char kbuf[2][16];
+
+static void setkey(RDB_val *key, int which, int i)
+{
+	key->mv_size = sprintf(kbuf[which], "key-%08d", i);
+	key->mv_data = kbuf[which];
+}
+
+/* Every key in both directions, with the read-ahead hint on or off */
+static void scan(RDB_txn *txn, RDB_dbi dbi, int advice)
+{
+	int i, rc;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	E(rdb_cursor_advise(cursor, advice));
+	for (i = 0; (rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0; i++)
+		CHECK(*(int *)data.mv_data == i, "forward scan");
+	CHECK(rc == RDB_NOTFOUND && i == COUNT, "forward scan count");
+	E(rdb_cursor_get(cursor, &key, &data, RDB_LAST));
+	for (i = COUNT - 1; (rc = rdb_cursor_get(cursor, &key, &data, RDB_PREV)) == 0; )
+		CHECK(*(int *)data.mv_data == --i, "backward scan");
+	CHECK(rc == RDB_NOTFOUND && i == 0, "backward scan count");
+	rdb_cursor_close(cursor);
+}
+
+static void advise(RDB_txn *txn, RDB_dbi dbi)
+{
+	int rc, adv, n;
+	RDB_val k1, k2;
+	static const int bounds[][2] = {
+		{ 0, COUNT - 1 }, { 100, 200 }, { 30000, 30000 },
+		{ 200, 100 }, { -1, 5 }, { COUNT - 5, COUNT + 5 }, { COUNT + 1, COUNT + 9 }
+	};
+
+	for (adv = RDB_ADV_NORMAL; adv <= RDB_ADV_COLD; adv++) {
+		E(rdb_dbi_advise(txn, dbi, NULL, NULL, adv));
+		for (n = 0; n < (int)(sizeof(bounds) / sizeof(bounds[0])); n++) {
+			setkey(&k1, 0, bounds[n][0]);
+			setkey(&k2, 1, bounds[n][1]);
+			E(rdb_dbi_advise(txn, dbi, &k1, &k2, adv));
+			E(rdb_dbi_advise(txn, dbi, &k1, NULL, adv));
+			E(rdb_dbi_advise(txn, dbi, NULL, &k2, adv));
+		}
+	}
+	/* Leave the map as it was */
+	E(rdb_dbi_advise(txn, dbi, NULL, NULL, RDB_ADV_NORMAL));
+	rc = rdb_dbi_advise(txn, dbi, NULL, NULL, RDB_ADV_COLD + 1);
+	CHECK(rc == EINVAL, "bad advice accepted");
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc;
+	RDB_env *env;
+	RDB_dbi dbi, hashed;
+	RDB_txn *txn;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	char val[64];
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "hints", RDB_CREATE, &dbi));
+	/* An empty DB has nothing to advise on */
+	E(rdb_dbi_advise(txn, dbi, NULL, NULL, RDB_ADV_WILLNEED));
+	memset(val, 'v', sizeof(val));
+	data.mv_size = sizeof(val);
+	data.mv_data = val;
+	for (i = 0; i < COUNT; i++) {
+		setkey(&key, 0, i);
+		memcpy(val, &i, sizeof(int));
+		E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+	}
+	/* Dirty pages are fine too */
+	advise(txn, dbi);
+	scan(txn, dbi, RDB_ADV_SEQUENTIAL);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	advise(txn, dbi);
+	rc = rdb_dbi_advise(txn, 99, NULL, NULL, RDB_ADV_NORMAL);
+	CHECK(rc == EINVAL, "bad dbi accepted");
+	scan(txn, dbi, RDB_ADV_SEQUENTIAL);
+	scan(txn, dbi, RDB_ADV_RANDOM);
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	rc = rdb_cursor_advise(cursor, RDB_ADV_WILLNEED);
+	CHECK(rc == EINVAL, "cursor took a range hint");
+	rdb_cursor_close(cursor);
+	rdb_txn_abort(txn);
+
+	/* Hashed DBs only take hints for all of their pages */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "hinted-hash", RDB_CREATE|RDB_HASHED, &hashed));
+	for (i = 0; i < COUNT; i += 3) {
+		setkey(&key, 0, i);
+		memcpy(val, &i, sizeof(int));
+		E(rdb_put(txn, hashed, &key, &data, 0));
+	}
+	E(rdb_dbi_advise(txn, hashed, NULL, NULL, RDB_ADV_WILLNEED));
+	setkey(&key, 0, 3);
+	rc = rdb_dbi_advise(txn, hashed, &key, NULL, RDB_ADV_WILLNEED);
+	CHECK(rc == RDB_INCOMPATIBLE, "range hint on hashed DB");
+	E(rdb_drop(txn, hashed, 1));
+	E(rdb_txn_commit(txn));
+
+	rdb_env_close(env);
+	printf("Access hints accepted\n");
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+/* batch.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for write batches: random puts and deletes across plain, dupsort
+ * and hashed DBs, applied as batches, must leave the same items as the
+ * same writes made one by one with rdb_put and rdb_del.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define DBPATH	"./tests/db/batch.rdb"
+#define KEYS	5000
+#define WRITES	3000	/* per batch */
+#define ROUNDS	20
+#define BIGSIZE	5000
+#define NDBS	3	/* plain, dupsort, hashed */
+
+static const char *names[NDBS] = { "plain", "dups", "hashed" };
+static const unsigned int dbflags[NDBS] = { 0, RDB_DUPSORT, RDB_HASHED };
+static char val[BIGSIZE];
+static unsigned long seed = 12345;
+
+static unsigned int rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* Each DB's copy written by batches, and one written item by item */
+static void open_dbs(RDB_txn *txn, RDB_dbi *bat, RDB_dbi *ref)
+{
+	int i, rc;
+	char name[32];
+
+	for (i = 0; i < NDBS; i++) {
+		sprintf(name, "b-%s", names[i]);
+		E(rdb_dbi_open(txn, name, RDB_CREATE|dbflags[i], &bat[i]));
+		sprintf(name, "r-%s", names[i]);
+		E(rdb_dbi_open(txn, name, RDB_CREATE|dbflags[i], &ref[i]));
+	}
+}
+
+/* The same items in both, in the same order unless hashed */
+static void compare(RDB_txn *txn, RDB_dbi bat, RDB_dbi ref, int hashed)
+{
+	int rc, rc2;
+	RDB_cursor *bc, *rcur;
+	RDB_val bk, bd, rk, rd, data;
+	RDB_stat bs, rs;
+
+	E(rdb_stat(txn, bat, &bs));
+	E(rdb_stat(txn, ref, &rs));
+	CHECK(bs.ms_entries == rs.ms_entries, "entries");
+	E(rdb_cursor_open(txn, bat, &bc));
+	E(rdb_cursor_open(txn, ref, &rcur));
+	for (;;) {
+		rc = rdb_cursor_get(bc, &bk, &bd, RDB_NEXT);
+		rc2 = rdb_cursor_get(rcur, &rk, &rd, RDB_NEXT);
+		if (hashed && !rc) {
+			/* Look each up instead */
+			rc2 = rdb_get(txn, ref, &bk, &data);
+			CHECK(rc2 == 0 && data.mv_size == bd.mv_size &&
+				!memcmp(data.mv_data, bd.mv_data, bd.mv_size), "hashed item");
+			continue;
+		}
+		CHECK(rc == rc2, "item count");
+		if (rc)
+			break;
+		CHECK(bk.mv_size == rk.mv_size && !memcmp(bk.mv_data, rk.mv_data, bk.mv_size),
+			"key");
+		CHECK(bd.mv_size == rd.mv_size && !memcmp(bd.mv_data, rd.mv_data, bd.mv_size),
+			"data");
+	}
+	CHECK(rc == RDB_NOTFOUND, "scan");
+	rdb_cursor_close(bc);
+	rdb_cursor_close(rcur);
+}
+
+/* One random write, to the batch and straight to the reference DB */
+static void write1(RDB_txn *txn, RDB_batch *batch, RDB_dbi *bat, RDB_dbi *ref)
+{
+	int d = rnd() % NDBS, op = rnd() % 10, rc;
+	RDB_val key, data, res;
+	char kbuf[16], dbuf[16];
+	unsigned int flags = 0;
+
+	key.mv_size = sprintf(kbuf, "%06u", rnd() % KEYS);
+	key.mv_data = kbuf;
+	if (d == 1) {
+		data.mv_size = sprintf(dbuf, "%04u", rnd() % 20);
+		data.mv_data = dbuf;
+	} else {
+		data.mv_size = rnd() % 50 == 0 ? BIGSIZE : 4 + rnd() % 40;
+		data.mv_data = val + rnd() % 64;
+		if (data.mv_size == BIGSIZE)
+			data.mv_data = val;
+	}
+	switch (op) {
+	case 0: case 1: case 2:
+		/* Delete all of a key's items, or a duplicate */
+		E(rdb_batch_del(batch, bat[d], &key, op == 2 ? &data : NULL));
+		rc = rdb_del(txn, ref[d], &key, op == 2 ? &data : NULL);
+		CHECK(rc == 0 || rc == RDB_NOTFOUND, "rdb_del");
+		return;
+	case 3:
+		flags = d == 1 ? RDB_NODUPDATA : RDB_NOOVERWRITE;
+		break;
+	case 4:
+		res = data;
+		E(rdb_batch_put(batch, bat[d], &key, &res, RDB_RESERVE));
+		memcpy(res.mv_data, data.mv_data, data.mv_size);
+		E(rdb_put(txn, ref[d], &key, &data, 0));
+		return;
+	}
+	E(rdb_batch_put(batch, bat[d], &key, &data, flags));
+	rc = rdb_put(txn, ref[d], &key, &data, flags);
+	CHECK(rc == 0 || rc == RDB_KEYEXIST, "rdb_put");
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi bat[NDBS], ref[NDBS];
+	RDB_batch *batch;
+	RDB_val key, data;
+
+	for (i = 0; i < BIGSIZE; i++)
+		val[i] = 'a' + i % 26;
+	remove(DBPATH);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_maxdbs(env, 2 * NDBS));
+	E(rdb_env_set_mapsize(env, 10485760*16));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	open_dbs(txn, bat, ref);
+	E(rdb_txn_commit(txn));
+	E(rdb_batch_create(&batch));
+
+	for (j = 0; j < ROUNDS; j++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		rdb_batch_reset(batch);
+		for (i = 0; i < WRITES; i++)
+			write1(txn, batch, bat, ref);
+		E(rdb_batch_apply(txn, batch));
+		for (i = 0; i < NDBS; i++)
+			compare(txn, bat[i], ref[i], dbflags[i] & RDB_HASHED);
+		E(rdb_txn_commit(txn));
+	}
+
+	/* A batch can be applied again, here after an abort */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_drop(txn, bat[0], 0));
+	E(rdb_batch_apply(txn, batch));
+	rdb_txn_abort(txn);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_batch_apply(txn, batch));
+	for (i = 0; i < NDBS; i++)
+		compare(txn, bat[i], ref[i], dbflags[i] & RDB_HASHED);
+	rdb_txn_abort(txn);
+
+	/* Emptying a DB and filling it again in one batch */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rdb_batch_reset(batch);
+	for (i = 0; i < KEYS; i++) {
+		key.mv_size = sprintf(val, "%06d", i);
+		key.mv_data = val;
+		E(rdb_batch_del(batch, bat[0], &key, NULL));
+	}
+	for (i = KEYS - 1; i >= 0; i -= 2) {
+		key.mv_size = sprintf(val, "%06d", i);
+		key.mv_data = val;
+		data = key;
+		E(rdb_batch_put(batch, bat[0], &key, &data, 0));
+	}
+	E(rdb_batch_apply(txn, batch));
+	E(rdb_drop(txn, ref[0], 0));
+	for (i = 1; i < KEYS; i += 2) {
+		key.mv_size = sprintf(val, "%06d", i);
+		key.mv_data = val;
+		data = key;
+		E(rdb_put(txn, ref[0], &key, &data, 0));
+	}
+	compare(txn, bat[0], ref[0], 0);
+	E(rdb_txn_commit(txn));
+
+	/* Deleting a dense range, keeping one key in eight, with a few puts
+	 * in between. The batch rebalances each leaf once it moves past it.
+	 */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rdb_batch_reset(batch);
+	for (i = KEYS / 5; i < KEYS * 4 / 5; i++) {
+		key.mv_size = sprintf(val, "%06d", i);
+		key.mv_data = val;
+		data = key;
+		if (i % 64 == 0) {
+			E(rdb_batch_put(batch, bat[0], &key, &data, 0));
+			E(rdb_put(txn, ref[0], &key, &data, 0));
+		} else if (i % 2 && i % 16 != 1) {
+			E(rdb_batch_del(batch, bat[0], &key, NULL));
+			E(rdb_del(txn, ref[0], &key, NULL));
+		}
+	}
+	E(rdb_batch_apply(txn, batch));
+	compare(txn, bat[0], ref[0], 0);
+	E(rdb_txn_commit(txn));
+
+	rc = rdb_batch_put(batch, bat[0], &key, &data, RDB_APPEND);
+	CHECK(rc == EINVAL, "RDB_APPEND in a batch");
+	E(rdb_batch_put(batch, 99, &key, &data, 0));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_batch_apply(txn, batch);
+	CHECK(rc == EINVAL, "invalid DB in a batch");
+	rdb_txn_abort(txn);
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	rc = rdb_batch_apply(txn, batch);
+	CHECK(rc == EACCES, "batch in a read-only transaction");
+	rdb_txn_abort(txn);
+
+	rdb_batch_free(batch);
+	rdb_env_close(env);
+	printf("%d batches of %d writes checked\n", ROUNDS, WRITES);
+	return 0;
+}
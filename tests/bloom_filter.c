@@ -0,0 +1,273 @@
+/* bloom_filter.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for RDB_BLOOM: lookups must never miss a key that is present */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	20000
+#define BATCH	100
+
+static char keys[COUNT][16];
+
+/* want[i] says whether key i should be present */
+static void check(RDB_txn *txn, RDB_dbi dbi, const char *want)
+{
+	int i, j, rc, rcs[BATCH];
+	RDB_cursor *cursor;
+	RDB_val key, data, bkeys[BATCH], bvals[BATCH];
+
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = strlen(keys[i]);
+		key.mv_data = keys[i];
+		rc = rdb_get(txn, dbi, &key, &data);
+		CHECK(rc == (want[i] ? RDB_SUCCESS : RDB_NOTFOUND), "rdb_get");
+		if (!rc)
+			CHECK(data.mv_size == sizeof(int) && *(int *)data.mv_data == i, "data");
+		rc = rdb_cursor_get(cursor, &key, &data, (i & 1) ? RDB_SET : RDB_SET_KEY);
+		CHECK(rc == (want[i] ? RDB_SUCCESS : RDB_NOTFOUND), "RDB_SET");
+	}
+	/* A cursor left by a filtered miss must still step from the start */
+	key.mv_size = strlen(keys[1]);
+	key.mv_data = keys[1];
+	if (!want[1] && rdb_cursor_get(cursor, &key, &data, RDB_SET) == RDB_NOTFOUND) {
+		rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT);
+		CHECK(rc == RDB_SUCCESS || rc == RDB_NOTFOUND, "RDB_NEXT after miss");
+	}
+	rdb_cursor_close(cursor);
+
+	for (i = 0; i < COUNT; i += BATCH) {
+		for (j = 0; j < BATCH; j++) {
+			bkeys[j].mv_size = strlen(keys[i + j]);
+			bkeys[j].mv_data = keys[i + j];
+		}
+		E(rdb_get_batch(txn, dbi, bkeys, bvals, rcs, BATCH));
+		for (j = 0; j < BATCH; j++)
+			CHECK(rcs[j] == (want[i + j] ? RDB_SUCCESS : RDB_NOTFOUND), "rdb_get_batch");
+	}
+}
+
+static void put(RDB_txn *txn, RDB_dbi dbi, int i, char *want)
+{
+	int rc;
+	RDB_val key, data;
+
+	key.mv_size = strlen(keys[i]);
+	key.mv_data = keys[i];
+	data.mv_size = sizeof(int);
+	data.mv_data = &i;
+	E(rdb_put(txn, dbi, &key, &data, 0));
+	if (want)
+		want[i] = 1;
+}
+
+/* In another process: add a filter to a DB, or check the DB with it */
+static int other(const char *name, unsigned int flags, const char *want)
+{
+	int rc, status;
+	pid_t pid;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+
+	if ((pid = fork()) == 0) {
+		E(rdb_env_create(&env));
+		E(rdb_env_set_maxdbs(env, 8));
+		E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		E(rdb_dbi_open(txn, name, flags, &dbi));
+		if (want)
+			check(txn, dbi, want);
+		E(rdb_txn_commit(txn));
+		rdb_env_close(env);
+		_exit(0);
+	}
+	return pid > 0 && waitpid(pid, &status, 0) == pid &&
+		WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static size_t main_entries(RDB_txn *txn)
+{
+	int rc;
+	RDB_dbi dbi;
+	RDB_stat st;
+
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_stat(txn, dbi, &st));
+	return st.ms_entries;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc;
+	RDB_env *env;
+	RDB_dbi dbi, dbi2, plain;
+	RDB_txn *txn, *child;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	unsigned int flags;
+	size_t nmain;
+	char *want;
+
+	for (i = 0; i < COUNT; i++)
+		sprintf(keys[i], "key-%08x", i * 2654435761U);
+	want = calloc(COUNT, 1);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_dbi_open(txn, NULL, RDB_BLOOM, &dbi);
+	CHECK(rc == EINVAL, "RDB_BLOOM accepted for main DB");
+	nmain = main_entries(txn);
+	E(rdb_dbi_open(txn, "dedup", RDB_CREATE|RDB_BLOOM, &dbi));
+	E(rdb_dbi_flags(txn, dbi, &flags));
+	CHECK(flags & RDB_BLOOM, "flag not kept");
+	CHECK(main_entries(txn) == nmain + 2, "filter DB missing");
+	for (i = 0; i < COUNT; i += 3)
+		put(txn, dbi, i, want);
+	/* An aborted child's keys must not matter, a committed one's must */
+	E(rdb_txn_begin(env, txn, 0, &child));
+	for (i = 1; i < COUNT; i += 3)
+		put(child, dbi, i, NULL);
+	rdb_txn_abort(child);
+	E(rdb_txn_begin(env, txn, 0, &child));
+	for (i = 1; i < COUNT; i += 6)
+		put(child, dbi, i, want);
+	E(rdb_txn_commit(child));
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	check(txn, dbi, want);
+	rdb_txn_abort(txn);
+
+	/* Deleted keys stay in the filter until it's rebuilt */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 9) {
+		key.mv_size = strlen(keys[i]);
+		key.mv_data = keys[i];
+		E(rdb_del(txn, dbi, &key, NULL));
+		want[i] = 0;
+	}
+	check(txn, dbi, want);
+	E(rdb_bloom_rebuild(txn, dbi, 4 * COUNT));
+	check(txn, dbi, want);
+	/* Writes through a cursor are filtered too */
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	for (i = 2; i < COUNT; i += 12) {
+		key.mv_size = strlen(keys[i]);
+		key.mv_data = keys[i];
+		data.mv_size = sizeof(int);
+		data.mv_data = &i;
+		E(rdb_cursor_put(cursor, &key, &data, 0));
+		want[i] = 1;
+	}
+	rdb_cursor_close(cursor);
+	E(rdb_txn_commit(txn));
+
+	/* Adding a filter to a DB that has data */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "plain", RDB_CREATE, &plain));
+	for (i = 0; i < COUNT; i++)
+		if (want[i])
+			put(txn, plain, i, NULL);
+	rc = rdb_bloom_rebuild(txn, plain, 0);
+	CHECK(rc == RDB_INCOMPATIBLE, "rebuilt a DB without filter");
+	E(rdb_txn_commit(txn));
+	rdb_dbi_close(env, plain);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "plain", RDB_CREATE|RDB_BLOOM, &plain));
+	E(rdb_dbi_flags(txn, plain, &flags));
+	CHECK(flags & RDB_BLOOM, "filter not added");
+	check(txn, plain, want);
+	E(rdb_txn_commit(txn));
+
+	/* Also while its handle is still open */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "later", RDB_CREATE, &dbi2));
+	for (i = 0; i < COUNT; i++)
+		if (want[i])
+			put(txn, dbi2, i, NULL);
+	E(rdb_txn_commit(txn));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "later", RDB_CREATE|RDB_BLOOM, &dbi2));
+	E(rdb_dbi_flags(txn, dbi2, &flags));
+	CHECK(flags & RDB_BLOOM, "filter not added to an open DB");
+	E(rdb_bloom_rebuild(txn, dbi2, 0));
+	check(txn, dbi2, want);
+	E(rdb_txn_commit(txn));
+	rdb_env_close(env);
+
+	/* The filters must survive reopening */
+	E(rdb_env_create(&env));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, "dedup", 0, &dbi));
+	E(rdb_dbi_open(txn, "plain", 0, &plain));
+	check(txn, dbi, want);
+	check(txn, plain, want);
+	E(rdb_txn_commit(txn));
+
+	/* Emptying starts the filter over, deleting takes it along */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	nmain = main_entries(txn);
+	E(rdb_drop(txn, plain, 0));
+	memset(want, 0, COUNT);
+	for (i = 5; i < COUNT; i += 7)
+		put(txn, plain, i, want);
+	check(txn, plain, want);
+	E(rdb_drop(txn, plain, 1));
+	CHECK(main_entries(txn) == nmain - 2, "filter DB left behind");
+	E(rdb_txn_commit(txn));
+
+	/* A filter added by another process while the DB is open here:
+	 * keys written here after that must go in it
+	 */
+	memset(want, 0, COUNT);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "shared", RDB_CREATE, &dbi2));
+	for (i = 0; i < COUNT; i += 4)
+		put(txn, dbi2, i, want);
+	E(rdb_txn_commit(txn));
+	CHECK(other("shared", RDB_CREATE|RDB_BLOOM, NULL), "filter not added elsewhere");
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 2; i < COUNT; i += 4)
+		put(txn, dbi2, i, want);
+	E(rdb_dbi_flags(txn, dbi2, &flags));
+	CHECK(flags & RDB_BLOOM, "filter added elsewhere not seen");
+	check(txn, dbi2, want);
+	E(rdb_txn_commit(txn));
+	CHECK(other("shared", 0, want), "keys missing from the filter");
+
+	rdb_env_close(env);
+	free(want);
+	printf("Bloom filtered lookups match\n");
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+/* commit_async.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_txn_commit_async: commits are visible at once, also to
+ * other processes, callbacks come in order, waiting works, and nothing
+ * is lost once the environment is closed and reopened. With RDB_PIPELINE,
+ * writers in several threads take turns while the syncer syncs, and each
+ * rdb_txn_commit still returns once its commit is durable.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define DBPATH	"./tests/db/async.rdb"
+#define COPYPATH	"./tests/db/async-copy.rdb"
+#define COMMITS	300
+#define ITEMS	20	/* per commit */
+#define THREADS	8
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t done[COMMITS + 2];
+static int ndone, failed;
+
+static void synced(size_t txnid, int rc, void *ctx)
+{
+	pthread_mutex_lock(&lock);
+	done[ndone++] = txnid;
+	if (rc)
+		failed = rc;
+	pthread_mutex_unlock(&lock);
+}
+
+static void put(RDB_txn *txn, RDB_dbi dbi, int c, int i)
+{
+	int rc;
+	RDB_val key, data;
+	char kbuf[32];
+
+	key.mv_size = sprintf(kbuf, "%04d-%02d", c, i);
+	key.mv_data = kbuf;
+	data.mv_size = sizeof(c);
+	data.mv_data = &c;
+	E(rdb_put(txn, dbi, &key, &data, 0));
+}
+
+static RDB_env *penv;
+static RDB_dbi pdbi;
+
+/* Pipelined commits of one thread's items */
+static void *writer(void *arg)
+{
+	int c, i, rc, t = (int)(size_t)arg;
+	RDB_txn *txn;
+	RDB_envinfo info;
+	size_t id;
+
+	for (c = t; c < COMMITS; c += THREADS) {
+		E(rdb_txn_begin(penv, NULL, 0, &txn));
+		for (i = 0; i < ITEMS; i++)
+			put(txn, pdbi, c, i);
+		id = rdb_txn_id(txn);
+		E(rdb_txn_commit(txn));
+		E(rdb_env_info(penv, &info));
+		CHECK(info.me_durable_txnid >= id, "pipelined commit not durable");
+	}
+	return NULL;
+}
+
+/* Every commit up to last is there, read by a fresh handle */
+static int check(const char *path, int last)
+{
+	int rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_stat st;
+
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, path, RDB_NOSUBDIR, 0664));
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_stat(txn, dbi, &st));
+	rdb_txn_abort(txn);
+	rdb_env_close(env);
+	return st.ms_entries == (size_t)last * ITEMS;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, c, rc, status;
+	RDB_env *env;
+	RDB_txn *txn, *child;
+	RDB_dbi dbi;
+	RDB_envinfo info;
+	RDB_stat st;
+	size_t id, last = 0;
+	pid_t pid;
+	pthread_t thr[THREADS];
+
+	remove(DBPATH);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_txn_commit(txn));
+
+	for (c = 0; c < COMMITS; c++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		for (i = 0; i < ITEMS; i++)
+			put(txn, dbi, c, i);
+		last = rdb_txn_id(txn);
+		E(rdb_txn_commit_async(txn, synced, NULL));
+
+		/* Visible before it is durable */
+		E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+		CHECK(rdb_txn_id(txn) == last, "commit not visible");
+		E(rdb_stat(txn, dbi, &st));
+		CHECK(st.ms_entries == (size_t)(c + 1) * ITEMS, "entries");
+		rdb_txn_abort(txn);
+
+		if (c == COMMITS / 2) {
+			/* Also to another process, from the lock file */
+			if ((pid = fork()) == 0)
+				_exit(!check(DBPATH, c + 1));
+			CHECK(pid > 0 && waitpid(pid, &status, 0) == pid, "fork");
+			CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+				"commit not visible to another process");
+		}
+		if (c % 50 == 49) {
+			E(rdb_env_wait_durable(env, last));
+			E(rdb_env_info(env, &info));
+			CHECK(info.me_durable_txnid >= last && info.me_last_txnid == last,
+				"durable txnid");
+		}
+	}
+	E(rdb_env_wait_durable(env, last));
+	rc = rdb_env_wait_durable(env, last + 10);
+	CHECK(rc == EINVAL, "waiting for a commit that isn't queued");
+
+	/* Nothing to write: the callback gets the commit before it */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_txn_commit_async(txn, synced, NULL));
+	E(rdb_env_wait_durable(env, last));
+
+	/* A synchronous commit makes the ones before it durable too */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	put(txn, dbi, COMMITS, 0);
+	E(rdb_txn_commit_async(txn, NULL, NULL));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	put(txn, dbi, COMMITS, 1);
+	id = rdb_txn_id(txn);
+	E(rdb_txn_commit(txn));
+	E(rdb_env_info(env, &info));
+	CHECK(info.me_durable_txnid == id, "synchronous commit not durable");
+	E(rdb_env_wait_durable(env, id - 1));
+
+	/* Neither nested, read-only, nor without the lock file */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_txn_begin(env, txn, 0, &child));
+	rc = rdb_txn_commit_async(child, NULL, NULL);
+	CHECK(rc == EINVAL, "nested transaction");
+	rdb_txn_abort(txn);
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	rc = rdb_txn_commit_async(txn, NULL, NULL);
+	CHECK(rc == EINVAL, "read-only transaction");
+	rdb_env_close(env);
+
+	CHECK(!failed, "a commit failed to sync");
+	CHECK(ndone == COMMITS + 1, "callbacks");
+	for (i = 1; i < ndone; i++)
+		CHECK(done[i] >= done[i-1], "callbacks out of order");
+	CHECK(done[COMMITS] == last, "empty commit's txnid");
+
+	/* Pending commits survive the handle; then drop the extra items */
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_drop(txn, dbi, 0));
+	for (c = 0; c < 10; c++)
+		for (i = 0; i < ITEMS; i++)
+			put(txn, dbi, c, i);
+	E(rdb_txn_commit_async(txn, NULL, NULL));
+	rdb_env_close(env);
+	CHECK(check(DBPATH, 10), "async commit lost at close");
+
+	/* A copy taken while commits are pending has what readers see */
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_drop(txn, dbi, 0));
+	E(rdb_txn_commit(txn));
+	for (j = 0; j < 10; j++) {
+		for (c = j * 20; c < (j + 1) * 20; c++) {
+			E(rdb_txn_begin(env, NULL, 0, &txn));
+			for (i = 0; i < ITEMS; i++)
+				put(txn, dbi, c, i);
+			E(rdb_txn_commit_async(txn, NULL, NULL));
+		}
+		/* The newest tree, not the data file's, as for readers */
+		E(rdb_env_stat(env, &st));
+		CHECK(st.ms_entries == (size_t)c * ITEMS, "rdb_env_stat behind the commits");
+		remove(COPYPATH);
+		E(rdb_env_copy(env, COPYPATH));
+		CHECK(check(COPYPATH, c), "pending commits missing from a copy");
+		/* The map can't shrink below it, nor adopt an older size */
+		E(rdb_env_set_mapsize(env, 4096));
+		E(rdb_env_info(env, &info));
+		CHECK(info.me_mapsize > info.me_last_pgno * st.ms_psize, "map shrunk below the tree");
+		E(rdb_env_set_mapsize(env, 10485760*4));
+		E(rdb_env_set_mapsize(env, 0));
+		E(rdb_env_info(env, &info));
+		CHECK(info.me_mapsize == 10485760*4, "mapsize(0) went back to an older size");
+	}
+	rdb_env_close(env);
+	remove(COPYPATH);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_WRITEMAP, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_txn_commit_async(txn, NULL, NULL);
+	CHECK(rc == EINVAL, "async commit with RDB_WRITEMAP");
+	rdb_env_close(env);
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_NOLOCK, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_txn_commit_async(txn, NULL, NULL);
+	CHECK(rc == EINVAL, "async commit without the lock file");
+	rdb_env_close(env);
+
+	remove(DBPATH);
+	E(rdb_env_create(&penv));
+	E(rdb_env_set_mapsize(penv, 10485760*4));
+	E(rdb_env_open(penv, DBPATH, RDB_NOSUBDIR|RDB_PIPELINE, 0664));
+	E(rdb_txn_begin(penv, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &pdbi));
+	E(rdb_txn_commit(txn));
+	for (i = 0; i < THREADS; i++)
+		CHECK(pthread_create(&thr[i], NULL, writer, (void *)(size_t)i) == 0,
+			"pthread_create");
+	for (i = 0; i < THREADS; i++)
+		pthread_join(thr[i], NULL);
+	E(rdb_env_info(penv, &info));
+	CHECK(info.me_durable_txnid == info.me_last_txnid, "pipelined commits pending");
+	rdb_env_close(penv);
+	CHECK(check(DBPATH, COMMITS), "pipelined commits lost");
+
+	printf("%d commits, %d synced asynchronously\n", COMMITS + 1, ndone);
+	return 0;
+}
@@ -0,0 +1,320 @@
+/* commit_io.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for the ways a commit can get its pages to disk: whichever
+ * is used, a reopened environment must have every committed item.
+ * Allocation runs must also cut the writes a scattered commit takes,
+ * and early writeback must write a big load before it commits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define DBPATH	"./tests/db/commit_io.rdb"
+#define COUNT	40000
+#define BIGSIZE	10000
+
+static char val[BIGSIZE];
+static int bigevery = 97;	/* one item in this many is big */
+
+/* Item i's data starts with its version, some are big enough to overflow */
+static size_t dsize(int i)
+{
+	return i % bigevery == 5 ? BIGSIZE : sizeof(int) * 2 + i % 50;
+}
+
+static void put(RDB_txn *txn, RDB_dbi dbi, int i, int version)
+{
+	int rc;
+	RDB_val key, data;
+	char kbuf[16];
+
+	key.mv_size = sprintf(kbuf, "%08d", i);
+	key.mv_data = kbuf;
+	memcpy(val, &version, sizeof(int));
+	memcpy(val + sizeof(int), &i, sizeof(int));
+	data.mv_size = dsize(i);
+	data.mv_data = val;
+	E(rdb_put(txn, dbi, &key, &data, 0));
+}
+
+/* Every item has the version in vers[], or is gone if that's 0 */
+static void check(const int *vers)
+{
+	int i, n, rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	char kbuf[16];
+
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_RDONLY, 0664));
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	for (i = n = 0; (rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0; n++) {
+		CHECK(key.mv_size == 8, "key");
+		memcpy(kbuf, key.mv_data, 8);
+		kbuf[8] = '\0';
+		i = atoi(kbuf);
+		CHECK(i >= 0 && i < COUNT && vers[i], "deleted item");
+		CHECK(data.mv_size == dsize(i) && ((int *)data.mv_data)[0] == vers[i] &&
+			((int *)data.mv_data)[1] == i, "data");
+	}
+	CHECK(rc == RDB_NOTFOUND, "scan");
+	for (i = 0; i < COUNT; i++)
+		n -= vers[i] != 0;
+	CHECK(n == 0, "missing items");
+	rdb_cursor_close(cursor);
+	rdb_txn_abort(txn);
+	rdb_env_close(env);
+}
+
+/* A big load, scattered updates, deletes, and small commits, synced or not */
+static void commits(unsigned int flags, unsigned int nthreads, int *vers)
+{
+	int i, j, rc;
+	unsigned int got;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key;
+	char kbuf[16];
+
+	remove(DBPATH);
+	memset(vers, 0, COUNT * sizeof(int));
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*16));
+	E(rdb_env_set_flushthreads(env, nthreads));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|flags, 0664));
+	E(rdb_env_get_flags(env, &got));
+	if ((flags & RDB_IOURING) && !(got & RDB_IOURING))
+		printf("io_uring not available, commits use write()\n");
+	if ((flags & RDB_DIRECT) && !(got & RDB_DIRECT))
+		printf("direct I/O not available, commits go through the cache\n");
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < COUNT; i++)
+		put(txn, dbi, i, vers[i] = 1);
+	E(rdb_txn_commit(txn));
+
+	/* Far apart, so each dirty page is a run of its own */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 37)
+		put(txn, dbi, i, ++vers[i]);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 1; i < COUNT; i += 3) {
+		key.mv_size = sprintf(kbuf, "%08d", i);
+		key.mv_data = kbuf;
+		E(rdb_del(txn, dbi, &key, NULL));
+		vers[i] = 0;
+	}
+	E(rdb_txn_commit(txn));
+
+	for (j = 0; j < 60; j++) {
+		if (j == 20)
+			E(rdb_env_set_flags(env, RDB_NOMETASYNC, 1));
+		if (j == 40)
+			E(rdb_env_set_flags(env, RDB_NOSYNC, 1));
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		i = (j * 7919) % COUNT;
+		put(txn, dbi, i, ++vers[i]);
+		E(rdb_txn_commit(txn));
+	}
+	rdb_env_close(env);
+	check(vers);
+}
+
+/* Scattered updates on a fragmented file; returns the runs written
+ * per page by the last half of the commits.
+ */
+static double runs(unsigned int allocrun, int *vers)
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_envinfo info;
+	size_t commits = 0, pages = 0, nruns = 0;
+
+	remove(DBPATH);
+	memset(vers, 0, COUNT * sizeof(int));
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*16));
+	E(rdb_env_set_allocrun(env, allocrun));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < COUNT; i++)
+		put(txn, dbi, i, vers[i] = 1);
+	E(rdb_txn_commit(txn));
+
+	for (j = 0; j < 100; j++) {
+		if (j == 50) {
+			E(rdb_env_info(env, &info));
+			commits = info.me_commits;
+			pages = info.me_commit_pages;
+			nruns = info.me_commit_runs;
+		}
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		for (i = j % 31; i < COUNT; i += 97)
+			put(txn, dbi, i, ++vers[i]);
+		E(rdb_txn_commit(txn));
+	}
+	E(rdb_env_info(env, &info));
+	CHECK(info.me_commits - commits == 50, "commits counted");
+	CHECK(info.me_commit_runs > nruns && info.me_commit_pages > pages, "runs counted");
+	rdb_env_close(env);
+	check(vers);
+	return (double)(info.me_commit_runs - nruns) / (info.me_commit_pages - pages);
+}
+
+/* Scattered updates with runs in a map not much bigger than the data:
+ * once new space runs short, pages must come from the freelist.
+ */
+static void smallmap(void)
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key, data;
+	char kbuf[16];
+	unsigned long seed = 1;
+
+	remove(DBPATH);
+	memset(val, 'v', 200);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760));
+	E(rdb_env_set_allocrun(env, 16));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+	key.mv_data = kbuf;
+	data.mv_size = 200;
+	data.mv_data = val;
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < 20000; i++) {
+		key.mv_size = sprintf(kbuf, "%08d", i);
+		E(rdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+	for (j = 0; j < 200; j++) {
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		for (i = 0; i < 300; i++) {
+			seed = seed * 1103515245 + 12345;
+			key.mv_size = sprintf(kbuf, "%08lu", (seed >> 8) % 20000);
+			E(rdb_put(txn, dbi, &key, &data, 0));
+		}
+		E(rdb_txn_commit(txn));
+	}
+	rdb_env_close(env);
+}
+
+/* A big load and scattered updates, writing pages back as they go */
+static void writeback(unsigned int flags, int *vers)
+{
+	int i, rc;
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_envinfo info;
+
+	remove(DBPATH);
+	memset(vers, 0, COUNT * sizeof(int));
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*16));
+	E(rdb_env_set_writeback(env, 256));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|flags, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < COUNT; i++)
+		put(txn, dbi, i, vers[i] = 1);
+	E(rdb_env_info(env, &info));
+	CHECK(info.me_commit_pages > 1000, "nothing written before the commit");
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 7)
+		put(txn, dbi, (i * 7919) % COUNT, ++vers[(i * 7919) % COUNT]);
+	E(rdb_txn_commit(txn));
+	rdb_env_close(env);
+	check(vers);
+}
+
+int main(int argc,char * argv[])
+{
+	int rc;
+	unsigned int got;
+	double scattered, clustered;
+	RDB_env *env;
+	static int vers[COUNT];
+
+	commits(0, 0, vers);
+	commits(RDB_IOURING, 0, vers);
+	/* Later transactions read the pages written back through the map */
+	commits(RDB_DIRECT, 0, vers);
+	commits(RDB_DIRECT|RDB_IOURING, 0, vers);
+	/* Synced by the syncer thread, except once RDB_NOSYNC is set */
+	commits(RDB_PIPELINE, 0, vers);
+
+	/* More big items make a load big enough for all of the threads */
+	bigevery = 13;
+	commits(0, 8, vers);
+	commits(RDB_DIRECT, 8, vers);
+	bigevery = 97;
+
+	E(rdb_env_create(&env));
+	rc = rdb_env_set_flushthreads(env, 65);
+	CHECK(rc == EINVAL, "too many flush threads");
+	rc = rdb_env_set_allocrun(env, 65537);
+	CHECK(rc == EINVAL, "allocation run too long");
+	rdb_env_close(env);
+
+	writeback(0, vers);
+	writeback(RDB_DIRECT, vers);
+
+	scattered = runs(0, vers);
+	clustered = runs(16, vers);
+	printf("%.2f runs per page, %.2f with allocation runs\n", scattered, clustered);
+	CHECK(clustered < scattered / 2, "allocation runs");
+	smallmap();
+
+	/* Nothing to submit with a writable map */
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_WRITEMAP|RDB_IOURING, 0664));
+	E(rdb_env_get_flags(env, &got));
+	CHECK(!(got & RDB_IOURING), "RDB_IOURING with RDB_WRITEMAP");
+	rdb_env_close(env);
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_WRITEMAP|RDB_DIRECT, 0664));
+	E(rdb_env_get_flags(env, &got));
+	CHECK(!(got & RDB_DIRECT), "RDB_DIRECT with RDB_WRITEMAP");
+	rdb_env_close(env);
+
+	printf("Commits written and read back\n");
+
+	return 0;
+}
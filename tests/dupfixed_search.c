@@ -0,0 +1,145 @@
+/* dupfixed_search.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for RDB_GET_BOTH/RDB_GET_BOTH_RANGE on integer DUPFIXED items */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+/* Stored items are 3*i+1 for i < count, plus values near the sign bit */
+static uint64_t item(int i, int count, int wide)
+{
+	if (i < count)
+		return 3 * (uint64_t)i + 1;
+	return (wide ? 0x7ffffffffffffff0ULL : 0x7ffffff0U) + 16 * (i - count);
+}
+
+static void check_dups(RDB_env *env, RDB_dbi dbi, int count, int wide)
+{
+	int i, rc, n = count + 4;
+	RDB_txn *txn;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	uint64_t want, got, probe;
+	uint32_t probe32;
+	char kval[] = "posting";
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	key.mv_size = sizeof(kval);
+	key.mv_data = kval;
+
+	for (i = 0; i <= 3 * count + 1; i++) {
+		probe = i;
+		probe32 = i;
+		data.mv_size = wide ? 8 : 4;
+		data.mv_data = wide ? (void *)&probe : (void *)&probe32;
+		rc = rdb_cursor_get(cursor, &key, &data, RDB_GET_BOTH);
+		if (i % 3 == 1 && i < 3 * count) {
+			CHECK(rc == RDB_SUCCESS, "GET_BOTH missed");
+		} else {
+			CHECK(rc == RDB_NOTFOUND, "GET_BOTH false hit");
+		}
+
+		data.mv_size = wide ? 8 : 4;
+		data.mv_data = wide ? (void *)&probe : (void *)&probe32;
+		E(rdb_cursor_get(cursor, &key, &data, RDB_GET_BOTH_RANGE));
+		want = i <= 3 * count - 2 ? 3 * (uint64_t)((i + 1) / 3) + 1 : item(count, count, wide);
+		got = 0;
+		memcpy(&got, data.mv_data, data.mv_size);
+		CHECK(got == want, "GET_BOTH_RANGE");
+	}
+
+	/* Items past the sign bit must still sort as unsigned */
+	for (i = count; i < n; i++) {
+		probe = item(i, count, wide);
+		probe32 = probe;
+		data.mv_size = wide ? 8 : 4;
+		data.mv_data = wide ? (void *)&probe : (void *)&probe32;
+		E(rdb_cursor_get(cursor, &key, &data, RDB_GET_BOTH));
+		probe++;
+		probe32++;
+		data.mv_size = wide ? 8 : 4;
+		data.mv_data = wide ? (void *)&probe : (void *)&probe32;
+		rc = rdb_cursor_get(cursor, &key, &data, RDB_GET_BOTH_RANGE);
+		if (i == n - 1) {
+			CHECK(rc == RDB_NOTFOUND, "GET_BOTH_RANGE past end");
+		} else {
+			CHECK(rc == RDB_SUCCESS, "GET_BOTH_RANGE");
+			got = 0;
+			memcpy(&got, data.mv_data, data.mv_size);
+			CHECK(got == item(i + 1, count, wide), "GET_BOTH_RANGE high");
+		}
+	}
+	rdb_cursor_close(cursor);
+	rdb_txn_abort(txn);
+}
+
+static void fill_dups(RDB_env *env, const char *name, int count, int wide, RDB_dbi *dbi)
+{
+	int i, rc, n = count + 4;
+	RDB_txn *txn;
+	RDB_val key, data;
+	uint64_t v64;
+	uint32_t v32;
+	char kval[] = "posting";
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, name, RDB_CREATE|RDB_DUPSORT|RDB_DUPFIXED|RDB_INTEGERDUP, dbi));
+	key.mv_size = sizeof(kval);
+	key.mv_data = kval;
+	/* Insert in reverse so the search isn't just appending */
+	for (i = n; --i >= 0; ) {
+		v64 = item(i, count, wide);
+		v32 = v64;
+		data.mv_size = wide ? 8 : 4;
+		data.mv_data = wide ? (void *)&v64 : (void *)&v32;
+		E(rdb_put(txn, *dbi, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+}
+
+int main(int argc,char * argv[])
+{
+	int rc;
+	RDB_env *env;
+	RDB_dbi dbi;
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	/* A handful of items stays in a sub-page, thousands spill into a sub-DB */
+	fill_dups(env, "dup32s", 5, 0, &dbi);
+	check_dups(env, dbi, 5, 0);
+	fill_dups(env, "dup64s", 5, 1, &dbi);
+	check_dups(env, dbi, 5, 1);
+	fill_dups(env, "dup32", 5000, 0, &dbi);
+	check_dups(env, dbi, 5000, 0);
+	fill_dups(env, "dup64", 5000, 1, &dbi);
+	check_dups(env, dbi, 5000, 1);
+	printf("DUPFIXED searches OK\n");
+
+	rdb_env_close(env);
+
+	return 0;
+}
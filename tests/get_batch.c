@@ -0,0 +1,151 @@
+/* get_batch.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_get_batch, checked against rdb_get */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	20000
+#define BATCH	300
+
+static char kbufs[BATCH][32];
+
+static void check_batch(RDB_txn *txn, RDB_dbi dbi, int intkey, int n)
+{
+	int i, rc, rcs[BATCH];
+	size_t ints[BATCH];
+	RDB_val keys[BATCH], vals[BATCH], data;
+
+	for (i = 0; i < n; i++) {
+		/* Odd numbers are missing, a few keys repeat */
+		int k = i % 17 == 0 ? 2 * (i / 17) : rand() % (2 * COUNT + 10);
+		if (intkey) {
+			ints[i] = k;
+			keys[i].mv_size = sizeof(size_t);
+			keys[i].mv_data = &ints[i];
+		} else {
+			keys[i].mv_size = sprintf(kbufs[i], "key-%07d", k);
+			keys[i].mv_data = kbufs[i];
+			/* Cut keys sort below the whole one, some between a
+			 * shortened separator and the first key of its leaf.
+			 */
+			if (i % 11 == 5)
+				keys[i].mv_size = 5 + rand() % 7;
+		}
+	}
+	if (n > 2)
+		keys[n / 2].mv_size = 0;
+	E(rdb_get_batch(txn, dbi, keys, vals, rcs, n));
+	for (i = 0; i < n; i++) {
+		if (!keys[i].mv_size) {
+			CHECK(rcs[i] == RDB_BAD_VALSIZE, "empty key");
+			continue;
+		}
+		rc = rdb_get(txn, dbi, &keys[i], &data);
+		CHECK(rc == rcs[i], "result code");
+		if (!rc)
+			CHECK(data.mv_size == vals[i].mv_size &&
+				!memcmp(data.mv_data, vals[i].mv_data, data.mv_size), "data");
+	}
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_dbi str, num, dup;
+	RDB_val key, data;
+	RDB_txn *txn;
+	size_t ik;
+	char kbuf[32], dbuf[64];
+
+	srand(9);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "batch-str", RDB_CREATE, &str));
+	E(rdb_dbi_open(txn, "batch-int", RDB_CREATE|RDB_INTEGERKEY, &num));
+	E(rdb_dbi_open(txn, "batch-dup", RDB_CREATE|RDB_DUPSORT, &dup));
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = sprintf(kbuf, "key-%07d", 2 * i);
+		key.mv_data = kbuf;
+		data.mv_size = sprintf(dbuf, "value %d %.*s", i, i % 40, "----------------------------------------");
+		data.mv_data = dbuf;
+		E(rdb_put(txn, str, &key, &data, 0));
+		for (j = 0; j < 1 + i % 3; j++) {
+			dbuf[0] = 'a' + 2 - j;
+			E(rdb_put(txn, dup, &key, &data, 0));
+		}
+		ik = 2 * i;
+		key.mv_size = sizeof(ik);
+		key.mv_data = &ik;
+		E(rdb_put(txn, num, &key, &data, 0));
+	}
+	/* Uncommitted pages get searched too */
+	for (i = 0; i < 20; i++) {
+		check_batch(txn, str, 0, BATCH);
+		check_batch(txn, dup, 0, BATCH);
+		check_batch(txn, num, 1, BATCH);
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	for (i = 0; i < 50; i++) {
+		check_batch(txn, str, 0, 1 + rand() % BATCH);
+		check_batch(txn, dup, 0, 1 + rand() % BATCH);
+		check_batch(txn, num, 1, 1 + rand() % BATCH);
+	}
+	rc = rdb_get_batch(txn, str, NULL, NULL, NULL, 1);
+	CHECK(rc == EINVAL, "NULL arrays accepted");
+	rdb_txn_abort(txn);
+
+	/* Deleting runs of keys leaves separators below the first key
+	 * of their leaf. Misses in that gap resume from the stack.
+	 */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i++) {
+		if ((i / 7) % 3)
+			continue;
+		key.mv_size = sprintf(kbuf, "key-%07d", 2 * i);
+		key.mv_data = kbuf;
+		E(rdb_del(txn, str, &key, NULL));
+		E(rdb_del(txn, dup, &key, NULL));
+		ik = 2 * i;
+		key.mv_size = sizeof(ik);
+		key.mv_data = &ik;
+		E(rdb_del(txn, num, &key, NULL));
+	}
+	for (i = 0; i < 20; i++) {
+		check_batch(txn, str, 0, BATCH);
+		check_batch(txn, dup, 0, BATCH);
+		check_batch(txn, num, 1, BATCH);
+	}
+	rdb_txn_abort(txn);
+	printf("batch lookups match\n");
+
+	rdb_env_close(env);
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/* group_commit.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_group_commit: many threads' writes share commits, each
+ * gets its own result, and a failed write leaves no trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define DBPATH	"./tests/db/group.rdb"
+#define THREADS	16
+#define WRITES	200
+#define FAILED	(-30)	/* a closure's own error code */
+
+static RDB_env *env;
+static RDB_dbi dbi;
+
+struct write {
+	int thread, n;
+	size_t txnid;
+};
+
+/* Every 7th write puts its item and then fails */
+static int put(RDB_txn *txn, void *ctx)
+{
+	struct write *w = ctx;
+	RDB_val key, data;
+	char kbuf[32];
+	int rc;
+
+	key.mv_size = sprintf(kbuf, "%02d-%04d", w->thread, w->n);
+	key.mv_data = kbuf;
+	data.mv_size = sizeof(*w);
+	data.mv_data = w;
+	w->txnid = rdb_txn_id(txn);
+	if ((rc = rdb_put(txn, dbi, &key, &data, RDB_NOOVERWRITE)) != 0)
+		return rc;
+	return w->n % 7 == 3 ? FAILED : 0;
+}
+
+static void *writer(void *arg)
+{
+	struct write *w = arg;
+	int i, rc;
+
+	for (i = 0; i < WRITES; i++) {
+		w[i].thread = w[0].thread;
+		w[i].n = i;
+		rc = rdb_group_commit(env, put, &w[i]);
+		CHECK(rc == (i % 7 == 3 ? FAILED : 0), "rdb_group_commit");
+	}
+	return NULL;
+}
+
+static int bytxn(const void *a, const void *b)
+{
+	const struct write *x = a, *y = b;
+	return x->txnid < y->txnid ? -1 : x->txnid > y->txnid;
+}
+
+static int nothing(RDB_txn *txn, void *ctx)
+{
+	return 0;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc, groups;
+	pthread_t thr[THREADS];
+	static struct write w[THREADS][WRITES];
+	struct write *all;
+	RDB_txn *txn;
+	RDB_stat st;
+	RDB_val key, data;
+	char kbuf[32];
+
+	remove(DBPATH);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR, 0664));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_txn_commit(txn));
+
+	for (i = 0; i < THREADS; i++) {
+		w[i][0].thread = i;
+		CHECK(pthread_create(&thr[i], NULL, writer, w[i]) == 0, "pthread_create");
+	}
+	for (i = 0; i < THREADS; i++)
+		pthread_join(thr[i], NULL);
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_stat(txn, dbi, &st));
+	CHECK(st.ms_entries == THREADS * (WRITES - (WRITES + 3) / 7), "entries");
+	for (i = 0; i < THREADS; i++) {
+		for (j = 0; j < WRITES; j++) {
+			key.mv_size = sprintf(kbuf, "%02d-%04d", i, j);
+			key.mv_data = kbuf;
+			rc = rdb_get(txn, dbi, &key, &data);
+			CHECK(rc == (j % 7 == 3 ? RDB_NOTFOUND : 0), "failed write kept");
+		}
+	}
+	rdb_txn_abort(txn);
+
+	/* Each transaction ID is one commit */
+	all = &w[0][0];
+	qsort(all, THREADS * WRITES, sizeof(struct write), bytxn);
+	for (i = groups = 0; i < THREADS * WRITES; i++)
+		groups += !i || all[i].txnid != all[i-1].txnid;
+	CHECK(groups < THREADS * WRITES, "no writes grouped");
+	printf("%d writes in %d commits\n", THREADS * WRITES, groups);
+
+	rdb_env_close(env);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_WRITEMAP, 0664));
+	rc = rdb_group_commit(env, nothing, NULL);
+	CHECK(rc == EINVAL, "group commit with RDB_WRITEMAP");
+	rdb_env_close(env);
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, DBPATH, RDB_NOSUBDIR|RDB_RDONLY, 0664));
+	rc = rdb_group_commit(env, nothing, NULL);
+	CHECK(rc == EACCES, "group commit in a read-only env");
+	rdb_env_close(env);
+
+	return 0;
+}
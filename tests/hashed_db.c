@@ -0,0 +1,263 @@
+/* hashed_db.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for RDB_HASHED tables, checked against what was stored */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	40000
+#define BATCH	100
+#define BIGSIZE	10000
+
+static char keys[COUNT][16];
+static char val[BIGSIZE];
+
+/* Item i's data starts with i, a few are big enough for overflow pages */
+static size_t dsize(int i)
+{
+	return i % 1000 == 7 ? BIGSIZE : sizeof(int) + i % 40;
+}
+
+static void mkval(RDB_val *data, int i)
+{
+	memcpy(val, &i, sizeof(int));
+	data->mv_size = dsize(i);
+	data->mv_data = val;
+}
+
+static void setkey(RDB_val *key, int i)
+{
+	key->mv_size = strlen(keys[i]);
+	key->mv_data = keys[i];
+}
+
+static void put(RDB_txn *txn, RDB_dbi dbi, int i, char *want)
+{
+	int rc;
+	RDB_val key, data;
+
+	setkey(&key, i);
+	mkval(&data, i);
+	E(rdb_put(txn, dbi, &key, &data, 0));
+	if (want)
+		want[i] = 1;
+}
+
+/* want[i] says whether key i should be present */
+static void check(RDB_txn *txn, RDB_dbi dbi, const char *want)
+{
+	int i, j, n = 0, rc, rcs[BATCH];
+	RDB_cursor *cursor;
+	RDB_val key, data, bkeys[BATCH], bvals[BATCH];
+	RDB_stat st;
+	char *seen;
+
+	for (i = 0; i < COUNT; i++) {
+		setkey(&key, i);
+		rc = rdb_get(txn, dbi, &key, &data);
+		CHECK(rc == (want[i] ? RDB_SUCCESS : RDB_NOTFOUND), "rdb_get");
+		if (!rc)
+			CHECK(data.mv_size == dsize(i) && *(int *)data.mv_data == i, "data");
+		n += want[i];
+	}
+	E(rdb_stat(txn, dbi, &st));
+	CHECK(st.ms_entries == (size_t)n, "entry count");
+
+	/* A scan sees every key once */
+	seen = calloc(COUNT, 1);
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	for (j = 0; (rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0; j++) {
+		memcpy(&i, data.mv_data, sizeof(int));
+		CHECK(i >= 0 && i < COUNT && want[i] && !seen[i], "scan");
+		CHECK(key.mv_size == strlen(keys[i]) && !memcmp(key.mv_data, keys[i], key.mv_size), "scan key");
+		seen[i] = 1;
+	}
+	CHECK(rc == RDB_NOTFOUND && j == n, "scan count");
+	free(seen);
+
+	for (i = 0; i < COUNT; i += 7) {
+		setkey(&key, i);
+		rc = rdb_cursor_get(cursor, &key, &data, (i & 1) ? RDB_SET : RDB_SET_KEY);
+		CHECK(rc == (want[i] ? RDB_SUCCESS : RDB_NOTFOUND), "RDB_SET");
+		if (!rc) {
+			E(rdb_cursor_get(cursor, &key, &data, RDB_GET_CURRENT));
+			CHECK(*(int *)data.mv_data == i, "RDB_GET_CURRENT");
+		}
+	}
+	rc = rdb_cursor_get(cursor, &key, &data, RDB_LAST);
+	CHECK(rc == RDB_INCOMPATIBLE, "RDB_LAST on hashed DB");
+	rdb_cursor_close(cursor);
+
+	for (i = 0; i < COUNT; i += BATCH) {
+		for (j = 0; j < BATCH; j++)
+			setkey(&bkeys[j], i + j);
+		E(rdb_get_batch(txn, dbi, bkeys, bvals, rcs, BATCH));
+		for (j = 0; j < BATCH; j++) {
+			CHECK(rcs[j] == (want[i + j] ? RDB_SUCCESS : RDB_NOTFOUND), "rdb_get_batch");
+			if (!rcs[j])
+				CHECK(*(int *)bvals[j].mv_data == i + j, "rdb_get_batch data");
+		}
+	}
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc, *order;
+	RDB_env *env;
+	RDB_dbi dbi;
+	RDB_txn *txn, *child;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	unsigned int flags;
+	char *want;
+
+	srand(9);
+	order = malloc(COUNT * sizeof(int));
+	for (i = 0; i < COUNT; i++) {
+		sprintf(keys[i], "hkey-%08x", i * 2654435761U);
+		order[i] = i;
+	}
+	for (i = COUNT - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		rc = order[i]; order[i] = order[j]; order[j] = rc;
+	}
+	want = calloc(COUNT, 1);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*16));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_dbi_open(txn, NULL, RDB_HASHED, &dbi);
+	CHECK(rc == EINVAL, "RDB_HASHED accepted for main DB");
+	rc = rdb_dbi_open(txn, "bad", RDB_CREATE|RDB_HASHED|RDB_DUPSORT, &dbi);
+	CHECK(rc == EINVAL, "HASHED|DUPSORT accepted");
+	E(rdb_dbi_open(txn, "hashed", RDB_CREATE|RDB_HASHED, &dbi));
+	E(rdb_dbi_flags(txn, dbi, &flags));
+	CHECK(flags & RDB_HASHED, "flag not kept");
+	check(txn, dbi, want);
+	for (i = 0; i < COUNT; i += 2)
+		put(txn, dbi, order[i], want);
+	/* An aborted child's keys must be gone, a committed one's kept */
+	E(rdb_txn_begin(env, txn, 0, &child));
+	for (i = 1; i < COUNT; i += 2)
+		put(child, dbi, order[i], NULL);
+	rdb_txn_abort(child);
+	E(rdb_txn_begin(env, txn, 0, &child));
+	for (i = 1; i < COUNT; i += 4)
+		put(child, dbi, order[i], want);
+	E(rdb_txn_commit(child));
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	/* Overwrites, and the flags that check for them */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 3) {
+		setkey(&key, i);
+		mkval(&data, i);
+		rc = rdb_put(txn, dbi, &key, &data, RDB_NOOVERWRITE);
+		if (want[i]) {
+			CHECK(rc == RDB_KEYEXIST, "RDB_NOOVERWRITE");
+			CHECK(*(int *)data.mv_data == i, "existing data");
+		} else {
+			CHECK(rc == RDB_SUCCESS, "rdb_put");
+			want[i] = 1;
+		}
+	}
+	for (i = 0; i < COUNT; i += 5) {
+		setkey(&key, i);
+		data.mv_size = dsize(i);
+		E(rdb_put(txn, dbi, &key, &data, RDB_RESERVE));
+		memset(data.mv_data, 0, data.mv_size);
+		memcpy(data.mv_data, &i, sizeof(int));
+		want[i] = 1;
+	}
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	/* Deletes by key, then through a scanning cursor */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 3) {
+		setkey(&key, i);
+		rc = rdb_del(txn, dbi, &key, NULL);
+		CHECK(rc == (want[i] ? RDB_SUCCESS : RDB_NOTFOUND), "rdb_del");
+		want[i] = 0;
+	}
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	while ((rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0) {
+		memcpy(&i, data.mv_data, sizeof(int));
+		if (i % 4 == 1) {
+			E(rdb_cursor_del(cursor, 0));
+			want[i] = 0;
+		} else if (i % 4 == 2) {
+			mkval(&data, i);
+			E(rdb_cursor_put(cursor, &key, &data, RDB_CURRENT));
+		}
+	}
+	CHECK(rc == RDB_NOTFOUND, "cursor scan");
+	rdb_cursor_close(cursor);
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+	rdb_env_close(env);
+
+	/* The table must survive reopening */
+	E(rdb_env_create(&env));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, "hashed", 0, &dbi));
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	/* Emptying it, by deletes and by rdb_drop */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i++) {
+		if (!want[i])
+			continue;
+		setkey(&key, i);
+		E(rdb_del(txn, dbi, &key, NULL));
+		want[i] = 0;
+	}
+	check(txn, dbi, want);
+	for (i = 0; i < COUNT; i += 2)
+		put(txn, dbi, order[i], want);
+	E(rdb_drop(txn, dbi, 0));
+	memset(want, 0, COUNT);
+	check(txn, dbi, want);
+	/* Leave some behind for the tools to copy */
+	for (i = 5; i < COUNT; i += 3)
+		put(txn, dbi, i, want);
+	check(txn, dbi, want);
+	E(rdb_txn_commit(txn));
+
+	rdb_env_close(env);
+	free(want);
+	free(order);
+	printf("Hashed lookups match\n");
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/* page_size.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_env_set_pagesize: every page size works the same, stays
+ * with the environment, and survives a compacting copy.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	20000
+#define BIGSIZE	20000
+
+static char val[BIGSIZE];
+
+/* Item i's data starts with i, every 50th is big enough for overflow pages */
+static size_t dsize(int i)
+{
+	return i % 50 == 3 ? BIGSIZE : sizeof(int) + i % 100;
+}
+
+static void check(RDB_env *env, unsigned int psize)
+{
+	int i, rc;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_cursor *cursor;
+	RDB_val key, data;
+	RDB_stat st;
+	char kbuf[16];
+
+	E(rdb_env_stat(env, &st));
+	CHECK(st.ms_psize == psize, "page size");
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, "sized", 0, &dbi));
+	E(rdb_stat(txn, dbi, &st));
+	CHECK(st.ms_entries == COUNT && st.ms_overflow_pages > 0, "entries");
+	E(rdb_cursor_open(txn, dbi, &cursor));
+	for (i = 0; (rc = rdb_cursor_get(cursor, &key, &data, RDB_NEXT)) == 0; i++) {
+		sprintf(kbuf, "%08d", i);
+		CHECK(key.mv_size == 8 && !memcmp(key.mv_data, kbuf, 8), "key");
+		CHECK(data.mv_size == dsize(i) && *(int *)data.mv_data == i, "data");
+	}
+	CHECK(rc == RDB_NOTFOUND && i == COUNT, "scan");
+	rdb_cursor_close(cursor);
+	rdb_txn_abort(txn);
+}
+
+int main(int argc,char * argv[])
+{
+	int i, n, rc;
+	unsigned int psize, os_psize = sysconf(_SC_PAGE_SIZE);
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_dbi dbi;
+	RDB_val key, data;
+	char path[64], copy[64], kbuf[16];
+
+	E(rdb_env_create(&env));
+	rc = rdb_env_set_pagesize(env, os_psize / 2);
+	CHECK(rc == EINVAL, "page size below the OS's");
+	rc = rdb_env_set_pagesize(env, os_psize * 3);
+	CHECK(rc == EINVAL, "page size not a power of two");
+	rc = rdb_env_set_pagesize(env, 1U << 20);
+	CHECK(rc == EINVAL, "page size too big");
+	rdb_env_close(env);
+
+	for (psize = os_psize; psize <= 32768; psize <<= 1) {
+		sprintf(path, "./tests/db/psize-%u.rdb", psize);
+		sprintf(copy, "./tests/db/psize-%u-copy.rdb", psize);
+		remove(path);
+		remove(copy);
+
+		E(rdb_env_create(&env));
+		E(rdb_env_set_pagesize(env, psize));
+		E(rdb_env_set_mapsize(env, 10485760*16));
+		E(rdb_env_set_maxdbs(env, 4));
+		E(rdb_env_open(env, path, RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+		rc = rdb_env_set_pagesize(env, psize);
+		CHECK(rc == EINVAL, "page size set on an open env");
+
+		E(rdb_txn_begin(env, NULL, 0, &txn));
+		E(rdb_dbi_open(txn, "sized", RDB_CREATE, &dbi));
+		/* Out of order, so pages split in the middle too */
+		for (i = 0; i < COUNT; i++) {
+			n = (i * 7919) % COUNT;
+			key.mv_size = sprintf(kbuf, "%08d", n);
+			key.mv_data = kbuf;
+			memcpy(val, &n, sizeof(int));
+			data.mv_size = dsize(n);
+			data.mv_data = val;
+			E(rdb_put(txn, dbi, &key, &data, 0));
+		}
+		E(rdb_txn_commit(txn));
+		check(env, psize);
+		E(rdb_env_copy2(env, copy, RDB_CP_COMPACT));
+		rdb_env_close(env);
+
+		/* The file's page size wins over a different setting */
+		E(rdb_env_create(&env));
+		E(rdb_env_set_pagesize(env, psize == os_psize ? psize * 2 : os_psize));
+		E(rdb_env_set_maxdbs(env, 4));
+		E(rdb_env_open(env, path, RDB_NOSUBDIR|RDB_RDONLY, 0664));
+		check(env, psize);
+		rdb_env_close(env);
+
+		E(rdb_env_create(&env));
+		E(rdb_env_set_maxdbs(env, 4));
+		E(rdb_env_open(env, copy, RDB_NOSUBDIR|RDB_RDONLY, 0664));
+		check(env, psize);
+		rdb_env_close(env);
+	}
+	printf("Page sizes %u to 32768 work\n", os_psize);
+
+	return 0;
+}
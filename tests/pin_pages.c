@@ -0,0 +1,143 @@
+/* pin_pages.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_dbi_pin: the locked pages must be the DB's branch pages
+ * and follow the tree through splits, deletes and a drop, for plain and
+ * hashed DBs alike.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	60000
+
+static char kbuf[16];
+
+static void setkey(RDB_val *key, int i)
+{
+	key->mv_size = sprintf(kbuf, "key-%08d", i);
+	key->mv_data = kbuf;
+}
+
+/* The locked bytes of the DB's branch pages */
+static size_t branches(RDB_env *env, RDB_dbi dbi)
+{
+	int rc;
+	RDB_txn *txn;
+	RDB_stat st;
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_stat(txn, dbi, &st));
+	rdb_txn_abort(txn);
+	CHECK(st.ms_branch_pages > 0, "no branch pages");
+	return st.ms_branch_pages * st.ms_psize;
+}
+
+/* Locked bytes must be all of the DB's branch pages, and no more */
+static void pinned(RDB_env *env, RDB_dbi dbi, size_t extra)
+{
+	int rc;
+	RDB_envinfo info;
+
+	E(rdb_env_info(env, &info));
+	CHECK(info.me_pinned == branches(env, dbi) + extra, "pinned bytes");
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc;
+	RDB_env *env;
+	RDB_dbi dbi, hashed;
+	RDB_txn *txn;
+	RDB_val key, data;
+	RDB_envinfo info;
+	char val[64];
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	memset(val, 'v', sizeof(val));
+	data.mv_size = sizeof(val);
+	data.mv_data = val;
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "pinned", RDB_CREATE, &dbi));
+	E(rdb_dbi_open(txn, "pinned-hash", RDB_CREATE|RDB_HASHED, &hashed));
+	for (i = 0; i < COUNT; i++) {
+		setkey(&key, i);
+		memcpy(val, &i, sizeof(int));
+		E(rdb_put(txn, dbi, &key, &data, RDB_APPEND));
+		if (i % 3 == 0)
+			E(rdb_put(txn, hashed, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	rc = rdb_dbi_pin(txn, dbi, 1);
+	CHECK(rc == EACCES, "pinned in a read-only txn");
+	rdb_txn_abort(txn);
+
+	/* Through splits, deletes and a drop */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_pin(txn, dbi, 1));
+	E(rdb_txn_commit(txn));
+	pinned(env, dbi, 0);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = COUNT; i < COUNT * 2; i += 2) {
+		setkey(&key, i);
+		E(rdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+	pinned(env, dbi, 0);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i += 3) {
+		setkey(&key, i);
+		E(rdb_del(txn, dbi, &key, NULL));
+	}
+	E(rdb_dbi_pin(txn, hashed, 1));
+	E(rdb_txn_commit(txn));
+	pinned(env, dbi, branches(env, hashed));
+
+	/* A hashed DB's directory, as its buckets grow */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 1; i < COUNT; i += 3) {
+		setkey(&key, i);
+		E(rdb_put(txn, hashed, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+	pinned(env, dbi, branches(env, hashed));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_drop(txn, hashed, 1));
+	E(rdb_txn_commit(txn));
+	pinned(env, dbi, 0);
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_pin(txn, dbi, 0));
+	E(rdb_txn_commit(txn));
+	E(rdb_env_info(env, &info));
+	CHECK(info.me_pinned == 0, "pages left locked");
+
+	rdb_env_close(env);
+	printf("Pinned pages follow the trees\n");
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+/* prefix_keys.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for RDB_PREFIXKEY branch pages, checked against a plain DB.
+ * Long keys in groups that share a long prefix force the prefix of a
+ * full branch page to be cut by a separator update, and branch pages
+ * to be merged with keys that don't share their prefix.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	12000
+#define LPFX	201		/* group letter and padding of long keys */
+#define LCOUNT	5000
+
+static int mkkey(char *buf, int i)
+{
+	/* A few keys outside the common prefix force it to be cut */
+	if (i % 100 == 99)
+		return sprintf(buf, "%c-outlier-%05d", 'a' + (i / 100) % 26, i);
+	return sprintf(buf, "tenant-%02d/orders/customer-history/pk%08d", 7, i);
+}
+
+static int lkey(char *buf, int group, int i)
+{
+	memset(buf, 'x', LPFX);
+	buf[0] = group;
+	return LPFX + sprintf(buf + LPFX, "%08d", i);
+}
+
+/* Apply the same put or delete of a long key to both DBs */
+static void both(RDB_txn *txn, RDB_dbi *dbi, int group, int i, int del)
+{
+	int rc, j;
+	RDB_val key, data;
+	char kbuf[LPFX + 16];
+
+	key.mv_size = lkey(kbuf, group, i);
+	key.mv_data = kbuf;
+	data.mv_size = sizeof(int);
+	data.mv_data = &i;
+	for (j = 0; j < 2; j++) {
+		if (del)
+			E(rdb_del(txn, dbi[j], &key, NULL));
+		else
+			E(rdb_put(txn, dbi[j], &key, &data, 0));
+	}
+}
+
+static void compare(RDB_txn *txn, RDB_dbi pfx, RDB_dbi plain)
+{
+	int rc, n = 0;
+	RDB_cursor *c1, *c2, *c3;
+	RDB_val k1, d1, k2, d2, k3, d3;
+	char buf[LPFX + 16];
+
+	E(rdb_cursor_open(txn, pfx, &c1));
+	E(rdb_cursor_open(txn, plain, &c2));
+	E(rdb_cursor_open(txn, plain, &c3));
+	while ((rc = rdb_cursor_get(c1, &k1, &d1, RDB_NEXT)) == 0) {
+		E(rdb_cursor_get(c2, &k2, &d2, RDB_NEXT));
+		CHECK(k1.mv_size == k2.mv_size && !memcmp(k1.mv_data, k2.mv_data, k1.mv_size), "key order");
+		CHECK(d1.mv_size == d2.mv_size && !memcmp(d1.mv_data, d2.mv_data, d1.mv_size), "data");
+		E(rdb_get(txn, pfx, &k2, &d2));
+		CHECK(d1.mv_size == d2.mv_size && !memcmp(d1.mv_data, d2.mv_data, d1.mv_size), "get");
+		n++;
+	}
+	CHECK(rc == RDB_NOTFOUND, "rdb_cursor_get");
+	rc = rdb_cursor_get(c2, &k2, &d2, RDB_NEXT);
+	CHECK(rc == RDB_NOTFOUND, "extra keys in plain DB");
+
+	/* Range searches must land on the same key */
+	while ((rc = rdb_cursor_get(c2, &k2, &d2, RDB_PREV)) == 0) {
+		k1.mv_size = k2.mv_size - 1;
+		memcpy(buf, k2.mv_data, k1.mv_size);
+		k1.mv_data = buf;
+		k3 = k1;
+		E(rdb_cursor_get(c1, &k1, &d1, RDB_SET_RANGE));
+		E(rdb_cursor_get(c3, &k3, &d3, RDB_SET_RANGE));
+		CHECK(k1.mv_size == k3.mv_size && !memcmp(k1.mv_data, k3.mv_data, k1.mv_size), "SET_RANGE");
+	}
+	CHECK(rc == RDB_NOTFOUND, "rdb_cursor_get");
+	rdb_cursor_close(c1);
+	rdb_cursor_close(c2);
+	rdb_cursor_close(c3);
+	printf("%d keys match\n", n);
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc, *order;
+	RDB_env *env;
+	RDB_dbi pfx, plain, ldbi[2];
+	RDB_val key, data;
+	RDB_txn *txn;
+	RDB_stat s1, s2;
+	char kbuf[64];
+
+	srand(6);
+	order = malloc(COUNT * sizeof(int));
+	for (i = 0; i < COUNT; i++)
+		order[i] = i;
+	for (i = COUNT - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		rc = order[i]; order[i] = order[j]; order[j] = rc;
+	}
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*2));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	rc = rdb_dbi_open(txn, "bad", RDB_CREATE|RDB_PREFIXKEY|RDB_INTEGERKEY, &pfx);
+	CHECK(rc == EINVAL, "PREFIXKEY|INTEGERKEY accepted");
+	E(rdb_dbi_open(txn, "pfx", RDB_CREATE|RDB_PREFIXKEY, &pfx));
+	E(rdb_dbi_open(txn, "plain", RDB_CREATE, &plain));
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = mkkey(kbuf, order[i]);
+		key.mv_data = kbuf;
+		data.mv_size = sizeof(int);
+		data.mv_data = &order[i];
+		E(rdb_put(txn, pfx, &key, &data, 0));
+		E(rdb_put(txn, plain, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	compare(txn, pfx, plain);
+	E(rdb_stat(txn, pfx, &s1));
+	E(rdb_stat(txn, plain, &s2));
+	printf("branch pages: %zu prefixed, %zu plain\n",
+		s1.ms_branch_pages, s2.ms_branch_pages);
+	CHECK(s1.ms_branch_pages < s2.ms_branch_pages, "no compression");
+	rdb_txn_abort(txn);
+
+	/* Delete most keys to exercise merges and node moves */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < COUNT; i++) {
+		if (i % 10 == 0)
+			continue;
+		key.mv_size = mkkey(kbuf, order[i]);
+		key.mv_data = kbuf;
+		E(rdb_del(txn, pfx, &key, NULL));
+		E(rdb_del(txn, plain, &key, NULL));
+		if (i % 2000 == 1)
+			compare(txn, pfx, plain);
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	compare(txn, pfx, plain);
+	rdb_txn_abort(txn);
+
+	/* "A" keys sort before the "B" keys in the leftmost leaf. When the
+	 * next leaf runs low, rdb_node_move() takes the last "A" key and
+	 * makes it the leaf's separator. It shares nothing with the prefix
+	 * of the full parent page, so the parent's nodes grow past the page
+	 * and rdb_update_key() must delete the separator and split the page
+	 * with RDB_SPLIT_REPLACE.
+	 */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "split", RDB_CREATE|RDB_PREFIXKEY, &ldbi[0]));
+	E(rdb_dbi_open(txn, "split-plain", RDB_CREATE, &ldbi[1]));
+	for (i = 0; i < 2000; i++)
+		both(txn, ldbi, 'B', i, 0);
+	for (i = 0; i < 6; i++)
+		both(txn, ldbi, 'A', i, 0);
+	E(rdb_stat(txn, ldbi[0], &s1));
+	for (i = 0; i < 40; i++)
+		both(txn, ldbi, 'B', i, 1);
+	E(rdb_stat(txn, ldbi[0], &s2));
+	CHECK(s2.ms_branch_pages > s1.ms_branch_pages, "separator update didn't split");
+	compare(txn, ldbi[0], ldbi[1]);
+	E(rdb_drop(txn, ldbi[0], 1));
+	E(rdb_drop(txn, ldbi[1], 1));
+	E(rdb_txn_commit(txn));
+
+	/* Empty the "B" and "C" groups down to their outer keys. Branch
+	 * pages that held only "B" or only "C" separators run low and are
+	 * merged, and each merge cuts the prefix of the page it merges into.
+	 */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "merge", RDB_CREATE|RDB_PREFIXKEY, &ldbi[0]));
+	E(rdb_dbi_open(txn, "merge-plain", RDB_CREATE, &ldbi[1]));
+	for (i = 0; i < LCOUNT; i++)
+		both(txn, ldbi, 'B', i, 0);
+	for (i = 0; i < LCOUNT; i++)
+		both(txn, ldbi, 'C', i, 0);
+	E(rdb_stat(txn, ldbi[0], &s1));
+	for (i = 10; i < LCOUNT; i++)
+		both(txn, ldbi, 'B', i, 1);
+	for (i = 0; i < LCOUNT - 10; i++)
+		both(txn, ldbi, 'C', i, 1);
+	E(rdb_stat(txn, ldbi[0], &s2));
+	CHECK(s2.ms_branch_pages < s1.ms_branch_pages && s2.ms_depth == 3,
+		"branch pages not merged");
+	compare(txn, ldbi[0], ldbi[1]);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	compare(txn, ldbi[0], ldbi[1]);
+	E(rdb_drop(txn, ldbi[0], 1));
+	E(rdb_drop(txn, ldbi[1], 1));
+	E(rdb_txn_commit(txn));
+
+	rdb_env_close(env);
+	free(order);
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/* search_loops.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for the integer key search loop, checked against the generic
+ * search with a custom comparator of the same order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	20000
+#define PROBES	20000
+
+static int cmp_u32(const RDB_val *a, const RDB_val *b)
+{
+	uint32_t x, y;
+	memcpy(&x, a->mv_data, sizeof(x));
+	memcpy(&y, b->mv_data, sizeof(y));
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_u64(const RDB_val *a, const RDB_val *b)
+{
+	uint64_t x, y;
+	memcpy(&x, a->mv_data, sizeof(x));
+	memcpy(&y, b->mv_data, sizeof(y));
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_u64_rev(const RDB_val *a, const RDB_val *b)
+{
+	return cmp_u64(b, a);
+}
+
+static uint64_t rand64(void)
+{
+	return (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ rand();
+}
+
+/* Keys are mostly evenly spaced, with scattered ones that throw
+ * off interpolation guesses
+ */
+static uint64_t key_at(int i, int wide)
+{
+	uint64_t k = i % 5 ? 1000 + 3 * (uint64_t)i : i * 0x9e3779b97f4a7c15ULL;
+	return wide ? k : (uint32_t)k;
+}
+
+static void put_both(RDB_txn *txn, RDB_dbi fast, RDB_dbi slow,
+	RDB_val *key, RDB_val *data)
+{
+	int rc;
+
+	E(rdb_put(txn, fast, key, data, 0));
+	E(rdb_put(txn, slow, key, data, 0));
+}
+
+/* Position a cursor on each DB at the same keys, and on the same
+ * data for DUPSORT DBs, and compare where they land.
+ */
+static void check_same(RDB_txn *txn, RDB_dbi fast, RDB_dbi slow, int ksize,
+	int dups)
+{
+	int i, rc, rc2;
+	uint64_t k, d;
+	uint32_t k32;
+	RDB_cursor *c1, *c2;
+	RDB_val key, data, k1, d1, k2, d2;
+
+	E(rdb_cursor_open(txn, fast, &c1));
+	E(rdb_cursor_open(txn, slow, &c2));
+	for (i = 0; i < PROBES; i++) {
+		if (dups)
+			k = rand() % COUNT;
+		else
+			k = i & 1 ? key_at(rand() % COUNT, ksize == 8) : rand64();
+		if (i % 97 == 0)
+			k = i & 2 ? 0 : ~(uint64_t)0;
+		k += i % 3 == 2;
+		k32 = (uint32_t)k;
+		key.mv_size = ksize;
+		key.mv_data = ksize == 8 ? (void *)&k : (void *)&k32;
+		k1 = k2 = key;
+		if (dups) {
+			d = i % 7 ? rand64() : 2 * (uint64_t)(rand() % 200);
+			data.mv_size = sizeof(d);
+			data.mv_data = &d;
+			d1 = d2 = data;
+			rc = rdb_cursor_get(c1, &k1, &d1, RDB_GET_BOTH_RANGE);
+			rc2 = rdb_cursor_get(c2, &k2, &d2, RDB_GET_BOTH_RANGE);
+		} else {
+			rc = rdb_cursor_get(c1, &k1, &d1, RDB_SET_RANGE);
+			rc2 = rdb_cursor_get(c2, &k2, &d2, RDB_SET_RANGE);
+		}
+		CHECK(rc == rc2, "result code");
+		if (rc == RDB_NOTFOUND)
+			continue;
+		CHECK(rc == RDB_SUCCESS, "rdb_cursor_get");
+		CHECK(k1.mv_size == k2.mv_size &&
+			!memcmp(k1.mv_data, k2.mv_data, k1.mv_size), "key");
+		CHECK(d1.mv_size == d2.mv_size &&
+			!memcmp(d1.mv_data, d2.mv_data, d1.mv_size), "data");
+	}
+	rdb_cursor_close(c1);
+	rdb_cursor_close(c2);
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_dbi w, wc, n, nc, dp, dpc, late;
+	RDB_val key, data;
+	RDB_txn *txn;
+	RDB_cursor *cur;
+	uint64_t k, prev, d;
+	uint32_t k32;
+	char dbuf[32];
+
+	srand(11);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 12));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "loop-u64", RDB_CREATE|RDB_INTEGERKEY, &w));
+	E(rdb_dbi_open(txn, "loop-u64-cmp", RDB_CREATE, &wc));
+	E(rdb_set_compare(txn, wc, cmp_u64));
+	E(rdb_dbi_open(txn, "loop-u32", RDB_CREATE|RDB_INTEGERKEY, &n));
+	E(rdb_dbi_open(txn, "loop-u32-cmp", RDB_CREATE, &nc));
+	E(rdb_set_compare(txn, nc, cmp_u32));
+	E(rdb_dbi_open(txn, "loop-dup", RDB_CREATE|RDB_DUPSORT|RDB_INTEGERDUP, &dp));
+	E(rdb_dbi_open(txn, "loop-dup-cmp", RDB_CREATE|RDB_DUPSORT, &dpc));
+	E(rdb_set_dupsort(txn, dpc, cmp_u64));
+	for (i = 0; i < COUNT; i++) {
+		data.mv_size = sprintf(dbuf, "value %d", i);
+		data.mv_data = dbuf;
+		k = key_at(i, 1);
+		key.mv_size = sizeof(k);
+		key.mv_data = &k;
+		put_both(txn, w, wc, &key, &data);
+		k32 = (uint32_t)key_at(i, 0);
+		key.mv_size = sizeof(k32);
+		key.mv_data = &k32;
+		put_both(txn, n, nc, &key, &data);
+		if (i % 20)
+			continue;
+		/* Enough duplicates for sub-DBs as well as sub-pages */
+		k = i % 400 ? i : i / 400;
+		key.mv_size = sizeof(k);
+		key.mv_data = &k;
+		for (j = 0; j < (i % 400 ? 3 : 200); j++) {
+			d = j % 2 ? rand64() : (uint64_t)j * 2;
+			data.mv_size = sizeof(d);
+			data.mv_data = &d;
+			put_both(txn, dp, dpc, &key, &data);
+		}
+	}
+	/* Dirty pages, then the same pages through the map */
+	check_same(txn, w, wc, 8, 0);
+	check_same(txn, n, nc, 4, 0);
+	check_same(txn, dp, dpc, 8, 1);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	check_same(txn, w, wc, 8, 0);
+	check_same(txn, n, nc, 4, 0);
+	check_same(txn, dp, dpc, 8, 1);
+	rdb_txn_abort(txn);
+
+	/* A comparator set after the cursor was opened is used by it */
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "loop-late", RDB_CREATE|RDB_INTEGERKEY, &late));
+	E(rdb_cursor_open(txn, late, &cur));
+	E(rdb_set_compare(txn, late, cmp_u64_rev));
+	for (i = 0; i < COUNT; i++) {
+		k = key_at(i, 1);
+		key.mv_size = sizeof(k);
+		key.mv_data = &k;
+		data.mv_size = sizeof(i);
+		data.mv_data = &i;
+		E(rdb_cursor_put(cur, &key, &data, 0));
+	}
+	j = 0;
+	prev = ~(uint64_t)0;
+	while ((rc = rdb_cursor_get(cur, &key, &data, j ? RDB_NEXT : RDB_FIRST)) == 0) {
+		memcpy(&k, key.mv_data, sizeof(k));
+		CHECK(k <= prev, "reverse order");
+		prev = k;
+		j++;
+	}
+	CHECK(rc == RDB_NOTFOUND, "rdb_cursor_get");
+	for (i = 0; i < COUNT; i++) {
+		k = key_at(i, 1);
+		key.mv_size = sizeof(k);
+		key.mv_data = &k;
+		E(rdb_get(txn, late, &key, &data));
+	}
+	rdb_cursor_close(cur);
+
+	/* Custom comparators would break the dump and load run on
+	 * this environment after the tests.
+	 */
+	E(rdb_drop(txn, w, 1));
+	E(rdb_drop(txn, wc, 1));
+	E(rdb_drop(txn, n, 1));
+	E(rdb_drop(txn, nc, 1));
+	E(rdb_drop(txn, dp, 1));
+	E(rdb_drop(txn, dpc, 1));
+	E(rdb_drop(txn, late, 1));
+	E(rdb_txn_commit(txn));
+	printf("integer searches match\n");
+
+	rdb_env_close(env);
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+/* seek_forward.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for RDB_SEEK_FORWARD, checked against RDB_SET_RANGE */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	30000
+
+static void seek_all(RDB_txn *txn, RDB_dbi dbi)
+{
+	int i, rc, rc2, target = 0, n = 0;
+	RDB_cursor *c1, *c2;
+	RDB_val k1, d1, k2, d2;
+	char buf[32];
+
+	E(rdb_cursor_open(txn, dbi, &c1));
+	E(rdb_cursor_open(txn, dbi, &c2));
+	for (i = 0; i < 20000; i++) {
+		/* Mostly small steps forward, sometimes a jump or a step back */
+		switch (rand() % 16) {
+		case 0: target = rand() % (3 * COUNT); break;
+		case 1: target -= rand() % 50; break;
+		default: target += rand() % 8; break;
+		}
+		if (target < 0 || target >= 3 * COUNT + 10)
+			target = 0;
+		k1.mv_size = sprintf(buf, "seek-%06d", target);
+		k1.mv_data = buf;
+		k2 = k1;
+		rc = rdb_cursor_get(c1, &k1, &d1, RDB_SEEK_FORWARD);
+		rc2 = rdb_cursor_get(c2, &k2, &d2, RDB_SET_RANGE);
+		CHECK(rc == rc2, "result code");
+		if (rc == RDB_NOTFOUND)
+			continue;
+		CHECK(rc == RDB_SUCCESS, "rdb_cursor_get");
+		CHECK(k1.mv_size == k2.mv_size && !memcmp(k1.mv_data, k2.mv_data, k1.mv_size), "key");
+		CHECK(d1.mv_size == d2.mv_size && !memcmp(d1.mv_data, d2.mv_data, d1.mv_size), "data");
+		n++;
+		/* Moving the cursor in between must not confuse the next seek */
+		if (i % 7 == 0) {
+			rc = rdb_cursor_get(c1, &k1, &d1, i % 14 ? RDB_NEXT : RDB_PREV);
+			CHECK(rc == RDB_SUCCESS || rc == RDB_NOTFOUND, "rdb_cursor_get");
+		}
+	}
+	rdb_cursor_close(c1);
+	rdb_cursor_close(c2);
+	printf("%d seeks match\n", n);
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_dbi dbi, dup;
+	RDB_val key, data;
+	RDB_txn *txn;
+	char kbuf[32], dbuf[32];
+
+	srand(11);
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*2));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "seek", RDB_CREATE, &dbi));
+	E(rdb_dbi_open(txn, "seek-dup", RDB_CREATE|RDB_DUPSORT, &dup));
+	/* Every third key, so seeks often fall between keys */
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = sprintf(kbuf, "seek-%06d", 3 * i);
+		key.mv_data = kbuf;
+		data.mv_size = sprintf(dbuf, "%d", i);
+		data.mv_data = dbuf;
+		E(rdb_put(txn, dbi, &key, &data, 0));
+		for (j = 0; j < i % 3; j++) {
+			dbuf[0] = 'a' + j;
+			E(rdb_put(txn, dup, &key, &data, 0));
+		}
+	}
+	seek_all(txn, dbi);
+	seek_all(txn, dup);
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	seek_all(txn, dbi);
+	seek_all(txn, dup);
+	rdb_txn_abort(txn);
+
+	rdb_env_close(env);
+
+	return 0;
+}
@@ -0,0 +1,270 @@
+/* separators.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for shortened leaf split separators. Each DB is checked against
+ * one with a custom comparator of the same order, which keeps whole
+ * separators. Big values give every leaf only a few keys, so nearly
+ * every pair of neighboring keys gets a separator, and lookups around
+ * each pair must land on the same keys in both DBs. The leaves may
+ * differ: a key between a shortened separator and the first key of
+ * its right leaf is added to that leaf instead of the left one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	3000
+#define VSIZE	400
+#define KMAX	300
+
+/* Same orders as the built-in comparators */
+static int cmp_mem(const RDB_val *a, const RDB_val *b)
+{
+	size_t len = a->mv_size < b->mv_size ? a->mv_size : b->mv_size;
+	int diff = memcmp(a->mv_data, b->mv_data, len);
+	return diff ? diff : a->mv_size < b->mv_size ? -1 : a->mv_size > b->mv_size;
+}
+
+static int cmp_memr(const RDB_val *a, const RDB_val *b)
+{
+	const unsigned char *p1 = (const unsigned char *)a->mv_data + a->mv_size;
+	const unsigned char *p2 = (const unsigned char *)b->mv_data + b->mv_size;
+	size_t len = a->mv_size < b->mv_size ? a->mv_size : b->mv_size;
+
+	while (len--) {
+		if (*--p1 != *--p2)
+			return *p1 - *p2;
+	}
+	return a->mv_size < b->mv_size ? -1 : a->mv_size > b->mv_size;
+}
+
+static int cmp_size(const RDB_val *a, const RDB_val *b)
+{
+	size_t x, y;
+	memcpy(&x, a->mv_data, sizeof(x));
+	memcpy(&y, b->mv_data, sizeof(y));
+	return x < y ? -1 : x > y;
+}
+
+enum { LASTBYTE, PREFIXES, BYTES, LONGTAIL, SORTEDTAIL, REVERSE, INTKEY };
+
+/* Build key \b i of a set, return its size */
+static int mkkey(unsigned char *buf, int set, int i)
+{
+	int n, j;
+	size_t v;
+
+	switch (set) {
+	case LASTBYTE:
+		/* Long shared prefix, neighbors differ in the last byte */
+		memset(buf, 'k', 100);
+		buf[100] = i >> 8;
+		buf[101] = i;
+		return 102;
+	case PREFIXES:
+		/* Runs of keys that each extend the one before */
+		n = sprintf((char *)buf, "%05d", i / 6);
+		for (j = 0; j < i % 6; j++)
+			buf[n++] = 'a' + j;
+		return n;
+	case BYTES:
+		/* Random keys over 0x00, 0x01, 0xfe and 0xff */
+		n = 1 + rand() % 8;
+		for (j = 0; j < n; j++)
+			buf[j] = "\x00\x01\xfe\xff"[rand() % 4];
+		return n;
+	case LONGTAIL:
+	case REVERSE:
+		/* A short distinct head and a long tail */
+		n = sprintf((char *)buf, "%08x", (unsigned)i * 2654435761u);
+		memset(buf + n, 'z', 200);
+		return n + 200;
+	case SORTEDTAIL:
+		n = sprintf((char *)buf, "%06d", i);
+		memset(buf + n, 'z', 200);
+		return n + 200;
+	default:
+		v = (size_t)i * 7919;
+		memcpy(buf, &v, sizeof(v));
+		return sizeof(v);
+	}
+}
+
+/* Check that a lookup gives the same answer in both DBs */
+static void probe(RDB_txn *txn, RDB_dbi *dbi, unsigned char *kbuf, size_t ksize)
+{
+	int rc, rc2;
+	RDB_cursor *c1, *c2;
+	RDB_val key, k1, d1, k2, d2;
+
+	key.mv_size = ksize;
+	key.mv_data = kbuf;
+	rc = rdb_get(txn, dbi[0], &key, &d1);
+	rc2 = rdb_get(txn, dbi[1], &key, &d2);
+	CHECK(rc == rc2, "rdb_get result");
+	E(rdb_cursor_open(txn, dbi[0], &c1));
+	E(rdb_cursor_open(txn, dbi[1], &c2));
+	k1 = k2 = key;
+	rc = rdb_cursor_get(c1, &k1, &d1, RDB_SET_RANGE);
+	rc2 = rdb_cursor_get(c2, &k2, &d2, RDB_SET_RANGE);
+	CHECK(rc == rc2, "RDB_SET_RANGE result");
+	if (!rc)
+		CHECK(k1.mv_size == k2.mv_size &&
+			!memcmp(k1.mv_data, k2.mv_data, k1.mv_size), "RDB_SET_RANGE key");
+	rdb_cursor_close(c1);
+	rdb_cursor_close(c2);
+}
+
+/* Walk both DBs together, and look up keys around each pair of
+ * neighbors: both keys, keys just past the left one, and prefixes
+ * of the right one, which include its shortened separator.
+ */
+static void check_pairs(RDB_txn *txn, RDB_dbi *dbi, int intkey)
+{
+	int rc, n = 0;
+	size_t i, len, v;
+	RDB_cursor *c1, *c2;
+	RDB_val k1, d1, k2, d2;
+	unsigned char left[KMAX + 1], right[KMAX + 1];
+	size_t lsize = 0;
+
+	E(rdb_cursor_open(txn, dbi[0], &c1));
+	E(rdb_cursor_open(txn, dbi[1], &c2));
+	while ((rc = rdb_cursor_get(c1, &k1, &d1, RDB_NEXT)) == 0) {
+		E(rdb_cursor_get(c2, &k2, &d2, RDB_NEXT));
+		CHECK(k1.mv_size == k2.mv_size &&
+			!memcmp(k1.mv_data, k2.mv_data, k1.mv_size), "key order");
+		memcpy(right, k1.mv_data, k1.mv_size);
+		probe(txn, dbi, right, k1.mv_size);
+		if (intkey) {
+			memcpy(&v, right, sizeof(v));
+			v--;
+			probe(txn, dbi, (unsigned char *)&v, sizeof(v));
+			v += 2;
+			probe(txn, dbi, (unsigned char *)&v, sizeof(v));
+		} else if (n) {
+			left[lsize] = 0;
+			probe(txn, dbi, left, lsize + 1);
+			for (len = 0; len < lsize && len < k1.mv_size &&
+				left[len] == right[len]; len++) ;
+			for (i = len; i < k1.mv_size; i++)
+				probe(txn, dbi, right, i);
+			if (right[k1.mv_size - 1]) {
+				right[k1.mv_size - 1]--;
+				probe(txn, dbi, right, k1.mv_size);
+				right[k1.mv_size - 1]++;
+			}
+		}
+		memcpy(left, right, k1.mv_size);
+		lsize = k1.mv_size;
+		n++;
+	}
+	CHECK(rc == RDB_NOTFOUND, "rdb_cursor_get");
+	RES(RDB_NOTFOUND, rdb_cursor_get(c2, &k2, &d2, RDB_NEXT));
+	rdb_cursor_close(c1);
+	rdb_cursor_close(c2);
+	CHECK(n > 0, "empty DB");
+}
+
+/* Fill a built-in and a custom comparator DB with the same keys,
+ * check them against each other and return their stats in \b st.
+ */
+static void run(RDB_env *env, int set, unsigned int flags, RDB_cmp_func *cmp,
+	int append, RDB_stat *st)
+{
+	int rc, i, j;
+	RDB_txn *txn;
+	RDB_dbi dbi[2];
+	RDB_val key, data;
+	unsigned char kbuf[KMAX], vbuf[VSIZE];
+
+	srand(set + 1);
+	memset(vbuf, 'v', sizeof(vbuf));
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_dbi_open(txn, "sep-builtin", RDB_CREATE|flags, &dbi[0]));
+	E(rdb_dbi_open(txn, "sep-custom", RDB_CREATE, &dbi[1]));
+	E(rdb_set_compare(txn, dbi[1], cmp));
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = mkkey(kbuf, set, i);
+		key.mv_data = kbuf;
+		data.mv_size = sizeof(vbuf);
+		data.mv_data = vbuf;
+		for (j = 0; j < 2; j++)
+			E(rdb_put(txn, dbi[j], &key, &data, append ? RDB_APPEND : 0));
+	}
+	check_pairs(txn, dbi, set == INTKEY);
+	E(rdb_stat(txn, dbi[0], &st[0]));
+	E(rdb_stat(txn, dbi[1], &st[1]));
+	E(rdb_txn_commit(txn));
+
+	/* And through the map */
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	check_pairs(txn, dbi, set == INTKEY);
+	rdb_txn_abort(txn);
+
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	E(rdb_drop(txn, dbi[0], 1));
+	E(rdb_drop(txn, dbi[1], 1));
+	E(rdb_txn_commit(txn));
+}
+
+int main(int argc,char * argv[])
+{
+	int rc;
+	RDB_env *env;
+	RDB_stat st[2];
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*4));
+	E(rdb_env_set_maxdbs(env, 4));
+	E(rdb_env_open(env, "./tests/db", RDB_NOSYNC, 0664));
+
+	/* Neighbors that differ in the last byte, that are prefixes of
+	 * each other, or that hold 0x00 and 0xff bytes
+	 */
+	run(env, LASTBYTE, 0, cmp_mem, 0, st);
+	run(env, PREFIXES, 0, cmp_mem, 0, st);
+	run(env, BYTES, 0, cmp_mem, 0, st);
+
+	/* Other orders keep whole separators */
+	run(env, REVERSE, RDB_REVERSEKEY, cmp_memr, 0, st);
+	CHECK(st[0].ms_branch_pages == st[1].ms_branch_pages &&
+		st[0].ms_leaf_pages == st[1].ms_leaf_pages, "reverse keys cut");
+	run(env, INTKEY, RDB_INTEGERKEY, cmp_size, 0, st);
+	CHECK(st[0].ms_branch_pages == st[1].ms_branch_pages &&
+		st[0].ms_leaf_pages == st[1].ms_leaf_pages, "integer keys cut");
+
+	/* Separators cut to the head take far fewer branch pages */
+	run(env, LONGTAIL, 0, cmp_mem, 0, st);
+	printf("long tails: %zu branch pages, %zu whole\n",
+		st[0].ms_branch_pages, st[1].ms_branch_pages);
+	CHECK(st[0].ms_branch_pages * 4 < st[1].ms_branch_pages, "not shortened");
+	run(env, SORTEDTAIL, 0, cmp_mem, 1, st);
+	CHECK(st[0].ms_branch_pages * 4 < st[1].ms_branch_pages, "append not shortened");
+	run(env, LASTBYTE, 0, cmp_mem, 1, st);
+	run(env, PREFIXES, 0, cmp_mem, 1, st);
+
+	printf("separators checked\n");
+
+	rdb_env_close(env);
+
+	return 0;
+}
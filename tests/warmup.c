@@ -0,0 +1,208 @@
+/* warmup.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for rdb_env_warmup: every branch and leaf page is loaded once,
+ * and for the hot page list that brings them back after a restart.
+ * Also for loading with huge pages, which the OS may or may not use.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "ripdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == RDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, rdb_strerror(rc)), abort()))
+
+#define COUNT	50000
+#define STOPPED	(-1)
+#define HOTLIST	"./tests/db/warmup.rdb-hot"
+
+static const char *names[] = { "warm-a", "warm-b", "warm-c" };
+
+struct progress {
+	RDB_warmup last;
+	int calls;
+	int stop_at;	/* stop after this many calls, 0 never */
+};
+
+static int prog(const RDB_warmup *wu, void *ctx)
+{
+	struct progress *p = ctx;
+
+	/* Progress only goes forward */
+	if (p->calls && (wu->mw_pages < p->last.mw_pages ||
+		wu->mw_pass < p->last.mw_pass || wu->mw_total != p->last.mw_total))
+		p->calls = -1000000;
+	p->last = *wu;
+	p->calls++;
+	return p->stop_at && p->calls >= p->stop_at ? STOPPED : 0;
+}
+
+static void warm(RDB_env *env, unsigned int flags, unsigned int nthreads,
+	size_t budget, int stop_at, int want, struct progress *p)
+{
+	int rc;
+
+	memset(p, 0, sizeof(*p));
+	p->stop_at = stop_at;
+	rc = rdb_env_warmup(env, flags, nthreads, budget, 0, prog, p);
+	CHECK(rc == want, "rdb_env_warmup");
+	CHECK(p->calls > 0, "progress");
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc;
+	RDB_env *env;
+	RDB_dbi dbi;
+	RDB_txn *txn;
+	RDB_val key, data;
+	RDB_stat st;
+	struct progress p;
+	struct stat sb;
+	FILE *fp;
+	size_t branches = 0, leaves = 0, roots = 0, hbranches;
+	char kbuf[32], val[100];
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_mapsize(env, 10485760*8));
+	E(rdb_env_set_maxdbs(env, 8));
+	/* An environment of its own, for exact page counts */
+	E(rdb_env_open(env, "./tests/db/warmup.rdb", RDB_NOSUBDIR|RDB_NOSYNC, 0664));
+
+	rc = rdb_env_warmup(env, 0x80, 1, 0, 0, NULL, NULL);
+	CHECK(rc == EINVAL, "bad flags accepted");
+	E(rdb_env_warmup(env, 0, 2, 0, 0, NULL, NULL));
+
+	memset(val, 'w', sizeof(val));
+	data.mv_size = sizeof(val);
+	data.mv_data = val;
+	E(rdb_txn_begin(env, NULL, 0, &txn));
+	for (j = 0; j < 3; j++) {
+		E(rdb_dbi_open(txn, names[j], RDB_CREATE, &dbi));
+		for (i = 0; i < COUNT >> j; i++) {
+			key.mv_size = sprintf(kbuf, "%d-%08x", j, i * 2654435761U);
+			key.mv_data = kbuf;
+			E(rdb_put(txn, dbi, &key, &data, 0));
+		}
+	}
+	E(rdb_dbi_open(txn, "warm-h", RDB_CREATE|RDB_HASHED, &dbi));
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = sprintf(kbuf, "h-%08x", i);
+		key.mv_data = kbuf;
+		E(rdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(rdb_txn_commit(txn));
+
+	E(rdb_txn_begin(env, NULL, RDB_RDONLY, &txn));
+	E(rdb_dbi_open(txn, NULL, 0, &dbi));
+	E(rdb_stat(txn, dbi, &st));
+	branches += st.ms_branch_pages;
+	leaves += st.ms_leaf_pages;
+	roots += st.ms_depth == 1;
+	for (j = 0; j < 3; j++) {
+		E(rdb_dbi_open(txn, names[j], 0, &dbi));
+		E(rdb_stat(txn, dbi, &st));
+		branches += st.ms_branch_pages;
+		leaves += st.ms_leaf_pages;
+		roots += st.ms_depth == 1;
+	}
+	/* The directory and the branch pages of buckets */
+	E(rdb_dbi_open(txn, "warm-h", 0, &dbi));
+	E(rdb_stat(txn, dbi, &st));
+	CHECK(st.ms_depth > 1, "no directory");
+	hbranches = st.ms_branch_pages;
+	leaves += st.ms_leaf_pages;
+	rdb_txn_abort(txn);
+
+	warm(env, 0, 4, 0, 0, RDB_SUCCESS, &p);
+	CHECK(p.last.mw_total == branches + hbranches + leaves, "total");
+	CHECK(p.last.mw_pages == p.last.mw_total, "not everything loaded");
+	CHECK(p.last.mw_pass == 1, "no leaf pass");
+
+	warm(env, 0, 1, 0, 0, RDB_SUCCESS, &p);
+	CHECK(p.last.mw_pages == p.last.mw_total, "not everything loaded");
+
+	/* Branch pages alone, and leaf roots, which come with them.
+	 * Of the hashed DB only the directory, not its buckets.
+	 */
+	warm(env, RDB_WARM_BRANCHONLY, 3, 0, 0, RDB_SUCCESS, &p);
+	CHECK(p.last.mw_pass == 0, "leaves loaded");
+	CHECK(p.last.mw_pages > branches + roots &&
+		p.last.mw_pages <= branches + hbranches + roots, "branch pages");
+
+	/* A budget stops it a little past the limit */
+	warm(env, 0, 2, 64 * 4096, 0, RDB_SUCCESS, &p);
+	CHECK(p.last.mw_pages >= 64 && p.last.mw_pages < p.last.mw_total, "budget");
+
+	/* So does the progress function */
+	warm(env, 0, 2, 0, 3, STOPPED, &p);
+	CHECK(p.calls == 3 && p.last.mw_pages < p.last.mw_total, "stopped");
+
+	/* Everything was just loaded, so the list can't be empty */
+	E(rdb_env_hotlist_save(env));
+	CHECK(stat(HOTLIST, &sb) == 0, "no hot page list");
+	CHECK(sb.st_size > (off_t)(8 + sizeof(size_t)) &&
+		(sb.st_size - 8 - sizeof(size_t)) % (2 * sizeof(size_t)) == 0, "hot page list size");
+	rdb_env_close(env);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db/warmup.rdb", RDB_NOSUBDIR|RDB_HOTLIST, 0664));
+	E(rdb_env_hotlist_replay(env));
+	fp = fopen(HOTLIST, "r+");
+	CHECK(fp != NULL, "fopen");
+	fputs("junk", fp);
+	fclose(fp);
+	rc = rdb_env_hotlist_replay(env);
+	CHECK(rc == RDB_INVALID, "damaged list replayed");
+	/* Closing takes a new sample */
+	rdb_env_close(env);
+	E(rdb_env_create(&env));
+	E(rdb_env_open(env, "./tests/db/warmup.rdb", RDB_NOSUBDIR|RDB_RDONLY, 0664));
+	E(rdb_env_hotlist_replay(env));
+	rdb_env_close(env);
+	remove(HOTLIST);
+
+	/* hugetlbfs can't be written without RDB_WRITEMAP, and this isn't it */
+	E(rdb_env_create(&env));
+	rc = rdb_env_open(env, "./tests/db/warmup.rdb", RDB_NOSUBDIR|RDB_HUGETLB, 0664);
+	CHECK(rc == EINVAL, "RDB_HUGETLB without RDB_WRITEMAP");
+	rdb_env_close(env);
+	E(rdb_env_create(&env));
+	rc = rdb_env_open(env, "./tests/db/warmup.rdb",
+		RDB_NOSUBDIR|RDB_HUGETLB|RDB_WRITEMAP, 0664);
+	CHECK(rc != RDB_SUCCESS, "RDB_HUGETLB off hugetlbfs");
+	rdb_env_close(env);
+
+	E(rdb_env_create(&env));
+	E(rdb_env_set_maxdbs(env, 8));
+	E(rdb_env_open(env, "./tests/db/warmup.rdb", RDB_NOSUBDIR|RDB_HUGEPAGE, 0664));
+	warm(env, 0, 2, 0, 0, RDB_SUCCESS, &p);
+	CHECK(p.last.mw_pages == branches + hbranches + leaves, "not everything loaded");
+	{
+		RDB_envinfo info;
+		E(rdb_env_info(env, &info));
+		CHECK(info.me_hugemapped <= info.me_mapsize, "huge pages outside the map");
+	}
+	rdb_env_close(env);
+
+	printf("Warm-up loaded %zu pages\n", branches + hbranches + leaves);
+
+	return 0;
+}
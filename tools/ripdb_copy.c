@@ -19,6 +19,8 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <signal.h>
 #include "ripdb.h"
 
@@ -27,6 +29,86 @@ sighandle(int sig)
 {
 }
 
+/* Rebuild the Bloom filters of a compacted copy, so they no longer
+ * hold the bits of deleted keys. One txn per DB keeps just two
+ * DB handles open at a time.
+ */
+static int
+rebloom(const char *path, unsigned flags)
+{
+	RDB_env *env;
+	RDB_txn *txn;
+	RDB_cursor *cursor;
+	RDB_dbi mdbi, dbi;
+	RDB_val key;
+	char *name = NULL, *str;
+	unsigned dbflags;
+	int rc;
+
+	rc = rdb_env_create(&env);
+	if (rc)
+		return rc;
+	rc = rdb_env_set_maxdbs(env, 2);
+	if (rc == RDB_SUCCESS)
+		rc = rdb_env_open(env, path, flags, 0600);
+	while (rc == RDB_SUCCESS) {
+		rc = rdb_txn_begin(env, NULL, 0, &txn);
+		if (rc)
+			break;
+		rc = rdb_dbi_open(txn, NULL, 0, &mdbi);
+		if (rc == RDB_SUCCESS)
+			rc = rdb_cursor_open(txn, mdbi, &cursor);
+		if (rc) {
+			rdb_txn_abort(txn);
+			break;
+		}
+		/* Find the next named DB after the last one done */
+		if (name) {
+			key.mv_size = strlen(name);
+			key.mv_data = name;
+			rc = rdb_cursor_get(cursor, &key, NULL, RDB_SET_RANGE);
+			if (rc == RDB_SUCCESS && key.mv_size == strlen(name) &&
+				!memcmp(key.mv_data, name, key.mv_size))
+				rc = rdb_cursor_get(cursor, &key, NULL, RDB_NEXT_NODUP);
+		} else {
+			rc = rdb_cursor_get(cursor, &key, NULL, RDB_FIRST);
+		}
+		for (; rc == RDB_SUCCESS; rc = rdb_cursor_get(cursor, &key, NULL, RDB_NEXT_NODUP)) {
+			if (memchr(key.mv_data, '\0', key.mv_size))
+				continue;
+			str = malloc(key.mv_size+1);
+			if (!str) {
+				rc = ENOMEM;
+				break;
+			}
+			memcpy(str, key.mv_data, key.mv_size);
+			str[key.mv_size] = '\0';
+			free(name);
+			name = str;
+			if (rdb_dbi_open(txn, name, 0, &dbi) == RDB_SUCCESS)
+				break;
+		}
+		rdb_cursor_close(cursor);
+		if (rc) {
+			rdb_txn_abort(txn);
+			if (rc == RDB_NOTFOUND)
+				rc = RDB_SUCCESS;
+			break;
+		}
+		rc = rdb_dbi_flags(txn, dbi, &dbflags);
+		if (rc == RDB_SUCCESS && (dbflags & RDB_BLOOM))
+			rc = rdb_bloom_rebuild(txn, dbi, 0);
+		if (rc == RDB_SUCCESS)
+			rc = rdb_txn_commit(txn);
+		else
+			rdb_txn_abort(txn);
+		rdb_dbi_close(env, dbi);
+	}
+	free(name);
+	rdb_env_close(env);
+	return rc;
+}
+
 int main(int argc,char * argv[])
 {
 	int rc;
@@ -73,6 +155,10 @@ int main(int argc,char * argv[])
 		else
 			rc = rdb_env_copy2(env, argv[2], cpflags);
 	}
+	if (rc == RDB_SUCCESS && argc == 3 && (cpflags & RDB_CP_COMPACT)) {
+		act = "rebuilding Bloom filters";
+		rc = rebloom(argv[2], flags & RDB_NOSUBDIR);
+	}
 	if (rc)
 		fprintf(stderr, "%s: %s failed, error %d (%s)\n",
 			progname, act, rc, rdb_strerror(rc));
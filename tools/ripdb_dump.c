@@ -41,6 +41,9 @@ flagbit dbflags[] = {
 	{ RDB_DUPFIXED, "dupfixed" },
 	{ RDB_INTEGERDUP, "integerdup" },
 	{ RDB_REVERSEDUP, "reversedup" },
+	{ RDB_PREFIXKEY, "prefixkey" },
+	{ RDB_BLOOM, "bloom" },
+	{ RDB_HASHED, "hashed" },
 	{ 0, NULL }
 };
 
@@ -35,6 +35,7 @@ static char *prog;
 static int Eof;
 
 static RDB_envinfo info;
+static unsigned int psize, hdrpsize;
 
 static RDB_val kbuf, dbuf;
 static RDB_val k0buf;
@@ -62,6 +63,9 @@ flagbit dbflags[] = {
 	{ RDB_DUPFIXED, S("dupfixed") },
 	{ RDB_INTEGERDUP, S("integerdup") },
 	{ RDB_REVERSEDUP, S("reversedup") },
+	{ RDB_PREFIXKEY, S("prefixkey") },
+	{ RDB_BLOOM, S("bloom") },
+	{ RDB_HASHED, S("hashed") },
 	{ 0, NULL, 0 }
 };
 
@@ -131,7 +135,15 @@ static void readhdr(void)
 				exit(EXIT_FAILURE);
 			}
 		} else if (!strncmp(dbuf.mv_data, "db_pagesize=", STRLENOF("db_pagesize="))) {
-			/* Accept and ignore: page size is fixed at build time for ripdb */
+			int i;
+			ptr = memchr(dbuf.mv_data, '\n', dbuf.mv_size);
+			if (ptr) *ptr = '\0';
+			i = sscanf((char *)dbuf.mv_data+STRLENOF("db_pagesize="), "%u", &hdrpsize);
+			if (i != 1) {
+				fprintf(stderr, "%s: line %" Z "d: invalid db_pagesize %s\n",
+					prog, lineno, (char *)dbuf.mv_data+STRLENOF("db_pagesize="));
+				exit(EXIT_FAILURE);
+			}
 		} else {
 			int i;
 			for (i=0; dbflags[i].bit; i++) {
@@ -281,7 +293,7 @@ badend:
 
 static void usage(void)
 {
-	fprintf(stderr, "usage: %s [-V] [-a] [-f input] [-n] [-s name] [-N] [-T] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-a] [-f input] [-n] [-p pagesize] [-s name] [-N] [-T] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -311,12 +323,13 @@ int main(int argc, char *argv[])
 	/* -a: append records in input order
 	 * -f: load file instead of stdin
 	 * -n: use NOSUBDIR flag on env_open
+	 * -p: page size for a new environment, instead of the dump's
 	 * -s: load into named subDB
 	 * -N: use NOOVERWRITE on puts
 	 * -T: read plaintext
 	 * -V: print version and exit
 	 */
-	while ((i = getopt(argc, argv, "af:ns:NTV")) != EOF) {
+	while ((i = getopt(argc, argv, "af:np:s:NTV")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", RDB_VERSION_STRING);
@@ -335,6 +348,9 @@ int main(int argc, char *argv[])
 		case 'n':
 			envflags |= RDB_NOSUBDIR;
 			break;
+		case 'p':
+			psize = strtoul(optarg, NULL, 0);
+			break;
 		case 's':
 			subname = strdup(optarg);
 			break;
@@ -373,6 +389,15 @@ int main(int argc, char *argv[])
 	if (info.me_mapsize)
 		rdb_env_set_mapsize(env, info.me_mapsize);
 
+	if (psize || hdrpsize) {
+		rc = rdb_env_set_pagesize(env, psize ? psize : hdrpsize);
+		/* The dump's page size may not suit this system, but -p must */
+		if (rc && psize) {
+			fprintf(stderr, "rdb_env_set_pagesize failed, error %d %s\n", rc, rdb_strerror(rc));
+			goto env_close;
+		}
+	}
+
 	if (info.me_mapaddr)
 		envflags |= RDB_FIXEDMAP;
 
@@ -391,7 +416,6 @@ int main(int argc, char *argv[])
 	while(!Eof) {
 		RDB_val key, data;
 		int batch = 0;
-		flags = 0;
 		int appflag;
 
 		if (!dohdr) {
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include "ripdb.h"
 
 #ifdef	_WIN32
@@ -35,9 +36,22 @@ static void prstat(RDB_stat *ms)
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+/* Print warm-up progress about once a second */
+static int warmprog(const RDB_warmup *wu, void *ctx)
+{
+	RDB_warmup *last = ctx;
+
+	if (wu->mw_seconds != last->mw_seconds)
+		fprintf(stderr, "  %s: %"Z"u of %"Z"u pages, %us\n",
+			wu->mw_pass ? "leaves" : "branches", wu->mw_pages, wu->mw_total,
+			wu->mw_seconds);
+	*last = *wu;
+	return 0;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-w threads [-W] [-b megabytes] [-t seconds]] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -53,6 +67,8 @@ int main(int argc, char *argv[])
 	char *envname;
 	char *subname = NULL;
 	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	unsigned int warmthreads = 0, warmflags = 0, warmtime = 0;
+	size_t warmbudget = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -64,15 +80,33 @@ int main(int argc, char *argv[])
 	 * -f: print freelist info
 	 * -r: print reader info
 	 * -n: use NOSUBDIR flag on env_open
+	 * -w: load the environment into memory first, with this many threads
+	 * -W: only load branch pages
+	 * -b: stop loading after this many megabytes
+	 * -t: stop loading after this many seconds
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "VWab:efnrs:t:w:")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", RDB_VERSION_STRING);
 			exit(0);
 			break;
+		case 'W':
+			warmflags |= RDB_WARM_BRANCHONLY;
+			break;
+		case 'b':
+			warmbudget = strtoul(optarg, NULL, 10) * 1048576;
+			break;
+		case 't':
+			warmtime = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			warmthreads = strtoul(optarg, NULL, 10);
+			if (!warmthreads)
+				usage(prog);
+			break;
 		case 'a':
 			if (subname)
 				usage(prog);
@@ -120,6 +154,20 @@ int main(int argc, char *argv[])
 		goto env_close;
 	}
 
+	if (warmthreads) {
+		RDB_warmup wu = {0};
+		rc = rdb_env_warmup(env, warmflags, warmthreads, warmbudget, warmtime,
+			warmprog, &wu);
+		if (rc && rc != ETIMEDOUT) {
+			fprintf(stderr, "rdb_env_warmup failed, error %d %s\n", rc, rdb_strerror(rc));
+			goto env_close;
+		}
+		printf("Warm-up\n");
+		printf("  Pages loaded: %"Z"u of %"Z"u\n", wu.mw_pages, wu.mw_total);
+		printf("  Seconds: %u%s\n", wu.mw_seconds, rc ? " (time limit)" : "");
+		rc = RDB_SUCCESS;
+	}
+
 	if (envinfo) {
 		(void)rdb_env_stat(env, &mst);
 		(void)rdb_env_info(env, &mei);